@@ -237,7 +237,8 @@ void cpu_exec_step_atomic(CPUState *cpu)
     target_ulong cs_base, cs_top = 0, pc;
     uint32_t cheri_flags = 0;
     uint32_t flags;
-    uint32_t cflags = 1;
+    /* Keep CF_LOG_INSTR so that these instructions are traced, too. */
+    uint32_t cflags = (curr_cflags() & ~CF_PARALLEL) | 1;
     uint32_t cf_mask = cflags & CF_HASH_MASK;
 
     if (sigsetjmp(cpu->jmp_env, 0) == 0) {
@@ -427,6 +428,13 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
         last_tb = NULL;
     }
 #endif
+    /*
+     * Tracing may have been switched on or off while executing last_tb, don't
+     * chain TBs translated with different settings.
+     */
+    if (last_tb && ((tb_cflags(last_tb) ^ tb_cflags(tb)) & CF_LOG_INSTR)) {
+        last_tb = NULL;
+    }
     /* See if we can patch the calling TB. */
     if (last_tb) {
         tb_add_jump(last_tb, tb_exit, tb);
@@ -39,6 +39,9 @@
 #ifdef CONFIG_PLUGIN
 #include "qemu/plugin-memory.h"
 #endif
+#ifdef TARGET_CHERI
+#include "cheri_tagmem.h"
+#endif
 
 /* DEBUG defines, enable DEBUG_TLB_LOG to log to the CPU_LOG_MMU target */
 /* #define DEBUG_TLB */
@@ -746,8 +749,9 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
 static inline void tlb_set_dirty1_locked(CPUTLBEntry *tlb_entry,
                                          target_ulong vaddr)
 {
-    if (tlb_entry->addr_write == (vaddr | TLB_NOTDIRTY)) {
-        tlb_entry->addr_write = vaddr;
+    /* Only TLB_NOTDIRTY is cleared, TLB_CHERI_TAGS must be preserved.  */
+    if ((tlb_entry->addr_write & ~TLB_CHERI_TAGS) == (vaddr | TLB_NOTDIRTY)) {
+        tlb_entry->addr_write &= ~TLB_NOTDIRTY;
     }
 }
 
@@ -942,6 +946,36 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
      */
     desc->iotlb[index].addr = iotlb - vaddr_page;
     desc->iotlb[index].attrs = attrs;
+#ifdef TARGET_CHERI
+    /*
+     * Remember where the tags for this page live so that capability loads
+     * and stores can skip the second address translation. ROM regions have
+     * host memory but must never hold tags.
+     */
+    if (is_ram && !memory_region_is_rom(section->mr) &&
+        section->mr->ram_block->cheri_tags) {
+        desc->iotlb[index].tagmem = section->mr->ram_block;
+        desc->iotlb[index].tagmem_offset = xlat - vaddr_page;
+    } else {
+        desc->iotlb[index].tagmem = NULL;
+        desc->iotlb[index].tagmem_offset = 0;
+    }
+    desc->iotlb[index].tagmem_prot =
+        prot & (PAGE_LC_CLEAR | PAGE_LC_TRAP | PAGE_SC_TRAP);
+    /*
+     * Capability loads and stores in generated code access the tag bitmap
+     * directly. Pages with capability load/store inhibits and vCPUs with
+     * tag change callbacks must use the helpers instead.
+     */
+    desc->iotlb[index].tagblock = NULL;
+    desc->iotlb[index].tagblock_word_ofs = 0;
+    if (desc->iotlb[index].tagmem && !desc->iotlb[index].tagmem_prot &&
+        !qemu_plugin_vcpu_cap_tag_enabled(cpu)) {
+        desc->iotlb[index].tagblock = cheri_tag_page_block_slot(
+            desc->iotlb[index].tagmem, xlat,
+            &desc->iotlb[index].tagblock_word_ofs);
+    }
+#endif
 
     /* Now calculate the new entry */
     tn.addend = addend - vaddr_page;
@@ -963,6 +997,19 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     tn.addr_write = -1;
     if (prot & PAGE_WRITE) {
         tn.addr_write = write_address;
+#ifdef TARGET_CHERI
+        /*
+         * Stores to pages that may hold tags take the slow path so that they
+         * can clear the tags, all others can stay in generated code. Tag
+         * blocks are only allocated with all other vCPUs stopped and all
+         * TLBs are flushed afterwards (see cheri_tag_block_prepare()), so an
+         * entry filled without the flag never outlives a new block.
+         */
+        if (desc->iotlb[index].tagmem &&
+            cheri_tag_page_may_have_tags(desc->iotlb[index].tagmem, xlat)) {
+            tn.addr_write |= TLB_CHERI_TAGS;
+        }
+#endif
         if (prot & PAGE_WRITE_INV) {
             tn.addr_write |= TLB_INVALID_MASK;
         }
@@ -1125,7 +1172,7 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
         cmp = atomic_read((target_ulong *)((uintptr_t)vtlb + elt_ofs));
 #endif
 
-        if (cmp == page) {
+        if (tlb_hit_page(cmp, page)) {
             /* Found entry in victim tlb, swap tlb and iotlb.  */
             CPUTLBEntry tmptlb, *tlb = &env_tlb(env)->f[mmu_idx].table[index];
 
@@ -1394,6 +1441,43 @@ bool tlb_plugin_lookup(CPUState *cpu, target_ulong addr, int mmu_idx,
 
 #endif
 
+#ifdef TARGET_CHERI
+bool tlb_vaddr_to_tagmem(CPUArchState *env, abi_ptr addr,
+                         MMUAccessType access_type, int mmu_idx,
+                         RAMBlock **tagmem, hwaddr *ram_offset, int *prot)
+{
+    uintptr_t index = tlb_index(env, mmu_idx, addr);
+    CPUTLBEntry *entry = tlb_entry(env, mmu_idx, addr);
+    target_ulong page = addr & TARGET_PAGE_MASK;
+    CPUIOTLBEntry *iotlbentry;
+    size_t elt_ofs;
+
+    switch (access_type) {
+    case MMU_DATA_LOAD:
+    case MMU_DATA_CAP_LOAD:
+        elt_ofs = offsetof(CPUTLBEntry, addr_read);
+        break;
+    case MMU_DATA_STORE:
+    case MMU_DATA_CAP_STORE:
+        elt_ofs = offsetof(CPUTLBEntry, addr_write);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    if (!tlb_hit_page(tlb_read_ofs(entry, elt_ofs), page) &&
+        !victim_tlb_hit(env, mmu_idx, index, elt_ofs, page)) {
+        return false;
+    }
+
+    iotlbentry = &env_tlb(env)->d[mmu_idx].iotlb[index];
+    *tagmem = iotlbentry->tagmem;
+    *ram_offset = iotlbentry->tagmem_offset + addr;
+    *prot = iotlbentry->tagmem_prot;
+    return true;
+}
+#endif
+
 /* Probe for a read-modify-write atomic operation.  Do not allow unaligned
  * operations, or io operations to proceed.  Return the host address.  */
 static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
@@ -1446,7 +1530,8 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
     }
 
     /* Let the guest notice RMW on a write-only page.  */
-    if (unlikely(tlbe->addr_read != (tlb_addr & ~TLB_NOTDIRTY))) {
+    if (unlikely(tlbe->addr_read !=
+                 (tlb_addr & ~(TLB_NOTDIRTY | TLB_CHERI_TAGS)))) {
         tlb_fill(env_cpu(env), addr, 1 << s_bits, MMU_DATA_LOAD,
                  mmu_idx, retaddr);
         /* Since we don't support reads and writes to different addresses,
@@ -1462,6 +1547,15 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
                        &env_tlb(env)->d[mmu_idx].iotlb[index], retaddr);
     }
 
+#ifdef TARGET_CHERI
+    if (unlikely(tlb_addr & TLB_CHERI_TAGS)) {
+        CPUIOTLBEntry *iotlbentry = &env_tlb(env)->d[mmu_idx].iotlb[index];
+        cheri_tag_phys_invalidate(env, iotlbentry->tagmem,
+                                  iotlbentry->tagmem_offset + addr,
+                                  1 << s_bits, &addr);
+    }
+#endif
+
     return hostaddr;
 
  stop_the_world:
@@ -1971,6 +2065,27 @@ store_helper(CPUArchState *env, target_ulong addr, uint64_t val,
 
         haddr = (void *)((uintptr_t)addr + entry->addend);
 
+#ifdef TARGET_CHERI
+        /*
+         * Any data store clears the tags of the capabilities it overlaps.
+         * Hold the tag writer locks so that a concurrent capability load
+         * cannot observe the new data together with the old tag.
+         */
+        if (tlb_addr & TLB_CHERI_TAGS) {
+            cheri_tag_writer_lock_range(haddr, size);
+            cheri_tag_phys_invalidate(env, iotlbentry->tagmem,
+                                      iotlbentry->tagmem_offset + addr, size,
+                                      &addr);
+            if (unlikely(need_swap)) {
+                store_memop(haddr, val, op ^ MO_BSWAP);
+            } else {
+                store_memop(haddr, val, op);
+            }
+            cheri_tag_writer_unlock_range(haddr, size);
+            return;
+        }
+#endif
+
         /*
          * Keep these two store_memop separate to ensure that the compiler
          * is able to fold the entire function to a single instruction.
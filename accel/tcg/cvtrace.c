@@ -0,0 +1,243 @@
+/*
+ * CHERI stream trace (cvtrace) output
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/thread.h"
+#include "qemu/error-report.h"
+#include "cpu.h"
+#include "exec/cvtrace.h"
+
+/* Records per batch (~232KiB), the first slot holds the CVT_BATCH record. */
+#define CVTRACE_BATCH_RECORDS 4096
+
+bool cvtrace_per_cpu;
+bool cvtrace_batch_records;
+uint64_t cvtrace_rotate_size;
+
+/* A trace file owned by this module (per-CPU and/or rotated output). */
+typedef struct CVTraceFile {
+    QemuMutex lock;
+    char *base;
+    int fd;
+    int cpu;            /* -1 if shared between all vCPUs */
+    unsigned segment;
+    uint64_t size;
+} CVTraceFile;
+
+typedef struct CVTraceState {
+    /* NULL when writing to the qemu log file. */
+    CVTraceFile *file;
+    uint64_t sequence;
+    uint16_t cycles;
+    unsigned count;
+    cvtrace_t records[CVTRACE_BATCH_RECORDS];
+} CVTraceState;
+
+static CVTraceFile *cvtrace_shared_file;
+static QemuMutex cvtrace_init_lock;
+
+static void __attribute__((__constructor__)) cvtrace_init_locks(void)
+{
+    qemu_mutex_init(&cvtrace_init_lock);
+}
+
+static void cvtrace_header(cvtrace_t *hdr, int cpu)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    if (cvtrace_batch_records) {
+        hdr->version = CVT_QEMU_VERSION_BATCH;
+        memcpy((char *)hdr + 1, CVT_QEMU_MAGIC_BATCH,
+               sizeof(CVT_QEMU_MAGIC_BATCH));
+    } else {
+        hdr->version = CVT_QEMU_VERSION;
+        memcpy((char *)hdr + 1, CVT_QEMU_MAGIC, sizeof(CVT_QEMU_MAGIC));
+    }
+    hdr->thread = cpu < 0 ? 0 : cpu;
+}
+
+static bool cvtrace_write_all(int fd, const void *buf, size_t len)
+{
+    ssize_t ret = qemu_write_full(fd, buf, len);
+
+    if (ret != (ssize_t)len) {
+        error_report_once("cvtrace: write failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/* Called with file->lock held. */
+static void cvtrace_file_open(CVTraceFile *file)
+{
+    g_autofree char *name = NULL;
+    cvtrace_t hdr;
+
+    if (file->fd >= 0) {
+        close(file->fd);
+    }
+    if (cvtrace_rotate_size) {
+        name = g_strdup_printf("%s.%u", file->base, file->segment++);
+    } else {
+        name = g_strdup(file->base);
+    }
+    file->fd = qemu_open(name, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (file->fd < 0) {
+        error_report("cvtrace: could not open '%s': %s", name,
+                     strerror(errno));
+        exit(1);
+    }
+    cvtrace_header(&hdr, file->cpu);
+    cvtrace_write_all(file->fd, &hdr, sizeof(hdr));
+    file->size = sizeof(hdr);
+}
+
+static CVTraceFile *cvtrace_file_new(int cpu)
+{
+    const char *log = qemu_get_log_filename();
+    CVTraceFile *file = g_new0(CVTraceFile, 1);
+
+    qemu_mutex_init(&file->lock);
+    file->cpu = cpu;
+    file->fd = -1;
+    if (cpu >= 0) {
+        file->base = g_strdup_printf("%s.cpu%d", log ?: "qemu-cvtrace", cpu);
+    } else {
+        file->base = g_strdup(log ?: "qemu-cvtrace");
+    }
+    cvtrace_file_open(file);
+    return file;
+}
+
+static CVTraceState *cvtrace_state(CPUState *cs)
+{
+    CVTraceState *state = cs->cvtrace;
+
+    if (unlikely(!state)) {
+        state = g_new0(CVTraceState, 1);
+        if (cvtrace_per_cpu) {
+            state->file = cvtrace_file_new(cs->cpu_index);
+        } else if (cvtrace_rotate_size) {
+            qemu_mutex_lock(&cvtrace_init_lock);
+            if (!cvtrace_shared_file) {
+                cvtrace_shared_file = cvtrace_file_new(-1);
+            }
+            qemu_mutex_unlock(&cvtrace_init_lock);
+            state->file = cvtrace_shared_file;
+        }
+        cs->cvtrace = state;
+    }
+    return state;
+}
+
+/* CVT_BATCH records are only needed if other vCPUs write to the same file. */
+static bool cvtrace_needs_batch_record(CVTraceState *state)
+{
+    return cvtrace_batch_records && !(state->file && state->file->cpu >= 0) &&
+           first_cpu && CPU_NEXT(first_cpu);
+}
+
+static void cvtrace_flush(CPUState *cs, CVTraceState *state)
+{
+    const cvtrace_t *data = &state->records[1];
+    size_t len = state->count * sizeof(cvtrace_t);
+
+    if (state->count == 0) {
+        return;
+    }
+    /* Tag the batch with its vCPU if it may be mixed with other vCPUs. */
+    if (cvtrace_needs_batch_record(state)) {
+        cvtrace_t *batch = &state->records[0];
+        memset(batch, 0, sizeof(*batch));
+        batch->version = CVT_BATCH;
+        batch->thread = (uint8_t)cs->cpu_index;
+        batch->val1 = tswap64(state->count);
+        batch->val2 = tswap64(state->sequence);
+        data = batch;
+        len += sizeof(cvtrace_t);
+    }
+    state->sequence++;
+    state->count = 0;
+
+    if (state->file) {
+        CVTraceFile *file = state->file;
+        qemu_mutex_lock(&file->lock);
+        if (cvtrace_rotate_size && file->size > sizeof(cvtrace_t) &&
+            file->size + len > cvtrace_rotate_size) {
+            cvtrace_file_open(file);
+        }
+        if (cvtrace_write_all(file->fd, data, len)) {
+            file->size += len;
+        }
+        qemu_mutex_unlock(&file->lock);
+    } else {
+        FILE *logfile = qemu_log_lock();
+        if (logfile) {
+            /* Keep ordering with anything else already written via stdio. */
+            fflush(logfile);
+            /* If the logfile is empty we need to emit the cvt magic. */
+            if (ftell(logfile) == 0) {
+                cvtrace_t hdr;
+                cvtrace_header(&hdr, -1);
+                cvtrace_write_all(fileno(logfile), &hdr, sizeof(hdr));
+            }
+            cvtrace_write_all(fileno(logfile), data, len);
+            /* Update the stdio file position after the raw writes. */
+            fseek(logfile, 0, SEEK_END);
+        }
+        qemu_log_unlock(logfile);
+    }
+}
+
+void cvtrace_new_insn(CPUState *cs, cvtrace_t *entry, uint64_t pc,
+                      uint8_t asid)
+{
+    CVTraceState *state = cvtrace_state(cs);
+
+    if (entry->version != 0) {
+        state->records[1 + state->count++] = *entry;
+        if (state->count == CVTRACE_BATCH_RECORDS - 1) {
+            cvtrace_flush(cs, state);
+        }
+    } else {
+        state->cycles = 0;
+    }
+    memset(entry, 0, sizeof(*entry));
+    entry->version = CVT_NO_REG;
+    entry->pc = tswap64(pc);
+    entry->cycles = tswap16(state->cycles++);
+    entry->thread = (uint8_t)cs->cpu_index;
+    entry->asid = asid;
+    entry->exception = 31;
+}
+
+void cvtrace_flush_cpu(CPUState *cs)
+{
+    if (cs->cvtrace) {
+        cvtrace_flush(cs, cs->cvtrace);
+    }
+}
+
+void cvtrace_flush_all(void)
+{
+    CPUState *cs;
+
+    CPU_FOREACH(cs) {
+        cvtrace_flush_cpu(cs);
+    }
+}
+
+void cvtrace_flush_at_exit(void)
+{
+    CPUState *cs;
+
+    CPU_FOREACH(cs) {
+        if (qemu_cpu_is_self(cs)) {
+            cvtrace_flush_cpu(cs);
+        }
+    }
+}
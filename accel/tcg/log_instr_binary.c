@@ -0,0 +1,171 @@
+/*
+ * Binary instruction trace
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/bswap.h"
+#include "qemu/units.h"
+#include "qemu/log-buffer.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/log_instr_binary.h"
+
+/* Per-vCPU buffer size, the writer thread is kicked when half full. */
+#define LOG_INSTR_BIN_BUFFER_SIZE   (4 * MiB)
+/* Longer text messages are truncated. */
+#define LOG_INSTR_BIN_MAX_TEXT      1024
+
+bool log_instr_binary;
+
+typedef struct LogInstrBinState {
+    LogBuffer *buf;
+    /* Register names that have already been sent, mapped to their id + 1 */
+    GHashTable *names;
+    uint32_t next_name;
+} LogInstrBinState;
+
+QEMU_BUILD_BUG_ON(sizeof(LogInstrBinRecord) != 32);
+
+void log_instr_binary_open(const char *filename, bool compress)
+{
+    LogInstrBinHeader header = {
+        .version = cpu_to_le32(LOG_INSTR_BIN_VERSION),
+        .record_size = cpu_to_le32(sizeof(LogInstrBinRecord)),
+    };
+
+    strncpy(header.magic, LOG_INSTR_BIN_MAGIC, sizeof(header.magic));
+    strncpy(header.target, TARGET_NAME, sizeof(header.target) - 1);
+    log_buffer_writer_open(filename, compress, &header, sizeof(header),
+                           &error_fatal);
+    atexit(log_buffer_writer_close);
+    log_instr_binary = true;
+}
+
+static LogInstrBinState *log_instr_bin_state(CPUState *cpu)
+{
+    LogInstrBinState *state = cpu->log_instr_bin;
+
+    if (unlikely(!state)) {
+        state = g_new0(LogInstrBinState, 1);
+        state->buf = log_buffer_new(LOG_INSTR_BIN_BUFFER_SIZE);
+        state->names = g_hash_table_new(NULL, NULL);
+        cpu->log_instr_bin = state;
+    }
+    return state;
+}
+
+static inline void log_instr_bin_emit(CPUState *cpu, uint8_t type,
+                                      uint8_t size, uint32_t info,
+                                      uint64_t addr, uint64_t value,
+                                      uint64_t value2)
+{
+    LogInstrBinRecord rec = {
+        .type = type,
+        .size = size,
+        .cpu = cpu_to_le16(cpu->cpu_index),
+        .info = cpu_to_le32(info),
+        .addr = cpu_to_le64(addr),
+        .value = cpu_to_le64(value),
+        .value2 = cpu_to_le64(value2),
+    };
+
+    log_buffer_write(log_instr_bin_state(cpu)->buf, &rec, sizeof(rec));
+}
+
+/*
+ * Emit a record followed by @len bytes of @str, padded to a whole number of
+ * records. Both are written at once so that they stay together in the file.
+ */
+static void log_instr_bin_emit_string(CPUState *cpu, uint8_t type,
+                                      uint32_t info, const char *str,
+                                      size_t len)
+{
+    LogInstrBinRecord recs[1 + DIV_ROUND_UP(LOG_INSTR_BIN_MAX_TEXT,
+                                            sizeof(LogInstrBinRecord))];
+
+    len = MIN(len, LOG_INSTR_BIN_MAX_TEXT);
+    memset(recs, 0, sizeof(recs));
+    recs[0].type = type;
+    recs[0].cpu = cpu_to_le16(cpu->cpu_index);
+    recs[0].info = cpu_to_le32(info);
+    recs[0].value = cpu_to_le64(len);
+    memcpy(&recs[1], str, len);
+    log_buffer_write(log_instr_bin_state(cpu)->buf, recs,
+                     sizeof(LogInstrBinRecord) *
+                         (1 + DIV_ROUND_UP(len, sizeof(LogInstrBinRecord))));
+}
+
+void log_instr_bin_insn(CPUArchState *env, target_ulong pc, uint32_t opcode,
+                        uint32_t size)
+{
+    log_instr_bin_emit(env_cpu(env), LOG_INSTR_BIN_INSN, size, opcode, pc, 0,
+                       0);
+}
+
+/* Returns the id of @name, sending it first if this vCPU has not yet. */
+static uint32_t log_instr_bin_name_id(CPUState *cpu, const char *name)
+{
+    LogInstrBinState *state = log_instr_bin_state(cpu);
+    uint32_t id = GPOINTER_TO_UINT(g_hash_table_lookup(state->names, name));
+
+    if (unlikely(!id)) {
+        id = ++state->next_name;
+        g_hash_table_insert(state->names, (gpointer)name,
+                            GUINT_TO_POINTER(id));
+        log_instr_bin_emit_string(cpu, LOG_INSTR_BIN_NAME, id - 1, name,
+                                  strlen(name));
+    }
+    return id - 1;
+}
+
+void log_instr_bin_reg(CPUArchState *env, const char *name, uint64_t value)
+{
+    CPUState *cpu = env_cpu(env);
+
+    log_instr_bin_emit(cpu, LOG_INSTR_BIN_REG, 0,
+                       log_instr_bin_name_id(cpu, name), 0, value, 0);
+}
+
+void log_instr_bin_cap_reg(CPUArchState *env, const char *name, uint64_t pesbt,
+                           uint64_t cursor, bool tag)
+{
+    CPUState *cpu = env_cpu(env);
+
+    log_instr_bin_emit(cpu, LOG_INSTR_BIN_CAP_REG, tag,
+                       log_instr_bin_name_id(cpu, name), 0, pesbt, cursor);
+}
+
+void log_instr_bin_mem(CPUArchState *env, bool store, target_ulong addr,
+                       uint64_t value, MemOp op)
+{
+    log_instr_bin_emit(env_cpu(env),
+                       store ? LOG_INSTR_BIN_MEM_STORE : LOG_INSTR_BIN_MEM_LOAD,
+                       memop_size(op), 0, addr, value, 0);
+}
+
+void log_instr_bin_cap_mem(CPUArchState *env, bool store, target_ulong addr,
+                           uint64_t pesbt, uint64_t cursor, bool tag)
+{
+    log_instr_bin_emit(env_cpu(env),
+                       store ? LOG_INSTR_BIN_CAP_STORE : LOG_INSTR_BIN_CAP_LOAD,
+                       0, tag, addr, pesbt, cursor);
+}
+
+void log_instr_bin_text(CPUArchState *env, const char *fmt, ...)
+{
+    char text[LOG_INSTR_BIN_MAX_TEXT + 1];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+    if (len > 0) {
+        log_instr_bin_emit_string(env_cpu(env), LOG_INSTR_BIN_TEXT, 0, text,
+                                  MIN(len, LOG_INSTR_BIN_MAX_TEXT));
+    }
+}
@@ -30,6 +30,7 @@
 #include "exec/tb-lookup.h"
 #include "disas/disas.h"
 #include "exec/log.h"
+#include "exec/log_instr_binary.h"
 #include "tcg/tcg.h"
 #ifdef TARGET_CHERI
 #include "cheri-helper-utils.h"
@@ -169,13 +170,42 @@ void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     return tb->tc.ptr;
 }
 
+#ifdef TARGET_CHERI
+void *HELPER(lookup_cap_jump_tb_ptr)(CPUArchState *env)
+{
+    CPUState *cpu = env_cpu(env);
+    TranslationBlock *tb;
+    target_ulong cs_base, cs_top = 0, pc;
+    uint32_t cheri_flags = 0;
+    uint32_t flags;
+
+    tb = tb_lookup__cap_jump(cpu, &pc, &cs_base, &cs_top, &cheri_flags, &flags,
+                             curr_cflags());
+    if (tb == NULL) {
+        return tcg_ctx->code_gen_epilogue;
+    }
+    qemu_log_mask_and_addr(CPU_LOG_EXEC, pc,
+                           "Chain %d (cap jump): %p [" TARGET_FMT_lx "/"
+                           TARGET_FMT_lx "/" TARGET_FMT_lx "/%#x/%#x] %s\n",
+                           cpu->cpu_index, tb->tc.ptr, cs_base, pc, cs_top,
+                           cheri_flags, flags, lookup_symbol(pc));
+    return tb->tc.ptr;
+}
+#endif
+
 #if defined(CONFIG_MIPS_LOG_INSTR)
 /*
- * Print the instruction to log file.
+ * Print the instruction to log file. @opcode and @size (in bytes, 0 if
+ * unknown) were read at translation time.
  */
-void HELPER(log_instruction)(CPUArchState *env, target_ulong pc)
+void HELPER(log_instruction)(CPUArchState *env, target_ulong pc,
+                             uint32_t opcode, uint32_t size)
 {
     if (unlikely(qemu_loglevel_mask(CPU_LOG_INSTR) && qemu_log_in_addr_range(pc))) {
+        if (log_instr_binary_enabled()) {
+            log_instr_bin_insn(env, pc, opcode, size);
+            return;
+        }
 #if defined(CONFIG_RVFI_DII) && defined(TARGET_RISCV)
         if (env->rvfi_dii_have_injected_insn) {
             uint32_t insn = env->rvfi_dii_trace.rvfi_dii_insn;
@@ -190,7 +220,7 @@ void HELPER(log_instruction)(CPUArchState *env, target_ulong pc)
     }
 }
 
-#ifdef TARGET_MIPS
+#if defined(TARGET_MIPS) || defined(TARGET_RISCV)
 /*
  * dump non-capability data to cvtrace entry
  */
@@ -225,12 +255,16 @@ void HELPER(dump_store64)(CPUArchState *env, target_ulong addr, uint64_t value,
         return;
 #endif
 
-#ifdef TARGET_MIPS
+#if defined(TARGET_MIPS) || defined(TARGET_RISCV)
     if (qemu_loglevel_mask(CPU_LOG_CVTRACE)) {
         cvtrace_dump_gpr_store(&env->cvtrace, addr, value);
         return;
     }
 #endif
+    if (log_instr_binary_enabled()) {
+        log_instr_bin_mem(env, true, addr, value, op);
+        return;
+    }
 
     // FIXME: value printed is not correct for sdl!
     // FIXME: value printed is not correct for sdr!
@@ -278,12 +312,16 @@ void HELPER(dump_load64)(CPUArchState *env, target_ulong addr, uint64_t value, M
         return;
 #endif
 
-#ifdef TARGET_MIPS
+#if defined(TARGET_MIPS) || defined(TARGET_RISCV)
     if (qemu_loglevel_mask(CPU_LOG_CVTRACE)) {
         cvtrace_dump_gpr_load(&env->cvtrace, addr, value);
         return;
     }
 #endif
+    if (log_instr_binary_enabled()) {
+        log_instr_bin_mem(env, false, addr, value, op);
+        return;
+    }
     // FIXME: cloadtags not correct
     switch (memop_size(op)) {
     case 8:
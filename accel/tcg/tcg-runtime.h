@@ -25,6 +25,9 @@ DEF_HELPER_FLAGS_1(ctpop_i32, TCG_CALL_NO_RWG_SE, i32, i32)
 DEF_HELPER_FLAGS_1(ctpop_i64, TCG_CALL_NO_RWG_SE, i64, i64)
 
 DEF_HELPER_FLAGS_1(lookup_tb_ptr, TCG_CALL_NO_WG_SE, ptr, env)
+#ifdef TARGET_CHERI
+DEF_HELPER_FLAGS_1(lookup_cap_jump_tb_ptr, TCG_CALL_NO_WG_SE, ptr, env)
+#endif
 
 DEF_HELPER_FLAGS_1(exit_atomic, TCG_CALL_NO_WG, noreturn, env)
 
@@ -159,7 +162,7 @@ DEF_HELPER_FLAGS_4(dump_load64, TCG_CALL_NO_RWG, void, env, cap_checked_ptr, i64
 DEF_HELPER_FLAGS_4(dump_load32, TCG_CALL_NO_RWG, void, env, cap_checked_ptr, i32, memop)
 DEF_HELPER_FLAGS_4(dump_store64, TCG_CALL_NO_RWG, void, env, cap_checked_ptr, i64, memop)
 DEF_HELPER_FLAGS_4(dump_store32, TCG_CALL_NO_RWG, void, env, cap_checked_ptr, i32, memop)
-DEF_HELPER_FLAGS_2(log_instruction, TCG_CALL_NO_RWG, void, env, tl)
+DEF_HELPER_FLAGS_4(log_instruction, TCG_CALL_NO_RWG, void, env, tl, i32, i32)
 #endif
 
 DEF_HELPER_FLAGS_3(gvec_mov, TCG_CALL_NO_RWG, void, ptr, ptr, i32)
@@ -52,6 +52,7 @@
 #include "translate-all.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
+#include "qemu/rcu.h"
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
 #include "qemu/main-loop.h"
@@ -101,6 +102,17 @@
 
 #define SMC_BITMAP_USE_THRESHOLD 10
 
+#ifndef CONFIG_SOFTMMU
+/*
+ * Readers only hold the RCU read lock (see page_get_target_data()), so
+ * page_set_flags() frees this after a grace period.
+ */
+typedef struct PageTargetData {
+    struct rcu_head rcu;
+    uint64_t data[];
+} PageTargetData;
+#endif
+
 typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
@@ -111,6 +123,7 @@ typedef struct PageDesc {
     unsigned int code_write_count;
 #else
     unsigned long flags;
+    PageTargetData *target_data;
 #endif
 #ifndef CONFIG_USER_ONLY
     QemuSpin lock;
@@ -369,6 +382,11 @@ static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
            and shift if to the number of actually executed instructions */
         cpu_neg(cpu)->icount_decr.u16.low += num_insns - i;
     }
+#ifdef TARGET_HAS_TB_INSN_COUNTER
+    if (reset_icount) {
+        restore_insn_count_to_opc(env, tb, num_insns - i);
+    }
+#endif
     restore_state_to_opc(env, tb, data);
 
 #ifdef CONFIG_PROFILER
@@ -1222,17 +1240,93 @@ static gboolean tb_host_size_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-void flush_tcg_on_log_instr_chage(void);
-void flush_tcg_on_log_instr_chage(void) {
-    warn_report("Calling real %s\r", __func__);
-    CPUState *cpu;
-    int cpu_index = 0;
+#ifdef CONFIG_MIPS_LOG_INSTR
+static gboolean tb_log_instr_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    GPtrArray *tbs = data;
+
+    if ((tb_cflags(tb) & (CF_LOG_INSTR | CF_INVALID)) == CF_LOG_INSTR) {
+        g_ptr_array_add(tbs, tb);
+    }
+    return false;
+}
+
+/*
+ * Discard the TBs that were translated with instruction tracing enabled.
+ * TBs without CF_LOG_INSTR don't depend on the trace settings, so the bulk of
+ * the translation cache (e.g. the kernel or other processes when tracing a
+ * single process) survives.
+ */
+static void do_tb_invalidate_log_instr(CPUState *cpu, run_on_cpu_data data)
+{
+    GPtrArray *tbs = g_ptr_array_new();
+
+    mmap_lock();
+    tcg_tb_foreach(tb_log_instr_iter, tbs);
+    for (guint i = 0; i < tbs->len; i++) {
+        tb_phys_invalidate(g_ptr_array_index(tbs, i), -1);
+    }
+    mmap_unlock();
+    g_ptr_array_free(tbs, true);
+}
+#endif
+
+#ifdef CONFIG_MIPS_LOG_INSTR
+static void tcg_log_instr_update_filtered(CPUState *cpu)
+{
+#ifdef CONFIG_USER_ONLY
+    /* There is only one address space in user mode. */
+    bool filtered = false;
+#else
+    bool filtered = !qemu_log_in_asid_filter(cpu->log_instr_asid);
+#endif
+
+    if (filtered != cpu->log_instr_filtered) {
+        atomic_set(&cpu->log_instr_filtered, filtered);
+        /* Stop chaining into TBs translated with the old setting. */
+        cpu_exit(cpu);
+    }
+}
+#endif
+
+void flush_tcg_on_log_instr_chage(bool invalidate);
+void flush_tcg_on_log_instr_chage(bool invalidate) {
+    CPUState *cpu = current_cpu ?: first_cpu;
+
+    if (!tcg_enabled() || !cpu) {
+        return;
+    }
+#ifdef CONFIG_MIPS_LOG_INSTR
+    if (invalidate) {
+        if (cpu_in_exclusive_context(cpu)) {
+            do_tb_invalidate_log_instr(cpu, RUN_ON_CPU_NULL);
+        } else {
+            async_safe_run_on_cpu(cpu, do_tb_invalidate_log_instr,
+                                  RUN_ON_CPU_NULL);
+        }
+    }
+#else
+    tb_flush(cpu);
+#endif
+    /* Make running vCPUs pick up the new CF_LOG_INSTR value. */
     CPU_FOREACH(cpu) {
-        warn_report("Flushing TCG for CPU %d\r", cpu_index++);
-        tb_flush(cpu);
+#ifdef CONFIG_MIPS_LOG_INSTR
+        /* The -dfilter ASIDs may have changed. */
+        tcg_log_instr_update_filtered(cpu);
+#endif
+        cpu_exit(cpu);
     }
 }
 
+#ifdef CONFIG_MIPS_LOG_INSTR
+void tcg_log_instr_update_asid(CPUState *cpu, uint64_t asid)
+{
+    cpu->log_instr_asid = asid;
+    tcg_log_instr_update_filtered(cpu);
+}
+#endif
+
 /* flush all the translation blocks */
 static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 {
@@ -1483,6 +1577,14 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
             atomic_set(&cpu->tb_jmp_cache[h], NULL);
         }
     }
+#ifdef TARGET_CHERI
+    h = tb_cap_jmp_cache_hash_func(tb->pc, tb->cs_base, tb->cs_top);
+    CPU_FOREACH(cpu) {
+        if (atomic_read(&cpu->tb_cap_jmp_cache[h]) == tb) {
+            atomic_set(&cpu->tb_cap_jmp_cache[h], NULL);
+        }
+    }
+#endif
 
     /* suppress this TB from the two jump lists */
     tb_remove_from_jmp_list(tb, 0);
@@ -2282,6 +2384,10 @@ void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
        overlap the flushed page.  */
     tb_jmp_cache_clear_page(cpu, addr - TARGET_PAGE_SIZE);
     tb_jmp_cache_clear_page(cpu, addr);
+#ifdef TARGET_CHERI
+    /* Not indexed by page, but small enough to just clear it. */
+    cpu_tb_cap_jmp_cache_clear(cpu);
+#endif
 }
 
 static void print_qht_statistics(struct qht_stats hst)
@@ -2546,6 +2652,7 @@ int page_get_flags(target_ulong address)
 void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
     target_ulong addr, len;
+    bool reset_target_data;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2562,6 +2669,8 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     if (flags & PAGE_WRITE) {
         flags |= PAGE_WRITE_ORG;
     }
+    reset_target_data = !(flags & PAGE_VALID) || (flags & PAGE_RESET);
+    flags &= ~PAGE_RESET;
 
     for (addr = start, len = end - start;
          len != 0;
@@ -2575,10 +2684,45 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
             p->first_tb) {
             tb_invalidate_phys_page(addr, 0);
         }
+        if (reset_target_data && p->target_data) {
+            PageTargetData *data = p->target_data;
+
+            atomic_rcu_set(&p->target_data, NULL);
+            g_free_rcu(data, rcu);
+        }
         p->flags = flags;
     }
 }
 
+void *page_get_target_data(target_ulong address)
+{
+    PageDesc *p = page_find(address >> TARGET_PAGE_BITS);
+    PageTargetData *data = p ? atomic_rcu_read(&p->target_data) : NULL;
+
+    return data ? data->data : NULL;
+}
+
+void *page_alloc_target_data(target_ulong address, size_t size)
+{
+    PageDesc *p = page_find(address >> TARGET_PAGE_BITS);
+    PageTargetData *ret, *old;
+
+    if (!p || !(p->flags & PAGE_VALID)) {
+        return NULL;
+    }
+    ret = atomic_rcu_read(&p->target_data);
+    if (!ret) {
+        /* Other guest threads may be allocating the same page's data. */
+        ret = g_malloc0(sizeof(PageTargetData) + size);
+        old = atomic_cmpxchg(&p->target_data, NULL, ret);
+        if (old) {
+            g_free(ret);
+            ret = old;
+        }
+    }
+    return ret->data;
+}
+
 int page_check_range(target_ulong start, target_ulong len, int flags)
 {
     PageDesc *p;
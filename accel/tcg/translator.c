@@ -35,6 +35,36 @@ void translator_loop_temp_check(DisasContextBase *db)
 
 #ifdef CONFIG_MIPS_LOG_INSTR
 extern int cl_default_trace_format;
+
+/*
+ * The opcode passed to helper_log_instruction() is only known once the
+ * instruction has been translated, so the helper call is emitted with
+ * placeholder constants that are patched here. The translator has just read
+ * these bytes, so reading them again cannot fault.
+ */
+static void translator_set_log_opcode(DisasContextBase *db, CPUState *cpu,
+                                      target_ulong pc, TCGOp *opcode_op,
+                                      TCGOp *size_op)
+{
+    CPUArchState *env = cpu->env_ptr;
+    uint32_t size = db->pc_next - pc;
+    uint32_t opcode;
+
+    switch (size) {
+    case 2:
+        opcode = cpu_lduw_code(env, pc);
+        break;
+    case 4:
+        opcode = cpu_ldl_code(env, pc);
+        break;
+    default:
+        opcode = 0;
+        size = 0;
+        break;
+    }
+    tcg_set_insn_param(opcode_op, 1, opcode);
+    tcg_set_insn_param(size_op, 1, size);
+}
 #endif
 #define DEBUG_INSTR_LOGGING 0
 
@@ -54,21 +84,27 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     db->singlestep_enabled = cpu->singlestep_enabled;
 #ifdef TARGET_CHERI
     db->pcc_base = tb->cs_base;
-    db->pcc_top = tb->cs_top;
+    db->cheri_flags = tb->cheri_flags;
+    db->pcc_top_check_end = NULL;
     cheri_debug_assert(db->pcc_base ==
                        cap_get_base(cheri_get_recent_pcc(cpu->env_ptr)));
-    cheri_debug_assert(db->pcc_top ==
-                       cap_get_top(cheri_get_recent_pcc(cpu->env_ptr)));
-    db->cheri_flags = tb->cheri_flags;
+    if (pcc_top_is_dynamic(db)) {
+        // Shared between PCCs with different tops, checked on TB entry.
+        db->pcc_top = TYPE_MAXIMUM(target_ulong);
+    } else {
+        db->pcc_top = tb->cs_top;
+        cheri_debug_assert(db->pcc_top ==
+                           cap_get_top(cheri_get_recent_pcc(cpu->env_ptr)));
+    }
     // TODO: verify cheri_flags are correct?
 #endif
     ops->init_disas_context(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 #ifdef CONFIG_MIPS_LOG_INSTR
-    // Note: changes to the instruction logging flags result in a call to
-    // tb_flush so we can do the logging checks at translate time.
-    bool should_log_instr =
-        qemu_loglevel_mask(CPU_LOG_INSTR | CPU_LOG_CVTRACE | CPU_LOG_USER_ONLY);
+    // Note: TBs translated with instruction logging enabled are marked with
+    // CF_LOG_INSTR, and changes to the logging flags or -dfilter discard
+    // them, so we can do the logging checks at translate time.
+    bool should_log_instr = tb_cflags(tb) & CF_LOG_INSTR;
     if (unlikely(should_log_instr && qemu_loglevel_mask(CPU_LOG_USER_ONLY))) {
         if (!ops->tb_in_user_mode(db, cpu)) {
 #if DEBUG_INSTR_LOGGING
@@ -89,7 +125,8 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
             " (usermode=%d)\n", db->pc_next, ops->tb_in_user_mode(db, cpu));
     }
 #endif
-    db->log_instr = should_log_instr;
+    db->log_instr = should_log_instr && qemu_log_in_addr_range(db->pc_next);
+    tcg_ctx->log_instr = db->log_instr;
 #endif
 
     /* Reset the temp count so that we can identify leaks */
@@ -112,6 +149,8 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
         gen_helper_raise_exception_pcc_perms(cpu_env);
     } else if (unlikely(!in_pcc_bounds(db, db->pc_next))) {
         gen_raise_pcc_violation(db, db->pc_next, 0);
+    } else if (pcc_top_is_dynamic(db)) {
+        gen_pcc_top_check_start(db);
     }
 #endif
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
@@ -119,6 +158,10 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     plugin_enabled = plugin_gen_tb_start(cpu, tb);
 
     while (true) {
+#if defined(CONFIG_MIPS_LOG_INSTR)
+        TCGOp *log_opcode_op = NULL, *log_size_op = NULL;
+        target_ulong insn_pc = db->pc_next;
+#endif
         db->num_insns++;
 #ifdef CONFIG_DEBUG_TCG
         // For debugging mark the current PCC.cursor as outdated
@@ -126,12 +169,27 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
             tcg_gen_movi_tl(_pc_is_current, 0);
         }
 #endif
-        ops->insn_start(db, cpu);
 #if defined(CONFIG_MIPS_LOG_INSTR)
+        // Instructions outside the -dfilter ranges get no logging code.
         if (unlikely(should_log_instr)) {
+            db->log_instr = qemu_log_in_addr_range(db->pc_next);
+            tcg_ctx->log_instr = db->log_instr;
+        }
+#endif
+        ops->insn_start(db, cpu);
+#if defined(CONFIG_MIPS_LOG_INSTR)
+        if (unlikely(db->log_instr)) {
             TCGv tpc = tcg_const_tl(db->pc_next);
-            gen_helper_log_instruction(cpu_env, tpc);
+            TCGv_i32 opcode = tcg_temp_new_i32();
+            TCGv_i32 size = tcg_temp_new_i32();
+            tcg_gen_movi_i32(opcode, 0);
+            log_opcode_op = tcg_last_op();
+            tcg_gen_movi_i32(size, 0);
+            log_size_op = tcg_last_op();
+            gen_helper_log_instruction(cpu_env, tpc, opcode, size);
             tcg_temp_free(tpc);
+            tcg_temp_free_i32(opcode);
+            tcg_temp_free_i32(size);
         }
 #endif
         tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
@@ -173,6 +231,12 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
         } else {
             ops->translate_insn(db, cpu);
         }
+#if defined(CONFIG_MIPS_LOG_INSTR)
+        if (log_opcode_op) {
+            translator_set_log_opcode(db, cpu, insn_pc, log_opcode_op,
+                                      log_size_op);
+        }
+#endif
 
         /* Stop translation if translate_insn so indicated.  */
         if (db->is_jmp != DISAS_NEXT) {
@@ -197,6 +261,11 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
     /* Emit code to exit the TB, as indicated by db->is_jmp.  */
     ops->tb_stop(db, cpu);
+#ifdef TARGET_CHERI
+    if (db->pcc_top_check_end) {
+        gen_pcc_top_check_end(db);
+    }
+#endif
     gen_tb_end(db->tb, db->num_insns - bp_insn);
 
     if (plugin_enabled) {
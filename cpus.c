@@ -59,6 +59,7 @@
 #include "sysemu/runstate.h"
 #include "hw/boards.h"
 #include "hw/hw.h"
+#include "exec/cvtrace.h"
 
 #ifdef CONFIG_LINUX
 
@@ -1158,6 +1159,10 @@ static void qemu_tcg_destroy_vcpu(CPUState *cpu)
 static void qemu_cpu_stop(CPUState *cpu, bool exit)
 {
     g_assert(qemu_cpu_is_self(cpu));
+#ifdef CONFIG_MIPS_LOG_INSTR
+    /* Only this thread may touch the trace buffer while the vCPU runs. */
+    cvtrace_flush_cpu(cpu);
+#endif
     cpu->stop = false;
     cpu->stopped = true;
     if (exit) {
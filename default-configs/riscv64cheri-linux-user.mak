@@ -0,0 +1 @@
+# Default configuration for riscv64cheri-linux-user
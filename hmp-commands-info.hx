@@ -252,6 +252,22 @@ SRST
     Show the active virtual memory mappings.
 ERST
 
+#if defined(TARGET_RISCV)
+    {
+        .name       = "pwc",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the page-walk cache statistics",
+        .cmd        = hmp_info_pwc,
+    },
+#endif
+
+SRST
+  ``info pwc``
+    Show the page-walk cache statistics and entries of the current CPU
+    (RISC-V only).
+ERST
+
     {
         .name       = "mtree",
         .args_type  = "flatview:-f,dispatch_tree:-d,owner:-o",
@@ -323,6 +339,24 @@ SRST
     being coalesced.
 ERST
 
+#if defined(TARGET_CHERI)
+    {
+        .name       = "cheri-bounds",
+        .args_type  = "max:i?",
+        .params     = "[max]",
+        .help       = "show the CHERI capability bounds profile, up to max "
+                      "entries (default: 10), sorted by number of events",
+        .cmd        = hmp_info_cheri_bounds,
+    },
+#endif
+
+SRST
+  ``info cheri-bounds`` [*max*]
+    Show the program counters that created the most out-of-bounds or
+    unrepresentable capabilities, up to *max* entries (default: 10). Recording
+    is controlled with ``cheri-bounds-profile`` (CHERI targets only).
+ERST
+
     {
         .name       = "kvm",
         .args_type  = "",
@@ -625,6 +625,26 @@ SRST
   whether profiling is on or off.
 ERST
 
+#if defined(TARGET_CHERI)
+    {
+        .name       = "cheri-bounds-profile",
+        .args_type  = "op:s?,interval:i?",
+        .params     = "[on|off|reset] [interval]",
+        .help       = "enable, disable or reset the CHERI capability bounds "
+                      "profile, recording every interval-th event. "
+                      "With no arguments, prints whether profiling is on or off.",
+        .cmd        = hmp_cheri_bounds_profile,
+    },
+#endif
+
+SRST
+``cheri-bounds-profile [on|off|reset]`` [*interval*]
+  Enable, disable or reset the per-PC profile of out-of-bounds and
+  unrepresentable capabilities (CHERI targets only). If *interval* is given,
+  only every *interval*-th event on each vCPU is recorded. With no arguments,
+  prints whether profiling is on or off. See ``info cheri-bounds``.
+ERST
+
     {
         .name       = "system_reset",
         .args_type  = "",
@@ -59,6 +59,7 @@
 
 #if defined(TARGET_CHERI)
 #include "cheri_tagmem.h"
+#include "hw/misc/cheri_tag_scanner.h"
 #endif
 
 #define ENVP_ADDR           0x80002000l
@@ -69,6 +70,7 @@
 #define FLASH_ADDRESS       0x1e000000ULL
 #define FPGA_ADDRESS        0x1f000000ULL
 #define RESET_ADDRESS       0x1fc00000ULL
+#define TAG_SCANNER_ADDRESS 0x1e800000ULL /* after the flash, outside PCI */
 
 #define FLASH_SIZE          0x400000
 
@@ -1279,6 +1281,7 @@ void mips_malta_init(MachineState *machine)
 
 #ifdef TARGET_CHERI
     cheri_tag_init(machine->ram, memory_region_size(machine->ram));
+    cheri_tag_scanner_create(TAG_SCANNER_ADDRESS);
 #endif /* TARGET_CHERI */
 
     /* alias for pre IO hole access */
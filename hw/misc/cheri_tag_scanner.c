@@ -0,0 +1,267 @@
+/*
+ * CHERI tag scanner
+ *
+ * Finds tagged capabilities in guest physical memory with find_next_bit() on
+ * the tag bitmaps instead of one tag lookup per capability-sized granule. See
+ * include/hw/misc/cheri_tag_scanner.h for the register interface.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/rcu.h"
+#include "exec/address-spaces.h"
+#include "exec/ramblock.h"
+#include "migration/vmstate.h"
+#include "hw/misc/cheri_tag_scanner.h"
+#include "cheri_tagmem.h"
+#include "trace.h"
+
+/* Results are written back to the guest in batches of this many entries. */
+#define CHERI_TAG_SCANNER_BATCH 512
+
+typedef struct CheriTagScanBatch {
+    CheriTagScannerState *s;
+    uint64_t entries[CHERI_TAG_SCANNER_BATCH];
+    unsigned n;
+    bool error;
+} CheriTagScanBatch;
+
+static void cheri_tag_scanner_flush(CheriTagScanBatch *b)
+{
+    CheriTagScannerState *s = b->s;
+    hwaddr dest = s->buf_addr + (s->count - b->n) * sizeof(uint64_t);
+    MemTxResult res;
+
+    if (b->n == 0) {
+        return;
+    }
+    res = address_space_write(&address_space_memory, dest,
+                              MEMTXATTRS_UNSPECIFIED, b->entries,
+                              b->n * sizeof(uint64_t));
+    if (res != MEMTX_OK) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: cannot write results to 0x%"
+                      HWADDR_PRIx "\n", __func__, dest);
+        b->error = true;
+    }
+    b->n = 0;
+}
+
+static void cheri_tag_scanner_emit(CheriTagScanBatch *b, hwaddr addr)
+{
+    b->entries[b->n++] = cpu_to_le64(addr);
+    b->s->count++;
+    if (b->n == CHERI_TAG_SCANNER_BATCH) {
+        cheri_tag_scanner_flush(b);
+    }
+}
+
+static void cheri_tag_scanner_run(CheriTagScannerState *s)
+{
+    g_autofree CheriTagScanBatch *b = g_new0(CheriTagScanBatch, 1);
+    hwaddr addr = QEMU_ALIGN_DOWN(s->start, CHERI_CAP_SIZE);
+
+    b->s = s;
+    s->count = 0;
+    s->status = 0;
+
+    RCU_READ_LOCK_GUARD();
+    while (addr < s->end && s->count < s->buf_len) {
+        hwaddr xlat, len = s->end - addr;
+        MemoryRegion *mr =
+            address_space_translate(&address_space_memory, addr, &xlat, &len,
+                                    false, MEMTXATTRS_UNSPECIFIED);
+        /* Only RAM has tags, skip everything else. */
+        if (!memory_region_is_ram(mr) || memory_region_is_rom(mr) ||
+            !mr->ram_block || !mr->ram_block->cheri_tags) {
+            addr += len;
+            continue;
+        }
+        ram_addr_t offset = xlat;
+        ram_addr_t end = xlat + len;
+        while (s->count < s->buf_len) {
+            offset = cheri_tag_phys_find_next(mr->ram_block, offset, end);
+            if (offset >= end) {
+                break;
+            }
+            cheri_tag_scanner_emit(b, addr + (offset - xlat));
+            offset += CHERI_CAP_SIZE;
+        }
+        addr += MIN(offset, end) - xlat;
+    }
+    cheri_tag_scanner_flush(b);
+
+    s->next = MIN(addr, s->end);
+    s->status = CHERI_TAG_SCANNER_STATUS_DONE;
+    if (s->next < s->end) {
+        s->status |= CHERI_TAG_SCANNER_STATUS_MORE;
+    }
+    if (b->error) {
+        s->status |= CHERI_TAG_SCANNER_STATUS_ERROR;
+    }
+    trace_cheri_tag_scanner_run(s->start, s->end, s->count, s->next);
+}
+
+static uint64_t cheri_tag_scanner_reg_read(CheriTagScannerState *s,
+                                           hwaddr reg)
+{
+    switch (reg) {
+    case CHERI_TAG_SCANNER_ID:
+        return CHERI_TAG_SCANNER_ID_VALUE;
+    case CHERI_TAG_SCANNER_START:
+        return s->start;
+    case CHERI_TAG_SCANNER_END:
+        return s->end;
+    case CHERI_TAG_SCANNER_BUF_ADDR:
+        return s->buf_addr;
+    case CHERI_TAG_SCANNER_BUF_LEN:
+        return s->buf_len;
+    case CHERI_TAG_SCANNER_STATUS:
+        return s->status;
+    case CHERI_TAG_SCANNER_COUNT:
+        return s->count;
+    case CHERI_TAG_SCANNER_NEXT:
+        return s->next;
+    case CHERI_TAG_SCANNER_GRANULE:
+        return CHERI_CAP_SIZE;
+    case CHERI_TAG_SCANNER_CTRL:
+        return 0;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, reg);
+        return 0;
+    }
+}
+
+static uint64_t cheri_tag_scanner_read(void *opaque, hwaddr addr,
+                                       unsigned int size)
+{
+    CheriTagScannerState *s = opaque;
+    uint64_t val = cheri_tag_scanner_reg_read(s, addr & ~7);
+
+    if (size == 4) {
+        val = extract64(val, (addr & 4) * 8, 32);
+    }
+    return val;
+}
+
+static void cheri_tag_scanner_write(void *opaque, hwaddr addr, uint64_t val,
+                                    unsigned int size)
+{
+    CheriTagScannerState *s = opaque;
+    hwaddr reg = addr & ~7;
+    uint64_t *field;
+
+    switch (reg) {
+    case CHERI_TAG_SCANNER_START:
+        field = &s->start;
+        break;
+    case CHERI_TAG_SCANNER_END:
+        field = &s->end;
+        break;
+    case CHERI_TAG_SCANNER_BUF_ADDR:
+        field = &s->buf_addr;
+        break;
+    case CHERI_TAG_SCANNER_BUF_LEN:
+        field = &s->buf_len;
+        break;
+    case CHERI_TAG_SCANNER_CTRL:
+        if (val & CHERI_TAG_SCANNER_CTRL_START) {
+            cheri_tag_scanner_run(s);
+        }
+        return;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, addr);
+        return;
+    }
+    if (size == 4) {
+        *field = deposit64(*field, (addr & 4) * 8, 32, val);
+    } else {
+        *field = val;
+    }
+}
+
+static const MemoryRegionOps cheri_tag_scanner_ops = {
+    .read = cheri_tag_scanner_read,
+    .write = cheri_tag_scanner_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 8,
+    },
+};
+
+static void cheri_tag_scanner_reset(DeviceState *dev)
+{
+    CheriTagScannerState *s = CHERI_TAG_SCANNER(dev);
+
+    s->start = 0;
+    s->end = 0;
+    s->buf_addr = 0;
+    s->buf_len = 0;
+    s->status = 0;
+    s->count = 0;
+    s->next = 0;
+}
+
+static const VMStateDescription vmstate_cheri_tag_scanner = {
+    .name = TYPE_CHERI_TAG_SCANNER,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT64(start, CheriTagScannerState),
+        VMSTATE_UINT64(end, CheriTagScannerState),
+        VMSTATE_UINT64(buf_addr, CheriTagScannerState),
+        VMSTATE_UINT64(buf_len, CheriTagScannerState),
+        VMSTATE_UINT64(status, CheriTagScannerState),
+        VMSTATE_UINT64(count, CheriTagScannerState),
+        VMSTATE_UINT64(next, CheriTagScannerState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void cheri_tag_scanner_init(Object *obj)
+{
+    CheriTagScannerState *s = CHERI_TAG_SCANNER(obj);
+
+    memory_region_init_io(&s->mmio, obj, &cheri_tag_scanner_ops, s,
+                          TYPE_CHERI_TAG_SCANNER, 0x1000);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
+}
+
+static void cheri_tag_scanner_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->reset = cheri_tag_scanner_reset;
+    dc->vmsd = &vmstate_cheri_tag_scanner;
+}
+
+static const TypeInfo cheri_tag_scanner_info = {
+    .name          = TYPE_CHERI_TAG_SCANNER,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(CheriTagScannerState),
+    .instance_init = cheri_tag_scanner_init,
+    .class_init    = cheri_tag_scanner_class_init,
+};
+
+static void cheri_tag_scanner_register_types(void)
+{
+    type_register_static(&cheri_tag_scanner_info);
+}
+
+type_init(cheri_tag_scanner_register_types)
+
+DeviceState *cheri_tag_scanner_create(hwaddr addr)
+{
+    DeviceState *dev = qdev_create(NULL, TYPE_CHERI_TAG_SCANNER);
+    qdev_init_nofail(dev);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, addr);
+    return dev;
+}
@@ -53,6 +53,7 @@
 
 #ifdef TARGET_CHERI
 #include "cheri_tagmem.h"
+#include "hw/misc/cheri_tag_scanner.h"
 #endif
 
 static const struct MemmapEntry {
@@ -63,6 +64,7 @@ static const struct MemmapEntry {
     [VIRT_MROM] =        {     0x1000,       0x11000 },
     [VIRT_TEST] =        {   0x100000,        0x1000 },
     [VIRT_RTC] =         {   0x101000,        0x1000 },
+    [VIRT_TAG_SCANNER] = {   0x102000,        0x1000 },
     [VIRT_CLINT] =       {  0x2000000,       0x10000 },
     [VIRT_PLIC] =        {  0xc000000,     0x4000000 },
     [VIRT_UART0] =       { 0x10000000,         0x100 },
@@ -421,6 +423,17 @@ static void create_fdt(RISCVVirtState *s, const struct MemmapEntry *memmap,
     qemu_fdt_setprop_cell(fdt, nodename, "interrupts", RTC_IRQ);
     g_free(nodename);
 
+#ifdef TARGET_CHERI
+    nodename = g_strdup_printf("/tag-scanner@%lx",
+        (long)memmap[VIRT_TAG_SCANNER].base);
+    qemu_fdt_add_subnode(fdt, nodename);
+    qemu_fdt_setprop_string(fdt, nodename, "compatible", "cheri,tag-scanner");
+    qemu_fdt_setprop_cells(fdt, nodename, "reg",
+        0x0, memmap[VIRT_TAG_SCANNER].base,
+        0x0, memmap[VIRT_TAG_SCANNER].size);
+    g_free(nodename);
+#endif
+
     nodename = g_strdup_printf("/flash@%" PRIx64, flashbase);
     qemu_fdt_add_subnode(s->fdt, nodename);
     qemu_fdt_setprop_string(s->fdt, nodename, "compatible", "cfi-flash");
@@ -602,6 +615,9 @@ static void riscv_virt_board_init(MachineState *machine)
         memmap[VIRT_CLINT].size, smp_cpus,
         SIFIVE_SIP_BASE, SIFIVE_TIMECMP_BASE, SIFIVE_TIME_BASE, true);
     sifive_test_create(memmap[VIRT_TEST].base);
+#ifdef TARGET_CHERI
+    cheri_tag_scanner_create(memmap[VIRT_TAG_SCANNER].base);
+#endif
 
     for (i = 0; i < VIRTIO_COUNT; i++) {
         sysbus_create_simple("virtio-mmio",
@@ -1403,6 +1403,7 @@ typedef struct {
 #define EF_RISCV_FLOAT_ABI_QUAD   0x0006
 #define EF_RISCV_RVE              0x0008
 #define EF_RISCV_TSO              0x0010
+#define EF_RISCV_CHERIABI         0x10000
 
 typedef struct elf32_rel {
   Elf32_Addr	r_offset;
@@ -261,6 +261,10 @@ extern intptr_t qemu_host_page_mask;
 /* FIXME: Code that sets/uses this is broken and needs to go away.  */
 #define PAGE_RESERVED  0x0020
 #endif
+#if defined(CONFIG_USER_ONLY)
+/* For linux-user, the page is being (re)mapped: discard its target data. */
+#define PAGE_RESET     0x0080
+#endif
 #ifdef TARGET_CHERI
 #define PAGE_LC_CLEAR	0x8000
 #define PAGE_LC_TRAP	0x4000
@@ -277,6 +281,15 @@ int walk_memory_regions(void *, walk_memory_regions_fn);
 int page_get_flags(target_ulong address);
 void page_set_flags(target_ulong start, target_ulong end, int flags);
 int page_check_range(target_ulong start, target_ulong len, int flags);
+/*
+ * Per-page data owned by the target (e.g. CHERI tags). It is allocated on
+ * first use and freed when the page is unmapped or remapped (PAGE_RESET).
+ * page_alloc_target_data() returns NULL if the page is not mapped.
+ * The returned pointer is only valid within an RCU read-side critical
+ * section, since another guest thread may unmap the page at any time.
+ */
+void *page_get_target_data(target_ulong address);
+void *page_alloc_target_data(target_ulong address, size_t size);
 #endif
 
 CPUArchState *cpu_copy(CPUArchState *env);
@@ -357,13 +370,19 @@ CPUArchState *cpu_copy(CPUArchState *env);
 #define TLB_BSWAP           (1 << (TARGET_PAGE_BITS_MIN - 5))
 /* Set if TLB entry writes ignored.  */
 #define TLB_DISCARD_WRITE   (1 << (TARGET_PAGE_BITS_MIN - 6))
+#ifdef TARGET_CHERI
+/* Set if writes to the page must clear CHERI capability tags.  */
+#define TLB_CHERI_TAGS      (1 << (TARGET_PAGE_BITS_MIN - 7))
+#else
+#define TLB_CHERI_TAGS      0
+#endif
 
 /* Use this mask to check interception with an alignment mask
  * in a TCG backend.
  */
 #define TLB_FLAGS_MASK \
     (TLB_INVALID_MASK | TLB_NOTDIRTY | TLB_MMIO \
-    | TLB_WATCHPOINT | TLB_BSWAP | TLB_DISCARD_WRITE)
+    | TLB_WATCHPOINT | TLB_BSWAP | TLB_DISCARD_WRITE | TLB_CHERI_TAGS)
 
 /**
  * tlb_hit_page: return true if page aligned @addr is a hit against the
@@ -146,6 +146,26 @@ typedef struct CPUIOTLBEntry {
      */
     hwaddr addr;
     MemTxAttrs attrs;
+#ifdef TARGET_CHERI
+    /*
+     * @tagmem is the RAMBlock holding the capability tags for this page (or
+     * NULL if the page cannot hold tags) and @tagmem_offset must be added to
+     * the virtual address to obtain the offset within that RAMBlock.
+     * @tagmem_prot caches the PAGE_LC_* and PAGE_SC_TRAP bits of the guest
+     * translation so that tag accesses don't need to walk the page tables.
+     */
+    RAMBlock *tagmem;
+    hwaddr tagmem_offset;
+    int tagmem_prot;
+    /*
+     * Used by capability loads and stores in generated code: @tagblock points
+     * to the slot holding the tag block pointer for this page and
+     * @tagblock_word_ofs is the offset of the page's first tag word in that
+     * block. NULL if the tags must be accessed via the helpers.
+     */
+    void **tagblock;
+    uint32_t tagblock_word_ofs;
+#endif
 } CPUIOTLBEntry;
 
 /*
@@ -305,4 +305,24 @@ void *tlb_vaddr_to_host(CPUArchState *env, abi_ptr addr,
                         MMUAccessType access_type, int mmu_idx);
 #endif
 
+#if defined(TARGET_CHERI) && !defined(CONFIG_USER_ONLY)
+/**
+ * tlb_vaddr_to_tagmem:
+ * @env: CPUArchState
+ * @addr: guest virtual address to look up
+ * @access_type: type of access (data or capability load/store)
+ * @mmu_idx: MMU index to use for lookup
+ * @tagmem: set to the RAMBlock holding the tags for @addr (may be NULL)
+ * @ram_offset: set to the offset of @addr within @tagmem
+ * @prot: set to the CHERI protection bits (PAGE_LC_*, PAGE_SC_TRAP)
+ *
+ * Look up the tag memory for @addr in the TCG softmmu TLB. Unlike
+ * tlb_vaddr_to_host() this never calls tlb_fill(), so it returns false on a
+ * TLB miss and the caller must perform a full translation instead.
+ */
+bool tlb_vaddr_to_tagmem(CPUArchState *env, abi_ptr addr,
+                         MMUAccessType access_type, int mmu_idx,
+                         RAMBlock **tagmem, hwaddr *ram_offset, int *prot);
+#endif
+
 #endif /* CPU_LDST_H */
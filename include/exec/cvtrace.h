@@ -0,0 +1,84 @@
+/*
+ * CHERI stream trace (cvtrace) output
+ *
+ * Each executed instruction is described by one fixed size struct cvtrace
+ * record. Records are batched per vCPU and written to the log file with a
+ * single write() per batch. With -cheri-cvtrace-per-cpu every vCPU gets its
+ * own file (<logfile>.cpu<N>), and -cheri-cvtrace-rotate-size starts a new
+ * file (<name>.<segment>) once the current one reaches the given size.
+ *
+ * Every file starts with a CVT_QEMU_VERSION header record. Each record names
+ * its vCPU in the thread field. With -cheri-cvtrace-batch, batches in a file
+ * shared by several vCPUs are additionally preceded by a CVT_BATCH record
+ * identifying the vCPU and batch sequence number; such files use the
+ * CVT_QEMU_VERSION_BATCH header since older readers do not know CVT_BATCH.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_CVTRACE_H
+#define EXEC_CVTRACE_H
+
+#ifdef CONFIG_MIPS_LOG_INSTR
+struct cvtrace {
+    uint8_t version;
+#define CVT_GPR     1   /* GPR change (val2) */
+#define CVT_LD_GPR  2   /* Load into GPR (val2) from address (val1) */
+#define CVT_ST_GPR  3   /* Store from GPR (val2) to address (val1) */
+#define CVT_NO_REG  4   /* No register is changed. */
+#define CVT_CAP     11  /* Cap change (val2,val3,val4,val5) */
+#define CVT_LD_CAP  12  /* Load Cap (val2,val3,val4,val5) from addr (val1) */
+#define CVT_ST_CAP  13  /* Store Cap (val2,val3,val4,val5) to addr (val1) */
+#define CVT_BATCH   0x90 /* val1 records from CPU thread follow, val2 is the
+                            batch sequence number for that CPU. Only in
+                            CVT_QEMU_VERSION_BATCH files. */
+    uint8_t exception;  /* 0=none, 1=TLB Mod, 2=TLB Load, 3=TLB Store, etc. */
+    uint16_t cycles;    /* Currently not used. */
+    uint32_t inst;      /* Encoded instruction. */
+    uint64_t pc;        /* PC value of instruction. */
+    uint64_t val1;      /* val1 is used for memory address. */
+    uint64_t val2;      /* val2, val3, val4, val5 are used for reg content. */
+    uint64_t val3;
+    uint64_t val4;
+    uint64_t val5;
+    uint8_t thread;     /* Hardware thread/CPU (i.e. cpu->cpu_index ) */
+    uint8_t asid;       /* Address Space ID (i.e. CP0_TCStatus & 0xff) */
+} __attribute__((packed));
+typedef struct cvtrace cvtrace_t;
+
+/* Version 3 Cheri Stream Trace header info */
+#define CVT_QEMU_VERSION    (0x80U + 3)
+#define CVT_QEMU_MAGIC      "CheriTraceV03"
+/* Version 4 adds CVT_BATCH records */
+#define CVT_QEMU_VERSION_BATCH  (0x80U + 4)
+#define CVT_QEMU_MAGIC_BATCH    "CheriTraceV04"
+
+/* Set from the command line before the first instruction is traced. */
+extern bool cvtrace_per_cpu;
+extern bool cvtrace_batch_records;
+extern uint64_t cvtrace_rotate_size;
+
+/*
+ * Queue the record for the previous instruction (if any) and start a new
+ * one for the instruction at @pc. The caller fills in the opcode.
+ */
+void cvtrace_new_insn(CPUState *cs, cvtrace_t *entry, uint64_t pc,
+                      uint8_t asid);
+/*
+ * Write out the records queued by @cs. Must be called from the thread
+ * running @cs (e.g. when it stops) since that thread appends to the queue
+ * without a lock.
+ */
+void cvtrace_flush_cpu(CPUState *cs);
+/* Write out all queued records. The vCPUs must be stopped. */
+void cvtrace_flush_all(void);
+/*
+ * atexit() handler for exit() calls from a vCPU thread: write out the records
+ * of the vCPUs run by the calling thread. Other vCPUs may still be running,
+ * so their records are dropped.
+ */
+void cvtrace_flush_at_exit(void);
+#endif /* CONFIG_MIPS_LOG_INSTR */
+
+#endif /* EXEC_CVTRACE_H */
@@ -46,6 +46,15 @@ typedef ram_addr_t tb_page_addr_t;
 void gen_intermediate_code(CPUState *cpu, TranslationBlock *tb, int max_insns);
 void restore_state_to_opc(CPUArchState *env, TranslationBlock *tb,
                           target_ulong *data);
+#ifdef TARGET_HAS_TB_INSN_COUNTER
+/*
+ * Targets that add the number of instructions in a TB to an instruction
+ * counter on TB entry undo the @not_executed instructions that did not
+ * retire. This includes the one that raised the exception.
+ */
+void restore_insn_count_to_opc(CPUArchState *env, TranslationBlock *tb,
+                               int not_executed);
+#endif
 
 void cpu_gen_init(void);
 
@@ -387,11 +396,13 @@ struct TranslationBlock {
 #define CF_USE_ICOUNT  0x00020000
 #define CF_INVALID     0x00040000 /* TB is stale. Set with @jmp_lock held */
 #define CF_PARALLEL    0x00080000 /* Generate code for a parallel context */
+#define CF_LOG_INSTR   0x00100000 /* Instruction tracing was enabled */
 #define CF_CLUSTER_MASK 0xff000000 /* Top 8 bits are cluster ID */
 #define CF_CLUSTER_SHIFT 24
 /* cflags' mask for hashing/comparison */
 #define CF_HASH_MASK   \
-    (CF_COUNT_MASK | CF_LAST_IO | CF_USE_ICOUNT | CF_PARALLEL | CF_CLUSTER_MASK)
+    (CF_COUNT_MASK | CF_LAST_IO | CF_USE_ICOUNT | CF_PARALLEL | \
+     CF_LOG_INSTR | CF_CLUSTER_MASK)
 
     /* Per-vCPU dynamic tracing state used to generate this TB */
     uint32_t trace_vcpu_dstate;
@@ -462,9 +473,25 @@ static inline uint32_t tb_cflags(const TranslationBlock *tb)
 static inline uint32_t curr_cflags(void)
 {
     return (parallel_cpus ? CF_PARALLEL : 0)
-         | (use_icount ? CF_USE_ICOUNT : 0);
+         | (use_icount ? CF_USE_ICOUNT : 0)
+#ifdef CONFIG_MIPS_LOG_INSTR
+         | (unlikely(qemu_loglevel_mask(CPU_LOG_INSTR | CPU_LOG_CVTRACE |
+                                        CPU_LOG_USER_ONLY)) &&
+            !(current_cpu && current_cpu->log_instr_filtered) ?
+            CF_LOG_INSTR : 0)
+#endif
+        ;
 }
 
+#ifdef CONFIG_MIPS_LOG_INSTR
+/*
+ * Called by the target on reset and whenever the current ASID changes so that
+ * instruction tracing can be limited to the ASIDs selected with
+ * -dfilter asid=N.
+ */
+void tcg_log_instr_update_asid(CPUState *cpu, uint64_t asid);
+#endif
+
 /* TranslationBlock invalidate API */
 #if defined(CONFIG_USER_ONLY)
 void tb_invalidate_phys_addr(target_ulong addr);
@@ -0,0 +1,87 @@
+/*
+ * Binary instruction trace
+ *
+ * An alternative to the text instruction trace (-d instr) that writes fixed
+ * size binary records through per-vCPU buffers drained by a writer thread
+ * (see qemu/log-buffer.h). Selected with "-cheri-trace-format binary" and
+ * rendered to the text format by scripts/render-instr-trace.py.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_LOG_INSTR_BINARY_H
+#define EXEC_LOG_INSTR_BINARY_H
+
+#include "exec/memop.h"
+
+#define LOG_INSTR_BIN_MAGIC     "QEMUINSTRTRACE"
+#define LOG_INSTR_BIN_VERSION   2
+
+/*
+ * File header, followed by a stream of LogInstrBinRecord. All fields are
+ * little-endian.
+ */
+typedef struct QEMU_PACKED LogInstrBinHeader {
+    char magic[16];
+    uint32_t version;
+    uint32_t record_size;
+    char target[24];
+} LogInstrBinHeader;
+
+enum {
+    LOG_INSTR_BIN_INSN = 1,      /* addr = pc, info = opcode, size = bytes
+                                    (0 if unknown) */
+    LOG_INSTR_BIN_REG,           /* info = name id, value */
+    LOG_INSTR_BIN_MEM_LOAD,      /* addr, value, size */
+    LOG_INSTR_BIN_MEM_STORE,     /* addr, value, size */
+    LOG_INSTR_BIN_CAP_LOAD,      /* addr, value = pesbt, value2 = cursor,
+                                    info = tag */
+    LOG_INSTR_BIN_CAP_STORE,     /* as above */
+    LOG_INSTR_BIN_NAME,          /* info = name id, value = length, followed
+                                    by the name in continuation records */
+    LOG_INSTR_BIN_TEXT,          /* value = length, followed by text in
+                                    continuation records */
+    LOG_INSTR_BIN_CAP_REG,       /* info = name id, size = tag,
+                                    value = pesbt, value2 = cursor */
+};
+
+typedef struct QEMU_PACKED LogInstrBinRecord {
+    uint8_t type;
+    uint8_t size;
+    uint16_t cpu;
+    uint32_t info;
+    uint64_t addr;
+    uint64_t value;
+    uint64_t value2;
+} LogInstrBinRecord;
+
+#ifdef CONFIG_MIPS_LOG_INSTR
+
+extern bool log_instr_binary;
+
+static inline bool log_instr_binary_enabled(void)
+{
+    return unlikely(log_instr_binary);
+}
+
+/* Open the trace file, called from vl.c. */
+void log_instr_binary_open(const char *filename, bool compress);
+
+void log_instr_bin_insn(CPUArchState *env, target_ulong pc, uint32_t opcode,
+                        uint32_t size);
+/* @name must be a string constant, it is only sent once per vCPU. */
+void log_instr_bin_reg(CPUArchState *env, const char *name, uint64_t value);
+/* As above, @pesbt is in the in-memory format of CAP_LOAD/CAP_STORE. */
+void log_instr_bin_cap_reg(CPUArchState *env, const char *name, uint64_t pesbt,
+                           uint64_t cursor, bool tag);
+void log_instr_bin_mem(CPUArchState *env, bool store, target_ulong addr,
+                       uint64_t value, MemOp op);
+void log_instr_bin_cap_mem(CPUArchState *env, bool store, target_ulong addr,
+                           uint64_t pesbt, uint64_t cursor, bool tag);
+void log_instr_bin_text(CPUArchState *env, const char *fmt, ...)
+    GCC_FMT_ATTR(2, 3);
+
+#endif /* CONFIG_MIPS_LOG_INSTR */
+
+#endif /* EXEC_LOG_INSTR_BINARY_H */
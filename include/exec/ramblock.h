@@ -48,6 +48,10 @@ struct RAMBlock {
 
     /* Bitmap of CHERI tag bits */
     struct CheriTagMem *cheri_tags;
+    /* CHERI tag blocks modified since they were last sent for migration */
+    unsigned long *cheri_tags_dirty;
+    /* Side table for the extra capability bits of CHERI magic128 */
+    struct CheriMagic128Block **cheri_magic128;
 
     /*
      * bitmap to track already cleared dirty bitmap.  When the bit is
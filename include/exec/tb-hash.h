@@ -59,6 +59,18 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 
 #endif /* CONFIG_SOFTMMU */
 
+#ifdef TARGET_CHERI
+static inline unsigned int tb_cap_jmp_cache_hash_func(target_ulong pc,
+                                                      target_ulong cs_base,
+                                                      target_ulong cs_top)
+{
+    target_ulong tmp = (pc >> 1) ^ (cs_base >> 3) ^ (cs_top >> 5);
+    tmp ^= tmp >> TB_CAP_JMP_CACHE_BITS;
+    tmp ^= tmp >> (2 * TB_CAP_JMP_CACHE_BITS);
+    return tmp & (TB_CAP_JMP_CACHE_SIZE - 1);
+}
+#endif
+
 static inline
 uint32_t tb_hash_func(tb_page_addr_t phys_pc, target_ulong pc, uint32_t flags,
                       uint32_t cf_mask, uint32_t trace_vcpu_dstate)
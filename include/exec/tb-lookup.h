@@ -16,6 +16,18 @@
 #include "exec/exec-all.h"
 #include "exec/tb-hash.h"
 
+static inline bool tb_lookup_matches(CPUState *cpu, TranslationBlock *tb,
+                                     target_ulong pc, target_ulong cs_base,
+                                     target_ulong cs_top, uint32_t cheri_flags,
+                                     uint32_t flags, uint32_t cf_mask)
+{
+    return tb && tb->pc == pc && tb->cs_base == cs_base &&
+           tb->cs_top == cs_top && tb->cheri_flags == cheri_flags &&
+           tb->flags == flags &&
+           tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+           (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask;
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *
 tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
@@ -33,11 +45,8 @@ tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
     cf_mask &= ~CF_CLUSTER_MASK;
     cf_mask |= cpu->cluster_index << CF_CLUSTER_SHIFT;
 
-    if (likely(tb && tb->pc == *pc && tb->cs_base == *cs_base &&
-               tb->cs_top == *cs_top && tb->cheri_flags == *cheri_flags &&
-               tb->flags == *flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask)) {
+    if (likely(tb_lookup_matches(cpu, tb, *pc, *cs_base, *cs_top, *cheri_flags,
+                                 *flags, cf_mask))) {
         return tb;
     }
     tb = tb_htable_lookup(cpu, *pc, *cs_base, *cs_top, *cheri_flags, *flags,
@@ -49,4 +58,42 @@ tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
     return tb;
 }
 
+#ifdef TARGET_CHERI
+/*
+ * Same as tb_lookup__cpu_state() but for the target of a capability jump.
+ * The cache used here is keyed on the PCC bounds as well as the target
+ * address, so code that is entered with different PCCs (e.g. shared library
+ * functions called from several compartments) and the call/return pairs
+ * between them do not keep evicting each other from tb_jmp_cache.
+ */
+static inline TranslationBlock *
+tb_lookup__cap_jump(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
+                    target_ulong *cs_top, uint32_t *cheri_flags,
+                    uint32_t *flags, uint32_t cf_mask)
+{
+    CPUArchState *env = (CPUArchState *)cpu->env_ptr;
+    TranslationBlock *tb;
+    uint32_t hash;
+
+    cpu_get_tb_cpu_state(env, pc, cs_base, cs_top, cheri_flags, flags);
+    hash = tb_cap_jmp_cache_hash_func(*pc, *cs_base, *cs_top);
+    tb = atomic_rcu_read(&cpu->tb_cap_jmp_cache[hash]);
+
+    cf_mask &= ~CF_CLUSTER_MASK;
+    cf_mask |= cpu->cluster_index << CF_CLUSTER_SHIFT;
+
+    if (likely(tb_lookup_matches(cpu, tb, *pc, *cs_base, *cs_top, *cheri_flags,
+                                 *flags, cf_mask))) {
+        return tb;
+    }
+    tb = tb_htable_lookup(cpu, *pc, *cs_base, *cs_top, *cheri_flags, *flags,
+                          cf_mask);
+    if (tb == NULL) {
+        return NULL;
+    }
+    atomic_set(&cpu->tb_cap_jmp_cache[hash], tb);
+    return tb;
+}
+#endif
+
 #endif /* EXEC_TB_LOOKUP_H */
@@ -74,6 +74,10 @@ typedef struct DisasContextBase {
     target_ulong pcc_base;
     target_ulong pcc_top;
     uint32_t cheri_flags;
+    /* TB_FLAG_PCC_TOP_DYNAMIC: minimum PCC top required by this TB */
+    target_ulong pcc_top_required;
+    TCGOp *pcc_top_check_end;
+    TCGOp *pcc_top_check_len;
 #endif
     DisasJumpType is_jmp;
     int num_insns;
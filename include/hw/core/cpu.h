@@ -271,6 +271,12 @@ struct hax_vcpu_state;
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
+#ifdef CONFIG_CHERI
+/* Jump cache for capability jumps, keyed on the target and the PCC bounds */
+#define TB_CAP_JMP_CACHE_BITS 8
+#define TB_CAP_JMP_CACHE_SIZE (1 << TB_CAP_JMP_CACHE_BITS)
+#endif
+
 /* work queue */
 
 /* The union type allows passing of 64 bit target pointers on 32 bit
@@ -393,6 +399,9 @@ struct CPUState {
 
     /* Accessed in parallel; all accesses must be atomic */
     struct TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+#ifdef CONFIG_CHERI
+    struct TranslationBlock *tb_cap_jmp_cache[TB_CAP_JMP_CACHE_SIZE];
+#endif
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -424,6 +433,19 @@ struct CPUState {
 
     GArray *plugin_mem_cbs;
 
+#ifdef CONFIG_MIPS_LOG_INSTR
+    /* Per-vCPU state of the binary instruction trace (-cheri-trace-format) */
+    struct LogInstrBinState *log_instr_bin;
+    /* Per-vCPU batch of CHERI stream trace records (see exec/cvtrace.h) */
+    struct CVTraceState *cvtrace;
+    /* The last ASID passed to tcg_log_instr_update_asid() */
+    uint64_t log_instr_asid;
+    /* The current ASID is excluded from tracing by -dfilter asid=N */
+    bool log_instr_filtered;
+#endif
+    /* Per-vCPU shard of the CHERI bounds profile (see cheri-bounds-stats.h) */
+    struct CheriBoundsShard *cheri_bounds;
+
     /* TODO Move common fields from CPUArchState here. */
     int cpu_index;
     int cluster_index;
@@ -460,6 +482,17 @@ extern CPUTailQ cpus;
 
 extern __thread CPUState *current_cpu;
 
+#ifdef CONFIG_CHERI
+static inline void cpu_tb_cap_jmp_cache_clear(CPUState *cpu)
+{
+    unsigned int i;
+
+    for (i = 0; i < TB_CAP_JMP_CACHE_SIZE; i++) {
+        atomic_set(&cpu->tb_cap_jmp_cache[i], NULL);
+    }
+}
+#endif
+
 static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
 {
     unsigned int i;
@@ -467,6 +500,9 @@ static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
     for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
         atomic_set(&cpu->tb_jmp_cache[i], NULL);
     }
+#ifdef CONFIG_CHERI
+    cpu_tb_cap_jmp_cache_clear(cpu);
+#endif
 }
 
 /**
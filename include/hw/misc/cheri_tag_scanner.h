@@ -0,0 +1,78 @@
+/*
+ * CHERI tag scanner
+ *
+ * MMIO device that finds all tagged capabilities in a range of guest
+ * physical memory using the tag bitmaps, so that revocation sweeps don't
+ * have to load every capability-sized granule.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef HW_MISC_CHERI_TAG_SCANNER_H
+#define HW_MISC_CHERI_TAG_SCANNER_H
+
+#include "hw/sysbus.h"
+
+#define TYPE_CHERI_TAG_SCANNER "cheri-tag-scanner"
+
+#define CHERI_TAG_SCANNER(obj) \
+    OBJECT_CHECK(CheriTagScannerState, (obj), TYPE_CHERI_TAG_SCANNER)
+
+/*
+ * Register layout, all registers are 64 bits wide and may be accessed as
+ * two 32-bit halves:
+ *
+ *   ID        (RO) CHERI_TAG_SCANNER_ID_VALUE
+ *   START     (RW) first guest physical address to scan
+ *   END       (RW) end of the range (exclusive)
+ *   BUF_ADDR  (RW) guest physical address of the result buffer
+ *   BUF_LEN   (RW) size of the result buffer in entries
+ *   CTRL      (WO) write CTRL_START to run a scan
+ *   STATUS    (RO) STATUS_* bits of the last scan
+ *   COUNT     (RO) number of entries written by the last scan
+ *   NEXT      (RO) address to continue from if STATUS_MORE is set
+ *   GRANULE   (RO) capability size in bytes
+ *
+ * A scan completes before the write to CTRL returns. It writes the physical
+ * address of each tagged capability in [START, END) to the result buffer as
+ * little-endian 64-bit values, in ascending order. If the buffer fills up,
+ * STATUS_MORE is set and the scan can be resumed by setting START to NEXT.
+ */
+enum {
+    CHERI_TAG_SCANNER_ID = 0x00,
+    CHERI_TAG_SCANNER_START = 0x08,
+    CHERI_TAG_SCANNER_END = 0x10,
+    CHERI_TAG_SCANNER_BUF_ADDR = 0x18,
+    CHERI_TAG_SCANNER_BUF_LEN = 0x20,
+    CHERI_TAG_SCANNER_CTRL = 0x28,
+    CHERI_TAG_SCANNER_STATUS = 0x30,
+    CHERI_TAG_SCANNER_COUNT = 0x38,
+    CHERI_TAG_SCANNER_NEXT = 0x40,
+    CHERI_TAG_SCANNER_GRANULE = 0x48,
+};
+
+#define CHERI_TAG_SCANNER_ID_VALUE      0x0000000147415443ULL /* "CTAG", v1 */
+#define CHERI_TAG_SCANNER_CTRL_START    0x1
+#define CHERI_TAG_SCANNER_STATUS_DONE   0x1
+#define CHERI_TAG_SCANNER_STATUS_MORE   0x2
+#define CHERI_TAG_SCANNER_STATUS_ERROR  0x4
+
+typedef struct CheriTagScannerState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    MemoryRegion mmio;
+    uint64_t start;
+    uint64_t end;
+    uint64_t buf_addr;
+    uint64_t buf_len;
+    uint64_t status;
+    uint64_t count;
+    uint64_t next;
+} CheriTagScannerState;
+
+DeviceState *cheri_tag_scanner_create(hwaddr addr);
+
+#endif
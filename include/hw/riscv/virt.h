@@ -45,6 +45,7 @@ enum {
     VIRT_MROM,
     VIRT_TEST,
     VIRT_RTC,
+    VIRT_TAG_SCANNER,
     VIRT_CLINT,
     VIRT_PLIC,
     VIRT_UART0,
@@ -45,6 +45,9 @@ CPUState *mon_get_cpu(void);
 
 void hmp_info_mem(Monitor *mon, const QDict *qdict);
 void hmp_info_tlb(Monitor *mon, const QDict *qdict);
+void hmp_info_pwc(Monitor *mon, const QDict *qdict);
+void hmp_info_cheri_bounds(Monitor *mon, const QDict *qdict);
+void hmp_cheri_bounds_profile(Monitor *mon, const QDict *qdict);
 void hmp_mce(Monitor *mon, const QDict *qdict);
 void hmp_info_local_apic(Monitor *mon, const QDict *qdict);
 void hmp_info_io_apic(Monitor *mon, const QDict *qdict);
@@ -0,0 +1,41 @@
+/*
+ * Buffered binary log writer
+ *
+ * Producers (usually one per vCPU) append records to their own lock-free
+ * single-producer/single-consumer ring. A dedicated writer thread drains all
+ * rings to a single output file, optionally compressing it with zstd.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_LOG_BUFFER_H
+#define QEMU_LOG_BUFFER_H
+
+typedef struct LogBuffer LogBuffer;
+
+/*
+ * Open @filename and start the writer thread. @header (if non-NULL) is
+ * written at the start of the file. Returns false and sets @errp on failure.
+ */
+bool log_buffer_writer_open(const char *filename, bool compress,
+                            const void *header, size_t header_len,
+                            Error **errp);
+/* Drain all buffers, stop the writer thread and close the file. */
+void log_buffer_writer_close(void);
+bool log_buffer_writer_active(void);
+
+/*
+ * Allocate a new buffer of @size bytes (rounded up to a power of two) and
+ * register it with the writer. Each buffer must only be written to by a
+ * single thread.
+ */
+LogBuffer *log_buffer_new(size_t size);
+/*
+ * Append @len bytes to @buf. Blocks if the buffer is full until the writer
+ * thread has drained enough of it. Data from one call is never split
+ * between other buffers' data in the output file.
+ */
+void log_buffer_write(LogBuffer *buf, const void *data, size_t len);
+
+#endif /* QEMU_LOG_BUFFER_H */
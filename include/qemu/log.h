@@ -159,8 +159,10 @@ extern const QEMULogItem qemu_log_items[];
 void qemu_set_log(int log_flags);
 void qemu_log_needs_buffers(void);
 void qemu_set_log_filename(const char *filename, Error **errp);
+const char *qemu_get_log_filename(void);
 void qemu_set_dfilter_ranges(const char *ranges, Error **errp);
 bool qemu_log_in_addr_range(uint64_t addr);
+bool qemu_log_in_asid_filter(uint64_t asid);
 int qemu_str_to_log_mask(const char *str);
 
 /* Print a usage message listing all the valid logging categories
@@ -60,6 +60,8 @@ enum qemu_plugin_event {
     QEMU_PLUGIN_EV_VCPU_SYSCALL_RET,
     QEMU_PLUGIN_EV_FLUSH,
     QEMU_PLUGIN_EV_ATEXIT,
+    QEMU_PLUGIN_EV_VCPU_CAP_TAG,
+    QEMU_PLUGIN_EV_VCPU_CAP_FAULT,
     QEMU_PLUGIN_EV_MAX, /* total number of plugin events we support */
 };
 
@@ -72,6 +74,8 @@ union qemu_plugin_cb_sig {
     qemu_plugin_vcpu_mem_cb_t        vcpu_mem;
     qemu_plugin_vcpu_syscall_cb_t    vcpu_syscall;
     qemu_plugin_vcpu_syscall_ret_cb_t vcpu_syscall_ret;
+    qemu_plugin_vcpu_cap_tag_cb_t    vcpu_cap_tag;
+    qemu_plugin_vcpu_cap_fault_cb_t  vcpu_cap_fault;
     void *generic;
 };
 
@@ -197,6 +201,12 @@ void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret);
 
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr, uint32_t meminfo);
 
+bool qemu_plugin_vcpu_cap_tag_enabled(CPUState *cpu);
+void qemu_plugin_vcpu_cap_tag_cb(CPUState *cpu, uint64_t vaddr,
+                                 uint64_t ram_addr, bool tag);
+void qemu_plugin_vcpu_cap_fault_cb(CPUState *cpu, unsigned int cause,
+                                   unsigned int reg);
+
 void qemu_plugin_flush_cb(void);
 
 void qemu_plugin_atexit_cb(void);
@@ -237,6 +247,20 @@ static inline void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                                            uint32_t meminfo)
 { }
 
+static inline bool qemu_plugin_vcpu_cap_tag_enabled(CPUState *cpu)
+{
+    return false;
+}
+
+static inline void qemu_plugin_vcpu_cap_tag_cb(CPUState *cpu, uint64_t vaddr,
+                                               uint64_t ram_addr, bool tag)
+{ }
+
+static inline void qemu_plugin_vcpu_cap_fault_cb(CPUState *cpu,
+                                                 unsigned int cause,
+                                                 unsigned int reg)
+{ }
+
 static inline void qemu_plugin_flush_cb(void)
 { }
 
@@ -370,6 +370,82 @@ qemu_plugin_register_vcpu_syscall_ret_cb(qemu_plugin_id_t id,
                                          qemu_plugin_vcpu_syscall_ret_cb_t cb);
 
 
+/*
+ * CHERI capabilities
+ *
+ * These are only useful when emulating a CHERI target. Elsewhere the
+ * callbacks below are never called and qemu_plugin_read_cap_reg() fails.
+ */
+
+/* A decompressed capability */
+struct qemu_plugin_cap {
+    uint64_t cursor;
+    uint64_t base;
+    /* one past the last accessible byte, saturated to UINT64_MAX */
+    uint64_t top;
+    uint32_t perms;
+    uint32_t uperms;
+    /* sign-extended, so the reserved (e.g. unsealed) otypes are negative */
+    int64_t otype;
+    bool tag;
+};
+
+/* Special capability registers for qemu_plugin_read_cap_reg() */
+enum qemu_plugin_cap_reg {
+    QEMU_PLUGIN_CAP_REG_PCC = -1,
+    QEMU_PLUGIN_CAP_REG_DDC = -2,
+};
+
+/**
+ * qemu_plugin_read_cap_reg() - read a capability register of a vCPU
+ * @vcpu_index: the vCPU, which must be the one running the callback
+ * @reg: general purpose capability register number or a
+ *       qemu_plugin_cap_reg
+ * @cap: filled in with the register contents
+ *
+ * Only call this from callbacks that may read the CPU's registers. Inside
+ * a translation block the PCC cursor may lag behind the current
+ * instruction.
+ *
+ * Returns false if @reg does not exist or the target is not CHERI.
+ */
+bool qemu_plugin_read_cap_reg(unsigned int vcpu_index, int reg,
+                              struct qemu_plugin_cap *cap);
+
+/**
+ * qemu_plugin_register_vcpu_cap_tag_cb() - register a tag change callback
+ * @id: plugin ID
+ * @cb: callback function
+ *
+ * The @cb function is called when a vCPU stores a tagged capability
+ * (@tag is true), and once for every tagged capability that a vCPU store
+ * invalidates (@tag is false). @vaddr is the virtual address of the
+ * capability and @ram_addr its offset in RAM, as returned by
+ * qemu_plugin_hwaddr_device_offset(). Tags cleared by DMA are not reported.
+ */
+typedef void
+(*qemu_plugin_vcpu_cap_tag_cb_t)(qemu_plugin_id_t id, unsigned int vcpu_index,
+                                 uint64_t vaddr, uint64_t ram_addr, bool tag);
+
+void qemu_plugin_register_vcpu_cap_tag_cb(qemu_plugin_id_t id,
+                                          qemu_plugin_vcpu_cap_tag_cb_t cb);
+
+/**
+ * qemu_plugin_register_vcpu_cap_fault_cb() - register a capability fault cb
+ * @id: plugin ID
+ * @cb: callback function
+ *
+ * The @cb function is called when a vCPU raises a CHERI exception, before
+ * it is delivered. @cause is the architectural capability exception cause
+ * and @reg the faulting register number as reported to the guest.
+ */
+typedef void
+(*qemu_plugin_vcpu_cap_fault_cb_t)(qemu_plugin_id_t id, unsigned int vcpu_index,
+                                   unsigned int cause, unsigned int reg);
+
+void qemu_plugin_register_vcpu_cap_fault_cb(qemu_plugin_id_t id,
+                                            qemu_plugin_vcpu_cap_fault_cb_t cb);
+
 /**
  * qemu_plugin_insn_disas() - return disassembly string for instruction
  * @insn: instruction reference
@@ -832,6 +832,9 @@ void tcg_gen_goto_tb(unsigned idx);
  * this op is equivalent to calling tcg_gen_exit_tb() with 0 as the argument.
  */
 void tcg_gen_lookup_and_goto_ptr(void);
+#ifdef TARGET_CHERI
+void tcg_gen_lookup_cap_jump_and_goto_ptr(void);
+#endif
 
 static inline void tcg_gen_plugin_cb_start(unsigned from, unsigned type,
                                            unsigned wr)
@@ -667,6 +667,11 @@ struct TCGContext {
     QSIMPLEQ_HEAD(, TCGOp) plugin_ops;
 #endif
 
+#ifdef CONFIG_MIPS_LOG_INSTR
+    /* The instruction being translated is traced (see translator_loop) */
+    bool log_instr;
+#endif
+
     TCGTempSet free_temps[TCG_TYPE_COUNT * 2];
     TCGTemp temps[TCG_MAX_TEMPS]; /* globals first, temps after */
 
@@ -60,6 +60,14 @@ unsigned long mmap_min_addr;
 unsigned long guest_base;
 int have_guest_base;
 
+#ifdef TARGET_CHERI
+/* CHERI debugging options, only settable in system emulation (see vl.c). */
+bool cheri_c2e_on_unrepresentable;
+bool cheri_debugger_on_unrepresentable;
+bool cheri_debugger_on_trap;
+bool cheri_shared_tbs;
+#endif
+
 /*
  * Used to implement backwards-compatibility for the `-strace`, and
  * QEMU_STRACE options. Without this, the QEMU_LOG can be overwritten by
@@ -16,6 +16,9 @@
 #include "syscall_defs.h"
 #include "target_syscall.h"
 #include "exec/gdbstub.h"
+#ifdef TARGET_CHERI
+#include "cheri_tagmem.h"
+#endif
 
 /* This is the size of the host kernel's sigset_t, needed where we make
  * direct system calls that take a sigset_t pointer and a size.
@@ -620,7 +623,12 @@ static inline void *lock_user(int type, abi_ulong guest_addr, long len, int copy
 static inline void unlock_user(void *host_ptr, abi_ulong guest_addr,
                                long len)
 {
-
+#ifdef TARGET_CHERI
+    /* Data written on behalf of the guest never holds valid capabilities. */
+    if (host_ptr && len > 0) {
+        cheri_tag_phys_invalidate(NULL, NULL, guest_addr, len, NULL);
+    }
+#endif
 #ifdef DEBUG_REMAP
     if (!host_ptr)
         return;
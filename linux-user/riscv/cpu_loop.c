@@ -23,6 +23,7 @@
 #include "qemu.h"
 #include "cpu_loop-common.h"
 #include "elf.h"
+#include "helper_utils.h"
 
 void cpu_loop(CPURISCVState *env)
 {
@@ -49,27 +50,34 @@ void cpu_loop(CPURISCVState *env)
             cpu_exec_step_atomic(cs);
             break;
         case RISCV_EXCP_U_ECALL:
-            env->pc += 4;
-            if (env->gpr[xA7] == TARGET_NR_arch_specific_syscall + 15) {
+            riscv_update_pc(env, cpu_get_recent_pc(env) + 4, false);
+            if (gpr_int_value(env, xA7) ==
+                TARGET_NR_arch_specific_syscall + 15) {
                 /* riscv_flush_icache_syscall is a no-op in QEMU as
                    self-modifying code is automatically detected */
                 ret = 0;
             } else {
+                /*
+                 * Hybrid code passes syscall arguments as integers: use the
+                 * address of each capability register and return the
+                 * result as an untagged integer.
+                 */
                 ret = do_syscall(env,
-                                 env->gpr[(env->elf_flags & EF_RISCV_RVE)
-                                    ? xT0 : xA7],
-                                 env->gpr[xA0],
-                                 env->gpr[xA1],
-                                 env->gpr[xA2],
-                                 env->gpr[xA3],
-                                 env->gpr[xA4],
-                                 env->gpr[xA5],
+                                 gpr_int_value(env,
+                                     (env->elf_flags & EF_RISCV_RVE)
+                                        ? xT0 : xA7),
+                                 gpr_int_value(env, xA0),
+                                 gpr_int_value(env, xA1),
+                                 gpr_int_value(env, xA2),
+                                 gpr_int_value(env, xA3),
+                                 gpr_int_value(env, xA4),
+                                 gpr_int_value(env, xA5),
                                  0, 0);
             }
             if (ret == -TARGET_ERESTARTSYS) {
-                env->pc -= 4;
+                riscv_update_pc(env, cpu_get_recent_pc(env) - 4, false);
             } else if (ret != -TARGET_QEMU_ESIGRETURN) {
-                env->gpr[xA0] = ret;
+                gpr_set_int_value(env, xA0, ret);
             }
             if (cs->singlestep_enabled) {
                 goto gdbstep;
@@ -82,7 +90,7 @@ void cpu_loop(CPURISCVState *env)
         case RISCV_EXCP_BREAKPOINT:
             signum = TARGET_SIGTRAP;
             sigcode = TARGET_TRAP_BRKPT;
-            sigaddr = env->pc;
+            sigaddr = cpu_get_recent_pc(env);
             break;
         case RISCV_EXCP_INST_PAGE_FAULT:
         case RISCV_EXCP_LOAD_PAGE_FAULT:
@@ -91,6 +99,15 @@ void cpu_loop(CPURISCVState *env)
             sigcode = TARGET_SEGV_MAPERR;
             sigaddr = env->badaddr;
             break;
+#ifdef TARGET_CHERI
+        case RISCV_EXCP_CHERI:
+            /* Capability faults do not record an address, report the pc. */
+            signum = TARGET_SIGSEGV;
+            sigcode = env->cap_cause == CapEx_LengthViolation ?
+                TARGET_SEGV_BNDERR : TARGET_SEGV_ACCERR;
+            sigaddr = cpu_get_recent_pc(env);
+            break;
+#endif
         case EXCP_DEBUG:
         gdbstep:
             signum = TARGET_SIGTRAP;
@@ -122,12 +139,17 @@ void target_cpu_copy_regs(CPUArchState *env, struct target_pt_regs *regs)
     TaskState *ts = cpu->opaque;
     struct image_info *info = ts->info;
 
-    env->pc = regs->sepc;
-    env->gpr[xSP] = regs->sp;
+    riscv_update_pc(env, regs->sepc, false);
+    gpr_set_int_value(env, xSP, regs->sp);
     env->elf_flags = info->elf_flags;
 
     if ((env->misa & RVE) && !(env->elf_flags & EF_RISCV_RVE)) {
         error_report("Incompatible ELF: RVE cpu requires RVE ABI binary");
         exit(EXIT_FAILURE);
     }
+    if (env->elf_flags & EF_RISCV_CHERIABI) {
+        error_report("Incompatible ELF: pure-capability (CheriABI) binaries "
+                     "are not supported, only hybrid ones");
+        exit(EXIT_FAILURE);
+    }
 }
@@ -20,6 +20,10 @@
 #include "qemu.h"
 #include "signal-common.h"
 #include "linux-user/trace.h"
+#include "helper_utils.h"
+#ifdef TARGET_CHERI
+#include "cheri-helper-utils.h"
+#endif
 
 /* Signal handler invocation must be transparent for the code being
    interrupted. Complete CPU (hart) state is saved on entry and restored
@@ -44,10 +48,25 @@ struct target_ucontext {
     target_sigset_t uc_sigmask;
 };
 
+#ifdef TARGET_CHERI
+/*
+ * The general purpose capability registers, stored with their tags like a
+ * capability store would. Signal handlers see (and may change) only the
+ * integer values in uc_mcontext, so a register is restored from here only
+ * if its address was not modified.
+ */
+struct target_cheri_sigcontext {
+    uint8_t cregs[31][CHERI_CAP_SIZE]; /* c0 is not present */
+} QEMU_ALIGNED(CHERI_CAP_SIZE);
+#endif
+
 struct target_rt_sigframe {
     uint32_t tramp[2]; /* not in kernel, which uses VDSO instead */
     struct target_siginfo info;
     struct target_ucontext uc;
+#ifdef TARGET_CHERI
+    struct target_cheri_sigcontext cheri; /* not in kernel */
+#endif
 };
 
 static abi_ulong get_sigframe(struct target_sigaction *ka,
@@ -64,8 +83,12 @@ static abi_ulong get_sigframe(struct target_sigaction *ka,
     /* This is the X/Open sanctioned signal stack switching.  */
     sp = target_sigsp(sp, ka) - framesize;
 
+#ifdef TARGET_CHERI
+    sp &= ~(abi_ulong)(CHERI_CAP_SIZE - 1); /* capabilities in the frame */
+#else
     /* XXX: kernel aligns with 0xf ? */
     sp &= ~3UL; /* align sp on 4-byte boundary */
+#endif
 
     return sp;
 }
@@ -74,10 +97,10 @@ static void setup_sigcontext(struct target_sigcontext *sc, CPURISCVState *env)
 {
     int i;
 
-    __put_user(env->pc, &sc->pc);
+    __put_user(cpu_get_recent_pc(env), &sc->pc);
 
     for (i = 1; i < 32; i++) {
-        __put_user(env->gpr[i], &sc->gpr[i - 1]);
+        __put_user(gpr_int_value(env, i), &sc->gpr[i - 1]);
     }
     for (i = 0; i < 32; i++) {
         __put_user(env->fpr[i], &sc->fpr[i]);
@@ -103,6 +126,36 @@ static void setup_ucontext(struct target_ucontext *uc,
     setup_sigcontext(&uc->uc_mcontext, env);
 }
 
+#ifdef TARGET_CHERI
+static void setup_cheri_sigcontext(CPURISCVState *env, abi_ulong frame_addr)
+{
+    abi_ulong addr = frame_addr + offsetof(struct target_rt_sigframe, cheri);
+    int i;
+
+    for (i = 1; i < 32; i++) {
+        store_cap_to_memory(env, i, addr + (i - 1) * CHERI_CAP_SIZE, 0);
+    }
+}
+
+static void restore_cheri_sigcontext(CPURISCVState *env,
+                                     struct target_sigcontext *sc,
+                                     abi_ulong frame_addr)
+{
+    abi_ulong addr = frame_addr + offsetof(struct target_rt_sigframe, cheri);
+    target_ulong val;
+    int i;
+
+    for (i = 1; i < 32; i++) {
+        __get_user(val, &sc->gpr[i - 1]);
+        load_cap_from_memory(env, i, i, &env->DDC,
+                             addr + (i - 1) * CHERI_CAP_SIZE, 0, NULL);
+        if (gpr_int_value(env, i) != val) {
+            gpr_set_int_value(env, i, val);
+        }
+    }
+}
+#endif
+
 static inline void install_sigtramp(uint32_t *tramp)
 {
     __put_user(0x08b00893, tramp + 0);  /* li a7, 139 = __NR_rt_sigreturn */
@@ -122,17 +175,28 @@ void setup_rt_frame(int sig, struct target_sigaction *ka,
     if (!lock_user_struct(VERIFY_WRITE, frame, frame_addr, 0)) {
         goto badframe;
     }
+#ifdef TARGET_CHERI
+    /* The frame is written directly, drop stale tags of the old stack. */
+    cheri_tag_phys_invalidate(NULL, NULL, frame_addr, sizeof(*frame), NULL);
+#endif
 
     setup_ucontext(&frame->uc, env, set);
     tswap_siginfo(&frame->info, info);
     install_sigtramp(frame->tramp);
 
-    env->pc = ka->_sa_handler;
-    env->gpr[xSP] = frame_addr;
-    env->gpr[xA0] = sig;
-    env->gpr[xA1] = frame_addr + offsetof(struct target_rt_sigframe, info);
-    env->gpr[xA2] = frame_addr + offsetof(struct target_rt_sigframe, uc);
-    env->gpr[xRA] = frame_addr + offsetof(struct target_rt_sigframe, tramp);
+#ifdef TARGET_CHERI
+    setup_cheri_sigcontext(env, frame_addr);
+#endif
+
+    riscv_update_pc(env, ka->_sa_handler, true);
+    gpr_set_int_value(env, xSP, frame_addr);
+    gpr_set_int_value(env, xA0, sig);
+    gpr_set_int_value(env, xA1,
+                      frame_addr + offsetof(struct target_rt_sigframe, info));
+    gpr_set_int_value(env, xA2,
+                      frame_addr + offsetof(struct target_rt_sigframe, uc));
+    gpr_set_int_value(env, xRA,
+                      frame_addr + offsetof(struct target_rt_sigframe, tramp));
 
     return;
 
@@ -146,12 +210,15 @@ badframe:
 
 static void restore_sigcontext(CPURISCVState *env, struct target_sigcontext *sc)
 {
+    target_ulong val;
     int i;
 
-    __get_user(env->pc, &sc->pc);
+    __get_user(val, &sc->pc);
+    riscv_update_pc(env, val, true);
 
     for (i = 1; i < 32; ++i) {
-        __get_user(env->gpr[i], &sc->gpr[i - 1]);
+        __get_user(val, &sc->gpr[i - 1]);
+        gpr_set_int_value(env, i, val);
     }
     for (i = 0; i < 32; ++i) {
         __get_user(env->fpr[i], &sc->fpr[i]);
@@ -184,13 +251,16 @@ long do_rt_sigreturn(CPURISCVState *env)
     struct target_rt_sigframe *frame;
     abi_ulong frame_addr;
 
-    frame_addr = env->gpr[xSP];
+    frame_addr = gpr_int_value(env, xSP);
     trace_user_do_sigreturn(env, frame_addr);
     if (!lock_user_struct(VERIFY_READ, frame, frame_addr, 1)) {
         goto badframe;
     }
 
     restore_ucontext(env, &frame->uc);
+#ifdef TARGET_CHERI
+    restore_cheri_sigcontext(env, &frame->uc.uc_mcontext, frame_addr);
+#endif
 
     if (do_sigaltstack(frame_addr + offsetof(struct target_rt_sigframe,
             uc.uc_stack), 0, get_sp_from_cpustate(env)) == -EFAULT) {
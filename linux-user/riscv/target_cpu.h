@@ -1,14 +1,16 @@
 #ifndef RISCV_TARGET_CPU_H
 #define RISCV_TARGET_CPU_H
 
+#include "helper_utils.h"
+
 static inline void cpu_clone_regs_child(CPURISCVState *env, target_ulong newsp,
                                         unsigned flags)
 {
     if (newsp) {
-        env->gpr[xSP] = newsp;
+        gpr_set_int_value(env, xSP, newsp);
     }
 
-    env->gpr[xA0] = 0;
+    gpr_set_int_value(env, xA0, 0);
 }
 
 static inline void cpu_clone_regs_parent(CPURISCVState *env, unsigned flags)
@@ -17,11 +19,11 @@ static inline void cpu_clone_regs_parent(CPURISCVState *env, unsigned flags)
 
 static inline void cpu_set_tls(CPURISCVState *env, target_ulong newtls)
 {
-    env->gpr[xTP] = newtls;
+    gpr_set_int_value(env, xTP, newtls);
 }
 
 static inline abi_ulong get_sp_from_cpustate(CPURISCVState *state)
 {
-   return state->gpr[xSP];
+   return gpr_int_value(state, xSP);
 }
 #endif
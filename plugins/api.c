@@ -47,6 +47,9 @@
 #include "hw/boards.h"
 #endif
 #include "trace/mem.h"
+#ifdef TARGET_CHERI
+#include "cheri-lazy-capregs.h"
+#endif
 
 /* Uninstall and Reset handlers */
 
@@ -303,6 +306,44 @@ uint64_t qemu_plugin_hwaddr_device_offset(const struct qemu_plugin_hwaddr *haddr
     return 0;
 }
 
+/*
+ * CHERI capability queries
+ */
+
+bool qemu_plugin_read_cap_reg(unsigned int vcpu_index, int reg,
+                              struct qemu_plugin_cap *cap)
+{
+#ifdef TARGET_CHERI
+    CPUState *cpu = qemu_get_cpu(vcpu_index);
+    CPUArchState *env;
+    const cap_register_t *cr;
+
+    if (!cpu) {
+        return false;
+    }
+    env = cpu->env_ptr;
+    if (reg == QEMU_PLUGIN_CAP_REG_PCC) {
+        cr = cheri_get_recent_pcc(env);
+    } else if (reg == QEMU_PLUGIN_CAP_REG_DDC) {
+        cr = cheri_get_ddc(env);
+    } else if (reg >= 0 && reg < ARRAY_SIZE(cheri_get_gpcrs(env)->decompressed)) {
+        cr = get_readonly_capreg(env, reg);
+    } else {
+        return false;
+    }
+    cap->cursor = cap_get_cursor(cr);
+    cap->base = cap_get_base(cr);
+    cap->top = cap_get_top(cr);
+    cap->perms = cr->cr_perms;
+    cap->uperms = cr->cr_uperms;
+    cap->otype = cap_get_otype(cr);
+    cap->tag = cr->cr_tag;
+    return true;
+#else
+    return false;
+#endif
+}
+
 /*
  * Queries to the number and potential maximum number of vCPUs there
  * will be. This helps the plugin dimension per-vcpu arrays.
@@ -57,8 +57,21 @@ struct qemu_plugin_ctx *plugin_id_to_ctx_locked(qemu_plugin_id_t id)
 
 static void plugin_cpu_update__async(CPUState *cpu, run_on_cpu_data data)
 {
+#ifdef TARGET_CHERI
+    bool cap_tag = test_bit(QEMU_PLUGIN_EV_VCPU_CAP_TAG, cpu->plugin_mask);
+#endif
+
     bitmap_copy(cpu->plugin_mask, &data.host_ulong, QEMU_PLUGIN_EV_MAX);
     cpu_tb_jmp_cache_clear(cpu);
+#ifdef TARGET_CHERI
+    /*
+     * TLB entries only allow tag updates from generated code while no tag
+     * change callback is registered, see tlb_set_page_with_attrs().
+     */
+    if (cap_tag != test_bit(QEMU_PLUGIN_EV_VCPU_CAP_TAG, cpu->plugin_mask)) {
+        tlb_flush(cpu);
+    }
+#endif
 }
 
 static void plugin_cpu_update__locked(gpointer k, gpointer v, gpointer udata)
@@ -374,6 +387,57 @@ void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret)
     }
 }
 
+bool qemu_plugin_vcpu_cap_tag_enabled(CPUState *cpu)
+{
+    return test_bit(QEMU_PLUGIN_EV_VCPU_CAP_TAG, cpu->plugin_mask);
+}
+
+void qemu_plugin_vcpu_cap_tag_cb(CPUState *cpu, uint64_t vaddr,
+                                 uint64_t ram_addr, bool tag)
+{
+    struct qemu_plugin_cb *cb, *next;
+    enum qemu_plugin_event ev = QEMU_PLUGIN_EV_VCPU_CAP_TAG;
+
+    if (!test_bit(ev, cpu->plugin_mask)) {
+        return;
+    }
+
+    QLIST_FOREACH_SAFE_RCU(cb, &plugin.cb_lists[ev], entry, next) {
+        qemu_plugin_vcpu_cap_tag_cb_t func = cb->f.vcpu_cap_tag;
+
+        func(cb->ctx->id, cpu->cpu_index, vaddr, ram_addr, tag);
+    }
+}
+
+void qemu_plugin_vcpu_cap_fault_cb(CPUState *cpu, unsigned int cause,
+                                   unsigned int reg)
+{
+    struct qemu_plugin_cb *cb, *next;
+    enum qemu_plugin_event ev = QEMU_PLUGIN_EV_VCPU_CAP_FAULT;
+
+    if (!test_bit(ev, cpu->plugin_mask)) {
+        return;
+    }
+
+    QLIST_FOREACH_SAFE_RCU(cb, &plugin.cb_lists[ev], entry, next) {
+        qemu_plugin_vcpu_cap_fault_cb_t func = cb->f.vcpu_cap_fault;
+
+        func(cb->ctx->id, cpu->cpu_index, cause, reg);
+    }
+}
+
+void qemu_plugin_register_vcpu_cap_tag_cb(qemu_plugin_id_t id,
+                                          qemu_plugin_vcpu_cap_tag_cb_t cb)
+{
+    plugin_register_cb(id, QEMU_PLUGIN_EV_VCPU_CAP_TAG, cb);
+}
+
+void qemu_plugin_register_vcpu_cap_fault_cb(qemu_plugin_id_t id,
+                                            qemu_plugin_vcpu_cap_fault_cb_t cb)
+{
+    plugin_register_cb(id, QEMU_PLUGIN_EV_VCPU_CAP_FAULT, cb);
+}
+
 void qemu_plugin_vcpu_idle_cb(CPUState *cpu)
 {
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_IDLE);
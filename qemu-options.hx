@@ -3721,7 +3721,8 @@ SRST
 ERST
 
 DEF("dfilter", HAS_ARG, QEMU_OPTION_DFILTER, \
-    "-dfilter range,..  filter debug output to range of addresses (useful for -d cpu,exec,etc..)\n",
+    "-dfilter range|asid=N,..\n"
+    "                filter debug output to range of addresses (useful for -d cpu,exec,etc..)\n",
     QEMU_ARCH_ALL)
 SRST
 ``-dfilter range1[,...]``
@@ -3737,6 +3738,12 @@ SRST
     Will dump output for any code in the 0x1000 sized block starting at
     0x8000 and the 0x200 sized block starting at 0xffffffc000080000 and
     another 0x1000 sized block starting at 0xffffffc00005f000.
+
+    An ``asid=N`` entry limits instruction tracing (``-d instr``,
+    ``cvtrace`` and ``user-instr``) to code running with address space ID
+    N; several ASIDs may be listed. Address ranges and ASIDs are applied
+    when code is translated, so instructions outside the filter run without
+    any tracing overhead.
 ERST
 
 DEF("seed", HAS_ARG, QEMU_OPTION_seed, \
@@ -4021,10 +4028,43 @@ SRST
 ERST
 
 DEF("cheri-trace-format", HAS_ARG, QEMU_OPTION_cheri_trace_format, \
-"-cheri-trace-format [text|cvtrace]     Select CHERI trace mode.\n", QEMU_ARCH_ALL)
+"-cheri-trace-format [text|cvtrace|binary|binary-zstd]\n"
+"                Select CHERI trace mode.\n", QEMU_ARCH_ALL)
 SRST
 ``-cheri-trace-format type``
-    Set CHERI trace format to <type> (text or cvtrace)
+    Set CHERI trace format to <type> (text, cvtrace, binary or binary-zstd).
+    The binary formats write fixed size records to ``<logfile>.bin`` (or
+    ``qemu-instr.bin`` without ``-D``) from a separate writer thread, use
+    ``scripts/render-instr-trace.py`` to convert them to the text format.
+ERST
+
+DEF("cheri-cvtrace-per-cpu", 0, QEMU_OPTION_cheri_cvtrace_per_cpu, \
+"-cheri-cvtrace-per-cpu\n"
+"                Write the cvtrace of each vCPU to its own file.\n", QEMU_ARCH_ALL)
+SRST
+``-cheri-cvtrace-per-cpu``
+    Write cvtrace records for vCPU N to ``<logfile>.cpuN`` instead of
+    interleaving batches from all vCPUs in the log file.
+ERST
+
+DEF("cheri-cvtrace-batch", 0, QEMU_OPTION_cheri_cvtrace_batch, \
+"-cheri-cvtrace-batch\n"
+"                Precede each batch of cvtrace records with a CVT_BATCH record.\n", QEMU_ARCH_ALL)
+SRST
+``-cheri-cvtrace-batch``
+    When several vCPUs write to the same cvtrace file, precede each batch of
+    records with a ``CVT_BATCH`` record giving the vCPU, the number of
+    records and a per-vCPU sequence number. Such files use the
+    ``CheriTraceV04`` header, which older trace readers do not accept.
+ERST
+
+DEF("cheri-cvtrace-rotate-size", HAS_ARG, QEMU_OPTION_cheri_cvtrace_rotate_size, \
+"-cheri-cvtrace-rotate-size size\n"
+"                Start a new cvtrace file once it reaches size bytes.\n", QEMU_ARCH_ALL)
+SRST
+``-cheri-cvtrace-rotate-size size``
+    Split cvtrace output into numbered files (``<name>.0``, ``<name>.1``,
+    ...) of at most ``size`` bytes each (default unit MiB).
 ERST
 
 DEF("cheri-c2e-on-unrepresentable", 0, QEMU_OPTION_cheri_c2e_on_unrepresentable, \
@@ -4048,6 +4088,28 @@ SRST
     Generate debugger exception when a capability fault is taken.
 ERST
 
+DEF("cheri-shared-tbs", 0, QEMU_OPTION_cheri_shared_tbs, \
+    "-cheri-shared-tbs     Share translated code between PCCs with different bounds\n", QEMU_ARCH_ALL)
+SRST
+``-cheri-shared-tbs``
+    Do not include the top of PCC in the translation block lookup key.
+    Translated code is shared by all PCCs with the same base and checks the
+    top of the live PCC once on block entry. This reduces retranslation when
+    many functions or libraries run with differently bounded PCCs.
+ERST
+
+DEF("cheri-tagmem-flat", 0, QEMU_OPTION_cheri_tagmem_flat, \
+    "-cheri-tagmem-flat     Store the tags of each RAM block in one flat bitmap\n", QEMU_ARCH_ALL)
+SRST
+``-cheri-tagmem-flat``
+    Reserve one bitmap covering all of each RAM block for its capability tags
+    instead of allocating blocks of 4096 tags on demand. The host kernel only
+    backs pages of the bitmap that are written, and tag lookups never check
+    for a missing block. Every guest page is assumed to possibly hold tags,
+    so stores cannot skip tag invalidation and generated code uses the tag
+    helpers.
+ERST
+
 #endif
 
 #ifdef CONFIG_RVFI_DII
@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Render a binary instruction trace written with
+# "-cheri-trace-format binary" (or binary-zstd) in the text trace format.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+
+import argparse
+import struct
+import subprocess
+import sys
+
+HEADER = struct.Struct("<16sII24s")
+RECORD = struct.Struct("<BBHIQQQ")
+MAGIC = b"QEMUINSTRTRACE"
+VERSION = 2
+
+(INSN, REG, MEM_LOAD, MEM_STORE, CAP_LOAD, CAP_STORE, NAME, TEXT,
+ CAP_REG) = range(1, 10)
+
+
+def open_trace(path):
+    if path.endswith(".zst"):
+        proc = subprocess.Popen(["zstd", "-dc", path], stdout=subprocess.PIPE)
+        return proc.stdout
+    f = open(path, "rb")
+    if f.read(4) == b"\x28\xb5\x2f\xfd":
+        f.close()
+        proc = subprocess.Popen(["zstd", "-dc", path], stdout=subprocess.PIPE)
+        return proc.stdout
+    f.seek(0)
+    return f
+
+
+def read_string(f, length):
+    nrec = (length + RECORD.size - 1) // RECORD.size
+    data = f.read(nrec * RECORD.size)
+    return data[:length].decode("utf-8", "replace")
+
+
+def render(f, out, cpu_filter):
+    magic, version, record_size, target = HEADER.unpack(f.read(HEADER.size))
+    if magic.rstrip(b"\0") != MAGIC:
+        sys.exit("not a binary instruction trace")
+    if version != VERSION or record_size != RECORD.size:
+        sys.exit("unsupported trace version %d (record size %d)" %
+                 (version, record_size))
+    print("# target: %s" % target.rstrip(b"\0").decode(), file=out)
+
+    names = {}
+    last_cpu = None
+    while True:
+        data = f.read(RECORD.size)
+        if len(data) < RECORD.size:
+            break
+        rtype, size, cpu, info, addr, value, value2 = RECORD.unpack(data)
+        if rtype == NAME:
+            names[(cpu, info)] = read_string(f, value)
+            continue
+        if rtype == TEXT:
+            text = read_string(f, value)
+            if cpu_filter is None or cpu == cpu_filter:
+                out.write(text)
+            continue
+        if cpu_filter is not None and cpu != cpu_filter:
+            continue
+        if rtype == INSN:
+            if cpu != last_cpu and cpu_filter is None:
+                print("--- cpu %d" % cpu, file=out)
+                last_cpu = cpu
+            if size:
+                print("0x%016x:  %0*x" % (addr, size * 2, info), file=out)
+            else:
+                print("0x%016x:  <unknown>" % addr, file=out)
+        elif rtype == REG:
+            print("    Write %s = %016x" %
+                  (names.get((cpu, info), "r%d" % info), value), file=out)
+        elif rtype == CAP_REG:
+            print("    Write %s|v:%d PESBT:%016x Cursor:%016x" %
+                  (names.get((cpu, info), "c%d" % info), size, value, value2),
+                  file=out)
+        elif rtype in (MEM_LOAD, MEM_STORE):
+            print("    Memory %s [%016x] = %0*x" %
+                  ("Read" if rtype == MEM_LOAD else "Write", addr,
+                   size * 2, value), file=out)
+        elif rtype in (CAP_LOAD, CAP_STORE):
+            print("    Cap Memory %s [%016x] = v:%d PESBT:%016x Cursor:%016x" %
+                  ("Read" if rtype == CAP_LOAD else "Write", addr, info,
+                   value, value2), file=out)
+        else:
+            sys.exit("unknown record type %d" % rtype)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Render a binary instruction trace as text")
+    parser.add_argument("trace", help="binary trace file")
+    parser.add_argument("--cpu", type=int, default=None,
+                        help="only show records for this vCPU")
+    args = parser.parse_args()
+    render(open_trace(args.trace), sys.stdout, args.cpu)
+
+
+if __name__ == "__main__":
+    main()
@@ -59,6 +59,8 @@
 #include "sysemu/numa.h"
 #include "sysemu/hostmem.h"
 #include "exec/gdbstub.h"
+#include "exec/log_instr_binary.h"
+#include "exec/cvtrace.h"
 #include "qemu/timer.h"
 #include "chardev/char.h"
 #include "qemu/bitmap.h"
@@ -173,11 +175,15 @@ int icount_align_option;
 #else
     int cl_default_trace_format = CPU_LOG_INSTR;
 #endif
+/* 0: text/cvtrace, 1: binary, 2: zstd compressed binary */
+static int cl_binary_trace;
 #endif /* CONFIG_MIPS_LOG_INSTR */
 #ifdef CONFIG_CHERI
 bool cheri_c2e_on_unrepresentable = false;
 bool cheri_debugger_on_unrepresentable = false;
 bool cheri_debugger_on_trap = false;
+bool cheri_shared_tbs = false;
+bool cheri_tagmem_flat = false;
 #endif
 #if defined(CHERI_128) && defined(TARGET_MIPS)
 #include "target/cheri-common/cheri_defs.h"
@@ -3711,11 +3717,31 @@ void qemu_init(int argc, char **argv, char **envp)
                     cl_default_trace_format = CPU_LOG_INSTR;
                 else if (strcmp(optarg, "cvtrace") == 0)
                     cl_default_trace_format = CPU_LOG_CVTRACE;
-                else {
+                else if (strcmp(optarg, "binary") == 0) {
+                    cl_default_trace_format = CPU_LOG_INSTR;
+                    cl_binary_trace = 1;
+                } else if (strcmp(optarg, "binary-zstd") == 0) {
+                    cl_default_trace_format = CPU_LOG_INSTR;
+                    cl_binary_trace = 2;
+                } else {
                     printf("Invalid choice for cheri-trace-format: '%s'\n", optarg);
                     exit(1);
                 }
                 break;
+            case QEMU_OPTION_cheri_cvtrace_per_cpu:
+                cvtrace_per_cpu = true;
+                break;
+            case QEMU_OPTION_cheri_cvtrace_batch:
+                cvtrace_batch_records = true;
+                break;
+            case QEMU_OPTION_cheri_cvtrace_rotate_size:
+                if (qemu_strtosz_MiB(optarg, NULL, &cvtrace_rotate_size) < 0 ||
+                    cvtrace_rotate_size < 1 * MiB) {
+                    error_report("Invalid cheri-cvtrace-rotate-size: '%s'",
+                                 optarg);
+                    exit(1);
+                }
+                break;
 #endif /* CONFIG_MIPS_LOG_INSTR */
 #endif /* CONFIG_CHERI */
 
@@ -3729,6 +3755,12 @@ void qemu_init(int argc, char **argv, char **envp)
             case QEMU_OPTION_cheri_debugger_on_trap:
                 cheri_debugger_on_trap = true;
                 break;
+            case QEMU_OPTION_cheri_shared_tbs:
+                cheri_shared_tbs = true;
+                break;
+            case QEMU_OPTION_cheri_tagmem_flat:
+                cheri_tagmem_flat = true;
+                break;
 #endif /* CONFIG_CHERI */
 #ifdef CONFIG_RVFI_DII
             case QEMU_OPTION_rvfi_dii_debug:
@@ -4056,6 +4088,15 @@ void qemu_init(int argc, char **argv, char **envp)
     /* Open the logfile at this point and set the log mask if necessary.
      */
     qemu_set_log_filename(log_file, &error_fatal);
+#ifdef CONFIG_MIPS_LOG_INSTR
+    if (cl_binary_trace) {
+        g_autofree char *bin_file =
+            log_file ? g_strdup_printf("%s.bin", log_file)
+                     : g_strdup("qemu-instr.bin");
+        log_instr_binary_open(bin_file, cl_binary_trace == 2);
+    }
+    atexit(cvtrace_flush_at_exit);
+#endif
     if (log_mask) {
         int mask;
         mask = qemu_str_to_log_mask(log_mask);
@@ -4682,6 +4723,9 @@ void qemu_cleanup(void)
 
     /* No more vcpu or device emulation activity beyond this point */
     vm_shutdown();
+#ifdef CONFIG_MIPS_LOG_INSTR
+    cvtrace_flush_all();
+#endif
     replay_finish();
 
     job_cancel_sync_all();
@@ -38,6 +38,39 @@
 #include "cheri_utils.h"
 #include "qemu/qemu-print.h"
 
+// Runtime per-PC profile of out-of-bounds and unrepresentable capabilities
+// (see cheri_bounds_stats.c). Unlike the DO_CHERI_STATISTICS histograms this
+// is always built and is turned on with the cheri-bounds-profile monitor
+// command. While it is off the only cost is one load and branch.
+typedef enum CheriBoundsEvent {
+    CHERI_BOUNDS_ONE_PAST_END,
+    CHERI_BOUNDS_AFTER,
+    CHERI_BOUNDS_BEFORE,
+    CHERI_BOUNDS_UNREPRESENTABLE,
+} CheriBoundsEvent;
+
+extern bool cheri_bounds_profile_enabled;
+void cheri_bounds_profile_record(CPUArchState *env, CheriBoundsEvent event,
+                                 uint64_t distance, uintptr_t retpc);
+
+static inline void cheri_bounds_profile_check(CPUArchState *env,
+                                              const cap_register_t *cr,
+                                              uintptr_t retpc)
+{
+    if (likely(!atomic_read(&cheri_bounds_profile_enabled)) || !cr->cr_tag)
+        return;
+    const uint64_t addr = cap_get_cursor(cr);
+    if (addr < cap_get_base(cr)) {
+        cheri_bounds_profile_record(env, CHERI_BOUNDS_BEFORE,
+                                    cap_get_base(cr) - addr, retpc);
+    } else if (addr == cap_get_top65(cr)) {
+        cheri_bounds_profile_record(env, CHERI_BOUNDS_ONE_PAST_END, 0, retpc);
+    } else if (addr > cap_get_top65(cr)) {
+        cheri_bounds_profile_record(env, CHERI_BOUNDS_AFTER,
+                                    addr - cap_get_top65(cr), retpc);
+    }
+}
+
 #if QEMU_USE_COMPRESSED_CHERI_CAPS
 
 extern bool cheri_c2e_on_unrepresentable;
@@ -47,6 +80,9 @@ static inline void
 _became_unrepresentable(CPUArchState *env, uint16_t reg, uintptr_t retpc)
 {
     env->statcounters_unrepresentable_caps++;
+    if (unlikely(atomic_read(&cheri_bounds_profile_enabled)))
+        cheri_bounds_profile_record(env, CHERI_BOUNDS_UNREPRESENTABLE, 0,
+                                    retpc);
 #ifdef TARGET_MIPS
     if (cheri_debugger_on_unrepresentable)
         do_raise_exception(env, EXCP_DEBUG, retpc);
@@ -134,10 +170,10 @@ static inline int out_of_bounds_stat_index(uint64_t howmuch) {
     return ARRAY_SIZE(bounds_buckets); // more than 64MB
 }
 
-static inline void check_out_of_bounds_stat(CPUArchState *env,
-                                            struct oob_stats_info *info,
-                                            const cap_register_t *capreg,
-                                            uintptr_t retpc)
+static inline void _check_out_of_bounds_stat(CPUArchState *env,
+                                             struct oob_stats_info *info,
+                                             const cap_register_t *capreg,
+                                             uintptr_t retpc)
 {
     int64_t howmuch =
         _howmuch_out_of_bounds(env, capreg, info->operation, retpc);
@@ -148,12 +184,21 @@ static inline void check_out_of_bounds_stat(CPUArchState *env,
     }
 }
 
+static inline void check_out_of_bounds_stat(CPUArchState *env,
+                                            struct oob_stats_info *info,
+                                            const cap_register_t *capreg,
+                                            uintptr_t retpc)
+{
+    cheri_bounds_profile_check(env, capreg, retpc);
+    _check_out_of_bounds_stat(env, info, capreg, retpc);
+}
+
 static inline void became_unrepresentable(CPUArchState *env, uint16_t reg,
                                           struct oob_stats_info *info,
                                           uintptr_t retpc) {
     const cap_register_t *capreg = get_readonly_capreg(env, reg);
     /* unrepresentable implies more than one out of bounds: */
-    check_out_of_bounds_stat(env, info, capreg, retpc);
+    _check_out_of_bounds_stat(env, info, capreg, retpc);
     info->unrepresentable++;
     qemu_log_mask(
         CPU_LOG_INSTR | CPU_LOG_CHERI_BOUNDS,
@@ -214,9 +259,13 @@ DECLARE_CHERI_STAT(csetoffset)
 // Don't collect any statistics by default (it slows down QEMU)
 struct oob_stats_info;
 #define OOB_INFO(op) NULL
-#define check_out_of_bounds_stat(env, op, capreg, retpc)                       \
-    do {                                                                       \
-    } while (0)
+static inline void check_out_of_bounds_stat(CPUArchState *env,
+                                            struct oob_stats_info *info,
+                                            const cap_register_t *capreg,
+                                            uintptr_t retpc)
+{
+    cheri_bounds_profile_check(env, capreg, retpc);
+}
 #define became_unrepresentable(env, reg, operation, retpc) _became_unrepresentable(env, reg, retpc)
 
 #endif /* DO_CHERI_STATISTICS */
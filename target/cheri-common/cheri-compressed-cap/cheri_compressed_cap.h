@@ -43,6 +43,9 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/param.h> /* for MIN() */
+#if defined(__BMI2__) && !defined(CC128_NO_PEXT)
+#include <immintrin.h> /* for _pext_u64() */
+#endif
 
 #ifndef cc128_debug_assert
 #ifdef cheri_debug_assert
@@ -417,7 +420,13 @@ TRUNCATE_LSB_FUNC(23)
 // FIXME: only one level of expansion works here?
 #define cc128_truncateLSB_generic(type_width) CC128_CONCAT(cc128_truncateLSB, type_width)
 
-static inline void decompress_128cap_already_xored(uint64_t pesbt, uint64_t cursor, cap_register_t* cdp) {
+/*
+ * Reference decoder, a direct transcription of capBitsToCapability() from
+ * cheri_prelude_128.sail. The decoder used by QEMU is
+ * decompress_128cap_already_xored() below, which must produce identical
+ * results (checked by test/decompress_bench.cpp).
+ */
+static inline void decompress_128cap_already_xored_ref(uint64_t pesbt, uint64_t cursor, cap_register_t* cdp) {
     cdp->_cr_cursor = cursor;
     cdp->cr_perms = (uint32_t)CC128_EXTRACT_FIELD(pesbt, HWPERMS);
     cdp->cr_uperms = (uint32_t)CC128_EXTRACT_FIELD(pesbt, UPERMS);
@@ -545,6 +554,76 @@ static inline void decompress_128cap_already_xored(uint64_t pesbt, uint64_t curs
     cdp->cr_base = (uint64_t)base;
 }
 
+/*
+ * Branch-free version of decompress_128cap_already_xored_ref().
+ *
+ * With the internal exponent the bottom/top fields are the same bits of the
+ * EBT field as without it, just with the low three bits replaced by the
+ * exponent, so B and T can be extracted with one mask each. The region
+ * corrections are computed with comparisons instead of branches and the
+ * cursor is shifted in two steps to avoid the undefined shift by 64 when
+ * E + 14 >= 64. With BMI2 the split exponent field is gathered with pext.
+ */
+#if defined(__BMI2__) && !defined(CC128_NO_PEXT)
+#define CC128_EXPONENT_PEXT_MASK \
+    (CC128_FIELD_EXPONENT_LOW_PART_MASK64 | CC128_FIELD_EXPONENT_HIGH_PART_MASK64)
+#endif
+static inline void decompress_128cap_already_xored(uint64_t pesbt, uint64_t cursor, cap_register_t* cdp) {
+    cdp->_cr_cursor = cursor;
+    cdp->cr_perms = (uint32_t)CC128_EXTRACT_FIELD(pesbt, HWPERMS);
+    cdp->cr_uperms = (uint32_t)CC128_EXTRACT_FIELD(pesbt, UPERMS);
+    cdp->cr_otype = (uint32_t)CC128_EXTRACT_FIELD(pesbt, OTYPE);
+    cdp->cr_flags = (uint8_t)CC128_EXTRACT_FIELD(pesbt, FLAGS);
+    cdp->cr_reserved = (uint8_t)CC128_EXTRACT_FIELD(pesbt, RESERVED);
+    cdp->cr_ebt = (uint32_t)CC128_EXTRACT_FIELD(pesbt, EBT);
+
+    const uint32_t IE = (uint32_t)CC128_EXTRACT_FIELD(pesbt, INTERNAL_EXPONENT);
+    // All ones if the internal exponent bit is set, zero otherwise
+    const uint32_t ie_mask = 0u - IE;
+    const uint32_t exp_low_mask = ie_mask & CC128_FIELD_EXPONENT_LOW_PART_MAX_VALUE;
+#ifdef CC128_EXPONENT_PEXT_MASK
+    uint32_t E = ie_mask & (uint32_t)_pext_u64(pesbt, CC128_EXPONENT_PEXT_MASK);
+#else
+    uint32_t E = ie_mask & (uint32_t)(CC128_EXTRACT_FIELD(pesbt, EXPONENT_LOW_PART) |
+                                      (CC128_EXTRACT_FIELD(pesbt, EXPONENT_HIGH_PART)
+                                       << CC128_FIELD_EXPONENT_LOW_PART_SIZE));
+#endif
+    const uint32_t B = (uint32_t)CC128_EXTRACT_FIELD(pesbt, EXP_ZERO_BOTTOM) & ~exp_low_mask;
+    uint32_t T = (uint32_t)CC128_EXTRACT_FIELD(pesbt, EXP_ZERO_TOP) & ~exp_low_mask;
+
+    // Reconstruct the top two bits of T (see the reference decoder)
+    const uint32_t TMask = CC_BITMASK64(CC128_MANTISSA_WIDTH - 2);
+    const uint32_t L_carry = T < (B & TMask);
+    const uint32_t BTop2 = B >> (CC128_MANTISSA_WIDTH - 2);
+    T |= ((BTop2 + L_carry + IE) & 0x3) << (CC128_MANTISSA_WIDTH - 2);
+    E = E < CC128_MAX_EXPONENT ? E : CC128_MAX_EXPONENT;
+
+    // E + 11 <= 63, so both shifts are well-defined for every exponent
+    const uint64_t a_mid = cursor >> (E + CC128_MANTISSA_WIDTH - 3);
+    const uint32_t a3 = (uint32_t)a_mid & 0x7;
+    const uint64_t a_top = a_mid >> 3;
+    const uint32_t B3 = B >> (CC128_MANTISSA_WIDTH - 3);
+    const uint32_t T3 = T >> (CC128_MANTISSA_WIDTH - 3);
+    const uint32_t R3 = (B3 - 1) & 0x7;
+    const uint32_t aHi = a3 < R3;
+    const uint32_t bHi = B3 < R3;
+    const uint32_t tHi = T3 < R3;
+
+    const cc128_length_t len_mask = ((cc128_length_t)1 << CC128_CAP_LEN_WIDTH) - 1;
+    cc128_length_t base = (cc128_length_t)(uint64_t)(a_top + bHi - aHi) << CC128_MANTISSA_WIDTH;
+    base = ((base | B) << E) & len_mask;
+    cc128_length_t top = (cc128_length_t)(uint64_t)(a_top + tHi - aHi) << CC128_MANTISSA_WIDTH;
+    top = ((top | T) << E) & len_mask;
+
+    // If base[64] is set the address wrapped around and top[64] is only set
+    // in the max top == 2**64 case (see the reference decoder).
+    const uint64_t base_high = (uint64_t)(base >> CC128_CAP_ADDR_WIDTH);
+    const uint64_t top_high = (uint64_t)(top >> CC128_CAP_ADDR_WIDTH);
+    const uint64_t new_top_high = base_high ? (aHi & tHi) : top_high;
+    cdp->_cr_top = ((cc128_length_t)new_top_high << CC128_CAP_ADDR_WIDTH) | (uint64_t)top;
+    cdp->cr_base = (uint64_t)base;
+}
+
 /*
  * Decompress a 128-bit capability.
  */
@@ -552,6 +631,17 @@ static inline void decompress_128cap(uint64_t pesbt, uint64_t cursor, cap_regist
     decompress_128cap_already_xored(pesbt ^ CC128_NULL_XOR_MASK, cursor, cdp);
 }
 
+/*
+ * Decompress @n capabilities as stored in memory (i.e. with the pesbt still
+ * XORed with CC128_NULL_XOR_MASK). Tags are not touched.
+ */
+static inline void decompress_128cap_array(const uint64_t* pesbt, const uint64_t* cursor, cap_register_t* cdp,
+                                           size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        decompress_128cap_already_xored(pesbt[i] ^ CC128_NULL_XOR_MASK, cursor[i], &cdp[i]);
+    }
+}
+
 static inline bool cc128_is_cap_sealed(const cap_register_t* cp) { return cp->cr_otype != CC128_OTYPE_UNSEALED; }
 
 /*
@@ -0,0 +1,152 @@
+/*
+ * Check that decompress_128cap_already_xored() matches the reference decoder
+ * and report the decode throughput of both.
+ *
+ * Usage: decompress_bench [--check-only|--bench-only] [cursors-per-ebt]
+ *
+ * The equivalence check walks every value of the 27-bit EBT field. For each
+ * one it decodes with cursors in every a3 region (the three cursor bits above
+ * the mantissa that select the base/top correction), with the remaining
+ * cursor bits and the permission/otype bits taken from a PRNG.
+ */
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../cheri_compressed_cap.h"
+
+static uint64_t xorshift_state = UINT64_C(0x9e3779b97f4a7c15);
+
+static inline uint64_t next_random(void) {
+    uint64_t x = xorshift_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return xorshift_state = x;
+}
+
+static bool same_cap(const cap_register_t& a, const cap_register_t& b) {
+    return a._cr_cursor == b._cr_cursor && a.cr_base == b.cr_base && a._cr_top == b._cr_top &&
+           a.cr_perms == b.cr_perms && a.cr_uperms == b.cr_uperms && a.cr_otype == b.cr_otype &&
+           a.cr_ebt == b.cr_ebt && a.cr_flags == b.cr_flags && a.cr_reserved == b.cr_reserved;
+}
+
+static void dump_cap(const char* name, const cap_register_t& c) {
+    fprintf(stderr, "  %s: base=0x%016" PRIx64 " top=0x%" PRIx64 "%016" PRIx64 " perms=0x%x uperms=0x%x otype=0x%x"
+            " ebt=0x%x flags=%d reserved=%d\n", name, c.cr_base, (uint64_t)(c._cr_top >> 64), (uint64_t)c._cr_top,
+            c.cr_perms, c.cr_uperms, c.cr_otype, c.cr_ebt, c.cr_flags, c.cr_reserved);
+}
+
+static bool check_one(uint64_t pesbt, uint64_t cursor) {
+    cap_register_t ref, fast;
+    memset(&ref, 0, sizeof(ref));
+    memset(&fast, 0, sizeof(fast));
+    decompress_128cap_already_xored_ref(pesbt, cursor, &ref);
+    decompress_128cap_already_xored(pesbt, cursor, &fast);
+    if (same_cap(ref, fast))
+        return true;
+    fprintf(stderr, "Mismatch for pesbt=0x%016" PRIx64 " cursor=0x%016" PRIx64 "\n", pesbt, cursor);
+    dump_cap("reference", ref);
+    dump_cap("fast", fast);
+    return false;
+}
+
+static bool check_exhaustive(unsigned cursors_per_ebt) {
+    const uint64_t num_ebt = UINT64_C(1) << CC128_FIELD_EBT_SIZE;
+    uint64_t checked = 0;
+    unsigned failures = 0;
+    for (uint64_t ebt = 0; ebt < num_ebt; ebt++) {
+        const uint64_t pesbt = (next_random() & ~CC128_FIELD_EBT_MASK64) | ebt;
+        // E is at most CC128_MAX_EXPONENT, so a3 lives in bits [E + 11, E + 13]
+        unsigned E = 0;
+        if (CC128_EXTRACT_FIELD(pesbt, INTERNAL_EXPONENT)) {
+            E = (unsigned)(CC128_EXTRACT_FIELD(pesbt, EXPONENT_LOW_PART) |
+                           (CC128_EXTRACT_FIELD(pesbt, EXPONENT_HIGH_PART) << CC128_FIELD_EXPONENT_LOW_PART_SIZE));
+            E = MIN(E, CC128_MAX_EXPONENT);
+        }
+        const unsigned a3_shift = E + CC128_MANTISSA_WIDTH - 3;
+        for (unsigned i = 0; i < cursors_per_ebt; i++) {
+            uint64_t cursor = next_random();
+            // Cover the address space ends, where base/top wrap, as well
+            if (i == 0)
+                cursor = 0;
+            else if (i == 1)
+                cursor = UINT64_MAX;
+            cursor &= ~(UINT64_C(7) << a3_shift);
+            cursor |= (uint64_t)(i & 7) << a3_shift;
+            checked++;
+            if (!check_one(pesbt, cursor) && ++failures >= 10) {
+                fprintf(stderr, "Too many failures, giving up\n");
+                return false;
+            }
+        }
+    }
+    printf("Checked %" PRIu64 " decodes, %u mismatches\n", checked, failures);
+    return failures == 0;
+}
+
+template <typename Fn> static double time_decodes(const char* name, uint64_t total, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(end - start).count();
+    double rate = (double)total / secs;
+    printf("%-12s %8.1f Mdecodes/s\n", name, rate / 1e6);
+    return rate;
+}
+
+static void benchmark(void) {
+    const size_t n = 1 << 16;
+    const unsigned rounds = 256;
+    std::vector<uint64_t> pesbt(n), cursor(n);
+    std::vector<cap_register_t> out(n);
+    for (size_t i = 0; i < n; i++) {
+        pesbt[i] = next_random();
+        cursor[i] = next_random();
+    }
+    const uint64_t total = (uint64_t)n * rounds;
+    double ref = time_decodes("reference", total, [&]() {
+        for (unsigned r = 0; r < rounds; r++)
+            for (size_t i = 0; i < n; i++)
+                decompress_128cap_already_xored_ref(pesbt[i] ^ CC128_NULL_XOR_MASK, cursor[i], &out[i]);
+    });
+    double fast = time_decodes("fast", total, [&]() {
+        for (unsigned r = 0; r < rounds; r++)
+            for (size_t i = 0; i < n; i++)
+                decompress_128cap_already_xored(pesbt[i] ^ CC128_NULL_XOR_MASK, cursor[i], &out[i]);
+    });
+    double batch = time_decodes("batch", total, [&]() {
+        for (unsigned r = 0; r < rounds; r++)
+            decompress_128cap_array(pesbt.data(), cursor.data(), out.data(), n);
+    });
+    printf("Speedup: fast %.2fx, batch %.2fx\n", fast / ref, batch / ref);
+}
+
+int main(int argc, char** argv) {
+    bool check = true, bench = true;
+    unsigned cursors_per_ebt = 8;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--check-only") == 0) {
+            bench = false;
+        } else if (strcmp(argv[i], "--bench-only") == 0) {
+            check = false;
+        } else {
+            cursors_per_ebt = (unsigned)strtoul(argv[i], nullptr, 0);
+            if (cursors_per_ebt == 0) {
+                fprintf(stderr, "Usage: %s [--check-only|--bench-only] [cursors-per-ebt]\n", argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+#ifdef CC128_EXPONENT_PEXT_MASK
+    printf("Using BMI2 pext\n");
+#endif
+    if (check && !check_exhaustive(cursors_per_ebt))
+        return EXIT_FAILURE;
+    if (bench)
+        benchmark();
+    return EXIT_SUCCESS;
+}
@@ -47,6 +47,7 @@
 // PCC bounds checks:
 DEF_HELPER_1(raise_exception_pcc_perms, noreturn, env)
 DEF_HELPER_3(raise_exception_pcc_bounds, noreturn, env, tl, i32)
+DEF_HELPER_1(pcc_top_check_failed, noreturn, env)
 DEF_HELPER_2(raise_exception_ddc_perms, noreturn, env, i32)
 DEF_HELPER_3(raise_exception_ddc_bounds, noreturn, env, tl, i32)
 
@@ -239,8 +239,20 @@ void store_cap_to_memory(CPUArchState *env, uint32_t cs, target_ulong vaddr,
 void load_cap_from_memory(CPUArchState *env, uint32_t cd, uint32_t cb,
                           const cap_register_t *source, target_ulong vaddr,
                           target_ulong retpc, hwaddr *physaddr);
-// Helper for RISCV AMOSWAP
+/*
+ * Atomically store capability register @cs to @vaddr if memory still holds
+ * the capability (@cmp_pesbt, @cmp_cursor, @cmp_tag). @cmp_tag is the tag
+ * bit in memory, not the one after clearing for missing load permissions.
+ * Safe to call from parallel vCPUs. Returns true if the store was performed.
+ */
+bool cmpxchg_cap_in_memory(CPUArchState *env, uint32_t cs, target_ulong vaddr,
+                           uint64_t cmp_pesbt, uint64_t cmp_cursor,
+                           bool cmp_tag, uintptr_t retpc);
+// Helper for RISCV AMOSWAP. If @raw_tag is non-NULL, it is set to the tag in
+// memory before any load-capability permission has cleared the returned tag,
+// which is what cmpxchg_cap_in_memory() must compare against.
 bool load_cap_from_memory_128(CPUArchState *env, uint64_t *pesbt,
                               uint64_t *cursor, uint32_t cb,
                               const cap_register_t *source, target_ulong vaddr,
-                              target_ulong retpc, hwaddr *physaddr);
+                              target_ulong retpc, hwaddr *physaddr,
+                              bool *raw_tag);
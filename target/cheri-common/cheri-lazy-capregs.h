@@ -43,6 +43,7 @@
 #include "cpu.h"
 #include "tcg/tcg.h"
 #include "qemu/log.h"
+#include "exec/log_instr_binary.h"
 
 static inline GPCapRegs *cheri_get_gpcrs(CPUArchState *env);
 
@@ -180,16 +181,116 @@ get_capreg_0_is_ddc(CPUArchState *env, unsigned regnum)
 
 
 #ifdef CONFIG_MIPS_LOG_INSTR
+
+#define cvtrace_dump_cap_load(trace, addr, cr)          \
+    cvtrace_dump_cap_ldst(trace, CVT_LD_CAP, addr, cr)
+#define cvtrace_dump_cap_store(trace, addr, cr)         \
+    cvtrace_dump_cap_ldst(trace, CVT_ST_CAP, addr, cr)
+
+/*
+* Dump cap load or store to cvtrace
+*/
+static inline void cvtrace_dump_cap_ldst(cvtrace_t *cvtrace, uint8_t version,
+                                         uint64_t addr, const cap_register_t *cr)
+{
+    if (unlikely(qemu_loglevel_mask(CPU_LOG_CVTRACE))) {
+        cvtrace->version = version;
+        cvtrace->val1 = tswap64(addr);
+        cvtrace->val2 = tswap64(((uint64_t)cr->cr_tag << 63) |
+            ((uint64_t)(cr->cr_otype & CAP_MAX_REPRESENTABLE_OTYPE) << 32) |
+            ((((cr->cr_uperms & CAP_UPERMS_ALL) << CAP_UPERMS_SHFT) |
+                (cr->cr_perms & CAP_PERMS_ALL)) << 1) |
+            (uint64_t)(cap_is_unsealed(cr) ? 0 : 1));
+    }
+}
+/*
+ * Dump cap tag, otype, permissions and seal bit to cvtrace entry
+ */
+static inline void
+cvtrace_dump_cap_perms(cvtrace_t *cvtrace, const cap_register_t *cr)
+{
+    if (unlikely(qemu_loglevel_mask(CPU_LOG_CVTRACE))) {
+        cvtrace->val2 = tswap64(((uint64_t)cr->cr_tag << 63) |
+            ((uint64_t)(cr->cr_otype & CAP_MAX_REPRESENTABLE_OTYPE)<< 32) |
+            ((((cr->cr_uperms & CAP_UPERMS_ALL) << CAP_UPERMS_SHFT) |
+                (cr->cr_perms & CAP_PERMS_ALL)) << 1) |
+            (uint64_t)(cap_is_unsealed(cr) ? 0 : 1));
+    }
+}
+
+/*
+ * Dump capability cursor, base and length to cvtrace entry
+ */
+static inline void cvtrace_dump_cap_cbl(cvtrace_t *cvtrace, const cap_register_t *cr)
+{
+    if (unlikely(qemu_loglevel_mask(CPU_LOG_CVTRACE))) {
+        cvtrace->val3 = tswap64(cr->_cr_cursor);
+        cvtrace->val4 = tswap64(cr->cr_base);
+        cvtrace->val5 = tswap64(cap_get_length64(cr)); // write UINT64_MAX for 1 << 64
+    }
+}
+
+/*
+ * Record a capability register write in the current cvtrace entry. MIPS
+ * compares the whole register file after each instruction instead (see
+ * dump_changed_cop2()).
+ */
+static inline void cvtrace_changed_capreg(CPUArchState *env,
+                                          const cap_register_t *cr)
+{
+#ifdef TARGET_RISCV
+    if (unlikely(qemu_loglevel_mask(CPU_LOG_CVTRACE))) {
+        if (env->cvtrace.version == CVT_NO_REG ||
+            env->cvtrace.version == CVT_GPR)
+            env->cvtrace.version = CVT_CAP;
+        cvtrace_dump_cap_perms(&env->cvtrace, cr);
+        cvtrace_dump_cap_cbl(&env->cvtrace, cr);
+    }
+#endif
+}
+
+/*
+ * Capability register writes in the binary trace use the same compressed
+ * representation as capability loads and stores. Without compressed
+ * capabilities there is no such representation, so they are sent as text.
+ */
+static inline void log_instr_bin_changed_capreg(CPUArchState *env,
+                                                const char *name,
+                                                const cap_register_t *cr)
+{
+#if QEMU_USE_COMPRESSED_CHERI_CAPS
+    log_instr_bin_cap_reg(env, name, compress_128cap(cr), cap_get_cursor(cr),
+                          cr->cr_tag);
+#else
+    log_instr_bin_text(env, "  %s <- " PRINT_CAP_FMTSTR "\n", name,
+                       PRINT_CAP_ARGS(cr));
+#endif
+}
+
 extern const char * const cheri_gp_regnames[];
-#define log_changed_capreg(env, name, newval) \
-    qemu_log_mask_and_addr(CPU_LOG_INSTR, cpu_get_recent_pc(env), \
-                           "  %s <- " PRINT_CAP_FMTSTR "\n", name, \
-                           PRINT_CAP_ARGS(newval))
+#define log_changed_capreg(env, name, newval)                                  \
+    do {                                                                       \
+        cvtrace_changed_capreg(env, newval);                                   \
+        if (log_instr_binary_enabled()) {                                      \
+            if (qemu_loglevel_mask(CPU_LOG_INSTR) &&                           \
+                qemu_log_in_addr_range(cpu_get_recent_pc(env))) {              \
+                log_instr_bin_changed_capreg(env, name, newval);               \
+            }                                                                  \
+        } else {                                                               \
+            qemu_log_mask_and_addr(CPU_LOG_INSTR, cpu_get_recent_pc(env),      \
+                                   "  %s <- " PRINT_CAP_FMTSTR "\n", name,     \
+                                   PRINT_CAP_ARGS(newval));                    \
+        }                                                                      \
+    } while (0)
 static inline void log_changed_capreg_int(CPUArchState *env, const char *name,
                                           target_ulong newval)
 {
     if (unlikely(qemu_loglevel_mask(CPU_LOG_INSTR)) &&
         qemu_log_in_addr_range(cpu_get_recent_pc(env))) {
+        if (log_instr_binary_enabled()) {
+            log_instr_bin_reg(env, name, newval);
+            return;
+        }
         qemu_log("  %s <- " TARGET_FMT_lx " (setting integer value)\n", name,
                  newval);
     }
@@ -73,4 +73,97 @@ static inline void gen_raise_pcc_violation(DisasContextBase *db,
     tcg_temp_free(taddr);
 }
 
+static inline bool pcc_top_is_dynamic(DisasContextBase *db)
+{
+    return (db->cheri_flags & TB_FLAG_PCC_TOP_DYNAMIC) != 0;
+}
+
+// Load the low 64 bits of the live PCC top. With TB_FLAG_PCC_TOP_DYNAMIC the
+// top is less than CAP_MAX_TOP, so this is the full value.
+// Note: CHERI requires a 64-bit host (__int128), so TCGv_i64 is a single
+// host register here.
+static inline void gen_load_pcc_top(TCGv_i64 top)
+{
+    tcg_gen_ld_i64(top, cpu_env,
+                   CHERI_PCC_ENV_OFFSET + offsetof(cap_register_t, _cr_top)
+#ifdef HOST_WORDS_BIGENDIAN
+                       + sizeof(uint64_t)
+#endif
+    );
+}
+
+// Check the TB against the live PCC top with a single compare on TB entry.
+// The end address is not known until the whole TB has been translated, so we
+// emit a dummy immediate and patch it in gen_pcc_top_check_end().
+static inline void gen_pcc_top_check_start(DisasContextBase *db)
+{
+    TCGLabel *in_bounds = gen_new_label();
+    TCGv_i64 top = tcg_temp_new_i64();
+    TCGv_i64 end = tcg_temp_new_i64();
+
+    db->pcc_top_required = 0;
+    gen_load_pcc_top(top);
+    tcg_gen_movi_i64(end, 0xdeadbeef);
+    db->pcc_top_check_end = tcg_last_op();
+    tcg_gen_brcond_i64(TCG_COND_GEU, top, end, in_bounds);
+    tcg_temp_free_i64(top);
+    tcg_temp_free_i64(end);
+
+    cheri_tcg_save_pc(db);
+    if (db->max_insns == 1) {
+        // A single instruction TB can only fail the check if this instruction
+        // runs off the end of PCC.
+        TCGv tpc = tcg_const_tl(db->pc_first);
+        TCGv_i32 tbytes = tcg_temp_new_i32();
+        tcg_gen_movi_i32(tbytes, 0xdeadbeef);
+        db->pcc_top_check_len = tcg_last_op();
+        gen_helper_raise_exception_pcc_bounds(cpu_env, tpc, tbytes);
+        tcg_temp_free_i32(tbytes);
+        tcg_temp_free(tpc);
+    } else {
+        db->pcc_top_check_len = NULL;
+        gen_helper_pcc_top_check_failed(cpu_env);
+    }
+    gen_set_label(in_bounds);
+}
+
+static inline void gen_pcc_top_check_end(DisasContextBase *db)
+{
+    tcg_set_insn_param(db->pcc_top_check_end, 1,
+                       MAX(db->pc_next, db->pcc_top_required));
+    if (db->pcc_top_check_len) {
+        tcg_set_insn_param(db->pcc_top_check_len, 1,
+                           db->pc_next - db->pc_first);
+    }
+}
+
+// Check a fixed branch target against the live PCC top. In multi-instruction
+// TBs the target is folded into the TB entry check. Otherwise (e.g. when
+// single-stepping after a failed TB entry check) we have to compare against
+// the live PCC when the branch is taken.
+static inline void gen_check_branch_target_pcc_top(DisasContextBase *db,
+                                                   target_ulong addr,
+                                                   TCGv branchcond)
+{
+    if (!pcc_top_is_dynamic(db)) {
+        return;
+    }
+    if (db->max_insns > 1) {
+        db->pcc_top_required = MAX(db->pcc_top_required, addr + 1);
+        return;
+    }
+    TCGLabel *skip_btarget_check = gen_new_label();
+    if (branchcond) {
+        tcg_gen_brcondi_tl(TCG_COND_EQ, branchcond, 0, skip_btarget_check);
+    }
+    TCGv_i64 top = tcg_temp_new_i64();
+    gen_load_pcc_top(top);
+    tcg_gen_brcondi_i64(TCG_COND_GTU, top, addr, skip_btarget_check);
+    tcg_temp_free_i64(top);
+    TCGv taddr = tcg_const_tl(addr);
+    gen_raise_pcc_violation_tcgv(db, taddr, 0);
+    tcg_temp_free(taddr);
+    gen_set_label(skip_btarget_check);
+}
+
 #endif // TARGET_CHERI
@@ -34,19 +34,180 @@
 #include "tcg/tcg.h"
 #include "tcg/tcg-op.h"
 #include "cheri-translate-utils-base.h"
+#include "cheri_tagmem.h"
 
 #ifdef TARGET_CHERI
-#define _gen_cap_check(type)                                                   \
+static inline intptr_t gpcr_field_offset(uint32_t regnum, size_t field)
+{
+    return CHERI_GPCRS_ENV_OFFSET + offsetof(GPCapRegs, decompressed) +
+           regnum * sizeof(cap_register_t) + field;
+}
+
+// Set @fail to non-zero unless [addr, addr + num_bytes) lies within the bounds
+// of the capability at @cap_offset in env. Capabilities with top == 2^64 are
+// also reported as failing, the helper handles them on the slow path.
+// Note: no branches here since TCG temporaries do not survive them.
+static inline void gen_cap_bounds_check_inline(TCGv_i64 fail, TCGv addr,
+                                               intptr_t cap_offset,
+                                               uint32_t num_bytes)
+{
+    intptr_t top = cap_offset + offsetof(cap_register_t, _cr_top);
+#ifdef HOST_WORDS_BIGENDIAN
+    intptr_t top_lo = top + sizeof(uint64_t), top_hi = top;
+#else
+    intptr_t top_lo = top, top_hi = top + sizeof(uint64_t);
+#endif
+    TCGv_i64 taddr = tcg_temp_new_i64();
+    TCGv_i64 tend = tcg_temp_new_i64();
+    TCGv_i64 tval = tcg_temp_new_i64();
+    TCGv_i64 tcmp = tcg_temp_new_i64();
+
+    tcg_gen_extu_tl_i64(taddr, addr);
+    tcg_gen_addi_i64(tend, taddr, num_bytes);
+    // addr < base
+    tcg_gen_ld_i64(tval, cpu_env,
+                   cap_offset + offsetof(cap_register_t, cr_base));
+    tcg_gen_setcond_i64(TCG_COND_LTU, tcmp, taddr, tval);
+    tcg_gen_or_i64(fail, fail, tcmp);
+    // top >= 2^64
+    tcg_gen_ld_i64(tval, cpu_env, top_hi);
+    tcg_gen_or_i64(fail, fail, tval);
+    // addr + num_bytes > top (or wrapped around)
+    tcg_gen_ld_i64(tval, cpu_env, top_lo);
+    tcg_gen_setcond_i64(TCG_COND_GTU, tcmp, tend, tval);
+    tcg_gen_or_i64(fail, fail, tcmp);
+    tcg_gen_setcond_i64(TCG_COND_LTU, tcmp, tend, taddr);
+    tcg_gen_or_i64(fail, fail, tcmp);
+
+    tcg_temp_free_i64(tcmp);
+    tcg_temp_free_i64(tval);
+    tcg_temp_free_i64(tend);
+    tcg_temp_free_i64(taddr);
+}
+
+typedef void cap_check_helper(TCGv_cap_checked_ptr, TCGv_ptr, TCGv_i32, TCGv,
+                              TCGv_i32);
+
+static inline void gen_cap_check_helper_call(TCGv_cap_checked_ptr resultaddr,
+                                             uint32_t capreg, TCGv offset,
+                                             uint32_t size,
+                                             cap_check_helper *gen_check_helper)
+{
+    TCGv_i32 tcs = tcg_const_i32(capreg);
+    TCGv_i32 tsize = tcg_const_i32(size);
+    gen_check_helper(resultaddr, cpu_env, tcs, offset, tsize);
+    tcg_temp_free_i32(tsize);
+    tcg_temp_free_i32(tcs);
+}
+
+// Compute the address of a @size byte access at @offset relative to @capreg
+// into @taddr and set @fail to non-zero unless @capreg is fully decompressed,
+// tagged, unsealed, has @required_perms and the access lies within bounds.
+// @capreg must be a GPR other than $c0.
+// Note: no branches here since TCG temporaries do not survive them.
+static inline void gen_cap_check_fail(TCGv_i64 fail, TCGv taddr,
+                                      uint32_t capreg, TCGv offset,
+                                      uint32_t size, uint32_t required_perms)
+{
+    TCGv_i64 tmp = tcg_temp_new_i64();
+
+    tcg_debug_assert(capreg != 0 && capreg < 32);
+    // Register state must be CREG_FULLY_DECOMPRESSED
+#ifdef TARGET_RISCV
+    tcg_gen_extract_i64(tmp, cpu_capreg_state, capreg * 2, 2);
+#else
+    tcg_gen_ld_i64(tmp, cpu_env,
+                   CHERI_GPCRS_ENV_OFFSET + offsetof(GPCapRegs, capreg_state));
+    tcg_gen_extract_i64(tmp, tmp, capreg * 2, 2);
+#endif
+    tcg_gen_setcondi_i64(TCG_COND_NE, tmp, tmp, CREG_FULLY_DECOMPRESSED);
+    tcg_gen_or_i64(fail, fail, tmp);
+    // Tagged
+    tcg_gen_ld8u_i64(tmp, cpu_env,
+                     gpcr_field_offset(capreg, offsetof(cap_register_t, cr_tag)));
+    tcg_gen_xori_i64(tmp, tmp, 1);
+    tcg_gen_or_i64(fail, fail, tmp);
+    // Unsealed
+    tcg_gen_ld32u_i64(
+        tmp, cpu_env,
+        gpcr_field_offset(capreg, offsetof(cap_register_t, cr_otype)));
+    tcg_gen_setcondi_i64(TCG_COND_LTU, tmp, tmp, CAP_OTYPE_UNSEALED);
+    tcg_gen_or_i64(fail, fail, tmp);
+    // Has the required permissions
+    tcg_gen_ld32u_i64(
+        tmp, cpu_env,
+        gpcr_field_offset(capreg, offsetof(cap_register_t, cr_perms)));
+    tcg_gen_not_i64(tmp, tmp);
+    tcg_gen_andi_i64(tmp, tmp, required_perms);
+    tcg_gen_or_i64(fail, fail, tmp);
+
+#ifdef TARGET_RISCV
+    // The cursor is the integer register value
+    gen_get_gpr(taddr, capreg);
+#else
+    tcg_gen_ld_tl(
+        taddr, cpu_env,
+        gpcr_field_offset(capreg, offsetof(cap_register_t, _cr_cursor)));
+#endif
+    tcg_gen_add_tl(taddr, taddr, offset);
+    gen_cap_bounds_check_inline(fail, taddr, gpcr_field_offset(capreg, 0),
+                                size);
+    tcg_temp_free_i64(tmp);
+}
+
+// Check a capability-relative load/store inline and only call the helper if
+// the base register is not fully decompressed or one of the checks fails.
+// The helper then raises the appropriate exception (or handles the rare
+// cases that are not checked inline).
+static inline void gen_cap_check_inline(TCGv_cap_checked_ptr resultaddr,
+                                        uint32_t capreg, TCGv offset,
+                                        MemOp op, uint32_t required_perms,
+                                        cap_check_helper *gen_check_helper)
+{
+    const uint32_t size = memop_size(op);
+
+    // $c0 is DDC on MIPS and NULL on RISC-V, both are handled by the helper.
+    if (capreg == 0 || capreg >= 32) {
+        gen_cap_check_helper_call(resultaddr, capreg, offset, size,
+                                  gen_check_helper);
+        return;
+    }
+
+    TCGLabel *done = gen_new_label();
+    // Both values are still needed on the slow path after the branch.
+    TCGv toffset = tcg_temp_local_new();
+    TCGv_cap_checked_ptr taddr = tcg_temp_local_new_cap_checked();
+    TCGv_i64 fail = tcg_const_i64(0);
+
+    tcg_gen_mov_tl(toffset, offset);
+    gen_cap_check_fail(fail, (TCGv)taddr, capreg, toffset, size,
+                       required_perms);
+#if defined(TARGET_MIPS) && defined(CHERI_UNALIGNED)
+    // Let the helper log unaligned accesses
+    TCGv_i64 tmp = tcg_temp_new_i64();
+    tcg_gen_extu_tl_i64(tmp, (TCGv)taddr);
+    tcg_gen_andi_i64(tmp, tmp, size - 1);
+    tcg_gen_or_i64(fail, fail, tmp);
+    tcg_temp_free_i64(tmp);
+#endif
+
+    tcg_gen_brcondi_i64(TCG_COND_EQ, fail, 0, done);
+    tcg_temp_free_i64(fail);
+    gen_cap_check_helper_call(taddr, capreg, toffset, size, gen_check_helper);
+    gen_set_label(done);
+
+    tcg_gen_mov_tl((TCGv)resultaddr, (TCGv)taddr);
+    tcg_temp_free_cap_checked(taddr);
+    tcg_temp_free(toffset);
+}
+
+#define _gen_cap_check(type, perms)                                            \
     static inline void generate_cap_##type##_check(                            \
         TCGv_cap_checked_ptr resultaddr, uint32_t capreg, TCGv offset,         \
         MemOp op)                                                              \
     {                                                                          \
-        TCGv_i32 tcs = tcg_const_i32(capreg);                                  \
-        TCGv_i32 tsize = tcg_const_i32(memop_size(op));                        \
-        gen_helper_cap_##type##_check(resultaddr, cpu_env, tcs, offset,        \
-                                      tsize);                                  \
-        tcg_temp_free_i32(tsize);                                              \
-        tcg_temp_free_i32(tcs);                                                \
+        gen_cap_check_inline(resultaddr, capreg, offset, op, perms,            \
+                             &gen_helper_cap_##type##_check);                  \
     }                                                                          \
     static inline void generate_cap_##type##_check_imm(                        \
         TCGv_cap_checked_ptr resultaddr, uint32_t capreg, target_long offset,  \
@@ -57,9 +218,390 @@
         tcg_temp_free(toffset);                                                \
     }
 
-_gen_cap_check(load)
-_gen_cap_check(store)
-_gen_cap_check(rmw)
+_gen_cap_check(load, CAP_PERM_LOAD)
+_gen_cap_check(store, CAP_PERM_STORE)
+_gen_cap_check(rmw, CAP_PERM_LOAD | CAP_PERM_STORE)
+
+/*
+ * Capability loads and stores (CLC/CSC) are handled entirely in generated code
+ * when the base register is a fully decompressed capability that permits the
+ * access and the target is a RAM page in the softmmu TLB whose tag bitmap
+ * can be accessed directly (see CPUIOTLBEntry.tagblock). Everything else,
+ * including all exceptions, calls the helper which redoes the whole access.
+ * The inline path assumes 64-bit guest words and 64-bit host pointers.
+ */
+#if defined(CHERI_128) && QEMU_USE_COMPRESSED_CHERI_CAPS &&                    \
+    !defined(CONFIG_USER_ONLY) && TCG_TARGET_REG_BITS == 64 &&                 \
+    TARGET_LONG_BITS == 64
+#define CHERI_INLINE_CAP_LOAD_STORE 1
+#else
+#define CHERI_INLINE_CAP_LOAD_STORE 0
+#endif
+
+#if CHERI_INLINE_CAP_LOAD_STORE
+static inline bool gen_cap_load_store_inline_ok(DisasContext *ctx, uint32_t cb)
+{
+    // $c0 is DDC on MIPS and NULL on RISC-V, both are handled by the helper.
+    if (cb == 0 || cb >= 32) {
+        return false;
+    }
+    // Concurrent capability loads rely on the tag seqlock in the helpers.
+    if (tb_cflags(ctx->base.tb) & CF_PARALLEL) {
+        return false;
+    }
+#ifdef CONFIG_MIPS_LOG_INSTR
+    if (ctx->base.log_instr) {
+        return false;
+    }
+#endif
+#ifdef CONFIG_RVFI_DII
+    return false;
+#else
+    return true;
+#endif
+}
+
+// Guest memory holds capabilities in target byte order
+static inline void gen_cap_mem_bswap(TCGv_i64 value)
+{
+#if defined(TARGET_WORDS_BIGENDIAN) != defined(HOST_WORDS_BIGENDIAN)
+    tcg_gen_bswap64_i64(value, value);
+#endif
+}
+
+static inline void gen_cap_statcounter_add(size_t env_offset, TCGv_i64 value)
+{
+    TCGv_i64 tmp = tcg_temp_new_i64();
+    tcg_gen_ld_i64(tmp, cpu_env, env_offset);
+    tcg_gen_add_i64(tmp, tmp, value);
+    tcg_gen_st_i64(tmp, cpu_env, env_offset);
+    tcg_temp_free_i64(tmp);
+}
+
+/*
+ * Look up the capability at @addr in the softmmu TLB for @mem_idx. Sets @fail
+ * unless the page is mapped for the access without any TLB flags, @addr is
+ * capability aligned and the tag block for the page is allocated. Otherwise
+ * @host is the host address of the capability and @tagword the host address
+ * of the 64-bit tag bitmap word holding its tag.
+ * If @fail is already set on entry the TLB entry may be stale, in which case
+ * the tag block slot is not dereferenced.
+ */
+static inline void gen_cap_tlb_lookup(TCGv_i64 fail, TCGv_i64 host,
+                                      TCGv_i64 tagword, TCGv_i64 addr,
+                                      int mem_idx, bool is_store)
+{
+    static void *const no_tagblock = NULL;
+    const int fast_ofs = TLB_MASK_TABLE_OFS(mem_idx);
+    const int desc_ofs = (int)offsetof(ArchCPU, neg.tlb.d[mem_idx]) -
+                         (int)offsetof(ArchCPU, env);
+    TCGv_ptr ptr = tcg_temp_new_ptr();
+    TCGv_i64 idx = tcg_temp_new_i64();
+    TCGv_i64 tmp = tcg_temp_new_i64();
+    TCGv_i64 cmp = tcg_temp_new_i64();
+    TCGv_i64 zero = tcg_const_i64(0);
+    TCGv_i64 null_slot = tcg_const_i64((uintptr_t)&no_tagblock);
+
+    // CPUTLBEntry, indexed the same way as in the backends' fast path
+    tcg_gen_shri_i64(idx, addr, TARGET_PAGE_BITS - CPU_TLB_ENTRY_BITS);
+    tcg_gen_ld_i64(tmp, cpu_env, fast_ofs + offsetof(CPUTLBDescFast, mask));
+    tcg_gen_and_i64(idx, idx, tmp);
+    tcg_gen_ld_i64(tmp, cpu_env, fast_ofs + offsetof(CPUTLBDescFast, table));
+    tcg_gen_add_i64(tmp, tmp, idx);
+    tcg_gen_trunc_i64_ptr(ptr, tmp);
+    tcg_gen_ld_i64(cmp, ptr,
+                   is_store ? offsetof(CPUTLBEntry, addr_write)
+                            : offsetof(CPUTLBEntry, addr_read));
+    tcg_gen_ld_i64(host, ptr, offsetof(CPUTLBEntry, addend));
+    tcg_gen_add_i64(host, host, addr);
+    if (is_store) {
+        // We update the tags ourselves
+        tcg_gen_andi_i64(cmp, cmp, ~(uint64_t)TLB_CHERI_TAGS);
+    }
+    // Any other TLB flag or a misaligned address makes this fail
+    tcg_gen_andi_i64(tmp, addr, TARGET_PAGE_MASK | (CHERI_CAP_SIZE - 1));
+    tcg_gen_setcond_i64(TCG_COND_NE, cmp, cmp, tmp);
+    tcg_gen_or_i64(fail, fail, cmp);
+
+    // The matching CPUIOTLBEntry
+    tcg_gen_shri_i64(idx, idx, CPU_TLB_ENTRY_BITS);
+    tcg_gen_muli_i64(idx, idx, sizeof(CPUIOTLBEntry));
+    tcg_gen_ld_i64(tmp, cpu_env, desc_ofs + offsetof(CPUTLBDesc, iotlb));
+    tcg_gen_add_i64(tmp, tmp, idx);
+    tcg_gen_trunc_i64_ptr(ptr, tmp);
+    tcg_gen_ld32u_i64(idx, ptr, offsetof(CPUIOTLBEntry, tagblock_word_ofs));
+    tcg_gen_ld_i64(tmp, ptr, offsetof(CPUIOTLBEntry, tagblock));
+    tcg_gen_movcond_i64(TCG_COND_NE, tmp, fail, zero, null_slot, tmp);
+    tcg_gen_movcond_i64(TCG_COND_EQ, tmp, tmp, zero, null_slot, tmp);
+    tcg_gen_trunc_i64_ptr(ptr, tmp);
+    tcg_gen_ld_i64(tmp, ptr, 0);
+    tcg_gen_setcondi_i64(TCG_COND_EQ, cmp, tmp, 0);
+    tcg_gen_or_i64(fail, fail, cmp);
+
+    // tagword = block + word_ofs + 8 * (tag index within the page / 64)
+    tcg_gen_add_i64(tagword, tmp, idx);
+    tcg_gen_andi_i64(tmp, addr, ~TARGET_PAGE_MASK);
+    tcg_gen_shri_i64(tmp, tmp, ctz32(CHERI_CAP_SIZE) + 6);
+    tcg_gen_shli_i64(tmp, tmp, 3);
+    tcg_gen_add_i64(tagword, tagword, tmp);
+
+    tcg_temp_free_i64(null_slot);
+    tcg_temp_free_i64(zero);
+    tcg_temp_free_i64(cmp);
+    tcg_temp_free_i64(tmp);
+    tcg_temp_free_i64(idx);
+    tcg_temp_free_ptr(ptr);
+}
+
+// Equivalent of update_compressed_capreg() for @regnum != 0.
+static inline void gen_update_compressed_capreg(uint32_t regnum,
+                                                TCGv_i64 pesbt, TCGv_i64 tag,
+                                                TCGv_i64 cursor)
+{
+    TCGv_i64 state = tcg_temp_new_i64();
+
+    tcg_debug_assert(regnum != 0 && regnum < 32);
+    tcg_gen_st_i64(pesbt, cpu_env,
+                   CHERI_GPCRS_ENV_OFFSET + offsetof(GPCapRegs, pesbt) +
+                       regnum * sizeof(uint64_t));
+    // CREG_UNTAGGED_CAP or CREG_TAGGED_CAP
+    tcg_gen_addi_i64(state, tag, CREG_UNTAGGED_CAP);
+#ifdef TARGET_RISCV
+    tcg_gen_mov_tl(_cpu_cursors_do_not_access_directly[regnum], cursor);
+    tcg_gen_deposit_i64(cpu_capreg_state, cpu_capreg_state, state, regnum * 2,
+                        2);
+#else
+    TCGv_i64 all_states = tcg_temp_new_i64();
+    tcg_gen_st_i64(cursor, cpu_env,
+                   gpcr_field_offset(regnum,
+                                     offsetof(cap_register_t, _cr_cursor)));
+    tcg_gen_ld_i64(all_states, cpu_env,
+                   CHERI_GPCRS_ENV_OFFSET + offsetof(GPCapRegs, capreg_state));
+    tcg_gen_deposit_i64(all_states, all_states, state, regnum * 2, 2);
+    tcg_gen_st_i64(all_states, cpu_env,
+                   CHERI_GPCRS_ENV_OFFSET + offsetof(GPCapRegs, capreg_state));
+    tcg_temp_free_i64(all_states);
+#endif
+    tcg_temp_free_i64(state);
+}
+
+// Read the in-memory representation of capability register @regnum.
+static inline void gen_get_capreg_for_mem(uint32_t regnum,
+                                          TCGv_i64 pesbt_for_mem,
+                                          TCGv_i64 tag, TCGv_i64 cursor)
+{
+    if (regnum == 0) {
+        // NULL
+        tcg_gen_movi_i64(pesbt_for_mem, 0);
+        tcg_gen_movi_i64(tag, 0);
+        tcg_gen_movi_i64(cursor, 0);
+        return;
+    }
+    TCGv_i64 state = tcg_temp_new_i64();
+    TCGv_i64 tmp = tcg_temp_new_i64();
+    TCGv_i64 zero = tcg_const_i64(0);
+#ifdef TARGET_RISCV
+    tcg_gen_extract_i64(state, cpu_capreg_state, regnum * 2, 2);
+    gen_get_gpr(cursor, regnum);
+#else
+    tcg_gen_ld_i64(state, cpu_env,
+                   CHERI_GPCRS_ENV_OFFSET + offsetof(GPCapRegs, capreg_state));
+    tcg_gen_extract_i64(state, state, regnum * 2, 2);
+    tcg_gen_ld_i64(cursor, cpu_env,
+                   gpcr_field_offset(regnum,
+                                     offsetof(cap_register_t, _cr_cursor)));
+#endif
+    // pesbt is valid for all states but CREG_INTEGER, which stores as NULL.
+    tcg_gen_ld_i64(pesbt_for_mem, cpu_env,
+                   CHERI_GPCRS_ENV_OFFSET + offsetof(GPCapRegs, pesbt) +
+                       regnum * sizeof(uint64_t));
+    tcg_gen_xori_i64(pesbt_for_mem, pesbt_for_mem, CC128_NULL_XOR_MASK);
+    tcg_gen_movcond_i64(TCG_COND_EQ, pesbt_for_mem, state, zero, zero,
+                        pesbt_for_mem);
+    // The tag is part of the state unless the register is fully decompressed
+    tcg_gen_ld8u_i64(tmp, cpu_env,
+                     gpcr_field_offset(regnum, offsetof(cap_register_t, cr_tag)));
+    tcg_gen_shri_i64(tag, state, 1);
+    tcg_gen_movi_i64(zero, CREG_FULLY_DECOMPRESSED);
+    tcg_gen_movcond_i64(TCG_COND_EQ, tag, state, zero, tmp, tag);
+    tcg_temp_free_i64(zero);
+    tcg_temp_free_i64(tmp);
+    tcg_temp_free_i64(state);
+}
+#endif /* CHERI_INLINE_CAP_LOAD_STORE */
+
+static inline void gen_cap_load_store_helper(uint32_t creg, uint32_t cb,
+                                             TCGv offset, bool is_store)
+{
+    TCGv_i32 tcreg = tcg_const_i32(creg);
+    TCGv_i32 tcb = tcg_const_i32(cb);
+    if (is_store) {
+        gen_helper_store_cap_via_cap(cpu_env, tcreg, tcb, offset);
+    } else {
+        gen_helper_load_cap_via_cap(cpu_env, tcreg, tcb, offset);
+    }
+    tcg_temp_free_i32(tcb);
+    tcg_temp_free_i32(tcreg);
+}
+
+// Load the capability at @offset relative to @cb into @cd (CLC).
+static inline void gen_load_cap_via_cap(DisasContext *ctx, uint32_t cd,
+                                        uint32_t cb, TCGv offset)
+{
+#if CHERI_INLINE_CAP_LOAD_STORE
+    if (!gen_cap_load_store_inline_ok(ctx, cb)) {
+        gen_cap_load_store_helper(cd, cb, offset, false);
+        return;
+    }
+    TCGLabel *slow = gen_new_label();
+    TCGLabel *done = gen_new_label();
+    // Still needed after the branch
+    TCGv toffset = tcg_temp_local_new();
+    TCGv taddr = tcg_temp_local_new();
+    TCGv_i64 host = tcg_temp_local_new_i64();
+    TCGv_i64 tagword = tcg_temp_local_new_i64();
+    TCGv_i64 fail = tcg_const_i64(0);
+
+    tcg_gen_mov_tl(toffset, offset);
+    // Without PERM_LOAD_CAP the tag is cleared, leave that to the helper.
+    gen_cap_check_fail(fail, taddr, cb, toffset, CHERI_CAP_SIZE,
+                       CAP_PERM_LOAD | CAP_PERM_LOAD_CAP);
+    gen_cap_tlb_lookup(fail, host, tagword, taddr, ctx->mem_idx, false);
+    tcg_gen_brcondi_i64(TCG_COND_NE, fail, 0, slow);
+    tcg_temp_free_i64(fail);
+
+    TCGv_ptr ptr = tcg_temp_new_ptr();
+    TCGv_i64 pesbt = tcg_temp_new_i64();
+    TCGv_i64 cursor = tcg_temp_new_i64();
+    TCGv_i64 tag = tcg_temp_new_i64();
+    TCGv_i64 tmp = tcg_temp_new_i64();
+    tcg_gen_trunc_i64_ptr(ptr, host);
+    tcg_gen_ld_i64(pesbt, ptr, CHERI_MEM_OFFSET_METADATA);
+    gen_cap_mem_bswap(pesbt);
+    tcg_gen_xori_i64(pesbt, pesbt, CC128_NULL_XOR_MASK);
+    tcg_gen_ld_i64(cursor, ptr, CHERI_MEM_OFFSET_CURSOR);
+    gen_cap_mem_bswap(cursor);
+    tcg_gen_trunc_i64_ptr(ptr, tagword);
+    tcg_gen_ld_i64(tag, ptr, 0);
+    tcg_gen_extract_i64(tmp, taddr, ctz32(CHERI_CAP_SIZE), 6);
+    tcg_gen_shr_i64(tag, tag, tmp);
+    tcg_gen_andi_i64(tag, tag, 1);
+
+    tcg_gen_movi_i64(tmp, 1);
+    gen_cap_statcounter_add(offsetof(CPUArchState, statcounters_cap_read), tmp);
+    gen_cap_statcounter_add(
+        offsetof(CPUArchState, statcounters_cap_read_tagged), tag);
+    // Loads into $c0 / $cnull are discarded
+    if (cd != 0) {
+        gen_update_compressed_capreg(cd, pesbt, tag, cursor);
+    }
+    tcg_temp_free_i64(tmp);
+    tcg_temp_free_i64(tag);
+    tcg_temp_free_i64(cursor);
+    tcg_temp_free_i64(pesbt);
+    tcg_temp_free_ptr(ptr);
+    tcg_gen_br(done);
+
+    gen_set_label(slow);
+    gen_cap_load_store_helper(cd, cb, toffset, false);
+    gen_set_label(done);
+    tcg_temp_free_i64(tagword);
+    tcg_temp_free_i64(host);
+    tcg_temp_free(taddr);
+    tcg_temp_free(toffset);
+#else
+    gen_cap_load_store_helper(cd, cb, offset, false);
+#endif
+}
+
+// Store capability @cs at @offset relative to @cb (CSC).
+static inline void gen_store_cap_via_cap(DisasContext *ctx, uint32_t cs,
+                                         uint32_t cb, TCGv offset)
+{
+#if CHERI_INLINE_CAP_LOAD_STORE
+    if (!gen_cap_load_store_inline_ok(ctx, cb)) {
+        gen_cap_load_store_helper(cs, cb, offset, true);
+        return;
+    }
+    TCGLabel *slow = gen_new_label();
+    TCGLabel *done = gen_new_label();
+    // Still needed after the branch
+    TCGv toffset = tcg_temp_local_new();
+    TCGv taddr = tcg_temp_local_new();
+    TCGv_i64 host = tcg_temp_local_new_i64();
+    TCGv_i64 tagword = tcg_temp_local_new_i64();
+    TCGv_i64 fail = tcg_const_i64(0);
+    TCGv_i64 tmp = tcg_temp_new_i64();
+
+    tcg_gen_mov_tl(toffset, offset);
+    // Requiring PERM_STORE_LOCAL means we don't have to check if @cs is local.
+    gen_cap_check_fail(fail, taddr, cb, toffset, CHERI_CAP_SIZE,
+                       CAP_PERM_STORE | CAP_PERM_STORE_CAP |
+                           CAP_PERM_STORE_LOCAL);
+    gen_cap_tlb_lookup(fail, host, tagword, taddr, ctx->mem_idx, true);
+    // Migration needs to see tag changes, cheri_tag_phys_set() handles that.
+    TCGv_ptr ptr = tcg_const_ptr(&cheri_tags_dirty_log);
+    tcg_gen_ld8u_i64(tmp, ptr, 0);
+    tcg_gen_or_i64(fail, fail, tmp);
+    tcg_temp_free_ptr(ptr);
+#ifdef TARGET_MIPS
+    // Stores to the linked capability must clear the link, see
+    // cheri_tag_phys_set().
+    tcg_gen_ld_i64(tmp, cpu_env, offsetof(CPUMIPSState, lladdr));
+    tcg_gen_andi_i64(tmp, tmp, ~(uint64_t)(CHERI_CAP_SIZE - 1));
+    tcg_gen_setcond_i64(TCG_COND_EQ, tmp, tmp, taddr);
+    tcg_gen_or_i64(fail, fail, tmp);
+#endif
+    tcg_temp_free_i64(tmp);
+    tcg_gen_brcondi_i64(TCG_COND_NE, fail, 0, slow);
+    tcg_temp_free_i64(fail);
+
+    ptr = tcg_temp_new_ptr();
+    TCGv_i64 pesbt_for_mem = tcg_temp_new_i64();
+    TCGv_i64 cursor = tcg_temp_new_i64();
+    TCGv_i64 tag = tcg_temp_new_i64();
+    TCGv_i64 word = tcg_temp_new_i64();
+    TCGv_i64 bit = tcg_temp_new_i64();
+    gen_get_capreg_for_mem(cs, pesbt_for_mem, tag, cursor);
+    tcg_gen_movi_i64(bit, 1);
+    gen_cap_statcounter_add(offsetof(CPUArchState, statcounters_cap_write),
+                            bit);
+    gen_cap_statcounter_add(
+        offsetof(CPUArchState, statcounters_cap_write_tagged), tag);
+
+    tcg_gen_trunc_i64_ptr(ptr, host);
+    gen_cap_mem_bswap(pesbt_for_mem);
+    tcg_gen_st_i64(pesbt_for_mem, ptr, CHERI_MEM_OFFSET_METADATA);
+    gen_cap_mem_bswap(cursor);
+    tcg_gen_st_i64(cursor, ptr, CHERI_MEM_OFFSET_CURSOR);
+    // word = (word & ~(1 << n)) | (tag << n)
+    tcg_gen_trunc_i64_ptr(ptr, tagword);
+    tcg_gen_ld_i64(word, ptr, 0);
+    tcg_gen_extract_i64(cursor, taddr, ctz32(CHERI_CAP_SIZE), 6);
+    tcg_gen_shl_i64(bit, bit, cursor);
+    tcg_gen_shl_i64(tag, tag, cursor);
+    tcg_gen_andc_i64(word, word, bit);
+    tcg_gen_or_i64(word, word, tag);
+    tcg_gen_st_i64(word, ptr, 0);
+    tcg_temp_free_i64(bit);
+    tcg_temp_free_i64(word);
+    tcg_temp_free_i64(tag);
+    tcg_temp_free_i64(cursor);
+    tcg_temp_free_i64(pesbt_for_mem);
+    tcg_temp_free_ptr(ptr);
+    tcg_gen_br(done);
+
+    gen_set_label(slow);
+    gen_cap_load_store_helper(cs, cb, toffset, true);
+    gen_set_label(done);
+    tcg_temp_free_i64(tagword);
+    tcg_temp_free_i64(host);
+    tcg_temp_free(taddr);
+    tcg_temp_free(toffset);
+#else
+    gen_cap_load_store_helper(cs, cb, offset, true);
+#endif
+}
 
 #ifdef TARGET_MIPS
 static inline void gen_load_gpr(TCGv t, int reg);
@@ -109,10 +651,22 @@ static inline void _generate_ddc_checked_ptr(
         tcg_gen_mov_tl((TCGv)checked_addr, ddc_offset);
     }
     if (unlikely(!have_cheri_tb_flags(ctx, TB_FLAG_CHERI_DDC_FULL_AS))) {
-        // We need a bounds check since DDC is not full address space
+        // We need a bounds check since DDC is not full address space. The
+        // helper is only called to raise the exception.
+        TCGLabel *in_bounds = gen_new_label();
+        TCGv taddr = tcg_temp_local_new();
+        TCGv_i64 fail = tcg_const_i64(0);
+        tcg_gen_mov_tl(taddr, (TCGv)checked_addr);
+        gen_cap_bounds_check_inline(fail, taddr, CHERI_DDC_ENV_OFFSET,
+                                    num_bytes);
+        tcg_gen_brcondi_i64(TCG_COND_EQ, fail, 0, in_bounds);
+        tcg_temp_free_i64(fail);
         TCGv tbytes = tcg_const_tl(num_bytes);
-        gen_helper_ddc_check_bounds(cpu_env, (TCGv)checked_addr, tbytes);
+        gen_helper_ddc_check_bounds(cpu_env, taddr, tbytes);
         tcg_temp_free(tbytes);
+        gen_set_label(in_bounds);
+        tcg_gen_mov_tl((TCGv)checked_addr, taddr);
+        tcg_temp_free(taddr);
     }
     // DDC has been checked now and checked_addr can be used directly.
 }
@@ -216,6 +770,9 @@ static inline void gen_check_pcc_bounds_next_inst(DisasContext *ctx,
     if (have_cheri_tb_flags(ctx, TB_FLAG_PCC_FULL_AS)) {
         return; // PCC spans the full address space, no need to check
     }
+    if (pcc_top_is_dynamic(&ctx->base)) {
+        return; // Checked against the live PCC on TB entry
+    }
 
     // Note: PC can only be incremented since a branch exits the TB, so checking
     // for pc_next < pcc.base should not be needed. Add a debug assertion in
@@ -237,6 +794,8 @@ static inline void gen_check_branch_target(DisasContext *ctx, target_ulong addr)
     if (unlikely(!in_pcc_bounds(&ctx->base, addr))) {
         cheri_tcg_prepare_for_unconditional_exception(&ctx->base);
         gen_raise_pcc_violation(&ctx->base, addr, 0);
+    } else {
+        gen_check_branch_target_pcc_top(&ctx->base, addr, NULL);
     }
 #endif
 }
@@ -276,7 +835,15 @@ static inline void gen_check_branch_target_dynamic(DisasContext *ctx, TCGv addr)
         tcg_gen_brcondi_tl(TCG_COND_LTU, addr, ctx->base.pcc_base,
                            bounds_violation);
     }
-    if (ctx->base.pcc_top != TYPE_MAXIMUM(target_ulong)) {
+    if (pcc_top_is_dynamic(&ctx->base)) {
+        TCGv_i64 top = tcg_temp_new_i64();
+        TCGv_i64 addr64 = tcg_temp_new_i64();
+        gen_load_pcc_top(top);
+        tcg_gen_extu_tl_i64(addr64, addr);
+        tcg_gen_brcond_i64(TCG_COND_GEU, addr64, top, bounds_violation);
+        tcg_temp_free_i64(addr64);
+        tcg_temp_free_i64(top);
+    } else if (ctx->base.pcc_top != TYPE_MAXIMUM(target_ulong)) {
         tcg_gen_brcondi_tl(TCG_COND_GEU, addr, ctx->base.pcc_top,
                            bounds_violation);
     }
@@ -295,8 +862,10 @@ static inline void gen_check_cond_branch_target(DisasContext *ctx,
 #ifdef TARGET_CHERI
     // In the common case the target will be within the bounds of PCC so we
     // don't need a check no matter whether the branch is taken or not.
-    if (likely(in_pcc_bounds(&ctx->base, addr)))
+    if (likely(in_pcc_bounds(&ctx->base, addr))) {
+        gen_check_branch_target_pcc_top(&ctx->base, addr, branchcond);
         return;
+    }
 
     TCGLabel *skip_btarget_check = gen_new_label();
     // skip the bounds violation if bcond == 0 (i.e. branch not taken)
@@ -0,0 +1,371 @@
+/*
+ * CHERI capability bounds profile
+ *
+ * Counts tagged capabilities that are created out of bounds (including one
+ * past the end) or that become unrepresentable, per guest program counter.
+ * Each vCPU records into its own shard so that the vCPU threads never contend
+ * with each other; the monitor only takes the shard locks while reading or
+ * resetting the results.
+ *
+ * Looking up the guest PC requires cpu_restore_state(), so with a sample
+ * interval of N only every Nth event on a vCPU is looked up and recorded. The
+ * others are only counted, in a counter that the vCPU updates without taking
+ * the lock. A reset bumps cheri_bounds_reset_gen instead of clearing that
+ * counter, and the vCPU drops its pending count once it sees the new
+ * generation.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/rcu.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "cheri-helper-utils.h"
+#ifndef CONFIG_USER_ONLY
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qerror.h"
+#include "qapi/qapi-commands-misc-target.h"
+#include "monitor/monitor.h"
+#include "monitor/hmp.h"
+#include "monitor/hmp-target.h"
+#endif
+
+#define CHERI_BOUNDS_NUM_EVENTS (CHERI_BOUNDS_UNREPRESENTABLE + 1)
+
+typedef struct CheriBoundsPC {
+    uint64_t pc; /* hash table key */
+    uint64_t counts[CHERI_BOUNDS_NUM_EVENTS];
+    uint64_t max_distance;
+} CheriBoundsPC;
+
+typedef struct CheriBoundsShard {
+    /* Protects everything but @countdown, @skipped and @reset_gen. */
+    QemuMutex lock;
+    GHashTable *pcs;
+    uint64_t events;
+    uint64_t sampled;
+    /*
+     * Only written by the owning vCPU, the monitor reads @skipped and
+     * @reset_gen. @skipped is always less than the sample interval.
+     */
+    uint32_t countdown;
+    uint32_t skipped;
+    uint32_t reset_gen;
+} CheriBoundsShard;
+
+bool cheri_bounds_profile_enabled;
+static uint32_t cheri_bounds_profile_interval = 1;
+static uint32_t cheri_bounds_reset_gen;
+
+static CheriBoundsShard *cheri_bounds_shard(CPUState *cs)
+{
+    CheriBoundsShard *shard = cs->cheri_bounds;
+
+    if (unlikely(!shard)) {
+        shard = g_new0(CheriBoundsShard, 1);
+        qemu_mutex_init(&shard->lock);
+        shard->pcs = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+                                           g_free);
+        /* Shards are never freed, the monitor may read this at any time. */
+        atomic_rcu_set(&cs->cheri_bounds, shard);
+    }
+    return shard;
+}
+
+void cheri_bounds_profile_record(CPUArchState *env, CheriBoundsEvent event,
+                                 uint64_t distance, uintptr_t retpc)
+{
+    CheriBoundsShard *shard = cheri_bounds_shard(env_cpu(env));
+    uint32_t reset_gen = atomic_read(&cheri_bounds_reset_gen);
+    CheriBoundsPC *entry;
+    uint64_t pc;
+
+    if (unlikely(shard->reset_gen != reset_gen)) {
+        /* Events counted before the reset. */
+        atomic_set(&shard->skipped, 0);
+        atomic_set(&shard->reset_gen, reset_gen);
+    }
+    if (shard->countdown > 1) {
+        shard->countdown--;
+        atomic_set(&shard->skipped, shard->skipped + 1);
+        return;
+    }
+    shard->countdown = atomic_read(&cheri_bounds_profile_interval);
+    pc = cpu_get_current_pc(env, retpc, false);
+
+    qemu_mutex_lock(&shard->lock);
+    shard->events += shard->skipped + 1;
+    atomic_set(&shard->skipped, 0);
+    shard->sampled++;
+    entry = g_hash_table_lookup(shard->pcs, &pc);
+    if (!entry) {
+        entry = g_new0(CheriBoundsPC, 1);
+        entry->pc = pc;
+        g_hash_table_insert(shard->pcs, &entry->pc, entry);
+    }
+    entry->counts[event]++;
+    entry->max_distance = MAX(entry->max_distance, distance);
+    qemu_mutex_unlock(&shard->lock);
+}
+
+#ifndef CONFIG_USER_ONLY
+
+/* The counts of all vCPUs for one PC. */
+typedef struct CheriBoundsResult {
+    CheriBoundsPC entry;
+    /* vCPUs that recorded events at this PC, in cpu_index order */
+    intList *cpus;
+    intList **cpus_tail;
+} CheriBoundsResult;
+
+static uint64_t cheri_bounds_total(const CheriBoundsPC *entry)
+{
+    uint64_t total = 0;
+
+    for (int i = 0; i < CHERI_BOUNDS_NUM_EVENTS; i++) {
+        total += entry->counts[i];
+    }
+    return total;
+}
+
+static gint cheri_bounds_result_cmp(gconstpointer a, gconstpointer b)
+{
+    const CheriBoundsResult *ra = *(CheriBoundsResult *const *)a;
+    const CheriBoundsResult *rb = *(CheriBoundsResult *const *)b;
+    uint64_t ta = cheri_bounds_total(&ra->entry);
+    uint64_t tb = cheri_bounds_total(&rb->entry);
+
+    if (ta != tb) {
+        return ta > tb ? -1 : 1;
+    }
+    if (ra->entry.pc != rb->entry.pc) {
+        return ra->entry.pc < rb->entry.pc ? -1 : 1;
+    }
+    return 0;
+}
+
+/* Add @entry, recorded by vCPU @cpu, to the result for its PC. */
+static void cheri_bounds_merge(GHashTable *merged, const CheriBoundsPC *entry,
+                               int cpu)
+{
+    CheriBoundsResult *r = g_hash_table_lookup(merged, &entry->pc);
+    intList *cpu_elem = g_new0(intList, 1);
+
+    if (!r) {
+        r = g_new0(CheriBoundsResult, 1);
+        r->entry.pc = entry->pc;
+        r->cpus_tail = &r->cpus;
+        g_hash_table_insert(merged, &r->entry.pc, r);
+    }
+    for (int i = 0; i < CHERI_BOUNDS_NUM_EVENTS; i++) {
+        r->entry.counts[i] += entry->counts[i];
+    }
+    r->entry.max_distance = MAX(r->entry.max_distance, entry->max_distance);
+    /* Each shard has one entry per PC and CPU_FOREACH is in index order. */
+    cpu_elem->value = cpu;
+    *r->cpus_tail = cpu_elem;
+    r->cpus_tail = &cpu_elem->next;
+}
+
+static void cheri_bounds_result_free(gpointer data)
+{
+    CheriBoundsResult *r = data;
+
+    qapi_free_intList(r->cpus);
+    g_free(r);
+}
+
+CheriBoundsStats *qmp_query_cheri_bounds(bool has_limit, int64_t limit,
+                                         Error **errp)
+{
+    CheriBoundsStats *stats;
+    CheriBoundsPCInfoList *head = NULL;
+    g_autoptr(GHashTable) merged = NULL;
+    g_autoptr(GPtrArray) results = NULL;
+    GHashTableIter iter;
+    CheriBoundsResult *r;
+    uint32_t reset_gen;
+    CPUState *cs;
+
+    if (has_limit && limit < 0) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "limit",
+                   "a non-negative value");
+        return NULL;
+    }
+
+    stats = g_new0(CheriBoundsStats, 1);
+    stats->enabled = atomic_read(&cheri_bounds_profile_enabled);
+    stats->sample_interval = atomic_read(&cheri_bounds_profile_interval);
+    merged = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+                                   cheri_bounds_result_free);
+    reset_gen = atomic_read(&cheri_bounds_reset_gen);
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cs) {
+        CheriBoundsShard *shard = atomic_rcu_read(&cs->cheri_bounds);
+        CheriBoundsPC *entry;
+
+        if (!shard) {
+            continue;
+        }
+        qemu_mutex_lock(&shard->lock);
+        stats->events += shard->events;
+        /* Unsampled events, unless they predate the last reset */
+        if (atomic_read(&shard->reset_gen) == reset_gen) {
+            stats->events += atomic_read(&shard->skipped);
+        }
+        stats->sampled += shard->sampled;
+        g_hash_table_iter_init(&iter, shard->pcs);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+            cheri_bounds_merge(merged, entry, cs->cpu_index);
+        }
+        qemu_mutex_unlock(&shard->lock);
+    }
+
+    /* Sort and limit the totals over all vCPUs. */
+    results = g_ptr_array_sized_new(g_hash_table_size(merged));
+    g_hash_table_iter_init(&iter, merged);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&r)) {
+        g_ptr_array_add(results, r);
+    }
+    g_ptr_array_sort(results, cheri_bounds_result_cmp);
+    if (has_limit && results->len > limit) {
+        g_ptr_array_set_size(results, limit);
+    }
+    /* Build the list back to front to keep the sort order. */
+    for (guint i = results->len; i > 0; i--) {
+        CheriBoundsPCInfoList *elem = g_new0(CheriBoundsPCInfoList, 1);
+        CheriBoundsPCInfo *info = g_new0(CheriBoundsPCInfo, 1);
+
+        r = g_ptr_array_index(results, i - 1);
+        info->cpus = r->cpus;
+        r->cpus = NULL;
+        info->pc = r->entry.pc;
+        info->one_past_end = r->entry.counts[CHERI_BOUNDS_ONE_PAST_END];
+        info->after_bounds = r->entry.counts[CHERI_BOUNDS_AFTER];
+        info->before_bounds = r->entry.counts[CHERI_BOUNDS_BEFORE];
+        info->unrepresentable = r->entry.counts[CHERI_BOUNDS_UNREPRESENTABLE];
+        info->max_distance = r->entry.max_distance;
+        elem->value = info;
+        elem->next = head;
+        head = elem;
+    }
+    stats->pcs = head;
+    return stats;
+}
+
+static void cheri_bounds_reset(void)
+{
+    CPUState *cs;
+
+    /* Makes the vCPUs drop the events they have not sampled yet. */
+    atomic_inc(&cheri_bounds_reset_gen);
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cs) {
+        CheriBoundsShard *shard = atomic_rcu_read(&cs->cheri_bounds);
+
+        if (!shard) {
+            continue;
+        }
+        qemu_mutex_lock(&shard->lock);
+        g_hash_table_remove_all(shard->pcs);
+        shard->events = 0;
+        shard->sampled = 0;
+        qemu_mutex_unlock(&shard->lock);
+    }
+}
+
+void qmp_cheri_bounds_profile(bool enable, bool has_sample_interval,
+                              uint32_t sample_interval, bool has_reset,
+                              bool reset, Error **errp)
+{
+    if (has_sample_interval) {
+        if (sample_interval == 0) {
+            error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "sample-interval",
+                       "a positive value");
+            return;
+        }
+        atomic_set(&cheri_bounds_profile_interval, sample_interval);
+    }
+    if (has_reset && reset) {
+        cheri_bounds_reset();
+    }
+    atomic_set(&cheri_bounds_profile_enabled, enable);
+}
+
+void hmp_info_cheri_bounds(Monitor *mon, const QDict *qdict)
+{
+    int64_t max = qdict_get_try_int(qdict, "max", 10);
+    Error *err = NULL;
+    CheriBoundsStats *stats = qmp_query_cheri_bounds(true, max, &err);
+    CheriBoundsPCInfoList *l;
+
+    if (err) {
+        hmp_handle_error(mon, err);
+        return;
+    }
+    monitor_printf(mon, "cheri-bounds-profile is %s, sampling 1 in %" PRIu32
+                   "\n", stats->enabled ? "on" : "off",
+                   stats->sample_interval);
+    monitor_printf(mon, "%" PRIu64 " events, %" PRIu64 " sampled\n",
+                   stats->events, stats->sampled);
+    if (stats->pcs) {
+        monitor_printf(mon, "%-18s %10s %10s %10s %10s %10s  %s\n", "PC",
+                       "past-end", "after", "before", "unrep", "max-dist",
+                       "CPUs");
+    }
+    for (l = stats->pcs; l; l = l->next) {
+        CheriBoundsPCInfo *info = l->value;
+        intList *cpu;
+
+        monitor_printf(mon, "0x%016" PRIx64 " %10" PRIu64 " %10" PRIu64
+                       " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " ",
+                       info->pc, info->one_past_end, info->after_bounds,
+                       info->before_bounds, info->unrepresentable,
+                       info->max_distance);
+        for (cpu = info->cpus; cpu; cpu = cpu->next) {
+            monitor_printf(mon, "%s%" PRId64, cpu == info->cpus ? " " : ",",
+                           cpu->value);
+        }
+        monitor_printf(mon, "\n");
+    }
+    qapi_free_CheriBoundsStats(stats);
+}
+
+void hmp_cheri_bounds_profile(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_try_str(qdict, "op");
+    bool has_interval = qdict_haskey(qdict, "interval");
+    int64_t interval = qdict_get_try_int(qdict, "interval", 1);
+    Error *err = NULL;
+
+    if (has_interval && (interval <= 0 || interval > UINT32_MAX)) {
+        error_setg(&err, QERR_INVALID_PARAMETER_VALUE, "interval",
+                   "a positive 32-bit value");
+    } else if (op == NULL) {
+        monitor_printf(mon, "cheri-bounds-profile is %s, sampling 1 in %"
+                       PRIu32 "\n",
+                       atomic_read(&cheri_bounds_profile_enabled) ? "on"
+                                                                  : "off",
+                       atomic_read(&cheri_bounds_profile_interval));
+        return;
+    } else if (!strcmp(op, "on")) {
+        qmp_cheri_bounds_profile(true, has_interval, interval, false, false,
+                                 &err);
+    } else if (!strcmp(op, "off")) {
+        qmp_cheri_bounds_profile(false, has_interval, interval, false, false,
+                                 &err);
+    } else if (!strcmp(op, "reset")) {
+        qmp_cheri_bounds_profile(atomic_read(&cheri_bounds_profile_enabled),
+                                 has_interval, interval, true, true, &err);
+    } else {
+        error_setg(&err, QERR_INVALID_PARAMETER, op);
+    }
+    hmp_handle_error(mon, err);
+}
+
+#endif /* !CONFIG_USER_ONLY */
@@ -143,6 +143,12 @@ typedef enum CheriTbFlags {
      * PCC spans the full adddress space and has base zero. This means we do
      * not need to perform bounds checks or subtract/add PCC.base
      */
-    TB_FLAG_PCC_FULL_AS = (1 << 7)
+    TB_FLAG_PCC_FULL_AS = (1 << 7),
+    /*
+     * The TB is shared between all PCCs with the same base (-cheri-shared-tbs)
+     * and tb->cs_top is zero. The top of PCC is checked against the live PCC
+     * on TB entry instead of at translate time.
+     */
+    TB_FLAG_PCC_TOP_DYNAMIC = (1 << 8),
 } CheriTbFlags;
 #endif // TARGET_CHERI
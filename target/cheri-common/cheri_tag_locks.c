@@ -0,0 +1,117 @@
+/*
+ * CHERI tag memory locking
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/seqlock.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "cheri_tagmem.h"
+
+/*
+ * Striped locks used to make the data and tag update of a capability store
+ * atomic with respect to capability loads. Writers serialize on the spinlock
+ * and readers retry if the sequence count changed. They are keyed on the host
+ * address of the capability, so all vCPUs agree on the stripe for a given
+ * guest physical address. Only needed if vCPUs run in parallel: with MTTCG
+ * and for guest threads in user mode.
+ */
+#define CHERI_TAG_LOCK_STRIPES 1024
+typedef struct CheriTagLockStripe {
+    QemuSpin lock;
+    QemuSeqLock seq;
+} QEMU_ALIGNED(64) CheriTagLockStripe;
+static CheriTagLockStripe cheri_tag_lock_stripes[CHERI_TAG_LOCK_STRIPES];
+
+static inline bool cheri_tag_need_locks(void)
+{
+#ifdef CONFIG_USER_ONLY
+    return parallel_cpus;
+#else
+    return qemu_tcg_mttcg_enabled();
+#endif
+}
+
+static inline CheriTagLockStripe *cheri_tag_lock_stripe(const void *host)
+{
+    return &cheri_tag_lock_stripes[((uintptr_t)host / CHERI_CAP_SIZE) %
+                                   CHERI_TAG_LOCK_STRIPES];
+}
+
+void cheri_tag_writer_lock(const void *host)
+{
+    if (cheri_tag_need_locks()) {
+        CheriTagLockStripe *stripe = cheri_tag_lock_stripe(host);
+        seqlock_write_lock(&stripe->seq, &stripe->lock);
+    }
+}
+
+void cheri_tag_writer_unlock(const void *host)
+{
+    if (cheri_tag_need_locks()) {
+        CheriTagLockStripe *stripe = cheri_tag_lock_stripe(host);
+        seqlock_write_unlock(&stripe->seq, &stripe->lock);
+    }
+}
+
+/*
+ * An unaligned data store may overlap two capabilities. Take both stripes,
+ * lowest first, so that two such stores cannot deadlock. The stripes are
+ * adjacent granules, so this is address order unless the index wraps.
+ */
+static inline void cheri_tag_lock_stripes_range(const void *host, size_t size,
+                                                CheriTagLockStripe **first,
+                                                CheriTagLockStripe **last)
+{
+    cheri_debug_assert(size > 0 && size <= CHERI_CAP_SIZE);
+    *first = cheri_tag_lock_stripe(host);
+    *last = cheri_tag_lock_stripe((const char *)host + size - 1);
+    if (*last < *first) {
+        CheriTagLockStripe *tmp = *first;
+        *first = *last;
+        *last = tmp;
+    }
+}
+
+void cheri_tag_writer_lock_range(const void *host, size_t size)
+{
+    if (cheri_tag_need_locks()) {
+        CheriTagLockStripe *first, *last;
+        cheri_tag_lock_stripes_range(host, size, &first, &last);
+        seqlock_write_lock(&first->seq, &first->lock);
+        if (last != first) {
+            seqlock_write_lock(&last->seq, &last->lock);
+        }
+    }
+}
+
+void cheri_tag_writer_unlock_range(const void *host, size_t size)
+{
+    if (cheri_tag_need_locks()) {
+        CheriTagLockStripe *first, *last;
+        cheri_tag_lock_stripes_range(host, size, &first, &last);
+        if (last != first) {
+            seqlock_write_unlock(&last->seq, &last->lock);
+        }
+        seqlock_write_unlock(&first->seq, &first->lock);
+    }
+}
+
+unsigned cheri_tag_reader_begin(const void *host)
+{
+    if (cheri_tag_need_locks()) {
+        return seqlock_read_begin(&cheri_tag_lock_stripe(host)->seq);
+    }
+    return 0;
+}
+
+bool cheri_tag_reader_retry(const void *host, unsigned start)
+{
+    if (cheri_tag_need_locks()) {
+        return seqlock_read_retry(&cheri_tag_lock_stripe(host)->seq, start);
+    }
+    return false;
+}
@@ -33,13 +33,18 @@
  */
 #include "cheri_tagmem.h"
 #include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
 #include "exec/log.h"
 #include "exec/ramblock.h"
 #include "cheri_tagmem.h"
+#include "cheri_tagstore.h"
 #include "cheri-helper-utils.h"
-// XXX: use hbitmap? Or a different data structure?
 #include "qemu/bitmap.h"
-#include "glib/ghash.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/plugin.h"
+#include "migration/qemu-file.h"
+#include "migration/register.h"
 
 #if defined(TARGET_MIPS)
 #include "cheri_utils.h"
@@ -59,13 +64,15 @@
  * capability-sized word in physical memory.  This allows capabilities
  * to be safely loaded and stored in meory without loss of integrity.
  *
- * For emulation purposes the tag is an one-byte flag.  This makes it
- * easy to set or unset a tag without the need of locking or atomics.
- * This requires eight times the memory, however.  To reduce the amount
- * of memory needed the tag flag array is allocated sparsely, 4K at at
- * time, and on demand.
+ * For emulation purposes the tags are stored in a bitmap and updated using
+ * atomic bit operations. To reduce the amount of memory needed the tag
+ * bitmap is allocated sparsely, 4K tags at a time, and on demand, unless
+ * -cheri-tagmem-flat selects a single bitmap per RAMBlock (see
+ * cheri_tagstore.h).
  *
- * FIXME: find a solution to make this safe (or just always disable multi-tcg)
+ * With MTTCG, capability stores additionally take a striped lock (see
+ * cheri_tag_writer_lock()) so that capability loads on other vCPUs never
+ * observe a new tag together with stale data or vice versa.
  *
  * XXX Should consider adding a reference count per tag block so that
  * blocks can be deallocated when no longer used maybe.
@@ -80,18 +87,26 @@
 #endif /* !(CHERI_MAGIC128 || CHERI_128) */
 #define CAP_SIZE            (1 << CAP_TAG_SHFT)
 #define CAP_MASK            ((1 << CAP_TAG_SHFT) - 1)
-#define CAP_TAGBLK_SHFT     12          // 2^12 or 4096 tags per block
-#define CAP_TAGBLK_MSK      ((1 << CAP_TAGBLK_SHFT) - 1)
-#define CAP_TAGBLK_SIZE       (1 << CAP_TAGBLK_SHFT)
-#define CAP_TAGBLK_IDX(tag_idx) ((tag_idx) & CAP_TAGBLK_MSK)
+#define CAP_TAGBLK_SHFT     CHERI_TAGBLK_SHFT
+#define CAP_TAGBLK_SIZE     CHERI_TAGBLK_SIZE
+#define CAP_TAGBLK_IDX(tag_idx) CHERI_TAGBLK_IDX(tag_idx)
 #ifdef CHERI_MAGIC128
-// "Magic" table to store the additional 128 metadata bits for the magic128
-// configuration of QEMU
-static GHashTable *magic128_table;
+// Side table for the additional 128 metadata bits of the magic128
+// configuration. ram->cheri_magic128 points to one lazily allocated block of
+// entries per guest page, indexed by tag index. A block is freed again once
+// the last tag in its page is cleared, so memory use follows the number of
+// pages holding tagged capabilities. Entries are only valid if the
+// corresponding tag is set.
+#define MAGIC128_BLK_SHFT   8           // 256 entries (4K of guest memory)
+#define MAGIC128_BLK_SIZE   (1 << MAGIC128_BLK_SHFT)
+#define MAGIC128_BLK_MSK    (MAGIC128_BLK_SIZE - 1)
 struct Magic128Data {
     uint64_t tps;    // type, permissions, sealed
     uint64_t length; // length of capability
 };
+typedef struct CheriMagic128Block {
+    struct Magic128Data data[MAGIC128_BLK_SIZE];
+} CheriMagic128Block;
 #endif
 
 static inline size_t num_tagblocks(RAMBlock* ram)
@@ -102,113 +117,370 @@ static inline size_t num_tagblocks(RAMBlock* ram)
     return result;
 }
 
-#define TAGMEM_USE_BITMAP 1
-#if TAGMEM_USE_BITMAP
-// Use one bit per tag:
-typedef struct CheriTagBlock {
-    DECLARE_BITMAP(tag_bitmap, CAP_TAGBLK_SIZE);
-} CheriTagBlock;
-#else
-// Use one byte per tag:
-typedef struct CheriTagBlock {
-    uint8_t _tags[CAP_TAGBLK_SIZE];
-} CheriTagBlock;
-#endif
-
-static CheriTagBlock *cheri_tag_new_tagblk(RAMBlock *ram, uint64_t tagidx)
+/*
+ * Stores to pages without a tag block stay in generated code since there is
+ * nothing to invalidate (see tlb_set_page_with_attrs()). This is no longer
+ * true once a block is allocated, so flush all TLBs and let the refill mark
+ * the entries for its pages with TLB_CHERI_TAGS.
+ */
+static void cheri_tag_block_allocated_notify(void)
 {
-    CheriTagBlock *tagblk, *old;
-
-    tagblk = g_malloc0(sizeof(CheriTagBlock));
-    if (tagblk == NULL) {
-        error_report("Can't allocate tag block.");
-        exit(1);
-    }
+    CPUState *cpu;
 
-    CheriTagBlock **tagmem = (CheriTagBlock **)ram->cheri_tags;
-    size_t tagblock_index = (tagidx >> CAP_TAGBLK_SHFT);
-    /* Possible race here so use atomic compare and swap. */
-    cheri_debug_assert(tagblock_index < num_tagblocks(ram) &&
-                       "Tag index out of bounds");
-    old = atomic_cmpxchg(&tagmem[tagblock_index], NULL, tagblk);
-    if (old != NULL) {
-        /* Lost the race, free. */
-        g_free(tagblk);
-        return old;
-    } else {
-        return tagblk;
+    CPU_FOREACH(cpu) {
+        tlb_flush(cpu);
     }
 }
 
 static inline QEMU_ALWAYS_INLINE CheriTagBlock *cheri_tag_block(size_t tag_index,
                                                                 RAMBlock *ram)
 {
-    const size_t tagbock_index = tag_index >> CAP_TAGBLK_SHFT;
     cheri_debug_assert(ram->cheri_tags);
-    cheri_debug_assert(tagbock_index < num_tagblocks(ram));
-    CheriTagBlock **tagmem = (CheriTagBlock **)ram->cheri_tags;
-    return tagmem[tagbock_index];
+    cheri_debug_assert((tag_index >> CAP_TAGBLK_SHFT) < num_tagblocks(ram));
+    return cheri_tag_store_block(ram->cheri_tags, tag_index);
+}
+
+static inline bool cheri_tag_block_allocated(RAMBlock *ram, size_t blk)
+{
+    return cheri_tag_block(blk << CAP_TAGBLK_SHFT, ram) != NULL;
 }
 
 static inline QEMU_ALWAYS_INLINE bool tagblock_get_tag(CheriTagBlock *block,
                                                        size_t block_index)
 {
-#if TAGMEM_USE_BITMAP
     return block ? test_bit(block_index, block->tag_bitmap) : false;
-#else
-    return block ? block->_tags[block_index] : false;
-#endif
 }
 
-static inline QEMU_ALWAYS_INLINE void tagblock_set_tag(CheriTagBlock *block,
-                                                       size_t block_index)
+/*
+ * Set while a migration (or savevm) is running so that modified tag blocks
+ * are sent again. See cheri_tags_save_setup(). Generated code that sets tags
+ * directly checks this flag and uses the helper if it is set.
+ */
+bool cheri_tags_dirty_log;
+
+static inline QEMU_ALWAYS_INLINE void tagblock_mark_dirty(RAMBlock *ram,
+                                                          size_t tag_index)
 {
-#if TAGMEM_USE_BITMAP
-    set_bit(block_index, block->tag_bitmap);
+    if (unlikely(atomic_read(&cheri_tags_dirty_log))) {
+        set_bit_atomic(tag_index >> CAP_TAGBLK_SHFT, ram->cheri_tags_dirty);
+    }
+}
+
+static inline QEMU_ALWAYS_INLINE bool tag_bit_get(size_t index, RAMBlock *ram)
+{
+    return tagblock_get_tag(cheri_tag_block(index, ram), CAP_TAGBLK_IDX(index));
+}
+
+static inline QEMU_ALWAYS_INLINE void tag_bit_set(size_t index, RAMBlock *ram)
+{
+    cheri_debug_assert((index >> CAP_TAGBLK_SHFT) < num_tagblocks(ram));
+    // The block has normally been allocated by cheri_tag_block_prepare().
+    if (unlikely(cheri_tag_store_set(ram->cheri_tags, index))) {
+        cheri_tag_block_allocated_notify();
+    }
+    tagblock_mark_dirty(ram, index);
+}
+
+void **cheri_tag_page_block_slot(RAMBlock *ram, ram_addr_t offset,
+                                 uint32_t *word_ofs)
+{
+#if HOST_LONG_BITS == 64 && !defined(CHERI_MAGIC128)
+    // Generated code indexes the page's tags with 64-bit loads
+    QEMU_BUILD_BUG_ON((TARGET_PAGE_SIZE >> CAP_TAG_SHFT) % BITS_PER_LONG);
+    size_t tag_idx = QEMU_ALIGN_DOWN(offset, TARGET_PAGE_SIZE) >> CAP_TAG_SHFT;
+
+    // Only the sparse layout has a block pointer for generated code to load.
+    if (!ram->cheri_tags || cheri_tag_store_is_flat(ram->cheri_tags)) {
+        return NULL;
+    }
+    cheri_debug_assert((tag_idx >> CAP_TAGBLK_SHFT) < num_tagblocks(ram));
+    *word_ofs = BIT_WORD(CAP_TAGBLK_IDX(tag_idx)) * sizeof(unsigned long);
+    return (void **)&ram->cheri_tags->blocks[tag_idx >> CAP_TAGBLK_SHFT];
 #else
-    block->_tags[block_index] = true;
+    return NULL;
 #endif
 }
 
-static inline QEMU_ALWAYS_INLINE void tagblock_clear_tag(CheriTagBlock *block,
-                                                         size_t block_index)
+bool cheri_tag_page_may_have_tags(RAMBlock *ram, ram_addr_t offset)
 {
-#if TAGMEM_USE_BITMAP
-    clear_bit(block_index, block->tag_bitmap);
-#else
-    block->_tags[block_index] = false;
+    // A page never spans multiple tag blocks
+    QEMU_BUILD_BUG_ON(TARGET_PAGE_SIZE > (CAP_TAGBLK_SIZE << CAP_TAG_SHFT));
+    return cheri_tag_block_allocated(ram,
+                                     offset >> (CAP_TAG_SHFT + CAP_TAGBLK_SHFT));
+}
+
+static void tag_block_mark_dirty(void *opaque, size_t blk)
+{
+    tagblock_mark_dirty(opaque, blk << CAP_TAGBLK_SHFT);
+}
+
+/*
+ * Clear @count tags starting at tag index @start. This works on whole tag
+ * blocks at a time and skips unallocated blocks. Blocks are zeroed rather
+ * than freed since other vCPUs may be accessing them without a lock.
+ * Returns true if any tag was previously set.
+ */
+static bool tag_bit_range_clear(RAMBlock *ram, size_t start, size_t count)
+{
+    cheri_debug_assert(start + count <= num_tagblocks(ram) * CAP_TAGBLK_SIZE);
+    return cheri_tag_store_clear_range(ram->cheri_tags, start, count,
+                                       tag_block_mark_dirty, ram);
+}
+
+/*
+ * Migration of tag memory.
+ *
+ * Tags are sent in a separate section after RAM. Only allocated tag blocks
+ * are sent, each as a little-endian bitmap. While migration is active every
+ * tag update marks its tag block in ram->cheri_tags_dirty so that the block
+ * is sent again in a later iteration (or in the final pass).
+ *
+ * Stream format, repeated until CHERI_TAGS_FLAG_EOS:
+ *   be64 flags
+ *   if CHERI_TAGS_FLAG_BLOCK: counted RAMBlock idstr, be64 tag block index,
+ *                             CAP_TAGBLK_SIZE / 8 bytes of tag bitmap
+ *   if CHERI_TAGS_FLAG_MAGIC128: counted RAMBlock idstr, be64 side table
+ *                                block index, MAGIC128_BLK_SIZE pairs of
+ *                                be64 tps and be64 length
+ * CHERI_TAGS_FLAG_RESET (sent once in the setup phase) makes the destination
+ * drop all tags, since loadvm may restore into a VM that already has tags.
+ * With CHERI_MAGIC128 each tag block is followed by the allocated side table
+ * blocks it covers. Writing a side table entry always sets its tag as well,
+ * so the tag block dirty bitmap also tracks changes to the side table.
+ */
+#define CHERI_TAGS_FLAG_RESET   0x1
+#define CHERI_TAGS_FLAG_BLOCK   0x2
+#define CHERI_TAGS_FLAG_EOS     0x4
+#define CHERI_TAGS_FLAG_MAGIC128 0x8
+
+static GSList *tagged_ram_blocks;
+
+#ifdef CHERI_MAGIC128
+static inline size_t num_magic128_blocks(RAMBlock *ram)
+{
+    return num_tagblocks(ram) << (CAP_TAGBLK_SHFT - MAGIC128_BLK_SHFT);
+}
+
+static void cheri_tags_put_magic128(QEMUFile *f, RAMBlock *ram, size_t blk)
+{
+    size_t first = blk << (CAP_TAGBLK_SHFT - MAGIC128_BLK_SHFT);
+    size_t last = first + (CAP_TAGBLK_SIZE >> MAGIC128_BLK_SHFT);
+
+    for (size_t i = first; i < last; i++) {
+        CheriMagic128Block *mblk = ram->cheri_magic128[i];
+        if (!mblk) {
+            continue;
+        }
+        qemu_put_be64(f, CHERI_TAGS_FLAG_MAGIC128);
+        qemu_put_counted_string(f, ram->idstr);
+        qemu_put_be64(f, i);
+        for (size_t j = 0; j < MAGIC128_BLK_SIZE; j++) {
+            qemu_put_be64(f, mblk->data[j].tps);
+            qemu_put_be64(f, mblk->data[j].length);
+        }
+    }
+}
+
+static int cheri_tags_load_magic128(QEMUFile *f)
+{
+    char idstr[256];
+
+    qemu_get_counted_string(f, idstr);
+    uint64_t blk = qemu_get_be64(f);
+    RAMBlock *ram = qemu_ram_block_by_name(idstr);
+    if (!ram || !ram->cheri_magic128 || blk >= num_magic128_blocks(ram)) {
+        error_report("%s: no magic128 table for block %" PRIu64 " of '%s'",
+                     __func__, blk, idstr);
+        return -EINVAL;
+    }
+    CheriMagic128Block **blkp = &ram->cheri_magic128[blk];
+    if (!*blkp) {
+        *blkp = g_new(CheriMagic128Block, 1);
+    }
+    for (size_t j = 0; j < MAGIC128_BLK_SIZE; j++) {
+        (*blkp)->data[j].tps = qemu_get_be64(f);
+        (*blkp)->data[j].length = qemu_get_be64(f);
+    }
+    return qemu_file_get_error(f);
+}
+#endif
+
+static void cheri_tags_put_block(QEMUFile *f, RAMBlock *ram, size_t blk)
+{
+    CheriTagBlock *block = cheri_tag_block(blk << CAP_TAGBLK_SHFT, ram);
+    DECLARE_BITMAP(tags, CAP_TAGBLK_SIZE);
+
+    bitmap_to_le(tags, block->tag_bitmap, CAP_TAGBLK_SIZE);
+    qemu_put_be64(f, CHERI_TAGS_FLAG_BLOCK);
+    qemu_put_counted_string(f, ram->idstr);
+    qemu_put_be64(f, blk);
+    qemu_put_buffer(f, (uint8_t *)tags, sizeof(tags));
+#ifdef CHERI_MAGIC128
+    cheri_tags_put_magic128(f, ram, blk);
 #endif
 }
 
-static inline QEMU_ALWAYS_INLINE bool tag_bit_get(size_t index, RAMBlock *ram)
+/* Send dirty tag blocks. Returns 1 if all of them have been sent. */
+static int cheri_tags_save_dirty(QEMUFile *f, bool final)
 {
-    return tagblock_get_tag(cheri_tag_block(index, ram), CAP_TAGBLK_IDX(index));
+    for (GSList *l = tagged_ram_blocks; l; l = l->next) {
+        RAMBlock *ram = l->data;
+        size_t nblocks = num_tagblocks(ram);
+        size_t blk = find_first_bit(ram->cheri_tags_dirty, nblocks);
+        for (; blk < nblocks;
+             blk = find_next_bit(ram->cheri_tags_dirty, nblocks, blk + 1)) {
+            if (!final && qemu_file_rate_limit(f)) {
+                return 0;
+            }
+            // Clear before sending so that concurrent updates resend it.
+            if (bitmap_test_and_clear_atomic(ram->cheri_tags_dirty, blk, 1)) {
+                cheri_tags_put_block(f, ram, blk);
+            }
+        }
+    }
+    return 1;
 }
 
-static inline QEMU_ALWAYS_INLINE void tag_bit_set(size_t index, RAMBlock *ram)
+static int cheri_tags_save_setup(QEMUFile *f, void *opaque)
 {
-    CheriTagBlock *block = cheri_tag_block(index, ram);
-    if (!block) {
-        block = cheri_tag_new_tagblk(ram, index);
+    qemu_put_be64(f, CHERI_TAGS_FLAG_RESET);
+    /*
+     * Enable logging before scanning so that a block allocated concurrently
+     * is marked by tag_bit_set() if the scan misses it.
+     */
+    atomic_set(&cheri_tags_dirty_log, true);
+    smp_mb();
+    for (GSList *l = tagged_ram_blocks; l; l = l->next) {
+        RAMBlock *ram = l->data;
+        size_t nblocks = num_tagblocks(ram);
+        for (size_t blk = 0; blk < nblocks; blk++) {
+            CheriTagBlock *block = cheri_tag_block(blk << CAP_TAGBLK_SHFT, ram);
+            // With the flat layout all blocks exist, only send the ones that
+            // have tags.
+            if (block && (!cheri_tag_store_is_flat(ram->cheri_tags) ||
+                          !bitmap_empty(block->tag_bitmap, CAP_TAGBLK_SIZE))) {
+                set_bit_atomic(blk, ram->cheri_tags_dirty);
+            }
+        }
     }
-    tagblock_set_tag(block, CAP_TAGBLK_IDX(index));
+    qemu_put_be64(f, CHERI_TAGS_FLAG_EOS);
+    return qemu_file_get_error(f);
 }
-static inline QEMU_ALWAYS_INLINE void tag_bit_clear(size_t index, RAMBlock *ram)
+
+static int cheri_tags_save_iterate(QEMUFile *f, void *opaque)
+{
+    int ret = cheri_tags_save_dirty(f, false);
+    qemu_put_be64(f, CHERI_TAGS_FLAG_EOS);
+    return qemu_file_get_error(f) ?: ret;
+}
+
+static int cheri_tags_save_complete(QEMUFile *f, void *opaque)
+{
+    cheri_tags_save_dirty(f, true);
+    qemu_put_be64(f, CHERI_TAGS_FLAG_EOS);
+    return qemu_file_get_error(f);
+}
+
+static void cheri_tags_save_pending(QEMUFile *f, void *opaque,
+                                    uint64_t max_size,
+                                    uint64_t *res_precopy_only,
+                                    uint64_t *res_compatible,
+                                    uint64_t *res_postcopy_only)
 {
-    CheriTagBlock *block = cheri_tag_block(index, ram);
-    if (block) {
-        tagblock_clear_tag(block, CAP_TAGBLK_IDX(index));
+    for (GSList *l = tagged_ram_blocks; l; l = l->next) {
+        RAMBlock *ram = l->data;
+        *res_precopy_only +=
+            bitmap_count_one(ram->cheri_tags_dirty, num_tagblocks(ram)) *
+            (CAP_TAGBLK_SIZE / BITS_PER_BYTE);
     }
 }
-//static inline QEMU_ALWAYS_INLINE void
-//tag_bit_range_clear(RAMBlock *ram, size_t start, size_t count)
-//{
-//    cheri_debug_assert(start + count < num_tagblocks(ram) * CAP_TAGBLK_SIZE);
-//    for (size_t i = start; i < start + count; i++) {
-//        // TODO: use memset/bitmap_clear_range for individual tag blocks
-//        tag_bit_clear(i, ram);
-//    }
-//}
+
+static void cheri_tags_save_cleanup(void *opaque)
+{
+    atomic_set(&cheri_tags_dirty_log, false);
+}
+
+static bool cheri_tags_is_active(void *opaque)
+{
+    return tagged_ram_blocks != NULL;
+}
+
+static int cheri_tags_load(QEMUFile *f, void *opaque, int version_id)
+{
+    DECLARE_BITMAP(tags, CAP_TAGBLK_SIZE);
+    char idstr[256];
+
+    for (;;) {
+        uint64_t flags = qemu_get_be64(f);
+        int ret = qemu_file_get_error(f);
+        if (ret) {
+            return ret;
+        }
+        if (flags & CHERI_TAGS_FLAG_EOS) {
+            return 0;
+        }
+        if (flags == CHERI_TAGS_FLAG_RESET) {
+            for (GSList *l = tagged_ram_blocks; l; l = l->next) {
+                RAMBlock *ram = l->data;
+                cheri_tag_store_reset(ram->cheri_tags);
+#ifdef CHERI_MAGIC128
+                for (size_t i = 0; i < num_magic128_blocks(ram); i++) {
+                    g_free(ram->cheri_magic128[i]);
+                    ram->cheri_magic128[i] = NULL;
+                }
+#endif
+            }
+            continue;
+        }
+#ifdef CHERI_MAGIC128
+        if (flags == CHERI_TAGS_FLAG_MAGIC128) {
+            ret = cheri_tags_load_magic128(f);
+            if (ret) {
+                return ret;
+            }
+            continue;
+        }
+#endif
+        if (flags != CHERI_TAGS_FLAG_BLOCK) {
+            error_report("%s: unknown flags 0x%" PRIx64, __func__, flags);
+            return -EINVAL;
+        }
+        qemu_get_counted_string(f, idstr);
+        uint64_t blk = qemu_get_be64(f);
+        qemu_get_buffer(f, (uint8_t *)tags, sizeof(tags));
+        RAMBlock *ram = qemu_ram_block_by_name(idstr);
+        if (!ram || !ram->cheri_tags || blk >= num_tagblocks(ram)) {
+            error_report("%s: no tag memory for block %" PRIu64 " of '%s'",
+                         __func__, blk, idstr);
+            return -EINVAL;
+        }
+        bitmap_from_le(tags, tags, CAP_TAGBLK_SIZE);
+        size_t first_tag = blk << CAP_TAGBLK_SHFT;
+        CheriTagBlock *block = cheri_tag_block(first_tag, ram);
+        if (!block) {
+            bool allocated;
+            if (bitmap_empty(tags, CAP_TAGBLK_SIZE)) {
+                continue;
+            }
+            block = cheri_tag_store_get_block(ram->cheri_tags, first_tag,
+                                              &allocated);
+            if (allocated) {
+                cheri_tag_block_allocated_notify();
+            }
+        }
+        bitmap_copy(block->tag_bitmap, tags, CAP_TAGBLK_SIZE);
+    }
+}
+
+static SaveVMHandlers savevm_cheri_tags_handlers = {
+    .save_setup = cheri_tags_save_setup,
+    .save_live_iterate = cheri_tags_save_iterate,
+    .save_live_complete_precopy = cheri_tags_save_complete,
+    .save_live_pending = cheri_tags_save_pending,
+    .save_cleanup = cheri_tags_save_cleanup,
+    .load_state = cheri_tags_load,
+    .is_active = cheri_tags_is_active,
+};
 
 void cheri_tag_init(MemoryRegion *mr, uint64_t memory_size)
 {
@@ -218,22 +490,27 @@ void cheri_tag_init(MemoryRegion *mr, uint64_t memory_size)
 
     size_t cheri_ntagblks = num_tagblocks(mr->ram_block);
     mr->ram_block->cheri_tags =
-        g_malloc0(cheri_ntagblks * sizeof(CheriTagBlock *));
+        cheri_tag_store_new(cheri_ntagblks, cheri_tagmem_flat);
     if (mr->ram_block->cheri_tags == NULL) {
         error_report("%s: Can't allocated tag memory", __func__);
         exit(-1);
     }
-#ifdef CHERI_MAGIC128
-    if (!magic128_table) {
-        magic128_table = g_hash_table_new(g_int64_hash, NULL);
+    mr->ram_block->cheri_tags_dirty = bitmap_new(cheri_ntagblks);
+    if (!tagged_ram_blocks) {
+        register_savevm_live("cheri-tags", 0, 1, &savevm_cheri_tags_handlers,
+                             NULL);
     }
-#endif
+    tagged_ram_blocks = g_slist_append(tagged_ram_blocks, mr->ram_block);
+#ifdef CHERI_MAGIC128
+    mr->ram_block->cheri_magic128 =
+        g_new0(CheriMagic128Block *, DIV_ROUND_UP(memory_size >> CAP_TAG_SHFT,
+                                                  MAGIC128_BLK_SIZE));
     if (qemu_tcg_mttcg_enabled()) {
-        warn_report("The CHERI tagged memory implementation is not thread-safe "
-                    "and therefore not compatible with MTTCG. Capability tags "
-                    "may mysteriously appear/disappear. Run with \"--accel "
-                    "tcg,thread=single\" to fix.");
+        warn_report("The CHERI magic128 tagged memory implementation is not "
+                    "thread-safe and therefore not compatible with MTTCG. Run "
+                    "with \"--accel tcg,thread=single\" to fix.");
     }
+#endif
 }
 
 static inline hwaddr v2p_addr(CPUArchState *env, target_ulong vaddr,
@@ -304,6 +581,28 @@ static inline RAMBlock *v2r_addr(CPUArchState *env, target_ulong vaddr,
     return block;
 }
 
+/*
+ * Fast path for tag accesses: the softmmu TLB entry for a page caches the
+ * location of its tag memory, so on a TLB hit we can skip both the
+ * target-specific translation in v2p_addr() and the address_space_translate()
+ * in p2r_addr(). Returns false on a TLB miss or if the page has no tag memory,
+ * in which case the caller must use the slow path (which will also raise any
+ * required exceptions).
+ */
+static inline bool v2r_addr_from_tlb(CPUArchState *env, target_ulong vaddr,
+                                     MMUAccessType rw, RAMBlock **ret_ram,
+                                     ram_addr_t *offset, int *prot)
+{
+    hwaddr ram_offset;
+    if (!tlb_vaddr_to_tagmem(env, vaddr, rw, cpu_mmu_index(env, false),
+                             ret_ram, &ram_offset, prot) ||
+        !*ret_ram) {
+        return false;
+    }
+    *offset = ram_offset;
+    return true;
+}
+
 void cheri_tag_invalidate(CPUArchState *env, target_ulong vaddr, int32_t size,
                           uintptr_t pc)
 {
@@ -343,6 +642,15 @@ void cheri_tag_invalidate(CPUArchState *env, target_ulong vaddr, int32_t size,
         exit(1);
     }
 
+    ram_addr_t offset;
+    RAMBlock *block;
+    int prot;
+    if (likely(v2r_addr_from_tlb(env, vaddr, MMU_DATA_STORE, &block, &offset,
+                                 &prot))) {
+        cheri_tag_phys_invalidate(env, block, offset, size, &vaddr);
+        return;
+    }
+
     /*
      * When resolving this address in the TLB, treat it like a data store
      * (MMU_DATA_STORE) rather than a capability store (MMU_DATA_CAP_STORE),
@@ -355,8 +663,7 @@ void cheri_tag_invalidate(CPUArchState *env, target_ulong vaddr, int32_t size,
     if (unlikely(!host_addr))
         return;
 
-    ram_addr_t offset;
-    RAMBlock *block = qemu_ram_block_from_host(host_addr, false, &offset);
+    block = qemu_ram_block_from_host(host_addr, false, &offset);
     if (unlikely(!block)) {
         // Not backed by RAM?
         error_report("%s: vaddr=0x%jx -> host_addr=%p not backed by RAM?",
@@ -366,6 +673,26 @@ void cheri_tag_invalidate(CPUArchState *env, target_ulong vaddr, int32_t size,
     cheri_tag_phys_invalidate(env, block, offset, size, &vaddr);
 }
 
+#ifdef CHERI_MAGIC128
+/* Free the side table blocks of pages that no longer have any tags set. */
+static void magic128_release_blocks(RAMBlock *ram, size_t first_tag,
+                                    size_t ntags)
+{
+    size_t blk = first_tag >> MAGIC128_BLK_SHFT;
+    size_t last_blk = (first_tag + ntags - 1) >> MAGIC128_BLK_SHFT;
+
+    for (; ntags && blk <= last_blk; blk++) {
+        ram_addr_t start = (ram_addr_t)blk << (MAGIC128_BLK_SHFT + CAP_TAG_SHFT);
+        ram_addr_t end = start + (MAGIC128_BLK_SIZE << CAP_TAG_SHFT);
+        if (ram->cheri_magic128[blk] &&
+            cheri_tag_phys_find_next(ram, start, end) >= end) {
+            g_free(ram->cheri_magic128[blk]);
+            ram->cheri_magic128[blk] = NULL;
+        }
+    }
+}
+#endif
+
 void cheri_tag_phys_invalidate(CPUArchState *env, RAMBlock *ram,
                                ram_addr_t ram_offset, ram_addr_t len,
                                const target_ulong *vaddr)
@@ -379,44 +706,90 @@ void cheri_tag_phys_invalidate(CPUArchState *env, RAMBlock *ram,
 
     ram_addr_t endaddr = (uint64_t)(ram_offset + len);
     ram_addr_t startaddr = QEMU_ALIGN_DOWN(ram_offset, CAP_SIZE);
+    size_t first_tag = startaddr >> CAP_TAG_SHFT;
+    size_t ntags = DIV_ROUND_UP(endaddr - startaddr, CAP_SIZE);
 
-    for(ram_addr_t addr = startaddr; addr < endaddr; addr += CAP_SIZE) {
-        uint64_t tag = addr >> CAP_TAG_SHFT;
-        CheriTagBlock *tagblk = cheri_tag_block(tag, ram);
-        if (tagblk != NULL) {
-            const size_t tagblk_index = CAP_TAGBLK_IDX(tag);
-            if (unlikely(env && vaddr &&
-                         should_log_mem_access(env, CPU_LOG_INSTR, *vaddr))) {
-                target_ulong write_vaddr =
-                    QEMU_ALIGN_DOWN(*vaddr, CAP_SIZE) + (addr - startaddr);
-                qemu_log("    Cap Tag Write [" TARGET_FMT_lx "/" RAM_ADDR_FMT
-                         "] %d -> 0\n",
-                         write_vaddr, addr,
-                         tagblock_get_tag(tagblk, tagblk_index));
-            }
-            if (unlikely(env &&
-                         should_log_mem_access(env, CPU_LOG_INSTR, addr))) {
-                qemu_log("    Cap Tag ramaddr Write [" RAM_ADDR_FMT
-                         "] %d -> 0\n",
-                         addr, tagblock_get_tag(tagblk, tagblk_index));
-            }
-            // changed |= tagblock_get_tag(tagblk, tagblk_index);
-            tagblock_clear_tag(tagblk, tagblk_index);
+    if (unlikely(env && vaddr &&
+                 should_log_mem_access(env, CPU_LOG_INSTR, *vaddr))) {
+        if (ntags == 1 && cheri_tag_block(first_tag, ram)) {
+            qemu_log("    Cap Tag Write [" TARGET_FMT_lx "/" RAM_ADDR_FMT
+                     "] %d -> 0\n",
+                     QEMU_ALIGN_DOWN(*vaddr, CAP_SIZE), startaddr,
+                     tag_bit_get(first_tag, ram));
+        } else if (ntags > 1) {
+            qemu_log("    Cap Tag Write [" TARGET_FMT_lx "/" RAM_ADDR_FMT
+                     "] %zu tags -> 0\n",
+                     QEMU_ALIGN_DOWN(*vaddr, CAP_SIZE), startaddr, ntags);
+        }
+    }
+    if (unlikely(env && vaddr &&
+                 qemu_plugin_vcpu_cap_tag_enabled(env_cpu(env)))) {
+        // Report each tag that is actually cleared
+        target_ulong cap_vaddr = QEMU_ALIGN_DOWN(*vaddr, CAP_SIZE);
+        ram_addr_t offset = startaddr;
+        while ((offset = cheri_tag_phys_find_next(ram, offset, endaddr)) <
+               endaddr) {
+            qemu_plugin_vcpu_cap_tag_cb(env_cpu(env),
+                                        cap_vaddr + (offset - startaddr),
+                                        ram->offset + offset, false);
+            offset += CAP_SIZE;
         }
     }
+    bool cleared = tag_bit_range_clear(ram, first_tag, ntags);
+    // The address filter applies to the guest address if there is one.
+    if (unlikely(cleared && env &&
+                 should_log_mem_access(env, CPU_LOG_INSTR,
+                                       vaddr ? *vaddr : startaddr))) {
+        qemu_log("    Cap Tag ramaddr Write [" RAM_ADDR_FMT "] %zu tags -> 0\n",
+                 startaddr, ntags);
+    }
+#ifdef CHERI_MAGIC128
+    if (cleared) {
+        magic128_release_blocks(ram, first_tag, ntags);
+    }
+#endif
 
 #ifdef TARGET_MIPS
     /* If a tag was cleared, unset the linkedflag and reset lladdr: */
     if (env && vaddr &&
-        QEMU_ALIGN_DOWN(*vaddr, CHERI_CAP_SIZE) ==
-            QEMU_ALIGN_DOWN(env->lladdr, CHERI_CAP_SIZE)) {
+        QEMU_ALIGN_DOWN(env->lladdr, CHERI_CAP_SIZE) -
+                QEMU_ALIGN_DOWN(*vaddr, CHERI_CAP_SIZE) <
+            (target_ulong)ntags * CHERI_CAP_SIZE) {
         env->linkedflag = 0;
         env->lladdr = 1;
     }
 #endif
 }
 
-void cheri_tag_set(CPUArchState *env, target_ulong vaddr, int reg, hwaddr* ret_paddr, uintptr_t pc)
+/*
+ * Allocate the tag block holding @tag_index before a tag in it is set. Under
+ * MTTCG another vCPU may already have passed the inline TLB compare for a
+ * store to one of the block's pages without TLB_CHERI_TAGS, and its data
+ * store could land after the tag is set. The block is therefore only
+ * allocated while all other vCPUs are stopped, restarting the instruction
+ * with cpu_loop_exit_atomic() if needed: no store is in flight then, and the
+ * other vCPUs flush their TLBs before they run again.
+ */
+static void cheri_tag_block_prepare(CPUArchState *env, RAMBlock *ram,
+                                    size_t tag_index, uintptr_t pc)
+{
+    bool allocated;
+
+    if (likely(cheri_tag_block(tag_index, ram))) {
+        return;
+    }
+    if (parallel_cpus) {
+        cpu_loop_exit_atomic(env_cpu(env), pc);
+    }
+    cheri_tag_store_get_block(ram->cheri_tags, tag_index, &allocated);
+    if (allocated) {
+        cheri_tag_block_allocated_notify();
+    }
+}
+
+static RAMBlock *cheri_tag_resolve_set(CPUArchState *env, target_ulong vaddr,
+                                       int reg, hwaddr *ret_paddr,
+                                       ram_addr_t *ram_offset, uintptr_t pc)
 {
     /*
      * This attempt to resolve a virtual address may cause both a data store
@@ -429,10 +802,51 @@ void cheri_tag_set(CPUArchState *env, target_ulong vaddr, int reg, hwaddr* ret_p
      * exception (and will populate the QEMU TCG soft-TLB for subsequent
      * data stores).
      */
-    ram_addr_t ram_offset;
-    RAMBlock *ram = v2r_addr(env, vaddr, ret_paddr, &ram_offset, MMU_DATA_CAP_STORE, reg, pc);
-    if (!ram)
+    RAMBlock *ram;
+    int prot;
+    // Pages with the store-capability inhibit set must take the slow path
+    // so that the correct exception is raised.
+    if (ret_paddr ||
+        !v2r_addr_from_tlb(env, vaddr, MMU_DATA_CAP_STORE, &ram, ram_offset,
+                           &prot) ||
+        (prot & PAGE_SC_TRAP)) {
+        ram = v2r_addr(env, vaddr, ret_paddr, ram_offset, MMU_DATA_CAP_STORE,
+                       reg, pc);
+    }
+    if (ram && ram->cheri_tags) {
+        cheri_tag_block_prepare(env, ram, *ram_offset >> CAP_TAG_SHFT, pc);
+    }
+    return ram;
+}
+
+RAMBlock *cheri_tag_resolve_store(CPUArchState *env, target_ulong vaddr,
+                                  int reg, bool tagged, ram_addr_t *ram_offset,
+                                  uintptr_t pc)
+{
+    if (tagged) {
+        return cheri_tag_resolve_set(env, vaddr, reg, NULL, ram_offset, pc);
+    }
+    // Same as cheri_tag_invalidate(): a plain data store translation.
+    RAMBlock *ram;
+    int prot;
+    if (likely(v2r_addr_from_tlb(env, vaddr, MMU_DATA_STORE, &ram, ram_offset,
+                                 &prot))) {
+        return ram;
+    }
+    void *host_addr =
+        probe_write(env, vaddr, CHERI_CAP_SIZE, cpu_mmu_index(env, false), pc);
+    if (unlikely(!host_addr)) {
+        return NULL;
+    }
+    return qemu_ram_block_from_host(host_addr, false, ram_offset);
+}
+
+void cheri_tag_phys_set(CPUArchState *env, RAMBlock *ram,
+                        ram_addr_t ram_offset, target_ulong vaddr)
+{
+    if (!ram || !ram->cheri_tags) {
         return;
+    }
     /* Get the tag number and tag block ptr. */
     if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR, vaddr))) {
         qemu_log(
@@ -440,6 +854,8 @@ void cheri_tag_set(CPUArchState *env, target_ulong vaddr, int reg, hwaddr* ret_p
             vaddr, ram_offset, tag_bit_get(ram_offset >> CAP_TAG_SHFT, ram));
     }
     tag_bit_set(ram_offset >> CAP_TAG_SHFT, ram);
+    qemu_plugin_vcpu_cap_tag_cb(env_cpu(env), vaddr, ram->offset + ram_offset,
+                                true);
 
 #ifdef TARGET_MIPS
     /* Check address to see if the linkedflag needs to be reset. */
@@ -452,20 +868,61 @@ void cheri_tag_set(CPUArchState *env, target_ulong vaddr, int reg, hwaddr* ret_p
 #endif
 }
 
+bool cheri_tag_phys_get(RAMBlock *ram, ram_addr_t ram_offset)
+{
+    if (!ram || !ram->cheri_tags) {
+        return false;
+    }
+    return tag_bit_get(ram_offset >> CAP_TAG_SHFT, ram);
+}
+
+ram_addr_t cheri_tag_phys_find_next(RAMBlock *ram, ram_addr_t start,
+                                    ram_addr_t end)
+{
+    if (!ram || !ram->cheri_tags) {
+        return end;
+    }
+    size_t end_idx = MIN(DIV_ROUND_UP(end, CAP_SIZE),
+                         num_tagblocks(ram) * CAP_TAGBLK_SIZE);
+    size_t idx = cheri_tag_store_find_next(ram->cheri_tags,
+                                           start >> CAP_TAG_SHFT, end_idx);
+    return idx < end_idx ? (ram_addr_t)idx << CAP_TAG_SHFT : end;
+}
+
+void cheri_tag_set(CPUArchState *env, target_ulong vaddr, int reg,
+                   hwaddr *ret_paddr, uintptr_t pc)
+{
+    ram_addr_t ram_offset;
+    RAMBlock *ram =
+        cheri_tag_resolve_set(env, vaddr, reg, ret_paddr, &ram_offset, pc);
+    cheri_tag_phys_set(env, ram, ram_offset, vaddr);
+}
+
+static RAMBlock *cheri_tag_resolve_get(CPUArchState *env, target_ulong vaddr,
+                                       MMUAccessType at, int reg, uintptr_t pc,
+                                       hwaddr *ret_paddr,
+                                       ram_addr_t *ram_offset, int *prot)
+{
+    RAMBlock *ram;
+
+    if (ret_paddr ||
+        !v2r_addr_from_tlb(env, vaddr, at, &ram, ram_offset, prot)) {
+        hwaddr paddr = v2p_addr(env, vaddr, at, reg, pc, prot);
+        if (ret_paddr)
+            *ret_paddr = paddr;
+        ram = p2r_addr(env, paddr, ram_offset, NULL);
+    }
+    return ram;
+}
+
 static CheriTagBlock *cheri_tag_get_block(CPUArchState *env, target_ulong vaddr,
                                           MMUAccessType at, int reg, int xshift,
                                           uintptr_t pc, hwaddr *ret_paddr,
                                           uint64_t *ret_tag_idx, int *prot)
 {
-    hwaddr paddr;
-
-    paddr = v2p_addr(env, vaddr, at, reg, pc, prot);
-
-    if (ret_paddr)
-        *ret_paddr = paddr;
-
     ram_addr_t ram_offset;
-    RAMBlock *ram = p2r_addr(env, paddr, &ram_offset, NULL);
+    RAMBlock *ram = cheri_tag_resolve_get(env, vaddr, at, reg, pc, ret_paddr,
+                                          &ram_offset, prot);
     if (!ram)
         return NULL;
 
@@ -534,39 +991,49 @@ void cheri_tag_set_m128(CPUArchState *env, target_ulong vaddr, int reg,
                         uint8_t tagbit, uint64_t tps, uint64_t length,
                         uintptr_t pc)
 {
-    // We index the "magic" table by physical address:
-    hwaddr paddr;
-    cheri_tag_set(env, vaddr, reg, &paddr, pc);
-    gpointer htable_key = GINT_TO_POINTER(paddr);
-    struct Magic128Data *data = g_hash_table_lookup(magic128_table, htable_key);
-    if (!data) {
-        data = g_malloc(sizeof(struct Magic128Data));
-        g_hash_table_insert(magic128_table, htable_key, data);
+    ram_addr_t ram_offset;
+    RAMBlock *ram =
+        cheri_tag_resolve_set(env, vaddr, reg, NULL, &ram_offset, pc);
+    if (!ram || !ram->cheri_tags) {
+        return;
+    }
+    size_t tag_idx = ram_offset >> CAP_TAG_SHFT;
+    CheriMagic128Block **blkp =
+        &ram->cheri_magic128[tag_idx >> MAGIC128_BLK_SHFT];
+    if (!*blkp) {
+        *blkp = g_new(CheriMagic128Block, 1);
     }
+    struct Magic128Data *data = &(*blkp)->data[tag_idx & MAGIC128_BLK_MSK];
     data->tps = tps;
     data->length = length;
+    cheri_tag_phys_set(env, ram, ram_offset, vaddr);
 }
 
 bool cheri_tag_get_m128(CPUArchState *env, target_ulong vaddr, int reg,
                         uint64_t *ret_tps, uint64_t *ret_length,
                         hwaddr *ret_paddr, int *prot, uintptr_t pc)
 {
-    hwaddr paddr;
-    bool tag = cheri_tag_get(env, vaddr, reg, &paddr, prot, pc);
+    ram_addr_t ram_offset = RAM_ADDR_INVALID;
+    RAMBlock *ram = cheri_tag_resolve_get(env, vaddr, MMU_DATA_CAP_LOAD, reg,
+                                          pc, ret_paddr, &ram_offset, prot);
+    bool tag = cheri_tag_phys_get(ram, ram_offset);
+    if (unlikely(ram && should_log_mem_access(env, CPU_LOG_INSTR, vaddr))) {
+        qemu_log("    Cap Tag Read [" TARGET_FMT_lx "/" RAM_ADDR_FMT
+                 "] -> %d\n", vaddr, ram_offset, tag);
+    }
     // Only fetch the extra data if the value is tagged
-    struct Magic128Data *data = NULL;
+    CheriMagic128Block *blk = NULL;
+    size_t tag_idx = ram_offset >> CAP_TAG_SHFT;
     if (tag) {
-        data = g_hash_table_lookup(magic128_table, GINT_TO_POINTER(paddr));
+        blk = ram->cheri_magic128[tag_idx >> MAGIC128_BLK_SHFT];
     }
-    if (data) {
-        *ret_tps = data->tps;
-        *ret_length = data->length;
+    if (blk) {
+        *ret_tps = blk->data[tag_idx & MAGIC128_BLK_MSK].tps;
+        *ret_length = blk->data[tag_idx & MAGIC128_BLK_MSK].length;
     } else {
         *ret_tps = 0ULL;
         *ret_length = 0ULL;
     }
-    if (ret_paddr)
-        *ret_paddr = paddr;
     return tag;
 }
 #endif /* CHERI_MAGIC128 */
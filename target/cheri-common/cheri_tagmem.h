@@ -37,11 +37,25 @@
 #include "exec/memory.h"
 
 #if defined(TARGET_CHERI)
+#ifdef CONFIG_USER_ONLY
+/*
+ * User mode has no guest RAM: the RAMBlock handles passed through this
+ * interface stand for the guest address space and offsets are guest virtual
+ * addresses (see cheri_tagmem_user.c).
+ */
+typedef target_ulong ram_addr_t;
+#endif
 /* Note: for cheri_tag_phys_invalidate, env may be NULL */
 void cheri_tag_phys_invalidate(CPUArchState *env, RAMBlock *ram,
                                ram_addr_t offset, size_t len,
                                const target_ulong *vaddr);
 void cheri_tag_init(MemoryRegion* mr, uint64_t memory_size);
+/*
+ * Returns false if no tags have been set in the page at @offset in @ram, in
+ * which case stores to it do not need to invalidate tags. Note: once this has
+ * returned true for a page it will continue to do so.
+ */
+bool cheri_tag_page_may_have_tags(RAMBlock *ram, ram_addr_t offset);
 void cheri_tag_invalidate(CPUArchState *env, target_ulong vaddr, int32_t size,
                           uintptr_t pc);
 bool cheri_tag_get(CPUArchState *env, target_ulong vaddr, int reg,
@@ -50,6 +64,55 @@ int cheri_tag_get_many(CPUArchState *env, target_ulong vaddr, int reg,
                        hwaddr *ret_paddr, uintptr_t pc);
 void cheri_tag_set(CPUArchState *env, target_ulong vaddr, int reg,
                    hwaddr *ret_paddr, uintptr_t pc);
+/*
+ * Resolve the tag memory for a capability store to @vaddr, taking any TLB
+ * exceptions (including the store-capability inhibit if @tagged) without
+ * modifying anything. Follow with cheri_tag_phys_set() or
+ * cheri_tag_phys_invalidate() while holding cheri_tag_writer_lock().
+ */
+RAMBlock *cheri_tag_resolve_store(CPUArchState *env, target_ulong vaddr,
+                                  int reg, bool tagged, ram_addr_t *ram_offset,
+                                  uintptr_t pc);
+void cheri_tag_phys_set(CPUArchState *env, RAMBlock *ram,
+                        ram_addr_t ram_offset, target_ulong vaddr);
+/* Read the tag for an address resolved with cheri_tag_resolve_store(). */
+bool cheri_tag_phys_get(RAMBlock *ram, ram_addr_t ram_offset);
+/*
+ * Return the offset of the first tagged capability in [@start, @end) of @ram,
+ * or @end if there is none. Only looks at the tag bitmaps, so unallocated
+ * tag blocks are skipped without touching them.
+ */
+ram_addr_t cheri_tag_phys_find_next(RAMBlock *ram, ram_addr_t start,
+                                    ram_addr_t end);
+/*
+ * Capability stores must update data and tag while holding the writer lock
+ * for the host address of the capability. Capability loads read both inside
+ * a cheri_tag_reader_begin()/cheri_tag_reader_retry() loop.
+ */
+void cheri_tag_writer_lock(const void *host);
+void cheri_tag_writer_unlock(const void *host);
+/*
+ * Data stores of @size bytes take the writer locks of every capability they
+ * overlap, which is two if an unaligned store crosses a capability boundary.
+ */
+void cheri_tag_writer_lock_range(const void *host, size_t size);
+void cheri_tag_writer_unlock_range(const void *host, size_t size);
+unsigned cheri_tag_reader_begin(const void *host);
+bool cheri_tag_reader_retry(const void *host, unsigned start);
+/*
+ * For capability loads and stores in generated code: return the address of
+ * the tag block pointer that covers the page at @offset in @ram and set
+ * @word_ofs to the byte offset of the page's first tag word within that
+ * block. Tag blocks are never freed, so the slot stays valid for the
+ * lifetime of the RAMBlock and only changes from NULL to non-NULL.
+ * Returns NULL if the tag memory layout does not allow this.
+ */
+void **cheri_tag_page_block_slot(RAMBlock *ram, ram_addr_t offset,
+                                 uint32_t *word_ofs);
+/* Non-zero while migration needs to see all tag changes. */
+extern bool cheri_tags_dirty_log;
+/* Use one flat bitmap per RAMBlock instead of sparse tag blocks. */
+extern bool cheri_tagmem_flat;
 #ifdef CHERI_MAGIC128
 bool cheri_tag_get_m128(CPUArchState *env, target_ulong vaddr, int reg,
         uint64_t *tps, uint64_t *length, hwaddr *ret_paddr, int *prot, uintptr_t pc);
@@ -0,0 +1,209 @@
+/*
+ * CHERI tag memory for user-mode emulation
+ *
+ * There is no guest physical memory in user mode, so tags are kept per guest
+ * virtual page as page target data (see page_alloc_target_data()): a bitmap
+ * with one bit per capability-sized granule that is allocated on the first
+ * tag write and dropped when the page is unmapped or mapped again. Fresh
+ * mappings therefore never contain tags.
+ *
+ * Other guest threads can unmap a page and free its bitmap at any time, so
+ * every access to a bitmap is done under the RCU read lock.
+ *
+ * cheri_tag_resolve_store() returns a placeholder RAMBlock and the guest
+ * virtual address as the offset, which the cheri_tag_phys_*() functions
+ * accept in return.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/rcu.h"
+#include "qemu/plugin.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/log.h"
+#include "cheri_tagmem.h"
+#include "cheri-helper-utils.h"
+
+#if !defined(CONFIG_USER_ONLY)
+#error "Should only be built for user-mode emulation"
+#endif
+
+#define TAGS_PER_PAGE   (TARGET_PAGE_SIZE / CHERI_CAP_SIZE)
+#define TAG_INDEX(addr) (((addr) & ~TARGET_PAGE_MASK) / CHERI_CAP_SIZE)
+
+static char cheri_user_tag_space;
+#define USER_TAG_RAM ((RAMBlock *)&cheri_user_tag_space)
+
+static inline unsigned long *page_tags(target_ulong vaddr)
+{
+    return page_get_target_data(vaddr);
+}
+
+static inline unsigned long *page_tags_alloc(target_ulong vaddr)
+{
+    return page_alloc_target_data(vaddr,
+                                  BITS_TO_LONGS(TAGS_PER_PAGE) *
+                                      sizeof(unsigned long));
+}
+
+static inline bool user_tag_get(target_ulong vaddr)
+{
+    RCU_READ_LOCK_GUARD();
+    unsigned long *tags = page_tags(vaddr);
+    return tags && test_bit(TAG_INDEX(vaddr), tags);
+}
+
+/* Clear the tags in [@start, @end) and report them to plugins. */
+static void user_tags_clear(CPUArchState *env, target_ulong start,
+                            target_ulong end)
+{
+    RCU_READ_LOCK_GUARD();
+    start = QEMU_ALIGN_DOWN(start, CHERI_CAP_SIZE);
+    while (start < end) {
+        target_ulong page_end = (start & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
+        target_ulong n = (MIN(end, page_end) - start + CHERI_CAP_SIZE - 1) /
+                         CHERI_CAP_SIZE;
+        unsigned long *tags = page_tags(start);
+        if (tags && env && qemu_plugin_vcpu_cap_tag_enabled(env_cpu(env))) {
+            unsigned long idx = TAG_INDEX(start);
+            while ((idx = find_next_bit(tags, TAG_INDEX(start) + n, idx)) <
+                   TAG_INDEX(start) + n) {
+                target_ulong addr =
+                    (start & TARGET_PAGE_MASK) + idx * CHERI_CAP_SIZE;
+                qemu_plugin_vcpu_cap_tag_cb(env_cpu(env), addr, addr, false);
+                idx++;
+            }
+        }
+        if (tags) {
+            bitmap_test_and_clear_atomic(tags, TAG_INDEX(start), n);
+        }
+        start = page_end;
+    }
+}
+
+void cheri_tag_invalidate(CPUArchState *env, target_ulong vaddr, int32_t size,
+                          uintptr_t pc)
+{
+    cheri_debug_assert(size > 0);
+    if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR, vaddr))) {
+        qemu_log("    Cap Tag Write [" TARGET_FMT_lx "] %d -> 0\n",
+                 QEMU_ALIGN_DOWN(vaddr, CHERI_CAP_SIZE), user_tag_get(vaddr));
+    }
+    user_tags_clear(env, vaddr, vaddr + size);
+}
+
+void cheri_tag_phys_invalidate(CPUArchState *env, RAMBlock *ram,
+                               ram_addr_t ram_offset, size_t len,
+                               const target_ulong *vaddr)
+{
+    user_tags_clear(env, ram_offset, ram_offset + len);
+}
+
+RAMBlock *cheri_tag_resolve_store(CPUArchState *env, target_ulong vaddr,
+                                  int reg, bool tagged, ram_addr_t *ram_offset,
+                                  uintptr_t pc)
+{
+    // Raise SIGSEGV for unmapped or read-only pages before touching anything.
+    probe_write(env, vaddr, CHERI_CAP_SIZE, cpu_mmu_index(env, false), pc);
+    *ram_offset = vaddr;
+    return USER_TAG_RAM;
+}
+
+void cheri_tag_phys_set(CPUArchState *env, RAMBlock *ram,
+                        ram_addr_t ram_offset, target_ulong vaddr)
+{
+    RCU_READ_LOCK_GUARD();
+    unsigned long *tags = page_tags_alloc(vaddr);
+
+    if (!tags) {
+        return;
+    }
+    if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR, vaddr))) {
+        qemu_log("    Cap Tag Write [" TARGET_FMT_lx "] %d -> 1\n", vaddr,
+                 test_bit(TAG_INDEX(vaddr), tags));
+    }
+    set_bit_atomic(TAG_INDEX(vaddr), tags);
+    qemu_plugin_vcpu_cap_tag_cb(env_cpu(env), vaddr, vaddr, true);
+}
+
+bool cheri_tag_phys_get(RAMBlock *ram, ram_addr_t ram_offset)
+{
+    return ram && user_tag_get(ram_offset);
+}
+
+ram_addr_t cheri_tag_phys_find_next(RAMBlock *ram, ram_addr_t start,
+                                    ram_addr_t end)
+{
+    RCU_READ_LOCK_GUARD();
+    start = QEMU_ALIGN_DOWN(start, CHERI_CAP_SIZE);
+    while (start < end) {
+        target_ulong page_end = (start & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
+        unsigned long *tags = page_tags(start);
+        if (tags) {
+            unsigned long last = TAG_INDEX(MIN(end, page_end) - 1) + 1;
+            unsigned long idx = find_next_bit(tags, last, TAG_INDEX(start));
+            if (idx < last) {
+                return (start & TARGET_PAGE_MASK) + idx * CHERI_CAP_SIZE;
+            }
+        }
+        start = page_end;
+    }
+    return end;
+}
+
+void cheri_tag_set(CPUArchState *env, target_ulong vaddr, int reg,
+                   hwaddr *ret_paddr, uintptr_t pc)
+{
+    ram_addr_t offset;
+    RAMBlock *ram = cheri_tag_resolve_store(env, vaddr, reg, true, &offset, pc);
+    if (ret_paddr) {
+        *ret_paddr = vaddr;
+    }
+    cheri_tag_phys_set(env, ram, offset, vaddr);
+}
+
+bool cheri_tag_get(CPUArchState *env, target_ulong vaddr, int reg,
+                   hwaddr *ret_paddr, int *prot, uintptr_t pc)
+{
+    bool result = user_tag_get(vaddr);
+
+    // There are no capability load/store inhibit bits in user mode.
+    *prot = 0;
+    if (ret_paddr) {
+        *ret_paddr = vaddr;
+    }
+    if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR, vaddr))) {
+        qemu_log("    Cap Tag Read [" TARGET_FMT_lx "] -> %d\n", vaddr, result);
+    }
+    return result;
+}
+
+// Same "cache line" of 8 capabilities as the system-mode implementation.
+#define CAP_TAG_GET_MANY_SHFT    3
+int cheri_tag_get_many(CPUArchState *env, target_ulong vaddr, int reg,
+                       hwaddr *ret_paddr, uintptr_t pc)
+{
+    target_ulong line = QEMU_ALIGN_DOWN(
+        vaddr, CHERI_CAP_SIZE << CAP_TAG_GET_MANY_SHFT);
+    int result = 0;
+
+    RCU_READ_LOCK_GUARD();
+    unsigned long *tags = page_tags(line);
+
+    if (ret_paddr) {
+        *ret_paddr = vaddr;
+    }
+    if (!tags) {
+        return 0;
+    }
+    for (int i = 0; i < (1 << CAP_TAG_GET_MANY_SHFT); i++) {
+        if (test_bit(TAG_INDEX(line) + i, tags)) {
+            result |= 1 << i;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,233 @@
+/*
+ * CHERI tag storage
+ *
+ * The target-independent part of the tag memory in cheri_tagmem.c: a bitmap
+ * with one bit per capability-sized granule, indexed by tag number. There
+ * are two layouts:
+ *
+ * - sparse (the default): an array of pointers to blocks of
+ *   CHERI_TAGBLK_SIZE tags that are allocated the first time a tag in them
+ *   is set. Memory use follows the amount of memory holding capabilities and
+ *   cheri_tag_page_may_have_tags() can skip pages without a block.
+ * - flat (-cheri-tagmem-flat): a single bitmap for the whole RAMBlock
+ *   reserved with mmap(MAP_NORESERVE), so that the host kernel provides zero
+ *   pages on demand and lookups never have to check for a missing block.
+ *
+ * Blocks are never freed while the store exists since other vCPUs may be
+ * accessing them without a lock.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef CHERI_TAGSTORE_H
+#define CHERI_TAGSTORE_H
+
+#include "qemu/atomic.h"
+#include "qemu/bitmap.h"
+
+#define CHERI_TAGBLK_SHFT       12      // 2^12 or 4096 tags per block
+#define CHERI_TAGBLK_SIZE       (1 << CHERI_TAGBLK_SHFT)
+#define CHERI_TAGBLK_IDX(tag)   ((tag) & (CHERI_TAGBLK_SIZE - 1))
+
+typedef struct CheriTagBlock {
+    DECLARE_BITMAP(tag_bitmap, CHERI_TAGBLK_SIZE);
+} CheriTagBlock;
+
+typedef struct CheriTagMem {
+    /* Sparse layout: one lazily allocated block per CHERI_TAGBLK_SIZE tags */
+    CheriTagBlock **blocks;
+    /* Flat layout: all blocks in one MAP_NORESERVE mapping */
+    CheriTagBlock *flat;
+    size_t nblocks;
+} CheriTagMem;
+
+static inline size_t cheri_tag_store_flat_size(size_t nblocks)
+{
+    return ROUND_UP(nblocks * sizeof(CheriTagBlock), qemu_real_host_page_size);
+}
+
+/* Returns NULL if the tag memory could not be allocated. */
+static inline CheriTagMem *cheri_tag_store_new(size_t nblocks, bool flat)
+{
+    CheriTagMem *tm = g_new0(CheriTagMem, 1);
+
+    tm->nblocks = nblocks;
+    if (flat) {
+        void *p = mmap(NULL, cheri_tag_store_flat_size(nblocks),
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+            g_free(tm);
+            return NULL;
+        }
+        tm->flat = p;
+    } else {
+        tm->blocks = g_try_new0(CheriTagBlock *, nblocks);
+        if (!tm->blocks) {
+            g_free(tm);
+            return NULL;
+        }
+    }
+    return tm;
+}
+
+static inline void cheri_tag_store_free(CheriTagMem *tm)
+{
+    if (tm->flat) {
+        munmap(tm->flat, cheri_tag_store_flat_size(tm->nblocks));
+    } else {
+        for (size_t i = 0; i < tm->nblocks; i++) {
+            g_free(tm->blocks[i]);
+        }
+        g_free(tm->blocks);
+    }
+    g_free(tm);
+}
+
+static inline bool cheri_tag_store_is_flat(const CheriTagMem *tm)
+{
+    return tm->flat != NULL;
+}
+
+/* Returns the block holding tag @tag or NULL if it has not been allocated. */
+static inline QEMU_ALWAYS_INLINE CheriTagBlock *
+cheri_tag_store_block(CheriTagMem *tm, size_t tag)
+{
+    size_t blk = tag >> CHERI_TAGBLK_SHFT;
+
+    if (tm->flat) {
+        return &tm->flat[blk];
+    }
+    return atomic_read(&tm->blocks[blk]);
+}
+
+/*
+ * Returns the block holding tag @tag, allocating it if needed. @allocated is
+ * set if this call installed a new block (the caller may need to tell the
+ * softmmu TLB that the block's pages now have tags).
+ */
+static inline CheriTagBlock *cheri_tag_store_get_block(CheriTagMem *tm,
+                                                       size_t tag,
+                                                       bool *allocated)
+{
+    CheriTagBlock *block = cheri_tag_store_block(tm, tag);
+    CheriTagBlock *old;
+
+    *allocated = false;
+    if (likely(block)) {
+        return block;
+    }
+    block = g_new0(CheriTagBlock, 1);
+    /* Possible race here so use atomic compare and swap. */
+    old = atomic_cmpxchg(&tm->blocks[tag >> CHERI_TAGBLK_SHFT], NULL, block);
+    if (old) {
+        /* Lost the race, free. */
+        g_free(block);
+        return old;
+    }
+    *allocated = true;
+    return block;
+}
+
+static inline QEMU_ALWAYS_INLINE bool cheri_tag_store_get(CheriTagMem *tm,
+                                                          size_t tag)
+{
+    CheriTagBlock *block = cheri_tag_store_block(tm, tag);
+
+    return block ? test_bit(CHERI_TAGBLK_IDX(tag), block->tag_bitmap) : false;
+}
+
+/* Returns true if a new block was allocated, see cheri_tag_store_get_block. */
+static inline QEMU_ALWAYS_INLINE bool cheri_tag_store_set(CheriTagMem *tm,
+                                                          size_t tag)
+{
+    bool allocated;
+    CheriTagBlock *block = cheri_tag_store_get_block(tm, tag, &allocated);
+
+    set_bit_atomic(CHERI_TAGBLK_IDX(tag), block->tag_bitmap);
+    return allocated;
+}
+
+static inline QEMU_ALWAYS_INLINE void cheri_tag_store_clear(CheriTagMem *tm,
+                                                            size_t tag)
+{
+    CheriTagBlock *block = cheri_tag_store_block(tm, tag);
+
+    if (block) {
+        clear_bit_atomic(CHERI_TAGBLK_IDX(tag), block->tag_bitmap);
+    }
+}
+
+/*
+ * Clear @count tags starting at @start, skipping unallocated blocks. Blocks
+ * are zeroed rather than freed. @changed_block is called (if non-NULL) for
+ * each block in which a tag was previously set. Returns true if any tag was
+ * previously set.
+ */
+static inline bool cheri_tag_store_clear_range(CheriTagMem *tm, size_t start,
+                                               size_t count,
+                                               void (*changed_block)(void *,
+                                                                     size_t),
+                                               void *opaque)
+{
+    bool changed = false;
+    size_t end = start + count;
+
+    while (start < end) {
+        size_t block_end = QEMU_ALIGN_DOWN(start, CHERI_TAGBLK_SIZE) +
+                           CHERI_TAGBLK_SIZE;
+        size_t n = MIN(end, block_end) - start;
+        CheriTagBlock *block = cheri_tag_store_block(tm, start);
+        if (block &&
+            bitmap_test_and_clear_atomic(block->tag_bitmap,
+                                         CHERI_TAGBLK_IDX(start), n)) {
+            if (changed_block) {
+                changed_block(opaque, start >> CHERI_TAGBLK_SHFT);
+            }
+            changed = true;
+        }
+        start += n;
+    }
+    return changed;
+}
+
+/* Returns the first set tag in [@start, @end) or @end if there is none. */
+static inline size_t cheri_tag_store_find_next(CheriTagMem *tm, size_t start,
+                                               size_t end)
+{
+    end = MIN(end, tm->nblocks << CHERI_TAGBLK_SHFT);
+    while (start < end) {
+        size_t block_start = QEMU_ALIGN_DOWN(start, CHERI_TAGBLK_SIZE);
+        size_t n = MIN(end - block_start, CHERI_TAGBLK_SIZE);
+        CheriTagBlock *block = cheri_tag_store_block(tm, start);
+        if (block) {
+            size_t bit = find_next_bit(block->tag_bitmap, n,
+                                       CHERI_TAGBLK_IDX(start));
+            if (bit < n) {
+                return block_start + bit;
+            }
+        }
+        start = block_start + n;
+    }
+    return end;
+}
+
+/* Drop all tags. Sparse blocks stay allocated but are zeroed. */
+static inline void cheri_tag_store_reset(CheriTagMem *tm)
+{
+    if (tm->flat) {
+        size_t size = cheri_tag_store_flat_size(tm->nblocks);
+        // Drop all pages so that they read as zero and stop using host memory.
+        if (qemu_madvise(tm->flat, size, QEMU_MADV_DONTNEED) != 0) {
+            memset(tm->flat, 0, size);
+        }
+        return;
+    }
+    for (size_t i = 0; i < tm->nblocks; i++) {
+        if (tm->blocks[i]) {
+            bitmap_zero(tm->blocks[i]->tag_bitmap, CHERI_TAGBLK_SIZE);
+        }
+    }
+}
+
+#endif /* CHERI_TAGSTORE_H */
@@ -125,6 +125,8 @@ static inline bool cheri_cap_perms_valid_for_exec(const cap_register_t *pcc)
 #define tb_in_capmode(tb)                                                      \
     ((tb->cheri_flags & TB_FLAG_CHERI_CAPMODE) == TB_FLAG_CHERI_CAPMODE)
 
+extern bool cheri_shared_tbs;
+
 static inline void cheri_cpu_get_tb_cpu_state(const cap_register_t *pcc,
                                               const cap_register_t *ddc,
                                               target_ulong *cs_base,
@@ -134,10 +136,17 @@ static inline void cheri_cpu_get_tb_cpu_state(const cap_register_t *pcc,
     cheri_debug_assert(*cheri_flags == 0);
     *cheri_flags |= cap_has_capmode_flag(pcc) ? TB_FLAG_CHERI_CAPMODE : 0;
     *cs_base = cap_get_base(pcc);
-    *cs_top = cap_get_top(pcc);
     *cheri_flags |=
         cheri_cap_perms_valid_for_exec(pcc) ? TB_FLAG_CHERI_PCC_VALID : 0;
-    if (cs_base == 0 && cap_get_top65(pcc) == CAP_MAX_TOP) {
+    if (cheri_shared_tbs && cap_get_top65(pcc) != CAP_MAX_TOP) {
+        // Don't include the top of PCC in the lookup key so that TBs can be
+        // reused by all PCCs with the same base.
+        *cs_top = 0;
+        *cheri_flags |= TB_FLAG_PCC_TOP_DYNAMIC;
+    } else {
+        *cs_top = cap_get_top(pcc);
+    }
+    if (*cs_base == 0 && cap_get_top65(pcc) == CAP_MAX_TOP) {
         *cheri_flags |= TB_FLAG_PCC_FULL_AS;
     }
     if (ddc->cr_tag && cap_is_unsealed(ddc)) {
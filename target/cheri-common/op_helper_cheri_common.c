@@ -41,6 +41,8 @@
 #include "exec/exec-all.h"
 #include "exec/helper-proto.h"
 #include "exec/memop.h"
+#include "exec/log_instr_binary.h"
+#include "qemu/atomic128.h"
 
 #include "cheri-helper-utils.h"
 #include "cheri_tagmem.h"
@@ -584,16 +586,14 @@ DEFINE_CHERI_STAT(csetaddr);
 DEFINE_CHERI_STAT(candaddr);
 DEFINE_CHERI_STAT(cfromptr);
 
+#endif
+
 static void cincoffset_impl(CPUArchState *env, uint32_t cd, uint32_t cb,
                             target_ulong rt, uintptr_t retpc,
                             struct oob_stats_info *oob_info)
 {
+#ifdef DO_CHERI_STATISTICS
     oob_info->num_uses++;
-#else
-static void cincoffset_impl(CPUArchState *env, uint32_t cd, uint32_t cb,
-                            target_ulong rt, uintptr_t retpc, void *dummy_arg)
-{
-    (void)dummy_arg;
 #endif
     const cap_register_t *cbp = get_readonly_capreg(env, cb);
     /*
@@ -611,8 +611,7 @@ static void cincoffset_impl(CPUArchState *env, uint32_t cd, uint32_t cb,
             cap_mark_unrepresentable(new_addr, &result);
         } else {
             result._cr_cursor = new_addr;
-            check_out_of_bounds_stat(env, oob_info, &result,
-                                     _host_return_address);
+            check_out_of_bounds_stat(env, oob_info, &result, retpc);
         }
         update_capreg(env, cd, &result);
     }
@@ -1051,6 +1050,10 @@ static inline void dump_cap_load(CPUArchState *env, uint64_t addr,
 {
 
     if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR, addr))) {
+        if (log_instr_binary_enabled()) {
+            log_instr_bin_cap_mem(env, false, addr, pesbt, cursor, tag);
+            return;
+        }
         qemu_log("    Cap Memory Read [" TARGET_FMT_lx
                  "] = v:%d PESBT:" TARGET_FMT_lx " Cursor:" TARGET_FMT_lx "\n",
                  addr, tag, pesbt, cursor);
@@ -1065,6 +1068,10 @@ static inline void dump_cap_store(CPUArchState *env, uint64_t addr, uint64_t pes
 {
 
     if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR, addr))) {
+        if (log_instr_binary_enabled()) {
+            log_instr_bin_cap_mem(env, true, addr, pesbt, cursor, tag);
+            return;
+        }
         qemu_log("    Cap Memory Write [" TARGET_FMT_lx
                  "] = v:%d PESBT:" TARGET_FMT_lx " Cursor:" TARGET_FMT_lx "\n",
                  addr, tag, pesbt, cursor);
@@ -1075,7 +1082,8 @@ static inline void dump_cap_store(CPUArchState *env, uint64_t addr, uint64_t pes
 bool load_cap_from_memory_128(CPUArchState *env, uint64_t *pesbt,
                               uint64_t *cursor, uint32_t cb,
                               const cap_register_t *source, target_ulong vaddr,
-                              target_ulong retpc, hwaddr *physaddr)
+                              target_ulong retpc, hwaddr *physaddr,
+                              bool *raw_tag)
 {
     cheri_debug_assert(QEMU_IS_ALIGNED(vaddr, CHERI_CAP_SIZE));
     /*
@@ -1087,13 +1095,21 @@ bool load_cap_from_memory_128(CPUArchState *env, uint64_t *pesbt,
     /* No TLB fault possible, should be safe to get a host pointer now */
     void *host = probe_read(env, vaddr, CHERI_CAP_SIZE,
                             cpu_mmu_index(env, false), retpc);
+    int prot;
+    bool tag;
     // When writing back pesbt we have to XOR with the NULL mask to ensure that
     // NULL capabilities have an all-zeroes representation.
     if (likely(host)) {
-        // Fast path, host address in TLB
-        *pesbt = ldq_p((char *)host + CHERI_MEM_OFFSET_METADATA) ^
-                CC128_NULL_XOR_MASK;
-        *cursor = ldq_p((char *)host + CHERI_MEM_OFFSET_CURSOR);
+        // Fast path, host address in TLB. With MTTCG, retry if a capability
+        // store to the same location raced with reading data and tag.
+        unsigned seq;
+        do {
+            seq = cheri_tag_reader_begin(host);
+            *pesbt = ldq_p((char *)host + CHERI_MEM_OFFSET_METADATA) ^
+                     CC128_NULL_XOR_MASK;
+            *cursor = ldq_p((char *)host + CHERI_MEM_OFFSET_CURSOR);
+            tag = cheri_tag_get(env, vaddr, cb, physaddr, &prot, retpc);
+        } while (cheri_tag_reader_retry(host, seq));
 #if defined(CONFIG_MIPS_LOG_INSTR)
         // cpu_ldq_data_ra() performs the read logging, with raw memory
         // accesses we have to do it manually
@@ -1114,9 +1130,11 @@ bool load_cap_from_memory_128(CPUArchState *env, uint64_t *pesbt,
         *pesbt = cpu_ldq_data_ra(env, vaddr + CHERI_MEM_OFFSET_METADATA, retpc) ^
                 CC128_NULL_XOR_MASK;
         *cursor = cpu_ldq_data_ra(env, vaddr + CHERI_MEM_OFFSET_CURSOR, retpc);
+        tag = cheri_tag_get(env, vaddr, cb, physaddr, &prot, retpc);
+    }
+    if (raw_tag) {
+        *raw_tag = tag;
     }
-    int prot;
-    bool tag = cheri_tag_get(env, vaddr, cb, physaddr, &prot, retpc);
     if (tag) {
         tag = cheri_tag_prot_clear_or_trap(env, vaddr, cb, source, prot, retpc, tag);
         if (unlikely(!tag &&
@@ -1145,12 +1163,10 @@ bool load_cap_from_memory_128(CPUArchState *env, uint64_t *pesbt,
         decompress_128cap_already_xored(*pesbt, *cursor, &ncd);
         ncd.cr_tag = tag;
         dump_cap_load(env, vaddr, compress_128cap(&ncd), *cursor, tag);
-#ifdef TARGET_MIPS
         if (unlikely(qemu_loglevel_mask(CPU_LOG_CVTRACE))) {
             cvtrace_dump_cap_load(&env->cvtrace, vaddr, &ncd);
             cvtrace_dump_cap_cbl(&env->cvtrace, &ncd);
         }
-#endif
     }
 #endif
     return tag;
@@ -1163,10 +1179,38 @@ void load_cap_from_memory(CPUArchState *env, uint32_t cd, uint32_t cb,
     uint64_t pesbt;
     uint64_t cursor;
     bool tag = load_cap_from_memory_128(env, &pesbt, &cursor, cb, source, vaddr,
-                                        retpc, physaddr);
+                                        retpc, physaddr, NULL);
     update_compressed_capreg(env, cd, pesbt, tag, cursor);
 }
 
+// Logging etc. after a successful capability store.
+static void cap_store_done(CPUArchState *env, target_ulong vaddr,
+                           uint64_t pesbt_for_mem, uint64_t cursor, bool tag)
+{
+#if defined(TARGET_RISCV) && defined(CONFIG_RVFI_DII)
+    env->rvfi_dii_trace.rvfi_dii_mem_addr = vaddr;
+    // env->rvfi_dii_trace.rvfi_dii_mem_wdata = cursor;
+    env->rvfi_dii_trace.rvfi_dii_mem_wmask = 0xff;
+#endif
+
+#if defined(CONFIG_MIPS_LOG_INSTR)
+    /* Log memory cap write, if needed. */
+    if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR | CPU_LOG_CVTRACE, vaddr))) {
+        // Decompress to log all fields
+        cap_register_t stored_cap;
+        const uint64_t pesbt = pesbt_for_mem ^ CC128_NULL_XOR_MASK;
+        decompress_128cap_already_xored(pesbt, cursor, &stored_cap);
+        stored_cap.cr_tag = tag;
+        cheri_debug_assert(cursor == cap_get_cursor(&stored_cap));
+        dump_cap_store(env, vaddr, pesbt, cursor, tag);
+        if (unlikely(qemu_loglevel_mask(CPU_LOG_CVTRACE))) {
+            cvtrace_dump_cap_store(&env->cvtrace, vaddr, &stored_cap);
+            cvtrace_dump_cap_cbl(&env->cvtrace, &stored_cap);
+        }
+    }
+#endif
+}
+
 void store_cap_to_memory(CPUArchState *env, uint32_t cs,
                          target_ulong vaddr, target_ulong retpc)
 {
@@ -1184,28 +1228,37 @@ void store_cap_to_memory(CPUArchState *env, uint32_t cs,
         tcg_debug_assert(!tag && "Wrong value for cnull?");
     }
     /*
-     * Touching the tags will take both the data write TLB fault and
+     * Resolving the tags will take both the data write TLB fault and
      * capability write TLB fault before updating anything.  Thereafter, the
      * data stores will not take additional faults, so there is no risk of
-     * accidentally tagging a shorn data write.  This, like the rest of the
-     * tag logic, is not multi-TCG-thread safe.
+     * accidentally tagging a shorn data write.  The data and tag updates are
+     * done under the tag writer lock so that concurrent capability loads
+     * (MTTCG) see either the old or the new capability.
      */
 
     env->statcounters_cap_write++;
     if (tag) {
         env->statcounters_cap_write_tagged++;
-        cheri_tag_set(env, vaddr, cs, NULL, retpc);
-    } else {
-        cheri_tag_invalidate(env, vaddr, CHERI_CAP_SIZE, retpc);
     }
+    ram_addr_t tag_offset;
+    RAMBlock *tag_ram =
+        cheri_tag_resolve_store(env, vaddr, cs, tag, &tag_offset, retpc);
     /* No TLB fault possible, should be safe to get a host pointer now */
     void* host = probe_write(env, vaddr, CHERI_CAP_SIZE, cpu_mmu_index(env, false), retpc);
     // When writing back pesbt we have to XOR with the NULL mask to ensure that
     // NULL capabilities have an all-zeroes representation.
     if (likely(host)) {
         // Fast path, host address in TLB
+        cheri_tag_writer_lock(host);
         stq_p((char*)host + CHERI_MEM_OFFSET_METADATA, pesbt_for_mem);
         stq_p((char*)host + CHERI_MEM_OFFSET_CURSOR, cursor);
+        if (tag) {
+            cheri_tag_phys_set(env, tag_ram, tag_offset, vaddr);
+        } else if (tag_ram) {
+            cheri_tag_phys_invalidate(env, tag_ram, tag_offset, CHERI_CAP_SIZE,
+                                      &vaddr);
+        }
+        cheri_tag_writer_unlock(host);
 #if defined(CONFIG_MIPS_LOG_INSTR)
         // cpu_stq_data_ra() performs the write logging, with raw memory
         // accesses we have to do it manually
@@ -1217,45 +1270,113 @@ void store_cap_to_memory(CPUArchState *env, uint32_t cs,
     } else {
         // Slow path for e.g. IO regions.
         qemu_log_mask(CPU_LOG_INSTR, "Using slow path for store to guest address " TARGET_FMT_plx "\n", vaddr);
+        if (tag) {
+            cheri_tag_phys_set(env, tag_ram, tag_offset, vaddr);
+        } else if (tag_ram) {
+            cheri_tag_phys_invalidate(env, tag_ram, tag_offset, CHERI_CAP_SIZE,
+                                      &vaddr);
+        }
         cpu_stq_data_ra(env, vaddr + CHERI_MEM_OFFSET_METADATA, pesbt_for_mem, retpc);
         cpu_stq_data_ra(env, vaddr + CHERI_MEM_OFFSET_CURSOR, cursor, retpc);
     }
-#if defined(TARGET_RISCV) && defined(CONFIG_RVFI_DII)
-    env->rvfi_dii_trace.rvfi_dii_mem_addr = vaddr;
-    // env->rvfi_dii_trace.rvfi_dii_mem_wdata = cursor;
-    env->rvfi_dii_trace.rvfi_dii_mem_wmask = 0xff;
-#endif
+    cap_store_done(env, vaddr, pesbt_for_mem, cursor, tag);
+}
 
-#if defined(CONFIG_MIPS_LOG_INSTR)
-    /* Log memory cap write, if needed. */
-    if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR | CPU_LOG_CVTRACE, vaddr))) {
-        /* Log memory cap write, if needed. */
-        // Decompress to log all fields
-        cap_register_t stored_cap;
-        const uint64_t pesbt = pesbt_for_mem ^ CC128_NULL_XOR_MASK;
-        decompress_128cap_already_xored(pesbt, cursor, &stored_cap);
-        stored_cap.cr_tag = tag;
-        cheri_debug_assert(cursor == cap_get_cursor(&stored_cap));
-        dump_cap_store(env, vaddr, pesbt, cursor, tag);
-#ifdef TARGET_MIPS
-        if (unlikely(qemu_loglevel_mask(CPU_LOG_CVTRACE))) {
-            cvtrace_dump_cap_store(&env->cvtrace, vaddr, &stored_cap);
-            cvtrace_dump_cap_cbl(&env->cvtrace, &stored_cap);
+static inline Int128 cap_to_host_int128(uint64_t pesbt_for_mem,
+                                        uint64_t cursor)
+{
+    uint8_t buf[CHERI_CAP_SIZE];
+    Int128 result;
+    stq_p(buf + CHERI_MEM_OFFSET_METADATA, pesbt_for_mem);
+    stq_p(buf + CHERI_MEM_OFFSET_CURSOR, cursor);
+    memcpy(&result, buf, sizeof(result));
+    return result;
+}
+
+bool cmpxchg_cap_in_memory(CPUArchState *env, uint32_t cs, target_ulong vaddr,
+                           uint64_t cmp_pesbt, uint64_t cmp_cursor,
+                           bool cmp_tag, uintptr_t retpc)
+{
+    uint64_t cursor = get_capreg_cursor(env, cs);
+    uint64_t pesbt_for_mem = get_capreg_pesbt(env, cs) ^ CC128_NULL_XOR_MASK;
+    bool tag = get_capreg_tag(env, cs);
+    bool success = false;
+
+    cheri_debug_assert(QEMU_IS_ALIGNED(vaddr, CHERI_CAP_SIZE));
+    // Take all TLB faults before acquiring the lock.
+    ram_addr_t tag_offset;
+    RAMBlock *tag_ram =
+        cheri_tag_resolve_store(env, vaddr, cs, tag, &tag_offset, retpc);
+    void *host = probe_write(env, vaddr, CHERI_CAP_SIZE,
+                             cpu_mmu_index(env, false), retpc);
+#if HAVE_CMPXCHG128
+    if (likely(host)) {
+        // The tag writer lock serializes against other capability stores,
+        // the host cmpxchg against plain data stores from other vCPUs.
+        Int128 cmpv = cap_to_host_int128(cmp_pesbt ^ CC128_NULL_XOR_MASK,
+                                         cmp_cursor);
+        Int128 newv = cap_to_host_int128(pesbt_for_mem, cursor);
+        cheri_tag_writer_lock(host);
+        if (cheri_tag_phys_get(tag_ram, tag_offset) == cmp_tag) {
+            Int128 oldv = atomic16_cmpxchg((Int128 *)host, cmpv, newv);
+            success = int128_eq(oldv, cmpv);
+        }
+        if (success) {
+            if (tag) {
+                cheri_tag_phys_set(env, tag_ram, tag_offset, vaddr);
+            } else if (tag_ram) {
+                cheri_tag_phys_invalidate(env, tag_ram, tag_offset,
+                                          CHERI_CAP_SIZE, &vaddr);
+            }
         }
+        cheri_tag_writer_unlock(host);
+        if (success) {
+            env->statcounters_cap_write++;
+            if (tag) {
+                env->statcounters_cap_write_tagged++;
+            }
+#if defined(CONFIG_MIPS_LOG_INSTR)
+            if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR | CPU_LOG_CVTRACE, vaddr))) {
+                helper_dump_store64(env, vaddr + CHERI_MEM_OFFSET_METADATA, pesbt_for_mem, MO_64);
+                helper_dump_store64(env, vaddr + CHERI_MEM_OFFSET_CURSOR, cursor, MO_64);
+            }
 #endif
+            cap_store_done(env, vaddr, pesbt_for_mem, cursor, tag);
+        }
+        return success;
     }
 #endif
+    // No host cmpxchg or not RAM: perform the operation with all other
+    // vCPUs stopped.
+    if (parallel_cpus) {
+        cpu_loop_exit_atomic(env_cpu(env), retpc);
+    }
+    uint64_t cur_pesbt, cur_cursor;
+    bool cur_tag;
+    int prot;
+    cur_pesbt = cpu_ldq_data_ra(env, vaddr + CHERI_MEM_OFFSET_METADATA, retpc) ^
+                CC128_NULL_XOR_MASK;
+    cur_cursor = cpu_ldq_data_ra(env, vaddr + CHERI_MEM_OFFSET_CURSOR, retpc);
+    cur_tag = cheri_tag_get(env, vaddr, cs, NULL, &prot, retpc);
+    if (cur_pesbt == cmp_pesbt && cur_cursor == cmp_cursor &&
+        cur_tag == cmp_tag) {
+        store_cap_to_memory(env, cs, vaddr, retpc);
+        success = true;
+    }
+    return success;
 }
 #endif
 
 QEMU_NORETURN static inline void raise_pcc_fault(CPUArchState *env,
-                                                 CheriCapExcCause cause)
+                                                 CheriCapExcCause cause,
+                                                 uintptr_t retpc)
 {
     cheri_debug_assert(pc_is_current(env));
-    // Note: we set pc=0 since PC will have been saved prior to calling the
-    // helper and we don't need to recompute it from the generated code.
+    // Note: PC will have been saved prior to calling the helper, but we still
+    // need the host return address to undo the per-TB instruction count for
+    // the rest of the TB (see restore_insn_count_to_opc()).
     raise_cheri_exception_impl(env, cause, CHERI_EXC_REGNUM_PCC,
-        /*instavail=*/true, 0);
+        /*instavail=*/true, retpc);
 }
 
 void CHERI_HELPER_IMPL(raise_exception_pcc_perms(CPUArchState *env))
@@ -1277,7 +1398,7 @@ void CHERI_HELPER_IMPL(raise_exception_pcc_perms(CPUArchState *env))
                      __func__, PRINT_CAP_ARGS(pcc));
         tcg_abort();
     }
-    raise_pcc_fault(env, cause);
+    raise_pcc_fault(env, cause, GETPC());
 }
 
 void CHERI_HELPER_IMPL(raise_exception_pcc_bounds(CPUArchState *env,
@@ -1292,7 +1413,22 @@ void CHERI_HELPER_IMPL(raise_exception_pcc_bounds(CPUArchState *env,
     // helpful).
     cheri_debug_assert(
         !cap_is_in_bounds(cheri_get_current_pcc(env), addr, num_bytes));
-    raise_pcc_fault(env, CapEx_LengthViolation);
+    raise_pcc_fault(env, CapEx_LengthViolation, GETPC());
+}
+
+void CHERI_HELPER_IMPL(pcc_top_check_failed(CPUArchState *env))
+{
+    // Called on entry to a TB translated with TB_FLAG_PCC_TOP_DYNAMIC when
+    // the live PCC does not cover the whole TB. Some of the instructions
+    // might still be in bounds, so we execute one instruction per TB until we
+    // reach the one that raises the bounds violation (see
+    // gen_pcc_top_check_start()).
+    // None of the instructions in this TB have been executed, so restore
+    // the state to undo the per-TB instruction count and icount budget.
+    CPUState *cpu = env_cpu(env);
+    cpu_restore_state(cpu, GETPC(), true);
+    cpu->cflags_next_tb = 1 | curr_cflags();
+    cpu_loop_exit_noexc(cpu);
 }
 
 void CHERI_HELPER_IMPL(raise_exception_ddc_perms(CPUArchState *env,
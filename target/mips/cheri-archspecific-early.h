@@ -82,6 +82,10 @@ static inline const cap_register_t *_cheri_get_pcc_unchecked(CPUMIPSState *env)
 {
     return &env->active_tc.PCC;
 }
+// Offsets in env for code that loads capability fields from generated code.
+#define CHERI_PCC_ENV_OFFSET offsetof(CPUMIPSState, active_tc.PCC)
+#define CHERI_DDC_ENV_OFFSET offsetof(CPUMIPSState, active_tc.CHWR.DDC)
+#define CHERI_GPCRS_ENV_OFFSET offsetof(CPUMIPSState, active_tc.gpcapregs)
 
 static inline GPCapRegs *cheri_get_gpcrs(CPUArchState *env) {
     return &env->active_tc.gpcapregs;
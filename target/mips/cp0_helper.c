@@ -32,6 +32,18 @@
 #include "sysemu/kvm.h"
 #include "sysemu/runstate.h"
 
+#ifdef CONFIG_MIPS_LOG_INSTR
+/* Report the address space for -dfilter asid=N: the MMID if it is in use. */
+void mips_log_instr_update_asid(CPUMIPSState *env)
+{
+    if ((env->CP0_Config5 >> CP0C5_MI) & 1) {
+        tcg_log_instr_update_asid(env_cpu(env),
+                                  (uint32_t)env->CP0_MemoryMapID);
+    } else {
+        tcg_log_instr_update_asid(env_cpu(env), cheri_get_asid(env));
+    }
+}
+#endif
 
 #ifndef CONFIG_USER_ONLY
 /* SMP helpers.  */
@@ -889,6 +901,9 @@ void helper_mtc0_memorymapid(CPUMIPSState *env, target_ulong arg1)
     /* If the MemoryMapID changes, flush qemu's TLB.  */
     if (old != env->CP0_MemoryMapID) {
         cpu_mips_tlb_flush(env);
+#ifdef CONFIG_MIPS_LOG_INSTR
+        mips_log_instr_update_asid(env);
+#endif
     }
 }
 
@@ -1172,7 +1187,20 @@ void helper_mtc0_entryhi(CPUMIPSState *env, target_ulong arg1)
     if ((old & env->CP0_EntryHi_ASID_mask) !=
         (val & env->CP0_EntryHi_ASID_mask)) {
         tlb_flush(env_cpu(env));
+#ifdef CONFIG_MIPS_LOG_INSTR
+        mips_log_instr_update_asid(env);
+#endif
     }
+#if defined(TARGET_CHERI)
+    /*
+     * The softmmu TLB caches PAGE_LC_TRAP (used by capability loads), which
+     * depends on the capability load generation bits.
+     */
+    else if ((old ^ val) & ((1UL << CP0EnHi_CLGU) | (1UL << CP0EnHi_CLGS) |
+                            (1UL << CP0EnHi_CLGK))) {
+        tlb_flush(env_cpu(env));
+    }
+#endif
 }
 
 void helper_mttc0_entryhi(CPUMIPSState *env, target_ulong arg1)
@@ -1342,6 +1370,10 @@ void helper_mtc0_config5(CPUMIPSState *env, target_ulong arg1)
     env->CP0_EntryHi_ASID_mask = (env->CP0_Config5 & (1 << CP0C5_MI)) ?
             0x0 : (env->CP0_Config4 & (1 << CP0C4_AE)) ? 0x3ff : 0xff;
     compute_hflags(env);
+#ifdef CONFIG_MIPS_LOG_INSTR
+    /* Config5.MI switches between the ASID and the MMID. */
+    mips_log_instr_update_asid(env);
+#endif
 }
 
 void helper_mtc0_lladdr(CPUMIPSState *env, target_ulong arg1)
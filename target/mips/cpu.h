@@ -5,6 +5,7 @@
 #include "exec/cpu-defs.h"
 #include "fpu/softfloat-types.h"
 #include "mips-defs.h"
+#include "exec/cvtrace.h"
 
 #ifdef TARGET_CHERI
 #include "cheri_defs.h"
@@ -102,6 +103,8 @@ struct CPUMIPSFPUContext {
 };
 
 #define TARGET_INSN_START_EXTRA_WORDS 2
+/* The icount statcounters are updated per TB, see restore_insn_count_to_opc() */
+#define TARGET_HAS_TB_INSN_COUNTER
 
 typedef struct CPUMIPSMVPContext CPUMIPSMVPContext;
 struct CPUMIPSMVPContext {
@@ -136,35 +139,6 @@ typedef struct mips_def_t mips_def_t;
 #define MIPS_KSCRATCH_NUM 6
 #define MIPS_MAAR_MAX 16 /* Must be an even number. */
 
-#ifdef CONFIG_MIPS_LOG_INSTR
-struct cvtrace {
-    uint8_t version;
-#define CVT_GPR     1   /* GPR change (val2) */
-#define CVT_LD_GPR  2   /* Load into GPR (val2) from address (val1) */
-#define CVT_ST_GPR  3   /* Store from GPR (val2) to address (val1) */
-#define CVT_NO_REG  4   /* No register is changed. */
-#define CVT_CAP     11  /* Cap change (val2,val3,val4,val5) */
-#define CVT_LD_CAP  12  /* Load Cap (val2,val3,val4,val5) from addr (val1) */
-#define CVT_ST_CAP  13  /* Store Cap (val2,val3,val4,val5) to addr (val1) */
-    uint8_t exception;  /* 0=none, 1=TLB Mod, 2=TLB Load, 3=TLB Store, etc. */
-    uint16_t cycles;    /* Currently not used. */
-    uint32_t inst;      /* Encoded instruction. */
-    uint64_t pc;        /* PC value of instruction. */
-    uint64_t val1;      /* val1 is used for memory address. */
-    uint64_t val2;      /* val2, val3, val4, val5 are used for reg content. */
-    uint64_t val3;
-    uint64_t val4;
-    uint64_t val5;
-    uint8_t thread;     /* Hardware thread/CPU (i.e. cpu->cpu_index ) */
-    uint8_t asid;       /* Address Space ID (i.e. CP0_TCStatus & 0xff) */
-} __attribute__((packed));
-typedef struct cvtrace cvtrace_t;
-
-/* Version 3 Cheri Stream Trace header info */
-#define CVT_QEMU_VERSION    (0x80U + 3)
-#define CVT_QEMU_MAGIC      "CheriTraceV03"
-#endif // CONFIG_MIPS_LOG_INSTR
-
 #if defined(TARGET_CHERI)
 
 struct cheri_cap_hwregs {
@@ -1055,6 +1029,10 @@ struct CPUMIPSState {
     uint32_t llnewval_wp;
 #ifdef TARGET_CHERI
     uint64_t linkedflag; // TODO: remove this!
+    /* Capability loaded by CLLC, compared against memory by CSCC */
+    uint64_t cap_llval_pesbt;
+    uint64_t cap_llval_cursor;
+    bool cap_llval_tag;
 #endif
     uint64_t CP0_LLAddr_rw_bitmask;
     int CP0_LLAddr_shift;
@@ -25,6 +25,7 @@
 #include "exec/log.h"
 #include "qemu/atomic.h"
 #include "qemu/error-report.h"
+#include "qemu/xxhash.h"
 #include "hw/mips/cpudevs.h"
 #include "qapi/qapi-commands-machine-target.h"
 
@@ -77,17 +78,153 @@ int fixed_mmu_map_address(CPUMIPSState *env, hwaddr *physical, int *prot,
     return TLBRET_MATCH;
 }
 
-/* MIPS32/MIPS64 R4000-style MMU emulation */
-int r4k_map_address(CPUMIPSState *env, hwaddr *physical, int *prot,
-                    target_ulong address, int rw, int access_type)
+/*
+ * Hash index for the R4000-style TLB, so that lookups don't have to scan all
+ * entries. Global entries are hashed without an ASID/MMID. Since the VPN2
+ * used as key depends on the page size a lookup has to probe once for every
+ * distinct PageMask in use, but there are normally only one or two of those.
+ */
+static inline target_ulong r4k_tlb_mask(uint32_t PageMask)
+{
+    /* 1k pages are not supported. */
+    return PageMask | ~(TARGET_PAGE_MASK << 1);
+}
+
+static inline unsigned r4k_tlb_hash(target_ulong vpn, uint32_t mmid, bool global)
+{
+    return qemu_xxhash4(vpn, global ? UINT64_MAX : mmid) &
+           (R4K_TLB_HASH_SIZE - 1);
+}
+
+static void r4k_tlb_index_remove(CPUMIPSTLBContext *tlbc, int idx)
+{
+    int bucket = tlbc->mmu.r4k.hash_bucket[idx];
+    int16_t *p;
+    uint32_t i;
+
+    if (bucket < 0) {
+        return;
+    }
+    for (p = &tlbc->mmu.r4k.hash_head[bucket]; *p != idx;
+         p = &tlbc->mmu.r4k.hash_next[*p]) {
+        assert(*p >= 0);
+    }
+    *p = tlbc->mmu.r4k.hash_next[idx];
+    tlbc->mmu.r4k.hash_bucket[idx] = -1;
+
+    for (i = 0; i < tlbc->mmu.r4k.nb_pagemasks; i++) {
+        if (tlbc->mmu.r4k.pagemasks[i] == tlbc->mmu.r4k.hash_pagemask[idx]) {
+            break;
+        }
+    }
+    assert(i < tlbc->mmu.r4k.nb_pagemasks);
+    if (--tlbc->mmu.r4k.pagemask_refs[i] == 0) {
+        uint32_t last = --tlbc->mmu.r4k.nb_pagemasks;
+        tlbc->mmu.r4k.pagemasks[i] = tlbc->mmu.r4k.pagemasks[last];
+        tlbc->mmu.r4k.pagemask_refs[i] = tlbc->mmu.r4k.pagemask_refs[last];
+    }
+}
+
+static void r4k_tlb_index_insert(CPUMIPSTLBContext *tlbc, int idx)
+{
+    r4k_tlb_t *tlb = &tlbc->mmu.r4k.tlb[idx];
+    uint32_t tlb_mmid;
+    unsigned bucket;
+    uint32_t i;
+
+    if (idx >= tlbc->tlb_in_use || tlb->EHINV) {
+        return;
+    }
+    tlb_mmid = tlbc->mmu.r4k.index_mi ? tlb->MMID : (uint32_t) tlb->ASID;
+    bucket = r4k_tlb_hash(tlb->VPN & ~r4k_tlb_mask(tlb->PageMask), tlb_mmid,
+                          tlb->G);
+    tlbc->mmu.r4k.hash_next[idx] = tlbc->mmu.r4k.hash_head[bucket];
+    tlbc->mmu.r4k.hash_head[bucket] = idx;
+    tlbc->mmu.r4k.hash_bucket[idx] = bucket;
+    tlbc->mmu.r4k.hash_pagemask[idx] = tlb->PageMask;
+
+    for (i = 0; i < tlbc->mmu.r4k.nb_pagemasks; i++) {
+        if (tlbc->mmu.r4k.pagemasks[i] == tlb->PageMask) {
+            break;
+        }
+    }
+    if (i == tlbc->mmu.r4k.nb_pagemasks) {
+        tlbc->mmu.r4k.nb_pagemasks++;
+        tlbc->mmu.r4k.pagemasks[i] = tlb->PageMask;
+        tlbc->mmu.r4k.pagemask_refs[i] = 0;
+    }
+    tlbc->mmu.r4k.pagemask_refs[i]++;
+}
+
+void r4k_tlb_index_update(CPUMIPSState *env, int idx)
+{
+    CPUMIPSTLBContext *tlbc = env->tlb;
+
+    r4k_tlb_index_remove(tlbc, idx);
+    r4k_tlb_index_insert(tlbc, idx);
+}
+
+void r4k_tlb_index_rebuild(CPUMIPSState *env)
+{
+    CPUMIPSTLBContext *tlbc = env->tlb;
+    int i;
+
+    memset(tlbc->mmu.r4k.hash_head, -1, sizeof(tlbc->mmu.r4k.hash_head));
+    memset(tlbc->mmu.r4k.hash_bucket, -1, sizeof(tlbc->mmu.r4k.hash_bucket));
+    tlbc->mmu.r4k.nb_pagemasks = 0;
+    tlbc->mmu.r4k.index_mi = !!((env->CP0_Config5 >> CP0C5_MI) & 1);
+    for (i = 0; i < tlbc->tlb_in_use; i++) {
+        r4k_tlb_index_insert(tlbc, i);
+    }
+}
+
+/*
+ * Return the lowest index of a valid TLB entry (including shadow entries)
+ * matching @address and the current ASID/MMID, or -1.
+ */
+int r4k_tlb_lookup(CPUMIPSState *env, target_ulong address)
 {
+    CPUMIPSTLBContext *tlbc = env->tlb;
     uint16_t ASID = env->CP0_EntryHi & env->CP0_EntryHi_ASID_mask;
     uint32_t MMID = env->CP0_MemoryMapID;
     bool mi = !!((env->CP0_Config5 >> CP0C5_MI) & 1);
-    uint32_t tlb_mmid;
-    int i;
+    int found = -1;
+    uint32_t m;
 
     MMID = mi ? MMID : (uint32_t) ASID;
+    if (unlikely(mi != tlbc->mmu.r4k.index_mi)) {
+        r4k_tlb_index_rebuild(env);
+    }
+    for (m = 0; m < tlbc->mmu.r4k.nb_pagemasks; m++) {
+        uint32_t PageMask = tlbc->mmu.r4k.pagemasks[m];
+        target_ulong mask = r4k_tlb_mask(PageMask);
+        target_ulong tag = address & ~mask;
+        int global;
+#if defined(TARGET_MIPS64)
+        tag &= env->SEGMask;
+#endif
+        for (global = 0; global < 2; global++) {
+            int i = tlbc->mmu.r4k.hash_head[r4k_tlb_hash(tag, MMID, global)];
+            for (; i >= 0; i = tlbc->mmu.r4k.hash_next[i]) {
+                r4k_tlb_t *tlb = &tlbc->mmu.r4k.tlb[i];
+                uint32_t tlb_mmid = mi ? tlb->MMID : (uint32_t) tlb->ASID;
+                /* Check ASID/MMID, virtual page number & size */
+                if (tlb->PageMask == PageMask && (tlb->VPN & ~mask) == tag &&
+                    (tlb->G == 1 || tlb_mmid == MMID) &&
+                    (found < 0 || i < found)) {
+                    found = i;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+/* MIPS32/MIPS64 R4000-style MMU emulation */
+int r4k_map_address(CPUMIPSState *env, hwaddr *physical, int *prot,
+                    target_ulong address, int rw, int access_type)
+{
+    int i;
 
 #if defined(TARGET_CHERI)
     unsigned gclg_bit;
@@ -110,81 +247,79 @@ int r4k_map_address(CPUMIPSState *env, hwaddr *physical, int *prot,
     bool gclg = !!(env->CP0_EntryHi & (1UL << gclg_bit));
 #endif
 
-    for (i = 0; i < env->tlb->tlb_in_use; i++) {
+    i = r4k_tlb_lookup(env, address);
+    if (i >= 0) {
         r4k_tlb_t *tlb = &env->tlb->mmu.r4k.tlb[i];
         /* 1k pages are not supported. */
         target_ulong mask = tlb->PageMask | ~(TARGET_PAGE_MASK << 1);
-        target_ulong tag = address & ~mask;
-        target_ulong VPN = tlb->VPN & ~mask;
-#if defined(TARGET_MIPS64)
-        tag &= env->SEGMask;
-#endif
-
-        /* Check ASID/MMID, virtual page number & size */
-        tlb_mmid = mi ? tlb->MMID : (uint32_t) tlb->ASID;
-        if ((tlb->G == 1 || tlb_mmid == MMID) && VPN == tag && !tlb->EHINV) {
-            /* TLB match */
-            int n = !!(address & mask & ~(mask >> 1));
-            /* Check access rights */
-            if (!(n ? tlb->V1 : tlb->V0)) {
-                return TLBRET_INVALID;
-            }
+        /* TLB match */
+        int n = !!(address & mask & ~(mask >> 1));
+        /* Check access rights */
+        if (!(n ? tlb->V1 : tlb->V0)) {
+            return TLBRET_INVALID;
+        }
 #if defined(TARGET_CHERI)
-            if (rw == MMU_DATA_CAP_STORE) {
-                /*
-                 * If we're trying to do a cap-store, first check for the
-                 * dirty/store-permitted bit before looking at the the
-                 * store-capability inhibit.
-                 */
-                if (!(n ? tlb->D1 : tlb->D0)) {
-                    return TLBRET_DIRTY;
-                }
-                if (n ? tlb->S1 : tlb->S0) {
-                    return TLBRET_S;
-                }
-            }
-#else
-            if (rw == MMU_INST_FETCH && (n ? tlb->XI1 : tlb->XI0)) {
-                return TLBRET_XI;
+        if (rw == MMU_DATA_CAP_STORE) {
+            /*
+             * If we're trying to do a cap-store, first check for the
+             * dirty/store-permitted bit before looking at the the
+             * store-capability inhibit.
+             */
+            if (!(n ? tlb->D1 : tlb->D0)) {
+                return TLBRET_DIRTY;
             }
-            if (rw == MMU_DATA_LOAD && (n ? tlb->RI1 : tlb->RI0)) {
-                return TLBRET_RI;
+            if (n ? tlb->S1 : tlb->S0) {
+                return TLBRET_S;
             }
+        }
+#else
+        if (rw == MMU_INST_FETCH && (n ? tlb->XI1 : tlb->XI0)) {
+            return TLBRET_XI;
+        }
+        if (rw == MMU_DATA_LOAD && (n ? tlb->RI1 : tlb->RI0)) {
+            return TLBRET_RI;
+        }
 #endif /* TARGET_CHERI */
 
-            if (( (rw != MMU_DATA_STORE)
+        if (( (rw != MMU_DATA_STORE)
 #if defined(TARGET_CHERI)
-                  && (rw != MMU_DATA_CAP_STORE)
+              && (rw != MMU_DATA_CAP_STORE)
 #endif
-                ) || (n ? tlb->D1 : tlb->D0)) {
+            ) || (n ? tlb->D1 : tlb->D0)) {
 
-                *physical = tlb->PFN[n] | (address & (mask >> 1));
-                *prot = PAGE_READ;
-                if (n ? tlb->D1 : tlb->D0) {
-                    *prot |= PAGE_WRITE;
-                }
+            *physical = tlb->PFN[n] | (address & (mask >> 1));
+            *prot = PAGE_READ;
+            if (n ? tlb->D1 : tlb->D0) {
+                *prot |= PAGE_WRITE;
+            }
 #if !defined(TARGET_CHERI)
-                if (!(n ? tlb->XI1 : tlb->XI0)) {
+            if (!(n ? tlb->XI1 : tlb->XI0)) {
 #else
-                if (true) {
+            if (true) {
 #endif
-                    *prot |= PAGE_EXEC;
-                }
+                *prot |= PAGE_EXEC;
+            }
 
 #if defined(TARGET_CHERI)
-                if (n ? tlb->L1 : tlb->L0) {
-                    *prot |= PAGE_LC_CLEAR;
-                }
-                bool pclg = n ? tlb->CLG1 : tlb->CLG0;
-                if (pclg != gclg) {
-                    *prot |= PAGE_LC_TRAP;
-                }
+            if (n ? tlb->L1 : tlb->L0) {
+                *prot |= PAGE_LC_CLEAR;
+            }
+            bool pclg = n ? tlb->CLG1 : tlb->CLG0;
+            if (pclg != gclg) {
+                *prot |= PAGE_LC_TRAP;
+            }
+            /*
+             * Not used for translation, but cached in the softmmu TLB so
+             * that tag writes know when to take the slow path.
+             */
+            if (n ? tlb->S1 : tlb->S0) {
+                *prot |= PAGE_SC_TRAP;
+            }
 #endif
 
-                return TLBRET_MATCH;
-            }
-            return TLBRET_DIRTY;
+            return TLBRET_MATCH;
         }
+        return TLBRET_DIRTY;
     }
     return TLBRET_NOMATCH;
 }
@@ -429,9 +564,15 @@ static int get_physical_address(CPUMIPSState *env, hwaddr *physical,
 
 void cpu_mips_tlb_flush(CPUMIPSState *env)
 {
+    uint32_t old_in_use = env->tlb->tlb_in_use;
+    int i;
+
     /* Flush qemu's TLB and discard all shadowed entries.  */
     tlb_flush(env_cpu(env));
     env->tlb->tlb_in_use = env->tlb->nb_tlb;
+    for (i = env->tlb->nb_tlb; i < old_in_use; i++) {
+        r4k_tlb_index_update(env, i);
+    }
 }
 
 /* Called for updates to CP0_Status.  */
@@ -1677,6 +1818,7 @@ void r4k_invalidate_tlb(CPUMIPSState *env, int idx, int use_extra)
          */
         env->tlb->mmu.r4k.tlb[env->tlb->tlb_in_use] = *tlb;
         env->tlb->tlb_in_use++;
+        r4k_tlb_index_update(env, env->tlb->tlb_in_use - 1);
         return;
     }
 
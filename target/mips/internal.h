@@ -130,6 +130,9 @@ struct r4k_tlb_t {
     uint64_t PFN[2];
 };
 
+#define R4K_TLB_HASH_BITS 8
+#define R4K_TLB_HASH_SIZE (1 << R4K_TLB_HASH_BITS)
+
 struct CPUMIPSTLBContext {
     uint32_t nb_tlb;
     uint32_t tlb_in_use;
@@ -144,6 +147,20 @@ struct CPUMIPSTLBContext {
     union {
         struct {
             r4k_tlb_t tlb[MIPS_TLB_MAX];
+            /*
+             * Hash index over the valid entries in tlb[0, tlb_in_use),
+             * keyed on (VPN2 & ~PageMask, ASID/MMID or global). Not
+             * migrated, rebuilt with r4k_tlb_index_rebuild().
+             */
+            int16_t hash_head[R4K_TLB_HASH_SIZE];
+            int16_t hash_next[MIPS_TLB_MAX];
+            int16_t hash_bucket[MIPS_TLB_MAX]; /* -1 if not indexed */
+            uint32_t hash_pagemask[MIPS_TLB_MAX]; /* PageMask when indexed */
+            /* Distinct PageMask values of the indexed entries */
+            uint32_t nb_pagemasks;
+            uint32_t pagemasks[MIPS_TLB_MAX];
+            uint16_t pagemask_refs[MIPS_TLB_MAX];
+            bool index_mi; /* Config5.MI when the index was built */
         } r4k;
     } mmu;
 };
@@ -161,6 +178,10 @@ void r4k_helper_tlbr(CPUMIPSState *env);
 void r4k_helper_tlbinv(CPUMIPSState *env);
 void r4k_helper_tlbinvf(CPUMIPSState *env);
 void r4k_invalidate_tlb(CPUMIPSState *env, int idx, int use_extra);
+/* Update the hash index after tlb[idx] or tlb_in_use changed. */
+void r4k_tlb_index_update(CPUMIPSState *env, int idx);
+void r4k_tlb_index_rebuild(CPUMIPSState *env);
+int r4k_tlb_lookup(CPUMIPSState *env, target_ulong address);
 
 void mips_cpu_do_transaction_failed(CPUState *cs, hwaddr physaddr,
                                     vaddr addr, unsigned size,
@@ -584,6 +605,10 @@ static inline unsigned cheri_get_asid(CPUMIPSState *env) {
     return ASID;
 }
 
+#ifdef CONFIG_MIPS_LOG_INSTR
+void mips_log_instr_update_asid(CPUMIPSState *env);
+#endif
+
 void set_CP0_EPC(CPUMIPSState *env, target_ulong value);
 void set_CP0_ErrorEPC(CPUMIPSState *env, target_ulong value);
 #ifdef CONFIG_MIPS_LOG_INSTR
@@ -12,6 +12,7 @@ static int cpu_post_load(void *opaque, int version_id)
     restore_msa_fp_status(env);
     compute_hflags(env);
     restore_pamask(env);
+    r4k_tlb_index_rebuild(env);
 
     return 0;
 }
@@ -45,7 +45,7 @@
 void helper_raise_exception_err(CPUMIPSState *env, uint32_t exception,
                                 int error_code)
 {
-    do_raise_exception_err(env, exception, error_code, 0);
+    do_raise_exception_err(env, exception, error_code, GETPC());
 }
 
 void helper_raise_exception(CPUMIPSState *env, uint32_t exception)
@@ -53,16 +53,15 @@ void helper_raise_exception(CPUMIPSState *env, uint32_t exception)
     do_raise_exception(env, exception, GETPC());
 }
 
+/*
+ * Only generated at the end of a TB with PC already saved, so there is no
+ * state to restore and the icount statcounter is exact.
+ */
 void helper_raise_exception_debug(CPUMIPSState *env)
 {
     do_raise_exception(env, EXCP_DEBUG, 0);
 }
 
-static void raise_exception(CPUMIPSState *env, uint32_t exception)
-{
-    do_raise_exception(env, exception, 0);
-}
-
 void helper_check_breakcount(struct CPUMIPSState* env)
 {
     CPUState *cs = env_cpu(env);
@@ -71,7 +70,7 @@ void helper_check_breakcount(struct CPUMIPSState* env)
         cs->breakcount--;
         if (cs->breakcount == 0UL) {
             qemu_log_mask(CPU_LOG_INSTR | CPU_LOG_INT | CPU_LOG_EXEC, "Reached breakcount!\n");
-            helper_raise_exception_debug(env);
+            do_raise_exception(env, EXCP_DEBUG, GETPC());
         }
     }
 }
@@ -679,6 +678,7 @@ static void r4k_mips_tlb_flush_extra(CPUMIPSState *env, int first)
     /* Discard entries from env->tlb[first] onwards.  */
     while (env->tlb->tlb_in_use > first) {
         r4k_invalidate_tlb(env, --env->tlb->tlb_in_use, 0);
+        r4k_tlb_index_update(env, env->tlb->tlb_in_use);
     }
 }
 
@@ -753,6 +753,7 @@ void r4k_helper_tlbinv(CPUMIPSState *env)
         tlb_mmid = mi ? tlb->MMID : (uint32_t) tlb->ASID;
         if (!tlb->G && tlb_mmid == MMID) {
             tlb->EHINV = 1;
+            r4k_tlb_index_update(env, idx);
         }
     }
     cpu_mips_tlb_flush(env);
@@ -764,6 +765,7 @@ void r4k_helper_tlbinvf(CPUMIPSState *env)
 
     for (idx = 0; idx < env->tlb->nb_tlb; idx++) {
         env->tlb->mmu.r4k.tlb[idx].EHINV = 1;
+        r4k_tlb_index_update(env, idx);
     }
     cpu_mips_tlb_flush(env);
 }
@@ -839,6 +841,7 @@ void r4k_helper_tlbwi(CPUMIPSState *env)
 
     r4k_invalidate_tlb(env, idx, 0);
     r4k_fill_tlb(env, idx);
+    r4k_tlb_index_update(env, idx);
 #ifdef CONFIG_MIPS_LOG_INSTR
     if (qemu_loglevel_mask(CPU_LOG_INSTR))
         r4k_dump_tlb(env, idx);
@@ -851,6 +854,7 @@ void r4k_helper_tlbwr(CPUMIPSState *env)
 
     r4k_invalidate_tlb(env, r, 1);
     r4k_fill_tlb(env, r);
+    r4k_tlb_index_update(env, r);
 #ifdef CONFIG_MIPS_LOG_INSTR
     if (qemu_loglevel_mask(CPU_LOG_INSTR))
         r4k_dump_tlb(env, r);
@@ -870,24 +874,11 @@ void r4k_helper_tlbp(CPUMIPSState *env)
     int i;
 
     MMID = mi ? MMID : (uint32_t) ASID;
-    for (i = 0; i < env->tlb->nb_tlb; i++) {
-        tlb = &env->tlb->mmu.r4k.tlb[i];
-        /* 1k pages are not supported. */
-        mask = tlb->PageMask | ~(TARGET_PAGE_MASK << 1);
-        tag = env->CP0_EntryHi & ~mask;
-        VPN = tlb->VPN & ~mask;
-#if defined(TARGET_MIPS64)
-        tag &= env->SEGMask;
-#endif
-        tlb_mmid = mi ? tlb->MMID : (uint32_t) tlb->ASID;
-        /* Check ASID/MMID, virtual page number & size */
-        if ((tlb->G == 1 || tlb_mmid == MMID) && VPN == tag && !tlb->EHINV) {
-            /* TLB match */
-            env->CP0_Index = i;
-            break;
-        }
-    }
-    if (i == env->tlb->nb_tlb) {
+    i = r4k_tlb_lookup(env, env->CP0_EntryHi);
+    if (i >= 0 && i < env->tlb->nb_tlb) {
+        /* TLB match */
+        env->CP0_Index = i;
+    } else {
         /* No match.  Discard any shadow entries, if any of them match.  */
         for (i = env->tlb->nb_tlb; i < env->tlb->tlb_in_use; i++) {
             tlb = &env->tlb->mmu.r4k.tlb[i];
@@ -1044,6 +1035,7 @@ static void global_invalidate_tlb(CPUMIPSState *env,
             (VAMatch && invVA) ||
             (MMidMatch && !(tlb->G) && invMMid)) {
             tlb->EHINV = 1;
+            r4k_tlb_index_update(env, idx);
         }
     }
     cpu_mips_tlb_flush(env);
@@ -1307,9 +1299,10 @@ void helper_wait(CPUMIPSState *env)
     cpu_reset_interrupt(cs, CPU_INTERRUPT_WAKE);
     /*
      * Last instruction in the block, PC was updated before
-     * - no need to recover PC and icount.
+     * - no need to recover PC and icount. This also means that the whole TB
+     * has been executed, so the icount statcounter needs no fixup either.
      */
-    raise_exception(env, EXCP_HLT);
+    do_raise_exception(env, EXCP_HLT, 0);
 }
 
 #if !defined(CONFIG_USER_ONLY)
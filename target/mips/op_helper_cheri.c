@@ -41,6 +41,7 @@
 #include "exec/exec-all.h"
 #include "exec/cpu_ldst.h"
 #include "exec/helper-proto.h"
+#include "exec/log_instr_binary.h"
 
 #ifndef TARGET_CHERI
 #error "This file should only be compiled for CHERI"
@@ -97,6 +98,14 @@ is_cap_sealed(const cap_register_t *cp)
 }
 
 void qemu_log_capreg(const cap_register_t *cr, const char* prefix, const char* name) {
+    if (log_instr_binary_enabled()) {
+        log_instr_bin_text(current_cpu->env_ptr,
+                           "%s%s|" PRINT_CAP_FMTSTR_L1 "\n"
+                           "             |" PRINT_CAP_FMTSTR_L2 "\n",
+                           prefix, name, PRINT_CAP_ARGS_L1(cr),
+                           PRINT_CAP_ARGS_L2(cr));
+        return;
+    }
     qemu_log("%s%s|" PRINT_CAP_FMTSTR_L1 "\n"
              "             |" PRINT_CAP_FMTSTR_L2 "\n",
              prefix, name, PRINT_CAP_ARGS_L1(cr), PRINT_CAP_ARGS_L2(cr));
@@ -773,8 +782,15 @@ target_ulong CHERI_HELPER_IMPL(cscc_without_tcg(CPUArchState *env, uint32_t cs,
     /* If linkedflag is zero then don't store capability. */
     if (!env->linkedflag || env->lladdr != vaddr)
         return 0;
+#if defined(CHERI_128) && QEMU_USE_COMPRESSED_CHERI_CAPS
+    // Only store if memory still holds the capability loaded by CLLC.
+    return cmpxchg_cap_in_memory(env, cs, vaddr, env->cap_llval_pesbt,
+                                 env->cap_llval_cursor, env->cap_llval_tag,
+                                 retpc);
+#else
     store_cap_to_memory(env, cs, vaddr, retpc);
     return 1;
+#endif
 }
 
 void CHERI_HELPER_IMPL(cllc_without_tcg(CPUArchState *env, uint32_t cd, uint32_t cb))
@@ -803,8 +819,21 @@ void CHERI_HELPER_IMPL(cllc_without_tcg(CPUArchState *env, uint32_t cd, uint32_t
     }
     cheri_debug_assert(align_of(CHERI_CAP_SIZE, addr) == 0);
     hwaddr physaddr;
+#if defined(CHERI_128) && QEMU_USE_COMPRESSED_CHERI_CAPS
+    uint64_t pesbt, cursor;
+    bool raw_tag;
+    bool tag = load_cap_from_memory_128(env, &pesbt, &cursor, cb, cbp, addr,
+                                        _host_return_address, &physaddr,
+                                        &raw_tag);
+    update_compressed_capreg(env, cd, pesbt, tag, cursor);
+    env->cap_llval_pesbt = pesbt;
+    env->cap_llval_cursor = cursor;
+    // CSCC compares against memory, so remember the unfiltered tag.
+    env->cap_llval_tag = raw_tag;
+#else
     load_cap_from_memory(env, cd, cb, cbp, /*addr=*/cap_get_cursor(cbp),
                          _host_return_address, &physaddr);
+#endif
     env->lladdr = addr;
     env->CP0_LLAddr = physaddr;
     env->linkedflag = 1; // FIXME: remove
@@ -826,7 +855,11 @@ void dump_changed_capreg(CPUArchState *env, const cap_register_t *cr,
             cvtrace_dump_cap_cbl(&env->cvtrace, cr);
         }
         if (qemu_loglevel_mask(CPU_LOG_INSTR)) {
-            qemu_log_capreg(cr, "    Write ", name);
+            if (log_instr_binary_enabled()) {
+                log_instr_bin_changed_capreg(env, name, cr);
+            } else {
+                qemu_log_capreg(cr, "    Write ", name);
+            }
         }
         *old_reg = *cr;
     }
@@ -942,22 +975,32 @@ void store_cap_to_memory(CPUArchState *env, uint32_t cs, target_ulong vaddr,
     inmemory_chericap256 mem_buffer;
     compress_256cap(&mem_buffer, csp);
     /*
-     * Touching the tags will take both the data write TLB fault and
-     * capability write TLB fault before updating anything.  Thereafter, the
-     * data stores will not take additional faults, so there is no risk of
-     * accidentally tagging a shorn data write.  This, like the rest of the
-     * tag logic, is not multi-TCG-thread safe.
+     * Take the data write TLB fault and, for a tagged capability, the
+     * capability write TLB fault before updating anything, so that there is
+     * no risk of leaving a shorn data write behind. The tag is not touched
+     * until the data has been written. This is not multi-TCG-thread safe.
      */
-    /* Store the "magic" data with the tags */
-    cheri_tag_set_m128(env, vaddr, cs, csp->cr_tag,
-                       mem_buffer.u64s[0] /* tps */,
-                       mem_buffer.u64s[3] /* length */, retpc);
+    probe_write(env, vaddr, CHERI_CAP_SIZE, cpu_mmu_index(env, false), retpc);
+    if (csp->cr_tag) {
+        ram_addr_t tag_offset;
+        cheri_tag_resolve_store(env, vaddr, cs, true, &tag_offset, retpc);
+    }
     env->statcounters_cap_write++;
     if (csp->cr_tag) {
         env->statcounters_cap_write_tagged++;
     }
     cpu_stq_data_ra(env, vaddr, mem_buffer.u64s[2], retpc); /* base */
     cpu_stq_data_ra(env, vaddr + 8, mem_buffer.u64s[1], retpc);
+    /*
+     * The data stores above cleared any old tag. For a tagged capability,
+     * set it and the "magic" data now. This can't fault since the TLB
+     * exceptions were taken above.
+     */
+    if (csp->cr_tag) {
+        cheri_tag_set_m128(env, vaddr, cs, csp->cr_tag,
+                           mem_buffer.u64s[0] /* tps */,
+                           mem_buffer.u64s[3] /* length */, retpc);
+    }
 
 #ifdef CONFIG_MIPS_LOG_INSTR
     /* Log memory cap write, if needed. */
@@ -1044,17 +1087,44 @@ void load_cap_from_memory(CPUArchState *env, uint32_t cd, uint32_t cb,
 {
     cap_register_t ncd;
     int prot;
-
-    // TODO: do one physical translation and then use that to speed up tag read
-    /* Load otype and perms from memory (might trap on load) */
+    bool tag;
     inmemory_chericap256 mem_buffer;
-    mem_buffer.u64s[0] =
-        cpu_ldq_data_ra(env, vaddr + 0, retpc); /* perms+otype */
-    mem_buffer.u64s[1] = cpu_ldq_data_ra(env, vaddr + 8, retpc);  /* cursor */
-    mem_buffer.u64s[2] = cpu_ldq_data_ra(env, vaddr + 16, retpc); /* base */
-    mem_buffer.u64s[3] = cpu_ldq_data_ra(env, vaddr + 24, retpc); /* length */
 
-    bool tag = cheri_tag_get(env, vaddr, cd, physaddr, &prot, retpc);
+    /* No TLB fault possible after this, so we can get a host pointer */
+    void *host = probe_read(env, vaddr, CHERI_CAP_SIZE,
+                            cpu_mmu_index(env, false), retpc);
+    if (likely(host)) {
+        // Fast path, host address in TLB. With MTTCG, retry if a capability
+        // store to the same location raced with reading data and tag.
+        unsigned seq;
+        do {
+            seq = cheri_tag_reader_begin(host);
+            for (int i = 0; i < 4; i++) {
+                mem_buffer.u64s[i] = ldq_p((char *)host + i * 8);
+            }
+            tag = cheri_tag_get(env, vaddr, cd, physaddr, &prot, retpc);
+        } while (cheri_tag_reader_retry(host, seq));
+#ifdef CONFIG_MIPS_LOG_INSTR
+        // cpu_ldq_data_ra() performs the read logging, with raw memory
+        // accesses we have to do it manually
+        if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR | CPU_LOG_CVTRACE,
+                                           vaddr))) {
+            for (int i = 0; i < 4; i++) {
+                helper_dump_load64(env, vaddr + i * 8, mem_buffer.u64s[i],
+                                   MO_64);
+            }
+        }
+#endif
+    } else {
+        // Slow path for e.g. IO regions.
+        mem_buffer.u64s[0] =
+            cpu_ldq_data_ra(env, vaddr + 0, retpc); /* perms+otype */
+        mem_buffer.u64s[1] = cpu_ldq_data_ra(env, vaddr + 8, retpc);  /* cursor */
+        mem_buffer.u64s[2] = cpu_ldq_data_ra(env, vaddr + 16, retpc); /* base */
+        mem_buffer.u64s[3] = cpu_ldq_data_ra(env, vaddr + 24, retpc); /* length */
+        tag = cheri_tag_get(env, vaddr, cd, physaddr, &prot, retpc);
+    }
+
     tag = cheri_tag_prot_clear_or_trap(env, vaddr, cb, source, prot, retpc, tag);
     env->statcounters_cap_read++;
     if (tag)
@@ -1108,26 +1178,62 @@ void store_cap_to_memory(CPUArchState *env, uint32_t cs, target_ulong vaddr,
     compress_256cap(&mem_buffer, csp);
 
     /*
-     * Touching the tags will take both the data write TLB fault and
+     * Resolving the tags will take both the data write TLB fault and
      * capability write TLB fault before updating anything.  Thereafter, the
      * data stores will not take additional faults, so there is no risk of
-     * accidentally tagging a shorn data write.  This, like the rest of the
-     * tag logic, is not multi-TCG-thread safe.
+     * accidentally tagging a shorn data write.  The data and the tag are
+     * written under the tag writer lock so that capability loads on other
+     * vCPUs (MTTCG) see either the old or the new capability.
      */
-
     env->statcounters_cap_write++;
     if (csp->cr_tag) {
         env->statcounters_cap_write_tagged++;
-        cheri_tag_set(env, vaddr, cs, NULL, retpc);
+    }
+    ram_addr_t tag_offset;
+    RAMBlock *tag_ram = cheri_tag_resolve_store(env, vaddr, cs, csp->cr_tag,
+                                                &tag_offset, retpc);
+    void *host = probe_write(env, vaddr, CHERI_CAP_SIZE,
+                             cpu_mmu_index(env, false), retpc);
+    if (likely(host)) {
+        // Fast path, host address in TLB
+        cheri_tag_writer_lock(host);
+        for (int i = 0; i < 4; i++) {
+            stq_p((char *)host + i * 8, mem_buffer.u64s[i]);
+        }
+        if (csp->cr_tag) {
+            cheri_tag_phys_set(env, tag_ram, tag_offset, vaddr);
+        } else if (tag_ram) {
+            cheri_tag_phys_invalidate(env, tag_ram, tag_offset, CHERI_CAP_SIZE,
+                                      &vaddr);
+        }
+        cheri_tag_writer_unlock(host);
+#ifdef CONFIG_MIPS_LOG_INSTR
+        // cpu_stq_data_ra() performs the write logging, with raw memory
+        // accesses we have to do it manually
+        if (unlikely(should_log_mem_access(env, CPU_LOG_INSTR | CPU_LOG_CVTRACE,
+                                           vaddr))) {
+            for (int i = 0; i < 4; i++) {
+                helper_dump_store64(env, vaddr + i * 8, mem_buffer.u64s[i],
+                                    MO_64);
+            }
+        }
+#endif
     } else {
-        cheri_tag_invalidate(env, vaddr, CHERI_CAP_SIZE, retpc);
+        // Slow path for e.g. IO regions.
+        qemu_log_mask(CPU_LOG_INSTR, "Using slow path for store to guest "
+                      "address " TARGET_FMT_plx "\n", vaddr);
+        cpu_stq_data_ra(env, vaddr + 0, mem_buffer.u64s[0], retpc);
+        cpu_stq_data_ra(env, vaddr + 8, mem_buffer.u64s[1], retpc);
+        cpu_stq_data_ra(env, vaddr + 16, mem_buffer.u64s[2], retpc);
+        cpu_stq_data_ra(env, vaddr + 24, mem_buffer.u64s[3], retpc);
+        if (csp->cr_tag) {
+            cheri_tag_phys_set(env, tag_ram, tag_offset, vaddr);
+        } else if (tag_ram) {
+            cheri_tag_phys_invalidate(env, tag_ram, tag_offset, CHERI_CAP_SIZE,
+                                      &vaddr);
+        }
     }
 
-    cpu_stq_data_ra(env, vaddr + 0, mem_buffer.u64s[0], retpc);
-    cpu_stq_data_ra(env, vaddr + 8, mem_buffer.u64s[1], retpc);
-    cpu_stq_data_ra(env, vaddr + 16, mem_buffer.u64s[2], retpc);
-    cpu_stq_data_ra(env, vaddr + 24, mem_buffer.u64s[3], retpc);
-
 #ifdef CONFIG_MIPS_LOG_INSTR
     /* Log memory cap write, if needed. */
     if (unlikely(qemu_loglevel_mask(CPU_LOG_INSTR))) {
@@ -36,6 +36,7 @@
 #include "exec/cpu_ldst.h"
 #include "exec/helper-proto.h"
 #include "exec/log.h"
+#include "exec/log_instr_binary.h"
 #include "cpu.h"
 #include "internal.h"
 
@@ -244,31 +245,11 @@ void helper_mips_cvtrace_log_instruction(CPUMIPSState *env, target_ulong pc)
 {
     if (unlikely(qemu_loglevel_mask(CPU_LOG_CVTRACE))) {
         int isa = (env->hflags & MIPS_HFLAG_M16) == 0 ? 0 : (env->insn_flags & ASE_MICROMIPS) ? 1 : 2;
-        static uint16_t cycles = 0;  /* XXX */
         uint32_t opcode;
-        CPUState *cs = env_cpu(env);
 
-        FILE* logfile = qemu_log_lock();
-        /* if the logfile is empty we need to emit the cvt magic */
-        if (env->cvtrace.version != 0 && ftell(logfile) != 0) {
-            /* Write previous instruction trace to log. */
-            fwrite(&env->cvtrace, sizeof(env->cvtrace), 1, logfile);
-        } else {
-            char buffer[sizeof(env->cvtrace)];
-
-            buffer[0] = CVT_QEMU_VERSION;
-            g_strlcpy(buffer+1, CVT_QEMU_MAGIC, sizeof(env->cvtrace)-2);
-            fwrite(buffer, sizeof(env->cvtrace), 1, logfile);
-            cycles = 0;
-        }
-        qemu_log_unlock(logfile);
-        bzero(&env->cvtrace, sizeof(env->cvtrace));
-        env->cvtrace.version = CVT_NO_REG;
-        env->cvtrace.pc = tswap64(pc);
-        env->cvtrace.cycles = tswap16(cycles++);
-        env->cvtrace.thread = (uint8_t)cs->cpu_index;
-        env->cvtrace.asid = (uint8_t)(env->active_tc.CP0_TCStatus & 0xff);
-        env->cvtrace.exception = 31;
+        /* Queue the previous instruction's record and start a new one. */
+        cvtrace_new_insn(env_cpu(env), &env->cvtrace, pc,
+                         (uint8_t)(env->active_tc.CP0_TCStatus & 0xff));
 
         /* Fetch opcode. */
         if (isa == 0) {
@@ -464,7 +445,13 @@ static void dump_changed_cop0_reg(CPUMIPSState *env, int idx,
 {
     if (value != env->last_cop0[idx]) {
         env->last_cop0[idx] = value;
-        if (cop0_name[idx])
+        if (log_instr_binary_enabled()) {
+            if (cop0_name[idx])
+                log_instr_bin_reg(env, cop0_name[idx], value);
+            else
+                log_instr_bin_text(env, "    Write (idx=%d) = " TARGET_FMT_lx
+                                   "\n", idx, value);
+        } else if (cop0_name[idx])
             qemu_log("    Write %s = " TARGET_FMT_lx "\n",
                     cop0_name[idx], value);
         else
@@ -650,6 +637,10 @@ static void dump_changed_regs(CPUMIPSState *env)
         if (cur->gpr[i] != env->last_gpr[i]) {
             env->last_gpr[i] = cur->gpr[i];
             cvtrace_dump_gpr(&env->cvtrace, cur->gpr[i]);
+            if (log_instr_binary_enabled()) {
+                log_instr_bin_reg(env, gpr_name[i], cur->gpr[i]);
+                continue;
+            }
             qemu_log_mask(CPU_LOG_INSTR, "    Write %s = " TARGET_FMT_lx "\n",
                           gpr_name[i], cur->gpr[i]);
         }
@@ -669,7 +660,11 @@ void helper_dump_changed_state(CPUMIPSState *env)
     /* Testing pointer equality is fine, it always points to the same constants */
     if (new_mode != env->last_mode) {
         env->last_mode = new_mode;
-        qemu_log_mask(CPU_LOG_INSTR, "--- %s\n", new_mode);
+        if (log_instr_binary_enabled()) {
+            log_instr_bin_text(env, "--- %s\n", new_mode);
+        } else {
+            qemu_log_mask(CPU_LOG_INSTR, "--- %s\n", new_mode);
+        }
     }
 
     if (qemu_loglevel_mask(CPU_LOG_INSTR | CPU_LOG_CVTRACE)) {
@@ -2802,6 +2802,8 @@ typedef struct DisasContext {
 #endif /* TARGET_CHERI */
     bool mi;
     int gi;
+    /* movi of the per-TB icount statcounter increment, patched at TB end */
+    TCGOp *statcounters_icount_op;
 } DisasContext;
 
 #define DISAS_STOP       DISAS_TARGET_0
@@ -2873,8 +2875,6 @@ static const char * const mxuregnames[] = {
         }                                                                     \
     } while (0)
 
-static inline void mips_update_statcounters_icount(DisasContext *ctx);
-
 /* General purpose registers moves. */
 static inline void gen_load_gpr(TCGv t, int reg)
 {
@@ -13666,6 +13666,12 @@ static void gen_rdhwr(DisasContext *ctx, int rt, int rd, int sel)
     case 4: /* ICOUNT */
         gen_helper_1e0i(rdhwr_statcounters_icount, t0, sel);
         gen_store_gpr(t0, rt);
+        /*
+         * The icount statcounter already includes the whole TB, end it here
+         * so that the value read is exact.
+         */
+        gen_save_pc(ctx->base.pc_next + 4);
+        ctx->base.is_jmp = DISAS_EXIT;
         break;
     case 5: /* ITLB MISS */
         gen_helper_rdhwr_statcounters_itlb_miss(t0, cpu_env);
@@ -13678,6 +13684,9 @@ static void gen_rdhwr(DisasContext *ctx, int rt, int rd, int sel)
     case 7: /* RESET */
         gen_helper_rdhwr_statcounters_reset(t0, cpu_env);
         gen_store_gpr(t0, rt);
+        /* Don't count the rest of this TB after the reset. */
+        gen_save_pc(ctx->base.pc_next + 4);
+        ctx->base.is_jmp = DISAS_EXIT;
         break;
     case 11:
         gen_helper_1e0i(rdhwr_statcounters_memory, t0, sel);
@@ -13796,7 +13805,7 @@ static void gen_branch(DisasContext *ctx, int insn_bytes)
                 save_cpu_state(ctx, 0);
                 gen_helper_0e0i(raise_exception, EXCP_DEBUG);
             }
-            tcg_gen_exit_tb(NULL, 0);
+            tcg_gen_lookup_cap_jump_and_goto_ptr();
             break;
 #endif /* TARGET_CHERI */
         default:
@@ -31660,51 +31669,65 @@ static bool mips_tr_tb_in_user_mode(DisasContextBase *dcbase, CPUState *cs)
     return (ctx->hflags & MIPS_HFLAG_UM) != 0;
 }
 
-static inline void mips_update_statcounters_icount(DisasContext *ctx)
+/*
+ * The icount statcounter is incremented once per TB by the number of
+ * instructions in it. That is only known at the end of translation, so the
+ * immediate is patched in mips_tr_tb_stop(). If an exception ends the TB
+ * early, restore_insn_count_to_opc() subtracts the instructions that were not
+ * executed.
+ */
+static void gen_statcounters_icount_start(DisasContext *ctx)
 {
-    // FIXME: Don't do this for every executed instruction.
-#ifdef NOTYET
-    _debug_value(cpu_PC, "mips_update_icount");
-    if (ctx->icount_already_added == ctx->base.num_insns) {
-        qemu_log("%s: icount already updated: %d\n", __func__, ctx->base.num_insns);
-        return;
-    }
-    target_ulong diff = ctx->base.num_insns - ctx->icount_already_added;
-#else
-    target_ulong diff = 1;
-#endif
-    if (ctx->hflags & MIPS_HFLAG_UM) {
-        tcg_gen_addi_tl(cpu_statcounters_icount_user,
-                        cpu_statcounters_icount_user, diff);
+    TCGv counter = (ctx->hflags & MIPS_HFLAG_UM) ?
+        cpu_statcounters_icount_user : cpu_statcounters_icount_kernel;
+    TCGv_i32 count = tcg_temp_new_i32();
+    TCGv t0 = tcg_temp_new();
+
+    tcg_gen_movi_i32(count, 0xdeadbeef);
+    ctx->statcounters_icount_op = tcg_last_op();
+    tcg_gen_extu_i32_tl(t0, count);
+    tcg_gen_add_tl(counter, counter, t0);
+    tcg_temp_free(t0);
+    tcg_temp_free_i32(count);
+}
+
+void restore_insn_count_to_opc(CPUMIPSState *env, TranslationBlock *tb,
+                               int not_executed)
+{
+    if (tb->flags & MIPS_HFLAG_UM) {
+        env->statcounters_icount_user -= not_executed;
     } else {
-        tcg_gen_addi_tl(cpu_statcounters_icount_kernel,
-                        cpu_statcounters_icount_kernel, diff);
+        env->statcounters_icount_kernel -= not_executed;
     }
-#ifdef NOTYET
-    ctx->icount_already_added = ctx->base.num_insns;
-#endif
 }
 
 static void mips_tr_tb_start(DisasContextBase *dcbase, CPUState *cs)
 {
+    DisasContext *ctx = container_of(dcbase, DisasContext, base);
+
+    /*
+     * This must come before anything that can raise an exception, including
+     * the PCC checks on TB entry, since restore_insn_count_to_opc() assumes
+     * that the whole TB has been counted.
+     */
+    gen_statcounters_icount_start(ctx);
 }
 
 static void mips_tr_insn_start(DisasContextBase *dcbase, CPUState *cs)
 {
     DisasContext *ctx = container_of(dcbase, DisasContext, base);
 
-    /* If QEMU was started with -bc option insert a check for breakcount */
-    if (unlikely(cs->breakcount)) {
-        gen_helper_check_breakcount(cpu_env);
-    }
-
     tcg_gen_insn_start(ctx->base.pc_next, ctx->hflags & MIPS_HFLAG_BMASK,
                        ctx->btarget);
 
-    /* Update the icount statcounter */
-    // TODO: it would be nice if we could do this at TB end but exceptions
-    // use longjmp to jump out of the tb so it is quite difficult.
-    mips_update_statcounters_icount(ctx); // Increment the current icount value
+    /*
+     * If QEMU was started with -bc option insert a check for breakcount.
+     * This comes after insn_start so that the exception restores the PC of
+     * this instruction.
+     */
+    if (unlikely(cs->breakcount)) {
+        gen_helper_check_breakcount(cpu_env);
+    }
 
 #ifdef CONFIG_MIPS_LOG_INSTR
     if (unlikely(ctx->base.log_instr)) {
@@ -31823,7 +31846,8 @@ static void mips_tr_translate_insn(DisasContextBase *dcbase, CPUState *cs)
 static void mips_tr_tb_stop(DisasContextBase *dcbase, CPUState *cs)
 {
     DisasContext *ctx = container_of(dcbase, DisasContext, base);
-    // tcg_debug_assert(ctx->icount_already_added == dcbase->num_insns);
+
+    tcg_set_insn_param(ctx->statcounters_icount_op, 1, ctx->base.num_insns);
 
     if (ctx->base.singlestep_enabled && ctx->base.is_jmp != DISAS_NORETURN) {
         save_cpu_state(ctx, ctx->base.is_jmp != DISAS_EXIT);
@@ -32215,6 +32239,7 @@ void cpu_state_reset(CPUMIPSState *env)
 #endif
     env->CP0_Random = env->tlb->nb_tlb - 1;
     env->tlb->tlb_in_use = env->tlb->nb_tlb;
+    r4k_tlb_index_rebuild(env);
     env->CP0_Wired = 0;
     env->CP0_GlobalNumber = (cs->cpu_index & 0xFF) << CP0GN_VPId;
     env->CP0_EBase = (cs->cpu_index & 0x3FF);
@@ -32357,6 +32382,9 @@ void cpu_state_reset(CPUMIPSState *env)
         // enable KX bit on startup
         env->CP0_Status |= (1 << CP0St_KX);
     }
+#ifdef CONFIG_MIPS_LOG_INSTR
+    mips_log_instr_update_asid(env);
+#endif
 }
 
 void restore_state_to_opc(CPUMIPSState *env, TranslationBlock *tb,
@@ -927,15 +927,11 @@ static inline target_long clc_sign_extend(target_long x, bool big_imm)
 static inline void generate_clc(DisasContext *ctx, int32_t cd, int32_t cb,
         int32_t rt, int32_t offset, bool big_imm)
 {
-    TCGv_i32 tcd = tcg_const_i32(cd);
-    TCGv_i32 tcb = tcg_const_i32(cb);
     TCGv toffset = tcg_temp_new();
     gen_load_gpr(toffset, rt);
     tcg_gen_addi_tl(toffset, toffset, clc_sign_extend(offset, big_imm) * 16);
-    gen_helper_load_cap_via_cap(cpu_env, tcd, tcb, toffset);
+    gen_load_cap_via_cap(ctx, cd, cb, toffset);
     tcg_temp_free(toffset);
-    tcg_temp_free_i32(tcb);
-    tcg_temp_free_i32(tcd);
 }
 
 static inline void generate_cllc(DisasContext *ctx, int32_t cd, int32_t cb)
@@ -950,15 +946,11 @@ static inline void generate_cllc(DisasContext *ctx, int32_t cd, int32_t cb)
 static inline void generate_csc(DisasContext *ctx, int32_t cs, int32_t cb,
         int32_t rt, int32_t offset, bool big_imm)
 {
-    TCGv_i32 tcs = tcg_const_i32(cs);
-    TCGv_i32 tcb = tcg_const_i32(cb);
     TCGv toffset = tcg_temp_new();
     gen_load_gpr(toffset, rt);
     tcg_gen_addi_tl(toffset, toffset, clc_sign_extend(offset, big_imm) * 16);
-    gen_helper_store_cap_via_cap(cpu_env, tcs, tcb, toffset);
+    gen_store_cap_via_cap(ctx, cs, cb, toffset);
     tcg_temp_free(toffset);
-    tcg_temp_free_i32(tcb);
-    tcg_temp_free_i32(tcs);
 }
 
 static inline void generate_cscc(DisasContext *ctx, int32_t cs, int32_t cb,
@@ -984,6 +984,7 @@ static void r4k_mmu_init (CPUMIPSState *env, const mips_def_t *def)
     env->tlb->helper_tlbr = r4k_helper_tlbr;
     env->tlb->helper_tlbinv = r4k_helper_tlbinv;
     env->tlb->helper_tlbinvf = r4k_helper_tlbinvf;
+    r4k_tlb_index_rebuild(env);
 }
 
 static void mmu_init (CPUMIPSState *env, const mips_def_t *def)
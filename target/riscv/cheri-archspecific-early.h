@@ -98,6 +98,10 @@ static inline const cap_register_t *_cheri_get_pcc_unchecked(CPURISCVState *env)
 {
     return &env->PCC;
 }
+// Offsets in env for code that loads capability fields from generated code.
+#define CHERI_PCC_ENV_OFFSET offsetof(CPURISCVState, PCC)
+#define CHERI_DDC_ENV_OFFSET offsetof(CPURISCVState, DDC)
+#define CHERI_GPCRS_ENV_OFFSET offsetof(CPURISCVState, gpcapregs)
 
 static inline GPCapRegs *cheri_get_gpcrs(CPUArchState *env) {
     return &env->gpcapregs;
@@ -34,6 +34,7 @@
 
 #include "cpu.h"
 #include "cheri-lazy-capregs.h"
+#include "qemu/plugin.h"
 
 extern bool cheri_debugger_on_trap;
 
@@ -43,6 +44,7 @@ static inline void QEMU_NORETURN raise_cheri_exception_impl(
 {
     env->cap_cause = cause;
     env->cap_index = regnum;
+    qemu_plugin_vcpu_cap_fault_cb(env_cpu(env), cause, regnum);
     // Allow drop into debugger on first CHERI trap:
     // FIXME: allow c command to work by adding another boolean flag to skip
     // this breakpoint when GDB asks to continue
@@ -36,9 +36,14 @@
 
 #include "rvfi_dii.h"
 #include "helper_utils.h"
+#ifdef CONFIG_RVFI_DII
+#include "exec/address-spaces.h"
+#include "exec/ram_addr.h"
+#endif
 
 #ifdef TARGET_CHERI
 #include "cheri-lazy-capregs.h"
+#include "cheri_tagmem.h"
 #endif
 
 /* RISC-V CPU definitions */
@@ -379,6 +384,30 @@ void restore_state_to_opc(CPURISCVState *env, TranslationBlock *tb,
 extern int rvfi_client_fd;
 extern bool rvfi_debug_output;
 
+/*
+ * TestRIG sends all instructions of a test before reading back the traces, so
+ * they are queued here and written with a single write() when the test ends
+ * (the halt trace), or when the buffer is full.
+ */
+#define RVFI_DII_TRACE_BATCH 1024
+static rvfi_dii_trace_t rvfi_dii_trace_buf[RVFI_DII_TRACE_BATCH];
+static unsigned rvfi_dii_trace_count;
+
+static void rvfi_dii_flush_traces(void)
+{
+    size_t len = rvfi_dii_trace_count * sizeof(rvfi_dii_trace_t);
+
+    if (len == 0) {
+        return;
+    }
+    ssize_t nbytes = qemu_write_full(rvfi_client_fd, rvfi_dii_trace_buf, len);
+    if (nbytes != (ssize_t)len) {
+        error_report("Failed to write trace entries to socket: %zd (%s)", nbytes, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    rvfi_dii_trace_count = 0;
+}
+
 static void rvfi_dii_send_trace(CPURISCVState* env, rvfi_dii_trace_t* trace)
 {
     if (rvfi_debug_output) {
@@ -387,11 +416,66 @@ static void rvfi_dii_send_trace(CPURISCVState* env, rvfi_dii_trace_t* trace)
                 (uintmax_t)trace->rvfi_dii_mem_addr, (uintmax_t)trace->rvfi_dii_mem_wdata, trace->rvfi_dii_mem_wmask,
                 (uintmax_t)trace->rvfi_dii_insn);
     }
-    ssize_t nbytes = write(rvfi_client_fd, trace, sizeof(*trace));
-    if (nbytes != sizeof(*trace)) {
-        error_report("Failed to write trace entry to socket: %zd (%s)", nbytes, strerror(errno));
-        exit(EXIT_FAILURE);
+    rvfi_dii_trace_buf[rvfi_dii_trace_count++] = *trace;
+    if (trace->rvfi_dii_halt || rvfi_dii_trace_count == RVFI_DII_TRACE_BATCH) {
+        rvfi_dii_flush_traces();
+    }
+}
+
+/*
+ * Zero the RVFI-DII RAM window and its tags for the next test. Most tests
+ * touch only a few pages, so instead of clearing all of it every time dirty
+ * logging is enabled for the RAM region and only the pages written since the
+ * previous reset are cleared (and the TBs on them invalidated).
+ */
+static void rvfi_dii_reset_ram(CPUState *cs)
+{
+    static MemoryRegion *ram_mr;
+    static hwaddr ram_offset;
+    DirtyBitmapSnapshot *snap;
+    uint8_t *host;
+    ram_addr_t ram_addr;
+
+    if (!ram_mr) {
+        MemoryRegionSection section = memory_region_find(
+            get_system_memory(), RVFI_DII_RAM_START, RVFI_DII_RAM_SIZE);
+        assert(section.mr && memory_region_is_ram(section.mr));
+        assert(int128_get64(section.size) == RVFI_DII_RAM_SIZE);
+        ram_mr = section.mr;
+        ram_offset = section.offset_within_region;
+        // Anything may have been written before logging started, clear it all
+        host = memory_region_get_ram_ptr(ram_mr) + ram_offset;
+        memset(host, 0, RVFI_DII_RAM_SIZE);
+#ifdef TARGET_CHERI
+        cheri_tag_phys_invalidate(NULL, ram_mr->ram_block, ram_offset,
+                                  RVFI_DII_RAM_SIZE, NULL);
+#endif
+        memory_region_set_log(ram_mr, true, DIRTY_MEMORY_VGA);
+        memory_region_reset_dirty(ram_mr, ram_offset, RVFI_DII_RAM_SIZE,
+                                  DIRTY_MEMORY_VGA);
+        tb_flush(cs);
+        return;
+    }
+
+    // This also re-arms the TLB so that the next write to each page is seen.
+    snap = memory_region_snapshot_and_clear_dirty(
+        ram_mr, ram_offset, RVFI_DII_RAM_SIZE, DIRTY_MEMORY_VGA);
+    host = memory_region_get_ram_ptr(ram_mr) + ram_offset;
+    ram_addr = memory_region_get_ram_addr(ram_mr) + ram_offset;
+    for (hwaddr page = 0; page < RVFI_DII_RAM_SIZE; page += TARGET_PAGE_SIZE) {
+        if (!memory_region_snapshot_get_dirty(ram_mr, snap, ram_offset + page,
+                                              TARGET_PAGE_SIZE)) {
+            continue;
+        }
+        memset(host + page, 0, TARGET_PAGE_SIZE);
+#ifdef TARGET_CHERI
+        cheri_tag_phys_invalidate(NULL, ram_mr->ram_block, ram_offset + page,
+                                  TARGET_PAGE_SIZE, NULL);
+#endif
+        tb_invalidate_phys_range(ram_addr + page,
+                                 ram_addr + page + TARGET_PAGE_SIZE);
     }
+    g_free(snap);
 }
 
 void rvfi_dii_communicate(CPUState* cs, CPURISCVState* env) {
@@ -439,20 +523,7 @@ void rvfi_dii_communicate(CPUState* cs, CPURISCVState* env) {
             // FIXME: Hopefully this resets RAM?
             qemu_system_reset(SHUTDOWN_CAUSE_HOST_SIGNAL);
             cs->cflags_next_tb |= CF_NOCACHE;
-            hwaddr system_ram_addr = cpu_get_phys_page_debug(cs, PC_ADDR(env));
-            hwaddr system_ram_size = RVFI_DII_RAM_SIZE;
-            void *ram_ptr = cpu_physical_memory_map(
-                system_ram_addr, &system_ram_size, /*is_write=*/true);
-            assert(system_ram_size == RVFI_DII_RAM_SIZE);
-            // TODO: would be nice to do this lazily instead of writing 8 MiB
-            // FIXME: is it safe to do a munmap/mmap? We could also MAP_FIXED over
-            // the existing mapping. This should be faster since we rarely use more
-            // than one page.
-            memset(ram_ptr, 0, system_ram_size);
-            // Unmap: this should invalidate all caches for that regio.
-            cpu_physical_memory_unmap(ram_ptr, system_ram_size, /*is_write=*/true, system_ram_size);
-            // Flush the TCG state:
-            tb_flush(cs);
+            rvfi_dii_reset_ram(cs);
             tlb_flush(cs); // Flush the QEMU guest->host tlb
 
             // TestRIG expects all capability registers to be max perms
@@ -470,6 +541,7 @@ void rvfi_dii_communicate(CPUState* cs, CPURISCVState* env) {
             // The remote disconnected.
             fprintf(stderr, "Received a quit command. Quitting.\n");
             info_report("Received a quit command. Quitting.\n");
+            rvfi_dii_flush_traces();
             close(rvfi_client_fd);
             rvfi_client_fd = 0;
             exit(EXIT_SUCCESS);
@@ -542,6 +614,7 @@ static void riscv_cpu_reset(DeviceState *dev)
     env->priv = PRV_M;
     env->mstatus &= ~(MSTATUS_MIE | MSTATUS_MPRV);
     env->mcause = 0;
+    riscv_pwc_flush(env);
 #endif
 
     cs->exception_index = EXCP_NONE;
@@ -584,6 +657,9 @@ static void riscv_cpu_reset(DeviceState *dev)
 #ifdef CONFIG_DEBUG_TCG
     env->_pc_is_current = true;
 #endif
+#ifdef CONFIG_MIPS_LOG_INSTR
+    tcg_log_instr_update_asid(cs, get_field(env->satp, SATP_ASID));
+#endif
 }
 
 static void riscv_cpu_disas_set_info(CPUState *s, disassemble_info *info)
@@ -708,6 +784,9 @@ static void riscv_cpu_realize(DeviceState *dev, Error **errp)
 
     riscv_cpu_register_gdb_regs_for_features(cs);
 
+#ifndef CONFIG_USER_ONLY
+    riscv_pwc_init();
+#endif
     qemu_init_vcpu(cs);
     cpu_reset(cs);
 
@@ -724,6 +803,19 @@ static void riscv_cpu_init(Object *obj)
 static const VMStateDescription vmstate_riscv_cpu = {
     .name = "cpu",
     .unmigratable = 1,
+#ifdef TARGET_CHERI
+    /*
+     * Not a complete description of the CPU state yet, which is why it is
+     * still unmigratable. minstret cannot be recomputed from anything else,
+     * unlike the timer based counters.
+     */
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT64(env.minstret, RISCVCPU),
+        VMSTATE_END_OF_LIST()
+    }
+#endif
 };
 
 static Property riscv_cpu_properties[] = {
@@ -25,9 +25,15 @@
 #include "qemu/units.h"
 #include "fpu/softfloat-types.h"
 #include "rvfi_dii.h"
+#include "exec/cvtrace.h"
 
 #define TCG_GUEST_DEFAULT_MO 0
 
+#ifdef TARGET_CHERI
+/* minstret is updated once per TB, see restore_insn_count_to_opc() */
+#define TARGET_HAS_TB_INSN_COUNTER
+#endif
+
 #define TYPE_RISCV_CPU "riscv-cpu"
 
 #define RISCV_CPU_TYPE_SUFFIX "-" TYPE_RISCV_CPU
@@ -99,6 +105,40 @@ typedef struct CPURISCVState CPURISCVState;
 #endif
 #include "pmp.h"
 
+#ifndef CONFIG_USER_ONLY
+/*
+ * Page-walk cache: remembers the page table that a Sv32/Sv39/Sv48/Sv57 walk
+ * reached after following the non-leaf PTEs for a given satp and VPN prefix.
+ * There is one direct mapped table per non-leaf level.
+ */
+#define RISCV_PWC_LEVELS    4   /* Sv57 has four levels of non-leaf PTEs */
+#define RISCV_PWC_ENTRIES   16
+
+typedef struct RISCVPWCEntry {
+    bool valid;
+    target_ulong satp;
+    target_ulong vpn;   /* VPN bits above the index into @base */
+    hwaddr base;        /* Physical address of the page table */
+    /*
+     * Host addresses and values of the non-leaf PTEs that lead to @base.
+     * The entry is only used while all of them are unchanged and the
+     * memory map has not changed since generation @memory_gen.
+     */
+    unsigned memory_gen;
+    const void *pte_host[RISCV_PWC_LEVELS];
+    target_ulong pte[RISCV_PWC_LEVELS];
+} RISCVPWCEntry;
+
+typedef struct RISCVPWCStats {
+    uint64_t walks;         /* Page table walks that could use the cache */
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stale;         /* Entries dropped since a PTE changed */
+    uint64_t flushes;
+    uint64_t pte_loads;     /* PTEs read from memory by these walks */
+} RISCVPWCStats;
+#endif
+
 struct CPURISCVState {
 #ifdef TARGET_CHERI
     struct GPCapRegs gpcapregs;
@@ -275,6 +315,9 @@ struct CPURISCVState {
 
     /* True if in debugger mode.  */
     bool debugger;
+
+    RISCVPWCEntry pwc[RISCV_PWC_LEVELS][RISCV_PWC_ENTRIES];
+    RISCVPWCStats pwc_stats;
 #endif
 
     float_status fp_status;
@@ -283,6 +326,9 @@ struct CPURISCVState {
     rvfi_dii_trace_t rvfi_dii_trace;
     bool rvfi_dii_have_injected_insn;
 #endif
+#ifdef CONFIG_MIPS_LOG_INSTR
+    cvtrace_t cvtrace;
+#endif
 #ifdef TARGET_CHERI
     // Some statcounters:
     uint64_t statcounters_cap_read;
@@ -293,6 +339,8 @@ struct CPURISCVState {
     uint64_t statcounters_imprecise_setbounds;
     uint64_t statcounters_unrepresentable_caps;
 
+    // Instructions retired (instret), added once per TB.
+    uint64_t minstret;
 #endif
 
     /* Fields from here on are preserved across CPU reset. */
@@ -504,6 +552,8 @@ int riscv_cpu_claim_interrupts(RISCVCPU *cpu, uint32_t interrupts);
 uint32_t riscv_cpu_update_mip(RISCVCPU *cpu, uint32_t mask, uint32_t value);
 #define BOOL_TO_MASK(x) (-!!(x)) /* helper for riscv_cpu_update_mip value */
 void riscv_cpu_set_rdtime_fn(CPURISCVState *env, uint64_t (*fn)(void));
+void riscv_pwc_init(void);
+void riscv_pwc_flush(CPURISCVState *env);
 #endif
 void riscv_cpu_set_mode(CPURISCVState *env, target_ulong newpriv);
 
@@ -21,6 +21,7 @@
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 #include "cpu.h"
+#include "exec/address-spaces.h"
 #include "exec/exec-all.h"
 #include "tcg/tcg-op.h"
 #include "trace.h"
@@ -290,6 +291,167 @@ void riscv_cpu_set_mode(CPURISCVState *env, target_ulong newpriv)
     env->load_res = -1;
 }
 
+/*
+ * Page-walk cache
+ *
+ * Most TLB misses (and the translations done for capability tag accesses)
+ * only differ from a previous walk in the leaf PTE, so the page table that
+ * the non-leaf PTEs lead to is cached per hart. A hit in the deepest level
+ * reduces the walk to loading the leaf PTE.
+ *
+ * Instead of tracking guest stores to page tables, every entry records the
+ * host address and value of each non-leaf PTE it was derived from and is
+ * only used while they are unchanged. The walker itself only updates A/D
+ * bits in leaf PTEs, so checking them is a few host loads. sfence.vma, satp
+ * and PMP writes flush the cache.
+ *
+ * The host addresses are only valid for the memory map they were looked up
+ * in, so entries also record riscv_pwc_memory_gen, which a memory listener
+ * bumps before and after every memory map change.
+ */
+static unsigned riscv_pwc_memory_gen;
+
+static void riscv_pwc_memory_changed(MemoryListener *listener)
+{
+    atomic_inc(&riscv_pwc_memory_gen);
+}
+
+static MemoryListener riscv_pwc_memory_listener = {
+    .begin = riscv_pwc_memory_changed,
+    .commit = riscv_pwc_memory_changed,
+};
+
+void riscv_pwc_init(void)
+{
+    static bool registered;
+
+    if (!registered) {
+        memory_listener_register(&riscv_pwc_memory_listener,
+                                 &address_space_memory);
+        registered = true;
+    }
+}
+
+void riscv_pwc_flush(CPURISCVState *env)
+{
+    memset(env->pwc, 0, sizeof(env->pwc));
+    env->pwc_stats.flushes++;
+}
+
+static inline target_ulong riscv_pwc_read_pte(const void *host)
+{
+#if defined(TARGET_RISCV32)
+    return ldl_le_p(host);
+#else
+    return ldq_le_p(host);
+#endif
+}
+
+/* VPN bits above the index into the page table used at @level */
+static inline target_ulong riscv_pwc_vpn(target_ulong addr, int level,
+                                         int levels, int ptidxbits)
+{
+    return addr >> (PGSHIFT + (levels - level) * ptidxbits);
+}
+
+/*
+ * Look for the deepest cached page table for @addr. Returns the level to
+ * continue the walk at (0 on a miss) and sets @base to its page table.
+ * @walk is initialised with the non-leaf PTEs that lead there.
+ */
+static int riscv_pwc_lookup(CPURISCVState *env, RISCVPWCEntry *walk,
+                            target_ulong addr, int levels, int ptidxbits,
+                            hwaddr *base)
+{
+    int level, i;
+
+    /* The PTE host addresses point into RAMBlocks freed by RCU */
+    RCU_READ_LOCK_GUARD();
+    /* Read before any PTE is translated, so a later change invalidates it */
+    walk->memory_gen = atomic_load_acquire(&riscv_pwc_memory_gen);
+    walk->satp = env->satp;
+    env->pwc_stats.walks++;
+    for (level = levels - 1; level > 0; level--) {
+        target_ulong vpn = riscv_pwc_vpn(addr, level, levels, ptidxbits);
+        RISCVPWCEntry *e = &env->pwc[level - 1][vpn % RISCV_PWC_ENTRIES];
+        bool intact = true;
+
+        if (!e->valid || e->satp != walk->satp || e->vpn != vpn) {
+            continue;
+        }
+        if (e->memory_gen != walk->memory_gen) {
+            intact = false;
+        }
+        for (i = 0; i < level && intact; i++) {
+            intact = riscv_pwc_read_pte(e->pte_host[i]) == e->pte[i];
+        }
+        if (!intact) {
+            e->valid = false;
+            env->pwc_stats.stale++;
+            continue;
+        }
+        memcpy(walk->pte_host, e->pte_host, sizeof(walk->pte_host));
+        memcpy(walk->pte, e->pte, sizeof(walk->pte));
+        *base = e->base;
+        env->pwc_stats.hits++;
+        return level;
+    }
+    env->pwc_stats.misses++;
+    return 0;
+}
+
+/* Load the PTE at @level of the walk and remember where it lives. */
+static target_ulong riscv_pwc_load_pte(CPURISCVState *env,
+                                       RISCVPWCEntry *walk, int level,
+                                       hwaddr pte_addr, MemTxAttrs attrs,
+                                       MemTxResult *res)
+{
+    CPUState *cs = env_cpu(env);
+    hwaddr xlat, len = sizeof(target_ulong);
+    MemoryRegion *mr;
+
+    env->pwc_stats.pte_loads++;
+    if (level < RISCV_PWC_LEVELS) {
+        RCU_READ_LOCK_GUARD();
+        mr = address_space_translate(cs->as, pte_addr, &xlat, &len, false,
+                                     attrs);
+        if (memory_region_is_ram(mr) && len == sizeof(target_ulong)) {
+            walk->pte_host[level] = qemu_map_ram_ptr(mr->ram_block, xlat);
+            walk->pte[level] = riscv_pwc_read_pte(walk->pte_host[level]);
+            *res = MEMTX_OK;
+            return walk->pte[level];
+        }
+        /* Page tables outside of RAM are not cached */
+        walk->pte_host[level] = NULL;
+    }
+#if defined(TARGET_RISCV32)
+    return address_space_ldl(cs->as, pte_addr, attrs, res);
+#else
+    return address_space_ldq(cs->as, pte_addr, attrs, res);
+#endif
+}
+
+/* Remember that the non-leaf PTEs of @walk lead to @base at @level. */
+static void riscv_pwc_insert(CPURISCVState *env, const RISCVPWCEntry *walk,
+                             target_ulong addr, int level, int levels,
+                             int ptidxbits, hwaddr base)
+{
+    target_ulong vpn = riscv_pwc_vpn(addr, level, levels, ptidxbits);
+    RISCVPWCEntry *e;
+    int i;
+
+    for (i = 0; i < level; i++) {
+        if (!walk->pte_host[i]) {
+            return;
+        }
+    }
+    e = &env->pwc[level - 1][vpn % RISCV_PWC_ENTRIES];
+    *e = *walk;
+    e->vpn = vpn;
+    e->base = base;
+    e->valid = true;
+}
+
 /* get_physical_address - get the physical address for this virtual address
  *
  * Do a page table walk to obtain the physical address corresponding to a
@@ -457,13 +619,24 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
         return TRANSLATE_FAIL;
     }
 
-    int ptshift = (levels - 1) * ptidxbits;
+    /* Only the common case of a single stage satp walk is cached */
+    const bool use_pwc = first_stage && !two_stage && !use_background &&
+                         env->priv_ver >= PRIV_VERSION_1_10_0;
+    const hwaddr root = base;
+    RISCVPWCEntry walk = { 0 };
+    int ptshift;
     int i;
 
 #if !TCG_OVERSIZED_GUEST
 restart:
 #endif
-    for (i = 0; i < levels; i++, ptshift -= ptidxbits) {
+    base = root;
+    i = 0;
+    if (use_pwc) {
+        i = riscv_pwc_lookup(env, &walk, addr, levels, ptidxbits, &base);
+    }
+    for (ptshift = (levels - 1 - i) * ptidxbits; i < levels;
+         i++, ptshift -= ptidxbits) {
         target_ulong idx;
         if (i == 0) {
             idx = (addr >> (PGSHIFT + ptshift)) &
@@ -494,11 +667,16 @@ restart:
             return TRANSLATE_PMP_FAIL;
         }
 
+        target_ulong pte;
+        if (use_pwc) {
+            pte = riscv_pwc_load_pte(env, &walk, i, pte_addr, attrs, &res);
+        } else {
 #if defined(TARGET_RISCV32)
-        target_ulong pte = address_space_ldl(cs->as, pte_addr, attrs, &res);
+            pte = address_space_ldl(cs->as, pte_addr, attrs, &res);
 #elif defined(TARGET_RISCV64)
-        target_ulong pte = address_space_ldq(cs->as, pte_addr, attrs, &res);
+            pte = address_space_ldq(cs->as, pte_addr, attrs, &res);
 #endif
+        }
         if (res != MEMTX_OK) {
             return TRANSLATE_FAIL;
         }
@@ -511,6 +689,10 @@ restart:
         } else if (!(pte & (PTE_R | PTE_W | PTE_X))) {
             /* Inner PTE, continue walking */
             base = ppn << PGSHIFT;
+            if (use_pwc && i + 1 < levels) {
+                riscv_pwc_insert(env, &walk, addr, i + 1, levels, ptidxbits,
+                                 base);
+            }
         } else if ((pte & (PTE_R | PTE_W | PTE_X)) == PTE_W) {
             /* Reserved leaf PTE flags: PTE_W */
             return TRANSLATE_FAIL;
@@ -203,7 +203,9 @@ static int write_fcsr(CPURISCVState *env, int csrno, target_ulong val)
 /* User Timers and Counters */
 static int read_instret(CPURISCVState *env, int csrno, target_ulong *val)
 {
-#if !defined(CONFIG_USER_ONLY)
+#if defined(TARGET_CHERI)
+    *val = env->minstret;
+#elif !defined(CONFIG_USER_ONLY)
     if (use_icount) {
         *val = cpu_get_icount();
     } else {
@@ -218,7 +220,9 @@ static int read_instret(CPURISCVState *env, int csrno, target_ulong *val)
 #if defined(TARGET_RISCV32)
 static int read_instreth(CPURISCVState *env, int csrno, target_ulong *val)
 {
-#if !defined(CONFIG_USER_ONLY)
+#if defined(TARGET_CHERI)
+    *val = env->minstret >> 32;
+#elif !defined(CONFIG_USER_ONLY)
     if (use_icount) {
         *val = cpu_get_icount() >> 32;
     } else {
@@ -854,8 +858,13 @@ static int write_satp(CPURISCVState *env, int csrno, target_ulong val)
         } else {
             if((val ^ env->satp) & SATP_ASID) {
                 tlb_flush(env_cpu(env));
+#ifdef CONFIG_MIPS_LOG_INSTR
+                tcg_log_instr_update_asid(env_cpu(env),
+                                          get_field(val, SATP_ASID));
+#endif
             }
             env->satp = val;
+            riscv_pwc_flush(env);
         }
     }
     return 0;
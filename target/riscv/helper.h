@@ -77,6 +77,7 @@ DEF_HELPER_3(sc_cap, tl, env, i32, i32)
 
 #ifdef CONFIG_MIPS_LOG_INSTR
 DEF_HELPER_FLAGS_3(log_gpr_write, TCG_CALL_NO_RWG, void, i32, tl, tl)
+DEF_HELPER_FLAGS_3(riscv_cvtrace_log_instruction, TCG_CALL_NO_RWG, void, env, tl, i32)
 #endif
 
 /* Special functions */
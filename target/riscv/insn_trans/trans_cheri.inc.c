@@ -257,7 +257,11 @@ static bool trans_cjalr(DisasContext *ctx, arg_cjalr *a)
     tcg_temp_free_i32(dest_regnum);
 
     gen_rvfi_dii_validate_jump(ctx);
-    lookup_and_goto_ptr(ctx);
+    if (ctx->base.singlestep_enabled) {
+        gen_exception_debug();
+    } else {
+        tcg_gen_lookup_cap_jump_and_goto_ptr();
+    }
     // PC has been updated -> exit translation block
     ctx->base.is_jmp = DISAS_NORETURN;
     return true;
@@ -299,10 +303,25 @@ static inline bool trans_lcddc(DisasContext *ctx, arg_lcddc *a)
     return gen_cheri_cap_cap_int_imm(a->rd, CHERI_EXC_REGNUM_DDC, a->rs1, 0, &gen_helper_load_cap_via_cap);
 }
 
+// Capability loads/stores relative to a capability register, see
+// gen_load_cap_via_cap()/gen_store_cap_via_cap().
+static inline bool gen_cap_load_store_imm(DisasContext *ctx, int creg, int cb,
+                                          target_long imm, bool is_store)
+{
+    TCGv toffset = tcg_const_tl(imm);
+    if (is_store) {
+        gen_store_cap_via_cap(ctx, creg, cb, toffset);
+    } else {
+        gen_load_cap_via_cap(ctx, creg, cb, toffset);
+    }
+    tcg_temp_free(toffset);
+    return true;
+}
+
 static inline bool trans_lccap(DisasContext *ctx, arg_lccap *a)
 {
     // No immediate available for lccap
-    return gen_cheri_cap_cap_imm(a->rd, a->rs1, 0, &gen_helper_load_cap_via_cap);
+    return gen_cap_load_store_imm(ctx, a->rd, a->rs1, 0, /*is_store=*/false);
 }
 
 static inline bool trans_lc(DisasContext *ctx, arg_lc *a)
@@ -311,7 +330,8 @@ static inline bool trans_lc(DisasContext *ctx, arg_lc *a)
         // Without capmode we load relative to DDC (lc instructions)
         return gen_cheri_cap_cap_int_imm(a->rd, CHERI_EXC_REGNUM_DDC, a->rs1, a->imm, &gen_helper_load_cap_via_cap);
     }
-    return gen_cheri_cap_cap_imm(a->rd, a->rs1, /*offset=*/a->imm, &gen_helper_load_cap_via_cap);
+    return gen_cap_load_store_imm(ctx, a->rd, a->rs1, /*offset=*/a->imm,
+                                  /*is_store=*/false);
 }
 
 /* Load Via Capability Register */
@@ -410,7 +430,8 @@ static inline bool trans_scddc(DisasContext *ctx, arg_scddc *a)
 static inline bool trans_sccap(DisasContext *ctx, arg_sccap *a)
 {
     // No immediate available for sccap
-    return gen_cheri_cap_cap_imm(a->rs2, a->rs1, /*offset=*/0, &gen_helper_store_cap_via_cap);
+    return gen_cap_load_store_imm(ctx, a->rs2, a->rs1, /*offset=*/0,
+                                  /*is_store=*/true);
 }
 
 static inline bool trans_sc(DisasContext *ctx, arg_sc *a)
@@ -420,50 +441,49 @@ static inline bool trans_sc(DisasContext *ctx, arg_sc *a)
         // Without capmode we store relative to DDC (sc instructions)
         return gen_cheri_cap_cap_int_imm(a->rs2, CHERI_EXC_REGNUM_DDC, a->rs1, a->imm, &gen_helper_store_cap_via_cap);
     }
-    return gen_cheri_cap_cap_imm(a->rs2, a->rs1, /*offset=*/a->imm, &gen_helper_store_cap_via_cap);
+    return gen_cap_load_store_imm(ctx, a->rs2, a->rs1, /*offset=*/a->imm,
+                                  /*is_store=*/true);
 }
 
 
 // Atomic ops
+// The helpers use a host 128-bit cmpxchg (see cmpxchg_cap_in_memory()), so
+// these no longer need to stop the world when running with MTTCG.
 static inline bool trans_lr_cap(DisasContext *ctx, arg_lr_cap *a)
 {
-    /* In a parallel context, stop the world and single step.  */
-    if (tb_cflags(ctx->base.tb) & CF_PARALLEL) {
-        gen_helper_exit_atomic(cpu_env);
-        ctx->base.is_jmp = DISAS_NORETURN;
-    } else {
-        // Note: we ignore the Acquire/release flags since this using
-        // helper_exit_atomic forces exlusive execution so we get SC semantics.
-        tcg_debug_assert(a->rs2 == 0);
-        gen_cheri_cap_cap(a->rd, a->rs1, &gen_helper_lr_cap);
+    tcg_debug_assert(a->rs2 == 0);
+    if (a->rl) {
+        tcg_gen_mb(TCG_MO_ALL | TCG_BAR_STRL);
+    }
+    gen_cheri_cap_cap(a->rd, a->rs1, &gen_helper_lr_cap);
+    if (a->aq) {
+        tcg_gen_mb(TCG_MO_ALL | TCG_BAR_LDAQ);
     }
     return true;
 }
 
 static inline bool trans_sc_cap(DisasContext *ctx, arg_sc_cap *a)
 {
-    /* In a parallel context, stop the world and single step.  */
-    if (tb_cflags(ctx->base.tb) & CF_PARALLEL) {
-        gen_helper_exit_atomic(cpu_env);
-        ctx->base.is_jmp = DISAS_NORETURN;
-    } else {
-        // Note: we ignore the Acquire/release flags since this using
-        // helper_exit_atomic forces exlusive execution so we get SC semantics.
-        gen_cheri_int_cap_cap(ctx, a->rd, a->rs1, a->rs2, &gen_helper_sc_cap);
+    // The host cmpxchg is sequentially consistent, so we only need to order
+    // the surrounding plain accesses.
+    if (a->rl) {
+        tcg_gen_mb(TCG_MO_ALL | TCG_BAR_STRL);
+    }
+    gen_cheri_int_cap_cap(ctx, a->rd, a->rs1, a->rs2, &gen_helper_sc_cap);
+    if (a->aq) {
+        tcg_gen_mb(TCG_MO_ALL | TCG_BAR_LDAQ);
     }
     return true;
 }
 
 static inline bool trans_amoswap_cap(DisasContext *ctx, arg_amoswap_cap *a)
 {
-    /* In a parallel context, stop the world and single step.  */
-    if (tb_cflags(ctx->base.tb) & CF_PARALLEL) {
-        gen_helper_exit_atomic(cpu_env);
-        ctx->base.is_jmp = DISAS_NORETURN;
-    } else {
-        // Note: we ignore the Acquire/release flags since this using
-        // helper_exit_atomic forces exlusive execution so we get SC semantics.
-        gen_cheri_cap_cap_cap(a->rd, a->rs1, a->rs2, &gen_helper_amoswap_cap);
+    if (a->rl) {
+        tcg_gen_mb(TCG_MO_ALL | TCG_BAR_STRL);
+    }
+    gen_cheri_cap_cap_cap(a->rd, a->rs1, a->rs2, &gen_helper_amoswap_cap);
+    if (a->aq) {
+        tcg_gen_mb(TCG_MO_ALL | TCG_BAR_LDAQ);
     }
     return true;
 }
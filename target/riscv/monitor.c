@@ -227,3 +227,40 @@ void hmp_info_mem(Monitor *mon, const QDict *qdict)
 
     mem_info_svxx(mon, env);
 }
+
+void hmp_info_pwc(Monitor *mon, const QDict *qdict)
+{
+    CPUArchState *env;
+    const RISCVPWCStats *stats;
+    int level, i;
+
+    env = mon_get_cpu_env();
+    if (!env) {
+        monitor_printf(mon, "No CPU available\n");
+        return;
+    }
+
+    stats = &env->pwc_stats;
+    monitor_printf(mon, "page-walk cache: %d levels x %d entries\n",
+                   RISCV_PWC_LEVELS, RISCV_PWC_ENTRIES);
+    monitor_printf(mon, "  walks      %" PRIu64 "\n", stats->walks);
+    monitor_printf(mon, "  hits       %" PRIu64 "\n", stats->hits);
+    monitor_printf(mon, "  misses     %" PRIu64 "\n", stats->misses);
+    monitor_printf(mon, "  stale      %" PRIu64 "\n", stats->stale);
+    monitor_printf(mon, "  flushes    %" PRIu64 "\n", stats->flushes);
+    monitor_printf(mon, "  PTE loads  %" PRIu64 " (%.2f per walk)\n",
+                   stats->pte_loads,
+                   stats->walks ? (double)stats->pte_loads / stats->walks : 0);
+
+    for (level = 1; level <= RISCV_PWC_LEVELS; level++) {
+        for (i = 0; i < RISCV_PWC_ENTRIES; i++) {
+            const RISCVPWCEntry *e = &env->pwc[level - 1][i];
+            if (e->valid) {
+                monitor_printf(mon, "level %d: satp " TARGET_FMT_lx
+                               " vpn " TARGET_FMT_lx " -> table "
+                               TARGET_FMT_plx "\n",
+                               level, e->satp, e->vpn, e->base);
+            }
+        }
+    }
+}
@@ -23,6 +23,7 @@
 #include "qemu/main-loop.h"
 #include "exec/exec-all.h"
 #include "exec/helper-proto.h"
+#include "exec/log_instr_binary.h"
 #ifdef TARGET_CHERI
 #include "cheri-helper-utils.h"
 #endif
@@ -92,7 +93,7 @@ void QEMU_NORETURN riscv_raise_exception(CPURISCVState *env,
 
 void helper_raise_exception(CPURISCVState *env, uint32_t exception)
 {
-    riscv_raise_exception(env, exception, 0);
+    riscv_raise_exception(env, exception, GETPC());
 }
 
 target_ulong helper_csrrw(CPURISCVState *env, target_ulong src,
@@ -244,10 +245,37 @@ target_ulong helper_mret(CPURISCVState *env, target_ulong cpu_pc_deb)
 #ifdef CONFIG_MIPS_LOG_INSTR
 void HELPER(log_gpr_write)(uint32_t regnum, target_ulong value, target_ulong pc)
 {
+    if (unlikely(qemu_loglevel_mask(CPU_LOG_CVTRACE))) {
+        CPURISCVState *env = current_cpu->env_ptr;
+        if (env->cvtrace.version == CVT_NO_REG)
+            env->cvtrace.version = CVT_GPR;
+        env->cvtrace.val2 = tswap64(value);
+        return;
+    }
+    if (log_instr_binary_enabled()) {
+        if (qemu_loglevel_mask(CPU_LOG_INSTR) && qemu_log_in_addr_range(pc)) {
+            log_instr_bin_reg(current_cpu->env_ptr, riscv_int_regnames[regnum],
+                              value);
+        }
+        return;
+    }
     qemu_log_mask_and_addr(CPU_LOG_INSTR, pc,
                            "    Write %s = " TARGET_FMT_lx "\n",
                            riscv_int_regnames[regnum], value);
 }
+
+/*
+ * Start the cvtrace record for the instruction at @pc.
+ */
+void HELPER(riscv_cvtrace_log_instruction)(CPURISCVState *env, target_ulong pc,
+                                           uint32_t opcode)
+{
+    if (unlikely(qemu_loglevel_mask(CPU_LOG_CVTRACE))) {
+        cvtrace_new_insn(env_cpu(env), &env->cvtrace, pc,
+                         (uint8_t)get_field(env->satp, SATP_ASID));
+        env->cvtrace.inst = opcode;
+    }
+}
 #endif
 
 void helper_wfi(CPURISCVState *env)
@@ -275,6 +303,7 @@ void helper_tlb_flush(CPURISCVState *env)
          get_field(env->mstatus, MSTATUS_TVM))) {
         riscv_raise_exception(env, RISCV_EXCP_ILLEGAL_INST, GETPC());
     } else {
+        riscv_pwc_flush(env);
         tlb_flush(cs);
     }
 }
@@ -190,8 +190,6 @@ void HELPER(amoswap_cap)(CPUArchState *env, uint32_t dest_reg,
                          uint32_t addr_reg, uint32_t val_reg)
 {
     uintptr_t _host_return_address = GETPC();
-    assert(cpu_in_exclusive_context(env_cpu(env)) &&
-           "Should have raised EXCP_ATOMIC");
     target_long offset = 0;
     if (!cheri_in_capmode(env)) {
         offset = get_capreg_cursor(env, addr_reg);
@@ -230,16 +228,22 @@ void HELPER(amoswap_cap)(CPUArchState *env, uint32_t dest_reg,
     if (addr == env->load_res) {
         env->load_res = -1; // Invalidate LR/SC to the same address
     }
-    // Load the value to store from the register file now in case the
-    // load_cap_from_memory call overwrites that register
+    // Swap using compare-and-exchange so that this is atomic with respect to
+    // other vCPUs. Retry if the memory was modified in between.
     uint64_t loaded_pesbt;
     uint64_t loaded_cursor;
-    bool loaded_tag =
-        load_cap_from_memory_128(env, &loaded_pesbt, &loaded_cursor, addr_reg,
-                                 cbp, addr, _host_return_address, NULL);
-    // The store may still trap, so we must only update the dest register after
-    // the store succeeded.
-    store_cap_to_memory(env, val_reg, addr, _host_return_address);
+    bool loaded_tag, raw_tag;
+    do {
+        loaded_tag = load_cap_from_memory_128(env, &loaded_pesbt,
+                                              &loaded_cursor, addr_reg, cbp,
+                                              addr, _host_return_address, NULL,
+                                              &raw_tag);
+        // The store may still trap, so we must only update the dest register
+        // after the store succeeded. Compare against the tag in memory, not
+        // the one that may have been cleared for the destination register.
+    } while (!cmpxchg_cap_in_memory(env, val_reg, addr, loaded_pesbt,
+                                    loaded_cursor, raw_tag,
+                                    _host_return_address));
     // Store succeeded -> we can update cd
     update_compressed_capreg(env, dest_reg, loaded_pesbt, loaded_tag,
                              loaded_cursor);
@@ -248,8 +252,6 @@ void HELPER(amoswap_cap)(CPUArchState *env, uint32_t dest_reg,
 void HELPER(lr_cap)(CPUArchState *env, uint32_t dest_reg, uint32_t addr_reg)
 {
     uintptr_t _host_return_address = GETPC();
-    assert(cpu_in_exclusive_context(env_cpu(env)) &&
-           "Should have raised EXCP_ATOMIC");
     target_long offset = 0;
     if (!cheri_in_capmode(env)) {
         offset = get_capreg_cursor(env, addr_reg);
@@ -279,13 +281,16 @@ void HELPER(lr_cap)(CPUArchState *env, uint32_t dest_reg, uint32_t addr_reg)
     }
     target_ulong pesbt;
     target_ulong cursor;
+    bool raw_tag;
     bool tag = load_cap_from_memory_128(env, &pesbt, &cursor, addr_reg, cbp,
-                                        addr, _host_return_address, NULL);
-    // If this didn't trap, update the lr state:
+                                        addr, _host_return_address, NULL,
+                                        &raw_tag);
+    // If this didn't trap, update the lr state. SC compares against memory,
+    // so remember the unfiltered tag.
     env->load_res = addr;
     env->load_val = cursor;
     env->load_pesbt = pesbt;
-    env->load_tag = tag;
+    env->load_tag = raw_tag;
     update_compressed_capreg(env, dest_reg, pesbt, tag, cursor);
 }
 
@@ -294,8 +299,6 @@ target_ulong HELPER(sc_cap)(CPUArchState *env, uint32_t addr_reg,
                             uint32_t val_reg)
 {
     uintptr_t _host_return_address = GETPC();
-    assert(cpu_in_exclusive_context(env_cpu(env)) &&
-           "Should have raised EXCP_ATOMIC");
     target_long offset = 0;
     if (!cheri_in_capmode(env)) {
         offset = get_capreg_cursor(env, addr_reg);
@@ -339,14 +342,14 @@ target_ulong HELPER(sc_cap)(CPUArchState *env, uint32_t addr_reg,
     if (addr != expected_addr) {
         goto sc_failed;
     }
-    // Now perform the "cmpxchg" operation
-    if (get_capreg_cursor(env, val_reg) != env->load_val ||
-        get_capreg_pesbt(env, val_reg) != env->load_pesbt ||
-        get_capreg_tag(env, val_reg) != env->load_tag) {
+    // Now perform the cmpxchg operation against the value loaded by LR.
+    // This store may still trap, which is why env->load_res was already
+    // cleared above: the SC fails if it is restarted after the trap.
+    if (!cmpxchg_cap_in_memory(env, val_reg, addr, env->load_pesbt,
+                               env->load_val, env->load_tag,
+                               _host_return_address)) {
         goto sc_failed;
     }
-    // This store may still trap, so we should update env->load_res before
-    store_cap_to_memory(env, val_reg, addr, _host_return_address);
     tcg_debug_assert(env->load_res == -1);
     return 0; // success
 sc_failed:
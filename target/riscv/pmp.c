@@ -319,6 +319,8 @@ void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
         pmp_write_cfg(env, (reg_index * sizeof(target_ulong)) + i,
             cfg_val);
     }
+    /* Cached page table walks skip the PMP checks on non-leaf PTEs */
+    riscv_pwc_flush(env);
 }
 
 
@@ -352,6 +354,7 @@ void pmpaddr_csr_write(CPURISCVState *env, uint32_t addr_index,
         if (!pmp_is_locked(env, addr_index)) {
             env->pmp_state.pmp[addr_index].addr_reg = val;
             pmp_update_rule(env, addr_index);
+            riscv_pwc_flush(env);
         } else {
             qemu_log_mask(LOG_GUEST_ERROR,
                           "ignoring pmpaddr write - locked\n");
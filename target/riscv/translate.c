@@ -66,6 +66,8 @@ typedef struct DisasContext {
     bool ext_ifencei;
 #ifdef TARGET_CHERI
     bool capmode;
+    /* movi of the per-TB minstret increment, patched at TB end */
+    TCGOp *minstret_op;
 #endif
 } DisasContext;
 
@@ -902,6 +904,21 @@ get_capmode_dependent_rmw_addr(DisasContext *ctx, int reg_num,
 /* Include the auto-generated decoder for 16 bit insn */
 #include "decode_insn16.inc.c"
 
+static inline void gen_cvtrace_log_instruction(DisasContext *ctx,
+                                               uint32_t opcode)
+{
+#ifdef CONFIG_MIPS_LOG_INSTR
+    if (unlikely(ctx->base.log_instr) &&
+        qemu_loglevel_mask(CPU_LOG_CVTRACE)) {
+        TCGv tpc = tcg_const_tl(ctx->base.pc_next);
+        TCGv_i32 topcode = tcg_const_i32(opcode);
+        gen_helper_riscv_cvtrace_log_instruction(cpu_env, tpc, topcode);
+        tcg_temp_free_i32(topcode);
+        tcg_temp_free(tpc);
+    }
+#endif
+}
+
 static void decode_opc(CPURISCVState *env, DisasContext *ctx)
 {
 #ifdef CONFIG_RVFI_DII
@@ -917,6 +934,7 @@ static void decode_opc(CPURISCVState *env, DisasContext *ctx)
     /* check for compressed insn */
     if (extract16(opcode, 0, 2) != 3) {
         gen_rvfi_dii_set_field_const(insn, opcode);
+        gen_cvtrace_log_instruction(ctx, opcode);
         gen_check_pcc_bounds_next_inst(ctx, 2);
         if (!has_ext(ctx, RVC)) {
             gen_exception_illegal(ctx);
@@ -939,6 +957,7 @@ static void decode_opc(CPURISCVState *env, DisasContext *ctx)
 #endif
         uint32_t opcode32 = opcode;
         opcode32 = deposit32(opcode32, 16, 16, next_16);
+        gen_cvtrace_log_instruction(ctx, opcode32);
         gen_check_pcc_bounds_next_inst(ctx, 4);
         ctx->pc_succ_insn = ctx->base.pc_next + 4;
         gen_rvfi_dii_set_field_const(insn, opcode32);
@@ -992,8 +1011,49 @@ static bool riscv_tr_tb_in_user_mode(DisasContextBase *dcbase, CPUState *cs)
     return env->priv == PRV_U;
 }
 
+#ifdef TARGET_CHERI
+/*
+ * minstret is incremented once per TB by the number of instructions in it,
+ * which is only known once translation is done, so the immediate is patched
+ * in riscv_tr_tb_stop(). If an exception ends the TB early,
+ * restore_insn_count_to_opc() subtracts the instructions that did not retire.
+ */
+static void gen_minstret_start(DisasContext *ctx)
+{
+    TCGv_i32 count = tcg_temp_new_i32();
+    TCGv_i64 t0 = tcg_temp_new_i64();
+    TCGv_i64 t1 = tcg_temp_new_i64();
+
+    tcg_gen_movi_i32(count, 0xdeadbeef);
+    ctx->minstret_op = tcg_last_op();
+    tcg_gen_extu_i32_i64(t0, count);
+    tcg_gen_ld_i64(t1, cpu_env, offsetof(CPURISCVState, minstret));
+    tcg_gen_add_i64(t1, t1, t0);
+    tcg_gen_st_i64(t1, cpu_env, offsetof(CPURISCVState, minstret));
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t0);
+    tcg_temp_free_i32(count);
+}
+
+void restore_insn_count_to_opc(CPURISCVState *env, TranslationBlock *tb,
+                               int not_executed)
+{
+    env->minstret -= not_executed;
+}
+#endif
+
 static void riscv_tr_tb_start(DisasContextBase *db, CPUState *cpu)
 {
+#ifdef TARGET_CHERI
+    DisasContext *ctx = container_of(db, DisasContext, base);
+
+    /*
+     * This must come before anything that can raise an exception, including
+     * the PCC checks on TB entry, since restore_insn_count_to_opc() assumes
+     * that the whole TB has been counted.
+     */
+    gen_minstret_start(ctx);
+#endif
 }
 
 static void riscv_tr_insn_start(DisasContextBase *dcbase, CPUState *cpu)
@@ -1042,6 +1102,9 @@ static void riscv_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
 {
     DisasContext *ctx = container_of(dcbase, DisasContext, base);
 
+#ifdef TARGET_CHERI
+    tcg_set_insn_param(ctx->minstret_op, 1, ctx->base.num_insns);
+#endif
     switch (ctx->base.is_jmp) {
     case DISAS_TOO_MANY:
         gen_goto_tb(ctx, 0, ctx->base.pc_next);
@@ -2720,6 +2720,24 @@ void tcg_gen_lookup_and_goto_ptr(void)
     }
 }
 
+#ifdef TARGET_CHERI
+/* Same as tcg_gen_lookup_and_goto_ptr() after installing a new PCC. */
+void tcg_gen_lookup_cap_jump_and_goto_ptr(void)
+{
+    if (TCG_TARGET_HAS_goto_ptr && !qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN)) {
+        TCGv_ptr ptr;
+
+        plugin_gen_disable_mem_helpers();
+        ptr = tcg_temp_new_ptr();
+        gen_helper_lookup_cap_jump_tb_ptr(ptr, cpu_env);
+        tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+        tcg_temp_free_ptr(ptr);
+    } else {
+        tcg_gen_exit_tb(NULL, 0);
+    }
+}
+#endif
+
 static inline MemOp tcg_canonicalize_memop(MemOp op, bool is64, bool st)
 {
     /* Trigger the asserts within as early as possible.  */
@@ -2817,7 +2835,13 @@ static inline void plugin_gen_mem_callbacks(TCGv_cap_checked_ptr vaddr, uint16_t
 #endif
 }
 
-#ifdef TARGET_CHERI
+#if defined(TARGET_CHERI) && defined(CONFIG_USER_ONLY)
+/*
+ * With softmmu, stores to pages that may hold tags miss the inline fast path
+ * (TLB_CHERI_TAGS) and the slow path invalidates the tags, so only user-mode
+ * needs to call a helper after every store.
+ */
+#define CHERI_EXPLICIT_TAG_INVALIDATE 1
 static inline void gen_cheri_invalidate_tags(TCGv_cap_checked_ptr out_addr, TCGv_i32 memop) {
     gen_helper_cheri_invalidate_tags(cpu_env, out_addr, memop);
 }
@@ -2886,7 +2910,7 @@ void tcg_gen_qemu_ld_i32_with_checked_addr(TCGv_i32 val, TCGv_cap_checked_ptr ad
     }
 #if defined(CONFIG_MIPS_LOG_INSTR)
     TCGv_i32 tcop = tcg_const_i32(memop);
-    if (unlikely(qemu_loglevel_mask(CPU_LOG_INSTR | CPU_LOG_CVTRACE))) {
+    if (unlikely(tcg_ctx->log_instr)) {
         gen_helper_dump_load32(cpu_env, saved_load_addr, val, tcop);
     }
     tcg_temp_free_i32(tcop);
@@ -2929,14 +2953,14 @@ void tcg_gen_qemu_st_i32_with_checked_addr(TCGv_i32 val, TCGv_cap_checked_ptr ad
     gen_rvfi_dii_set_field_const(mem_wmask, memop_rvfi_mask(memop));
 
     plugin_gen_mem_callbacks(addr, info);
-#if defined(TARGET_CHERI) || defined(CONFIG_MIPS_LOG_INSTR)
+#if defined(CHERI_EXPLICIT_TAG_INVALIDATE) || defined(CONFIG_MIPS_LOG_INSTR)
     TCGv_i32 tcop = tcg_const_i32(memop);
 #if defined(CONFIG_MIPS_LOG_INSTR)
-    if (unlikely(qemu_loglevel_mask(CPU_LOG_INSTR | CPU_LOG_CVTRACE))) {
+    if (unlikely(tcg_ctx->log_instr)) {
         gen_helper_dump_store32(cpu_env, addr, val, tcop);
     }
 #endif
-#ifdef TARGET_CHERI
+#ifdef CHERI_EXPLICIT_TAG_INVALIDATE
     gen_cheri_invalidate_tags(addr, tcop);
 #endif
     tcg_temp_free_i32(tcop);
@@ -3017,7 +3041,7 @@ void tcg_gen_qemu_ld_i64_with_checked_addr(TCGv_i64 val, TCGv_cap_checked_ptr ad
     }
 #if defined(CONFIG_MIPS_LOG_INSTR)
     TCGv_i32 tcop = tcg_const_i32(memop);
-    if (unlikely(qemu_loglevel_mask(CPU_LOG_INSTR | CPU_LOG_CVTRACE))) {
+    if (unlikely(tcg_ctx->log_instr)) {
         gen_helper_dump_load64(cpu_env, saved_load_addr, val, tcop);
     }
     tcg_temp_free_i32(tcop);
@@ -3070,14 +3094,14 @@ void tcg_gen_qemu_st_i64_with_checked_addr(TCGv_i64 val, TCGv_cap_checked_ptr ad
     gen_rvfi_dii_set_field_const(mem_wmask, memop_rvfi_mask(memop));
 
     plugin_gen_mem_callbacks(addr, info);
-#if defined(TARGET_CHERI) || defined(CONFIG_MIPS_LOG_INSTR)
+#if defined(CHERI_EXPLICIT_TAG_INVALIDATE) || defined(CONFIG_MIPS_LOG_INSTR)
     TCGv_i32 tcop = tcg_const_i32(memop);
 #if defined(CONFIG_MIPS_LOG_INSTR)
-    if (unlikely(qemu_loglevel_mask(CPU_LOG_INSTR | CPU_LOG_CVTRACE))) {
+    if (unlikely(tcg_ctx->log_instr)) {
         gen_helper_dump_store64(cpu_env, addr, val, tcop);
     }
 #endif
-#if defined(TARGET_CHERI)
+#ifdef CHERI_EXPLICIT_TAG_INVALIDATE
     gen_cheri_invalidate_tags(addr, tcop);
 #endif
     tcg_temp_free_i32(tcop);
@@ -3210,7 +3234,7 @@ void tcg_gen_atomic_cmpxchg_i32_with_checked_addr(
             tcg_gen_ext_i32(retv, retv, memop);
         }
     }
-#ifdef TARGET_CHERI
+#ifdef CHERI_EXPLICIT_TAG_INVALIDATE
     // XXX: always clear the tag even on failure
     TCGv_i32 op = tcg_const_i32(memop);
     gen_cheri_invalidate_tags(checked_addr, op);
@@ -3280,7 +3304,7 @@ void tcg_gen_atomic_cmpxchg_i64_with_checked_addr(
             tcg_gen_ext_i64(retv, retv, memop);
         }
     }
-#ifdef TARGET_CHERI
+#ifdef CHERI_EXPLICIT_TAG_INVALIDATE
     // XXX: always clear the tag even on failure
     TCGv_i32 op = tcg_const_i32(memop);
     gen_cheri_invalidate_tags(checked_addr, op);
@@ -3300,7 +3324,7 @@ static void do_nonatomic_op_i32(TCGv_i32 ret, TCGv_cap_checked_ptr checked_addr,
 
     tcg_gen_qemu_ld_i32_with_checked_addr(t1, checked_addr, idx, memop & ~MO_SIGN);
     gen(t2, t1, val);
-    // Note: For CHERI tcg_gen_qemu_st_i32 calls gen_cheri_invalidate_tags()
+    // Note: For CHERI tcg_gen_qemu_st_i32 also invalidates the tags
     tcg_gen_qemu_st_i32_with_checked_addr(t2, checked_addr, idx, memop);
 
     tcg_gen_ext_i32(ret, (new_val ? t2 : t1), memop);
@@ -3328,7 +3352,7 @@ static void do_atomic_op_i32(TCGv_i32 ret, TCGv_cap_checked_ptr checked_addr,
 #else
     gen(ret, cpu_env, addr, val);
 #endif
-#ifdef TARGET_CHERI
+#ifdef CHERI_EXPLICIT_TAG_INVALIDATE
     TCGv_i32 op = tcg_const_i32(memop);
     gen_cheri_invalidate_tags(checked_addr, op);
     tcg_temp_free_i32(op);
@@ -3351,7 +3375,7 @@ static void do_nonatomic_op_i64(TCGv_i64 ret, TCGv_cap_checked_ptr checked_addr,
     memop = tcg_canonicalize_memop(memop, 1, 0);
     tcg_gen_qemu_ld_i64_with_checked_addr(t1, checked_addr, idx, memop & ~MO_SIGN);
     gen(t2, t1, val);
-    // Note: For CHERI tcg_gen_qemu_st_i64 calls gen_cheri_invalidate_tags()
+    // Note: For CHERI tcg_gen_qemu_st_i64 also invalidates the tags
     tcg_gen_qemu_st_i64_with_checked_addr(t2, checked_addr, idx, memop);
 
     tcg_gen_ext_i64(ret, (new_val ? t2 : t1), memop);
@@ -3401,7 +3425,7 @@ static void do_atomic_op_i64(TCGv_i64 ret, TCGv_cap_checked_ptr checked_addr,
             tcg_gen_ext_i64(ret, ret, memop);
         }
     }
-#ifdef TARGET_CHERI
+#ifdef CHERI_EXPLICIT_TAG_INVALIDATE
     TCGv_i32 op = tcg_const_i32(memop);
     gen_cheri_invalidate_tags(checked_addr, op);
     tcg_temp_free_i32(op);
@@ -0,0 +1,160 @@
+/*
+ * CHERI tag memory layout benchmark
+ *
+ * Compares the two tag storage layouts of target/cheri-common/cheri_tagstore.h
+ * (used by cheri_tagmem.c): an array of lazily allocated 4096-tag blocks (the
+ * default) and a single flat bitmap reserved with mmap(MAP_NORESERVE)
+ * (-cheri-tagmem-flat).
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "target/cheri-common/cheri_tagstore.h"
+
+#define CAP_TAG_SHFT        4
+
+#define RAM_SIZE            (1 * GiB)
+#define NTAGS               (RAM_SIZE >> CAP_TAG_SHFT)
+#define NBLOCKS             (NTAGS >> CHERI_TAGBLK_SHFT)
+#define NOPS                (64 * 1024 * 1024)
+
+typedef struct TagMemLayout {
+    const char *name;
+    bool flat;
+} TagMemLayout;
+
+static const TagMemLayout layouts[] = {
+    { "blocks", false },
+    { "flat", true },
+};
+
+/* Check that both layouts behave the same before timing them. */
+static void test_tagmem_basic(const void *opaque)
+{
+    const TagMemLayout *layout = opaque;
+    CheriTagMem *tm = cheri_tag_store_new(NBLOCKS, layout->flat);
+    size_t last = NTAGS - 1;
+
+    g_assert(tm);
+    g_assert(cheri_tag_store_is_flat(tm) == layout->flat);
+    g_assert(!cheri_tag_store_get(tm, 0));
+    g_assert(cheri_tag_store_find_next(tm, 0, NTAGS) == NTAGS);
+
+    /* Only the first set in a sparse block allocates it. */
+    g_assert(cheri_tag_store_set(tm, 5) == !layout->flat);
+    g_assert(!cheri_tag_store_set(tm, 6));
+    cheri_tag_store_set(tm, last);
+    g_assert(cheri_tag_store_get(tm, 5));
+    g_assert(cheri_tag_store_get(tm, last));
+    g_assert(cheri_tag_store_find_next(tm, 0, NTAGS) == 5);
+    g_assert(cheri_tag_store_find_next(tm, 7, NTAGS) == last);
+
+    cheri_tag_store_clear(tm, 5);
+    g_assert(!cheri_tag_store_get(tm, 5));
+    g_assert(cheri_tag_store_clear_range(tm, 0, CHERI_TAGBLK_SIZE, NULL,
+                                         NULL));
+    g_assert(!cheri_tag_store_clear_range(tm, 0, CHERI_TAGBLK_SIZE, NULL,
+                                          NULL));
+    g_assert(cheri_tag_store_block(tm, 0));
+
+    cheri_tag_store_reset(tm);
+    g_assert(!cheri_tag_store_get(tm, last));
+    g_assert(cheri_tag_store_find_next(tm, 0, NTAGS) == NTAGS);
+    cheri_tag_store_free(tm);
+}
+
+/*
+ * @tagged_percent of the tag blocks contain tags, the remaining accesses hit
+ * tag-free memory, as is typical for a guest that stores few capabilities.
+ */
+typedef struct TagMemBenchParams {
+    const TagMemLayout *layout;
+    unsigned tagged_percent;
+} TagMemBenchParams;
+
+static size_t *make_indices(unsigned tagged_percent)
+{
+    size_t *idx = g_new(size_t, NOPS);
+    size_t tagged_blocks = MAX(1, NBLOCKS * tagged_percent / 100);
+
+    for (size_t i = 0; i < NOPS; i++) {
+        size_t blk = g_test_rand_int_range(0, NBLOCKS);
+        if (g_test_rand_int_range(0, 100) < tagged_percent) {
+            blk %= tagged_blocks;
+        }
+        idx[i] = (blk << CHERI_TAGBLK_SHFT) |
+                 g_test_rand_int_range(0, CHERI_TAGBLK_SIZE);
+    }
+    return idx;
+}
+
+static void test_tagmem_speed(const void *opaque)
+{
+    const TagMemBenchParams *params = opaque;
+    CheriTagMem *tm;
+    size_t *idx = make_indices(params->tagged_percent);
+    size_t tagged_blocks = MAX(1, NBLOCKS * params->tagged_percent / 100);
+    size_t count = 0;
+    double set_time, get_time, clear_time;
+
+    tm = cheri_tag_store_new(NBLOCKS, params->layout->flat);
+    g_assert(tm);
+    for (size_t i = 0; i < tagged_blocks << CHERI_TAGBLK_SHFT; i += 7) {
+        cheri_tag_store_set(tm, i);
+    }
+
+    g_test_timer_start();
+    for (size_t i = 0; i < NOPS; i++) {
+        count += cheri_tag_store_get(tm, idx[i]);
+    }
+    get_time = g_test_timer_elapsed();
+
+    g_test_timer_start();
+    for (size_t i = 0; i < NOPS; i += 2) {
+        cheri_tag_store_set(tm, idx[i]);
+    }
+    set_time = g_test_timer_elapsed();
+
+    g_test_timer_start();
+    for (size_t i = 0; i < NOPS; i++) {
+        cheri_tag_store_clear(tm, idx[i]);
+    }
+    clear_time = g_test_timer_elapsed();
+
+    g_print("%s (%u%% tagged): ", params->layout->name, params->tagged_percent);
+    g_print("get %.2f Mops/sec, ", (double)NOPS / MiB / get_time);
+    g_print("set %.2f Mops/sec, ", (double)NOPS / 2 / MiB / set_time);
+    g_print("clear %.2f Mops/sec ", (double)NOPS / MiB / clear_time);
+    g_print("(%zu tagged) ", count);
+
+    cheri_tag_store_free(tm);
+    g_free(idx);
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned tagged_percent[] = { 1, 10, 100 };
+    char name[64];
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (size_t i = 0; i < ARRAY_SIZE(layouts); i++) {
+        snprintf(name, sizeof(name), "/cheri/tagmem/%s/basic",
+                 layouts[i].name);
+        g_test_add_data_func(name, &layouts[i], test_tagmem_basic);
+        for (size_t j = 0; j < ARRAY_SIZE(tagged_percent); j++) {
+            TagMemBenchParams *params = g_new(TagMemBenchParams, 1);
+            params->layout = &layouts[i];
+            params->tagged_percent = tagged_percent[j];
+            snprintf(name, sizeof(name), "/cheri/tagmem/%s/speed-%upct",
+                     layouts[i].name, tagged_percent[j]);
+            g_test_add_data_func_full(name, params, test_tagmem_speed,
+                                      g_free);
+        }
+    }
+
+    return g_test_run();
+}
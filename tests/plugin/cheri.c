@@ -0,0 +1,86 @@
+/*
+ * Count capability tag changes and capability faults on CHERI targets
+ *
+ * For every fault the bounds of the faulting register are recorded, which
+ * gives a rough profile of which kinds of capabilities trap.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define MAX_CAUSE 64
+
+static GMutex lock;
+static uint64_t tags_set;
+static uint64_t tags_cleared;
+static uint64_t faults[MAX_CAUSE];
+/* Sum of log2(length) of the faulting capability, per cause */
+static uint64_t fault_len_log2[MAX_CAUSE];
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) out = g_string_new("");
+    int i;
+
+    g_string_printf(out, "tags set: %" PRIu64 "\n", tags_set);
+    g_string_append_printf(out, "tags cleared: %" PRIu64 "\n", tags_cleared);
+    for (i = 0; i < MAX_CAUSE; i++) {
+        if (faults[i]) {
+            g_string_append_printf(out, "cause %#x: %" PRIu64
+                                   " faults, avg log2(length) %.1f\n", i,
+                                   faults[i],
+                                   (double)fault_len_log2[i] / faults[i]);
+        }
+    }
+    qemu_plugin_outs(out->str);
+}
+
+static void vcpu_cap_tag(qemu_plugin_id_t id, unsigned int vcpu_index,
+                         uint64_t vaddr, uint64_t ram_addr, bool tag)
+{
+    g_mutex_lock(&lock);
+    if (tag) {
+        tags_set++;
+    } else {
+        tags_cleared++;
+    }
+    g_mutex_unlock(&lock);
+}
+
+static void vcpu_cap_fault(qemu_plugin_id_t id, unsigned int vcpu_index,
+                           unsigned int cause, unsigned int reg)
+{
+    struct qemu_plugin_cap cap;
+    unsigned len_log2 = 0;
+
+    if (qemu_plugin_read_cap_reg(vcpu_index, reg, &cap) &&
+        cap.top > cap.base) {
+        len_log2 = 63 - __builtin_clzll(cap.top - cap.base);
+    }
+    cause %= MAX_CAUSE;
+    g_mutex_lock(&lock);
+    faults[cause]++;
+    fault_len_log2[cause] += len_log2;
+    g_mutex_unlock(&lock);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    qemu_plugin_register_vcpu_cap_tag_cb(id, vcpu_cap_tag);
+    qemu_plugin_register_vcpu_cap_fault_cb(id, vcpu_cap_fault);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
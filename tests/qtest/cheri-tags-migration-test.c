@@ -0,0 +1,230 @@
+/*
+ * QTest testcase for the migration of CHERI tag memory
+ *
+ * A small guest on the Malta board keeps storing tagged capabilities to,
+ * and clearing them from, one slot per page of a 4MiB region while the VM
+ * is migrated. After the first pass the test makes the guest spread out
+ * over the whole region, so tags are both set and cleared in blocks that
+ * have already been sent and in blocks that did not have any tags yet.
+ * Once migration completes, the cheri-tag-scanner device is used to check
+ * that the (paused) destination has exactly the tags of the stopped source.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/bswap.h"
+#include "hw/misc/cheri_tag_scanner.h"
+
+#include "migration-helpers.h"
+
+#define TAG_SCANNER_ADDRESS 0x1e800000ULL
+
+/* Guest physical addresses used by the test */
+#define MASK_ADDRESS        0x0f0000ULL /* slot mask read by the guest */
+#define COUNT_ADDRESS       (MASK_ADDRESS + 4) /* completed iterations */
+#define REGION_ADDRESS      0x100000ULL
+#define REGION_SLOTS        1024        /* one slot per 4K page */
+#define REGION_SIZE         (REGION_SLOTS * 0x1000ULL)
+#define SCAN_BUF_ADDRESS    0x800000ULL
+#define SCAN_BUF_LEN        REGION_SLOTS
+
+/*
+ * Boot code, executed from the reset vector. The board ID is written at
+ * offset 0x10, so the code starts at 0x20. Iteration n uses the slot in page
+ * (n & mask) of the region. It stores a tagged copy of DDC there, or clears
+ * the tag with an integer store if bit 10 of n is set.
+ */
+static const uint32_t boot_code[] = {
+    0x10000007, /* b       0x20 */
+    0x00000000, /* nop */
+    0, 0, 0, 0, 0, 0,
+    0x3c085000, /* lui     t0, 0x5000 (Status.CU2 | Status.CU0) */
+    0x40886000, /* mtc0    t0, $12 */
+    0x00000000, /* nop */
+    0x4801037f, /* creadhwr c1, $0 (DDC) */
+    0x3c0ba010, /* lui     t3, 0xa010 (KSEG1 address of REGION_ADDRESS) */
+    0x3c0ca00f, /* lui     t4, 0xa00f (KSEG1 address of MASK_ADDRESS) */
+    0x00005025, /* move    t2, zero */
+    /* loop: */
+    0x8d8d0000, /* lw      t5, 0(t4) */
+    0x014d4824, /* and     t1, t2, t5 */
+    0x00094b38, /* dsll    t1, t1, 12 */
+    0x0169402d, /* daddu   t0, t3, t1 */
+    0x31490400, /* andi    t1, t2, 0x400 */
+    0x15200003, /* bnez    t1, clear */
+    0x00000000, /* nop */
+    0x10000002, /* b       next */
+    0xf8214000, /* csc     c1, t0, 0(c1) */
+    /* clear: */
+    0xfd000000, /* sd      zero, 0(t0) */
+    /* next: */
+    0x654a0001, /* daddiu  t2, t2, 1 */
+    0x1000fff4, /* b       loop */
+    0xad8a0004, /* sw      t2, 4(t4) (COUNT_ADDRESS) */
+};
+
+static char *tmpdir;
+
+static char *write_boot_image(void)
+{
+    uint32_t image[ARRAY_SIZE(boot_code)];
+    char *path = g_strdup_printf("%s/boot.bin", tmpdir);
+    GError *err = NULL;
+
+    for (size_t i = 0; i < ARRAY_SIZE(boot_code); i++) {
+        image[i] = cpu_to_be32(boot_code[i]);
+    }
+    g_file_set_contents(path, (char *)image, sizeof(image), &err);
+    g_assert_no_error(err);
+    return path;
+}
+
+/* Returns the number of tagged capabilities in [start, end). */
+static uint64_t scan_tags(QTestState *qts, uint64_t start, uint64_t end,
+                          uint64_t *addrs)
+{
+    uint64_t status, count;
+
+    g_assert_cmphex(qtest_readq(qts, TAG_SCANNER_ADDRESS +
+                                CHERI_TAG_SCANNER_ID), ==,
+                    CHERI_TAG_SCANNER_ID_VALUE);
+    qtest_writeq(qts, TAG_SCANNER_ADDRESS + CHERI_TAG_SCANNER_START, start);
+    qtest_writeq(qts, TAG_SCANNER_ADDRESS + CHERI_TAG_SCANNER_END, end);
+    qtest_writeq(qts, TAG_SCANNER_ADDRESS + CHERI_TAG_SCANNER_BUF_ADDR,
+                 SCAN_BUF_ADDRESS);
+    qtest_writeq(qts, TAG_SCANNER_ADDRESS + CHERI_TAG_SCANNER_BUF_LEN,
+                 SCAN_BUF_LEN);
+    qtest_writeq(qts, TAG_SCANNER_ADDRESS + CHERI_TAG_SCANNER_CTRL,
+                 CHERI_TAG_SCANNER_CTRL_START);
+    status = qtest_readq(qts, TAG_SCANNER_ADDRESS + CHERI_TAG_SCANNER_STATUS);
+    g_assert_cmphex(status, ==, CHERI_TAG_SCANNER_STATUS_DONE);
+    count = qtest_readq(qts, TAG_SCANNER_ADDRESS + CHERI_TAG_SCANNER_COUNT);
+    g_assert_cmpuint(count, <=, SCAN_BUF_LEN);
+    qtest_memread(qts, SCAN_BUF_ADDRESS, addrs, count * sizeof(uint64_t));
+    for (uint64_t i = 0; i < count; i++) {
+        addrs[i] = le64_to_cpu(addrs[i]);
+    }
+    return count;
+}
+
+static void migrate_set_parameter_int(QTestState *who, const char *parameter,
+                                      long long value)
+{
+    QDict *rsp;
+
+    rsp = qtest_qmp(who,
+                    "{ 'execute': 'migrate-set-parameters',"
+                    "'arguments': { %s: %lld } }",
+                    parameter, value);
+    g_assert(qdict_haskey(rsp, "return"));
+    qobject_unref(rsp);
+}
+
+static int64_t get_migration_pass(QTestState *who)
+{
+    QDict *rsp_return, *rsp_ram;
+    int64_t result = 0;
+
+    rsp_return = migrate_query(who);
+    if (qdict_haskey(rsp_return, "ram")) {
+        rsp_ram = qdict_get_qdict(rsp_return, "ram");
+        result = qdict_get_try_int(rsp_ram, "dirty-sync-count", 0);
+    }
+    qobject_unref(rsp_return);
+    return result;
+}
+
+/* Wait until migration has synced the dirty bitmaps @npasses more times. */
+static void wait_for_migration_passes(QTestState *who, int npasses)
+{
+    int64_t initial_pass = get_migration_pass(who);
+
+    while (get_migration_pass(who) < initial_pass + npasses) {
+        g_usleep(1000);
+    }
+}
+
+static void test_migrate_tags(void)
+{
+    g_autofree char *bios = write_boot_image();
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpdir);
+    g_autofree uint64_t *src_tags = g_new(uint64_t, SCAN_BUF_LEN);
+    g_autofree uint64_t *dst_tags = g_new(uint64_t, SCAN_BUF_LEN);
+    uint64_t src_count, dst_count;
+    QTestState *from, *to;
+
+    from = qtest_initf("-accel tcg -M malta -m 64M -bios %s", bios);
+    /* Keep the destination paused so that its tags can be compared. */
+    to = qtest_initf("-accel tcg -M malta -m 64M -bios %s -S -incoming %s",
+                     bios, uri);
+
+    /* Start in the first 16 pages (the first tag block) only. */
+    qtest_writel(from, MASK_ADDRESS, 15);
+    for (int i = 0; qtest_readl(from, COUNT_ADDRESS) < 4 * 1024; i++) {
+        g_assert_cmpint(i, <, 1000);
+        g_usleep(10 * 1000);
+    }
+
+    /* The guest dirties pages faster than this allows, so it can't finish. */
+    migrate_set_parameter_int(from, "downtime-limit", 1);
+    migrate_set_parameter_int(from, "max-bandwidth", 10 * 1000 * 1000);
+    migrate_qmp(from, uri, "{}");
+    /* Wait for the first pass to complete and the second one to start. */
+    wait_for_migration_passes(from, 2);
+
+    /* Now set and clear tags in blocks that have not been sent yet. */
+    qtest_writel(from, MASK_ADDRESS, REGION_SLOTS - 1);
+    wait_for_migration_passes(from, 2);
+
+    migrate_set_parameter_int(from, "downtime-limit", 10 * 1000);
+    wait_for_migration_complete(from);
+    wait_for_migration_complete(to);
+
+    /* The guest covered the whole region during migration. */
+    g_assert_cmpuint(qtest_readl(from, COUNT_ADDRESS), >, 8 * 1024);
+    g_assert_cmpuint(qtest_readl(to, COUNT_ADDRESS), ==,
+                     qtest_readl(from, COUNT_ADDRESS));
+
+    src_count = scan_tags(from, REGION_ADDRESS, REGION_ADDRESS + REGION_SIZE,
+                          src_tags);
+    dst_count = scan_tags(to, REGION_ADDRESS, REGION_ADDRESS + REGION_SIZE,
+                          dst_tags);
+    g_assert_cmpuint(src_count, >, 0);
+    g_assert_cmpuint(dst_count, ==, src_count);
+    for (uint64_t i = 0; i < src_count; i++) {
+        g_assert_cmphex(dst_tags[i], ==, src_tags[i]);
+    }
+
+    qtest_quit(from);
+    qtest_quit(to);
+}
+
+int main(int argc, char **argv)
+{
+    g_autofree char *boot = NULL;
+    g_autofree char *sock = NULL;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    tmpdir = g_dir_make_tmp("cheri-tags-test-XXXXXX", NULL);
+    g_assert(tmpdir);
+
+    qtest_add_func("/cheri/tags/migration", test_migrate_tags);
+
+    ret = g_test_run();
+
+    boot = g_strdup_printf("%s/boot.bin", tmpdir);
+    unlink(boot);
+    sock = g_strdup_printf("%s/migsocket", tmpdir);
+    unlink(sock);
+    rmdir(tmpdir);
+    g_free(tmpdir);
+
+    return ret;
+}
@@ -0,0 +1,132 @@
+/*
+ * CHERI instruction-level microbenchmarks
+ *
+ * Times loops of the capability instructions whose emulation cost matters
+ * most and prints, for each of them, a line of the form
+ *
+ *   bench: <name> ops=<n> insns=<n> ns=<n> ns/op=<n.nnn> mips=<n>
+ *
+ * where ns is host time measured with the guest timer, insns the number of
+ * guest instructions retired and an "op" the instruction being measured
+ * (e.g. one CLC or CSC, or one capability copied by the memcpy kernel).
+ * compare-bench.py compares two such outputs.
+ *
+ * Each kernel is run once to translate it and then BENCH_RUNS times; the
+ * fastest run is reported to filter out host noise.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <minilib.h>
+#include "cheri-bench.h"
+#include "bench-arch.h"
+
+#ifndef BENCH_SCALE
+#define BENCH_SCALE 1
+#endif
+#define BENCH_RUNS 3
+
+#define ARRAY_SIZE(x) ((sizeof(x) / sizeof((x)[0])))
+
+typedef struct Benchmark {
+    const char *name;
+    void (*fn)(void *buf, unsigned long iters);
+    unsigned long buf_offset;
+    unsigned long ops_per_iter;
+    unsigned long iters;
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    { "clc-csc", bench_clc_csc, 0, 8, 1 << 20 },
+    { "cap-int", bench_cap_int, BENCH_SCRATCH, 8, 1 << 20 },
+    { "bounds",  bench_bounds,  0, 4, 1 << 20 },
+    { "cjalr",   bench_cjalr,   0, 2, 1 << 20 },
+    { "memcpy",  bench_memcpy,  0, BENCH_MEMCPY_SIZE / CHERI_CAP_SIZE, 1 << 9 },
+    { "ddc-int", bench_ddc_int, BENCH_SCRATCH, 8, 1 << 20 },
+};
+
+__attribute__((aligned(BENCH_BUF_SIZE)))
+static uint8_t bench_buf[BENCH_BUF_SIZE];
+
+void __sys_outc(char c)
+{
+    bench_arch_putc(c);
+}
+
+/* Print @value / 1000 with three decimals, ml_printf() has no %f. */
+static void print_milli(uint64_t value)
+{
+    uint64_t frac = value % 1000;
+
+    ml_printf("%llu.%c%c%c", (unsigned long long)(value / 1000),
+              '0' + (int)(frac / 100), '0' + (int)(frac / 10 % 10),
+              '0' + (int)(frac % 10));
+}
+
+static void run_benchmark(const Benchmark *b)
+{
+    unsigned long iters = b->iters * BENCH_SCALE;
+    uint64_t ops = (uint64_t)iters * b->ops_per_iter;
+    uint64_t best_ns = UINT64_MAX, best_insns = 0;
+    void *buf = bench_buf + b->buf_offset;
+
+    /* Translate the kernel and fault in the TLB before timing it. */
+    b->fn(buf, 16);
+
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        uint64_t insns = bench_arch_instret();
+        uint64_t ns = bench_arch_time_ns();
+
+        b->fn(buf, iters);
+        ns = bench_arch_time_ns() - ns;
+        insns = bench_arch_instret() - insns;
+        if (ns < best_ns) {
+            best_ns = ns;
+            best_insns = insns;
+        }
+    }
+    if (best_ns == 0) {
+        best_ns = 1;
+    }
+
+    ml_printf("bench: %s ops=%llu insns=%llu ns=%llu ns/op=", b->name,
+              (unsigned long long)ops, (unsigned long long)best_insns,
+              (unsigned long long)best_ns);
+    print_milli(best_ns * 1000 / ops);
+    ml_printf(" mips=%llu\n",
+              (unsigned long long)(best_insns * 1000 / best_ns));
+}
+
+/* The capabilities must survive the copies in both directions. */
+static bool check_tags(void)
+{
+    const unsigned long ncaps = BENCH_MEMCPY_SIZE / CHERI_CAP_SIZE;
+    unsigned long src = bench_count_tags(bench_buf, ncaps);
+    unsigned long dst = bench_count_tags(bench_buf + BENCH_MEMCPY_SIZE, ncaps);
+
+    if (src != ncaps || dst != ncaps) {
+        ml_printf("FAIL: %lu/%lu source and %lu/%lu destination "
+                  "capabilities tagged\n", src, ncaps, dst, ncaps);
+        return false;
+    }
+    return true;
+}
+
+int main(void)
+{
+    ml_printf("CHERI microbenchmarks, %d-byte capabilities\n",
+              CHERI_CAP_SIZE);
+
+    bench_fill_caps(bench_buf, BENCH_MEMCPY_SIZE / CHERI_CAP_SIZE);
+    for (int i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+        run_benchmark(&benchmarks[i]);
+    }
+    if (!check_tags()) {
+        return 1;
+    }
+    ml_printf("PASS\n");
+    return 0;
+}
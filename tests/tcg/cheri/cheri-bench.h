@@ -0,0 +1,56 @@
+/*
+ * CHERI microbenchmark kernels
+ *
+ * The kernels are written in assembly (<arch>/kernels.S) so that each loop
+ * iteration executes exactly the instructions being measured plus the loop
+ * overhead, independent of the compiler. All of them are called from hybrid
+ * C code with an integer pointer into the benchmark buffer and an iteration
+ * count.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef CHERI_BENCH_H
+#define CHERI_BENCH_H
+
+#if CHERI_CAP_SIZE == 16
+# define CHERI_CAP_SIZE_LOG2 4
+#elif CHERI_CAP_SIZE == 32
+# define CHERI_CAP_SIZE_LOG2 5
+#else
+# error "Target does not specify a valid CHERI_CAP_SIZE"
+#endif
+
+/*
+ * Layout of the benchmark buffer: tagged capabilities that bench_memcpy()
+ * copies to the next BENCH_MEMCPY_SIZE bytes, followed by scratch space for
+ * the integer kernels so that they do not clear any tags.
+ */
+#define BENCH_MEMCPY_SIZE   16384
+#define BENCH_SCRATCH       (2 * BENCH_MEMCPY_SIZE)
+#define BENCH_BUF_SIZE      (4 * BENCH_MEMCPY_SIZE)
+
+#ifndef __ASSEMBLER__
+
+/* Store @ncaps tagged capabilities derived from DDC to @buf. */
+void bench_fill_caps(void *buf, unsigned long ncaps);
+/* Return how many of the @ncaps capabilities at @buf are tagged. */
+unsigned long bench_count_tags(void *buf, unsigned long ncaps);
+
+/* Load the capabilities in slots 0-3 and store them to slots 4-7. */
+void bench_clc_csc(void *buf, unsigned long iters);
+/* Four 64-bit loads and four 64-bit stores through a capability. */
+void bench_cap_int(void *buf, unsigned long iters);
+/* Two pairs of CSetBounds and CIncOffset, each deriving from the last. */
+void bench_bounds(void *buf, unsigned long iters);
+/* Call an empty function with CJALR, which returns with CJR. */
+void bench_cjalr(void *buf, unsigned long iters);
+/* Copy BENCH_MEMCPY_SIZE bytes with capability loads and stores. */
+void bench_memcpy(void *buf, unsigned long iters);
+/* Four 64-bit loads and four 64-bit stores through DDC (legacy code). */
+void bench_ddc_int(void *buf, unsigned long iters);
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* CHERI_BENCH_H */
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+#
+# Compare two outputs of the CHERI microbenchmarks (cheri-bench.c)
+#
+# Prints the host ns per operation and the guest MIPS of both runs and fails
+# if any kernel got slower by more than the threshold. A change in the guest
+# instructions per operation means the kernels differ between the two runs,
+# which is reported but not treated as a regression.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+
+import argparse
+import re
+import sys
+
+BENCH_RE = re.compile(r"^bench: (?P<name>\S+) ops=(?P<ops>\d+) "
+                      r"insns=(?P<insns>\d+) ns=(?P<ns>\d+) "
+                      r"ns/op=(?P<ns_per_op>[\d.]+) mips=(?P<mips>\d+)$")
+
+
+def parse(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            m = BENCH_RE.match(line.strip())
+            if m:
+                results[m.group("name")] = {
+                    "ops": int(m.group("ops")),
+                    "insns": int(m.group("insns")),
+                    "ns_per_op": float(m.group("ns_per_op")),
+                    "mips": int(m.group("mips")),
+                }
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compare two CHERI microbenchmark outputs")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="maximum slowdown in percent (default: 10)")
+    parser.add_argument("baseline", help="output of the reference run")
+    parser.add_argument("current", help="output of the run to check")
+    args = parser.parse_args()
+
+    baseline = parse(args.baseline)
+    current = parse(args.current)
+    if not current:
+        print("%s: no benchmark results" % args.current)
+        return 1
+
+    failed = False
+    print("%-10s %12s %12s %8s %9s %8s" %
+          ("kernel", "base ns/op", "ns/op", "change", "base MIPS", "MIPS"))
+    for name, cur in current.items():
+        base = baseline.get(name)
+        if base is None:
+            print("%-10s %12s %12.3f %8s %9s %8d" %
+                  (name, "-", cur["ns_per_op"], "new", "-", cur["mips"]))
+            continue
+        change = (cur["ns_per_op"] / base["ns_per_op"] - 1) * 100 \
+            if base["ns_per_op"] else 0.0
+        verdict = ""
+        if change > args.threshold:
+            verdict = "  REGRESSION"
+            failed = True
+        if base["insns"] * cur["ops"] != cur["insns"] * base["ops"]:
+            verdict += "  (guest instructions per op changed)"
+        print("%-10s %12.3f %12.3f %+7.1f%% %9d %8d%s" %
+              (name, base["ns_per_op"], cur["ns_per_op"], change,
+               base["mips"], cur["mips"], verdict))
+    for name in baseline:
+        if name not in current:
+            print("%-10s missing from %s" % (name, args.current))
+            failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
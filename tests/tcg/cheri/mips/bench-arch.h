@@ -0,0 +1,65 @@
+/*
+ * Platform support for the CHERI microbenchmarks on the MIPS Malta machine
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef BENCH_ARCH_H
+#define BENCH_ARCH_H
+
+/* ISA COM1 through the GT-64120 PCI I/O window, uncached */
+#define MALTA_UART              0xffffffffb80003f8
+/* Writing MALTA_SOFTRES_POWEROFF here powers the board off */
+#define MALTA_SOFTRES           0xffffffffbf000500
+#define MALTA_SOFTRES_POWEROFF  0x44
+/* QEMU runs the CPU at 100MHz and Count at half of that. */
+#define MIPS_NS_PER_COUNT       20
+
+#define UART_THR                0
+#define UART_LSR                5
+#define UART_LSR_THRE           0x20
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+static inline void bench_arch_putc(char c)
+{
+    volatile uint8_t *uart = (volatile uint8_t *)MALTA_UART;
+
+    while (!(uart[UART_LSR] & UART_LSR_THRE)) {
+    }
+    uart[UART_THR] = c;
+}
+
+/* Count is only 32 bits wide, extend it assuming we read it often enough. */
+static inline uint64_t bench_arch_time_ns(void)
+{
+    static uint32_t last;
+    static uint64_t high;
+    uint32_t count;
+
+    asm volatile("mfc0 %0, $9" : "=r"(count));
+    if (count < last) {
+        high += UINT64_C(1) << 32;
+    }
+    last = count;
+    return (high | count) * MIPS_NS_PER_COUNT;
+}
+
+/* The BERI statcounters instruction count (RDHWR 4) */
+static inline uint64_t bench_arch_instret(void)
+{
+    uint64_t insns;
+
+    asm volatile(".set push\n\t"
+                 ".set mips64r2\n\t"
+                 "rdhwr %0, $4\n\t"
+                 ".set pop" : "=r"(insns));
+    return insns;
+}
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* BENCH_ARCH_H */
@@ -0,0 +1,54 @@
+/*
+ * Platform support for the CHERI microbenchmarks on the RISC-V virt machine
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef BENCH_ARCH_H
+#define BENCH_ARCH_H
+
+#define VIRT_TEST           0x100000
+#define VIRT_UART0          0x10000000
+#define VIRT_TEST_FAIL      0x3333
+#define VIRT_TEST_PASS      0x5555
+/* The CLINT timer (and with it the time CSR) runs at 10MHz. */
+#define VIRT_NS_PER_TICK    100
+
+#define UART_THR            0
+#define UART_LSR            5
+#define UART_LSR_THRE       0x20
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+static inline void bench_arch_putc(char c)
+{
+    volatile uint8_t *uart = (volatile uint8_t *)VIRT_UART0;
+
+    while (!(uart[UART_LSR] & UART_LSR_THRE)) {
+    }
+    uart[UART_THR] = c;
+}
+
+static inline uint64_t bench_arch_time_ns(void)
+{
+    uint64_t ticks;
+
+    asm volatile("rdtime %0" : "=r"(ticks));
+    return ticks * VIRT_NS_PER_TICK;
+}
+
+/* QEMU counts minstret exactly for CHERI, not with the host TSC. */
+static inline uint64_t bench_arch_instret(void)
+{
+    uint64_t insns;
+
+    asm volatile("rdinstret %0" : "=r"(insns));
+    return insns;
+}
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* BENCH_ARCH_H */
@@ -60,6 +60,17 @@ fi
 : ${cross_cc_cflags_s390x="-m64"}
 : ${cross_cc_cflags_sparc="-m32 -mv8plus -mcpu=ultrasparc"}
 : ${cross_cc_cflags_sparc64="-m64 -mcpu=ultrasparc"}
+# CHERI targets need a CHERI LLVM clang, e.g. from cheribuild. The system
+# tests are bare metal so there is nothing to link against. The linux-user
+# tests need a RISC-V Linux sysroot, e.g. passed with --sysroot in
+# cross_cc_cflags_riscv64cheri_user.
+: ${cross_cc_cheri128="clang"}
+: ${cross_cc_cflags_cheri128="-target mips64-unknown-elf -mcpu=beri -cheri=128 -mabi=n64 -mno-abicalls -fno-pic -G0 -msoft-float -nostdlib -fuse-ld=lld"}
+: ${cross_cc_cheri256="clang"}
+: ${cross_cc_cflags_cheri256="-target mips64-unknown-elf -mcpu=beri -cheri=256 -mabi=n64 -mno-abicalls -fno-pic -G0 -msoft-float -nostdlib -fuse-ld=lld"}
+: ${cross_cc_riscv64cheri="clang"}
+: ${cross_cc_cflags_riscv64cheri="-target riscv64-unknown-elf -march=rv64imafdcxcheri -mabi=lp64d -mcmodel=medany -mno-relax -nostdlib -fuse-ld=lld"}
+: ${cross_cc_cflags_riscv64cheri_user="-target riscv64-unknown-linux-gnu -march=rv64imafdcxcheri -mabi=lp64d -fuse-ld=lld"}
 
 for target in $target_list; do
   arch=${target%%-*}
@@ -88,6 +99,9 @@ for target in $target_list; do
     alpha|cris|hppa|i386|lm32|m68k|openrisc|riscv64|s390x|sh4|sparc64)
       arches=$target
       ;;
+    cheri128|cheri256|riscv64cheri)
+      arches=$arch
+      ;;
     *)
       continue
       ;;
@@ -193,6 +207,12 @@ for target in $target_list; do
   esac
 
   eval "target_compiler_cflags=\${cross_cc_cflags_$arch}"
+  case $target in
+    riscv64cheri-linux-user)
+      # The flags above are for the bare metal system tests
+      target_compiler_cflags=$cross_cc_cflags_riscv64cheri_user
+      ;;
+  esac
   echo "CROSS_CC_GUEST_CFLAGS=$target_compiler_cflags" >> $config_target_mak
 
   got_cross_cc=no
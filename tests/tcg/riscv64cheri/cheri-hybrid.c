@@ -0,0 +1,135 @@
+/*
+ * Smoke test for CHERI-RISC-V hybrid binaries in linux-user
+ *
+ * Checks that capabilities keep their tags through memory, that memory
+ * written by the kernel (read(), fresh mmap()s) loses them, and that a
+ * signal frame saves and restores the capability registers.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define fail_unless(x)                                                  \
+    do {                                                                \
+        if (!(x)) {                                                     \
+            fprintf(stderr, "FAILED at %s:%d\n", __FILE__, __LINE__);   \
+            exit(EXIT_FAILURE);                                         \
+        }                                                               \
+    } while (0)
+
+static char object[64];
+static void *__capability volatile slots[4];
+
+static void *__capability object_cap(void)
+{
+    void *__capability cap = (__cheri_tocap void *__capability)object;
+
+    return __builtin_cheri_bounds_set(cap, sizeof(object));
+}
+
+/* A capability stored with CSC and loaded with CLC keeps its tag. */
+static void test_store_load(void)
+{
+    void *__capability cap = object_cap();
+    void *__capability loaded;
+
+    slots[1] = cap;
+    loaded = slots[1];
+    fail_unless(__builtin_cheri_tag_get(loaded));
+    fail_unless(__builtin_cheri_address_get(loaded) ==
+                (uintptr_t)object);
+    fail_unless(__builtin_cheri_length_get(loaded) == sizeof(object));
+
+    /* An integer store into the capability clears its tag. */
+    *(volatile uint64_t *)&slots[1] = (uintptr_t)object;
+    fail_unless(!__builtin_cheri_tag_get(slots[1]));
+}
+
+/* Data written by a syscall is plain data. */
+static void test_read_clears_tags(void)
+{
+    char data[sizeof(slots[0])];
+    int fds[2];
+
+    memset(data, 0x5a, sizeof(data));
+    fail_unless(pipe(fds) == 0);
+    fail_unless(write(fds[1], data, sizeof(data)) == sizeof(data));
+
+    slots[2] = object_cap();
+    fail_unless(__builtin_cheri_tag_get(slots[2]));
+    fail_unless(read(fds[0], (void *)&slots[2], sizeof(data)) ==
+                sizeof(data));
+    fail_unless(!__builtin_cheri_tag_get(slots[2]));
+    fail_unless(memcmp((void *)&slots[2], data, sizeof(data)) == 0);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* Mapping a page again drops the tags of the old mapping. */
+static void test_mmap_clears_tags(void)
+{
+    size_t len = getpagesize();
+    void *__capability *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    fail_unless(p != MAP_FAILED);
+    p[0] = object_cap();
+    fail_unless(__builtin_cheri_tag_get(((void *__capability volatile *)p)[0]));
+    fail_unless(mmap(p, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == p);
+    fail_unless(!__builtin_cheri_tag_get(((void *__capability volatile *)p)[0]));
+    munmap(p, len);
+}
+
+static volatile int got_signal;
+
+static void handler(int sig)
+{
+    got_signal = sig;
+    /*
+     * The compiler only saves and restores the integer part of s1, so this
+     * leaves cs1 untagged unless sigreturn restores it from the frame.
+     */
+    asm volatile("li s1, 0" : : : "s1");
+}
+
+/* cs1 holds a tagged capability while a signal is delivered. */
+static void test_signal_frame(void)
+{
+    void *__capability cap = object_cap();
+    void *__capability out;
+    register long a0 asm("a0") = getpid();
+    register long a1 asm("a1") = SIGUSR1;
+    register long a7 asm("a7") = SYS_kill;
+
+    fail_unless(signal(SIGUSR1, handler) != SIG_ERR);
+    asm volatile("cmove cs1, %[in]\n\t"
+                 "ecall\n\t"
+                 "cmove %[out], cs1"
+                 : [out] "=C"(out), "+r"(a0)
+                 : [in] "C"(cap), "r"(a1), "r"(a7)
+                 : "s1", "memory");
+    fail_unless(a0 == 0);
+    fail_unless(got_signal == SIGUSR1);
+    fail_unless(__builtin_cheri_tag_get(out));
+    fail_unless(__builtin_cheri_equal_exact(out, cap));
+}
+
+int main(void)
+{
+    test_store_load();
+    test_read_clears_tags();
+    test_mmap_clears_tags();
+    test_signal_frame();
+    return EXIT_SUCCESS;
+}
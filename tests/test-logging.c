@@ -87,6 +87,32 @@ static void test_parse_range(void)
     error_free_or_abort(&err);
 }
 
+static void test_parse_asid(void)
+{
+    Error *err = NULL;
+
+    qemu_set_dfilter_ranges("0x1000+0x100", &error_abort);
+    g_assert(qemu_log_in_asid_filter(0));
+    g_assert(qemu_log_in_asid_filter(42));
+
+    qemu_set_dfilter_ranges("asid=42,asid=0x10", &error_abort);
+    g_assert(qemu_log_in_asid_filter(42));
+    g_assert(qemu_log_in_asid_filter(16));
+    g_assert_false(qemu_log_in_asid_filter(0));
+    /* Only ASIDs given, so all addresses are in range. */
+    g_assert(qemu_log_in_addr_range(0));
+    g_assert(qemu_log_in_addr_range(UINT64_MAX));
+
+    qemu_set_dfilter_ranges("0x1000+0x100,asid=7", &error_abort);
+    g_assert(qemu_log_in_asid_filter(7));
+    g_assert_false(qemu_log_in_asid_filter(8));
+    g_assert(qemu_log_in_addr_range(0x1000));
+    g_assert_false(qemu_log_in_addr_range(0x1100));
+
+    qemu_set_dfilter_ranges("asid=seven", &err);
+    error_free_or_abort(&err);
+}
+
 static void set_log_path_tmp(char const *dir, char const *tpl, Error **errp)
 {
     gchar *file_path = g_build_filename(dir, tpl, NULL);
@@ -209,6 +235,7 @@ int main(int argc, char **argv)
     g_assert_nonnull(tmp_path);
 
     g_test_add_func("/logging/parse_range", test_parse_range);
+    g_test_add_func("/logging/parse_asid", test_parse_asid);
     g_test_add_data_func("/logging/parse_path", tmp_path, test_parse_path);
     g_test_add_data_func("/logging/logfile_write_path",
                          tmp_path, test_logfile_write);
@@ -0,0 +1,233 @@
+/*
+ * Buffered binary log writer
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/atomic.h"
+#include "qemu/error-report.h"
+#include "qemu/host-utils.h"
+#include "qemu/log-buffer.h"
+#include "qemu/thread.h"
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+
+/* How often the writer thread drains the buffers when nobody kicks it. */
+#define LOG_BUFFER_WRITER_INTERVAL_MS 100
+
+struct LogBuffer {
+    uint8_t *data;
+    size_t mask;
+    /* Only written by the producer. */
+    size_t head;
+    /* Only written by the writer thread. */
+    size_t tail;
+    /* Posted by the writer thread after it has drained this buffer. */
+    QemuSemaphore drained;
+    LogBuffer *next;
+};
+
+typedef struct LogBufferWriter {
+    QemuThread thread;
+    QemuSemaphore kick;
+    /* Protects the list of buffers, producers add to it at any time. */
+    QemuMutex lock;
+    LogBuffer *buffers;
+    FILE *file;
+    bool stop;
+#ifdef CONFIG_ZSTD
+    ZSTD_CStream *zcs;
+    void *zbuf;
+    size_t zbuf_size;
+#endif
+} LogBufferWriter;
+
+static LogBufferWriter *writer;
+
+static void log_buffer_output(LogBufferWriter *w, const void *data,
+                              size_t len, bool end)
+{
+#ifdef CONFIG_ZSTD
+    if (w->zcs) {
+        ZSTD_inBuffer in = { .src = data, .size = len, .pos = 0 };
+        size_t remaining;
+        do {
+            ZSTD_outBuffer out = { .dst = w->zbuf, .size = w->zbuf_size };
+            remaining = ZSTD_compressStream2(w->zcs, &out, &in,
+                                             end ? ZSTD_e_end
+                                                 : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) {
+                error_report("log buffer: zstd compression failed: %s",
+                             ZSTD_getErrorName(remaining));
+                return;
+            }
+            fwrite(w->zbuf, 1, out.pos, w->file);
+        } while (in.pos < in.size || (end && remaining));
+        return;
+    }
+#endif
+    fwrite(data, 1, len, w->file);
+}
+
+/* Write out everything that has been committed to @buf so far. */
+static void log_buffer_drain(LogBufferWriter *w, LogBuffer *buf)
+{
+    size_t head = atomic_load_acquire(&buf->head);
+    size_t tail = buf->tail;
+
+    if (head == tail) {
+        return;
+    }
+    size_t start = tail & buf->mask;
+    size_t len = head - tail;
+    size_t first = MIN(len, buf->mask + 1 - start);
+    log_buffer_output(w, buf->data + start, first, false);
+    if (first < len) {
+        log_buffer_output(w, buf->data, len - first, false);
+    }
+    atomic_store_release(&buf->tail, head);
+    qemu_sem_post(&buf->drained);
+}
+
+static void log_buffer_drain_all(LogBufferWriter *w)
+{
+    qemu_mutex_lock(&w->lock);
+    for (LogBuffer *buf = w->buffers; buf; buf = buf->next) {
+        log_buffer_drain(w, buf);
+    }
+    qemu_mutex_unlock(&w->lock);
+}
+
+static void *log_buffer_writer_thread(void *opaque)
+{
+    LogBufferWriter *w = opaque;
+
+    while (!atomic_read(&w->stop)) {
+        qemu_sem_timedwait(&w->kick, LOG_BUFFER_WRITER_INTERVAL_MS);
+        log_buffer_drain_all(w);
+    }
+    return NULL;
+}
+
+bool log_buffer_writer_open(const char *filename, bool compress,
+                            const void *header, size_t header_len,
+                            Error **errp)
+{
+    LogBufferWriter *w;
+
+    if (writer) {
+        error_setg(errp, "binary log file is already open");
+        return false;
+    }
+#ifndef CONFIG_ZSTD
+    if (compress) {
+        error_setg(errp, "binary log compression requires zstd support");
+        return false;
+    }
+#endif
+    w = g_new0(LogBufferWriter, 1);
+    w->file = fopen(filename, "wb");
+    if (!w->file) {
+        error_setg_errno(errp, errno, "could not open binary log file '%s'",
+                         filename);
+        g_free(w);
+        return false;
+    }
+#ifdef CONFIG_ZSTD
+    if (compress) {
+        w->zcs = ZSTD_createCStream();
+        w->zbuf_size = ZSTD_CStreamOutSize();
+        w->zbuf = g_malloc(w->zbuf_size);
+    }
+#endif
+    if (header) {
+        log_buffer_output(w, header, header_len, false);
+    }
+    qemu_mutex_init(&w->lock);
+    qemu_sem_init(&w->kick, 0);
+    qemu_thread_create(&w->thread, "log-writer", log_buffer_writer_thread, w,
+                       QEMU_THREAD_JOINABLE);
+    atomic_set(&writer, w);
+    return true;
+}
+
+void log_buffer_writer_close(void)
+{
+    LogBufferWriter *w = writer;
+
+    if (!w) {
+        return;
+    }
+    atomic_set(&w->stop, true);
+    qemu_sem_post(&w->kick);
+    qemu_thread_join(&w->thread);
+    log_buffer_drain_all(w);
+    log_buffer_output(w, NULL, 0, true);
+    fclose(w->file);
+#ifdef CONFIG_ZSTD
+    if (w->zcs) {
+        ZSTD_freeCStream(w->zcs);
+        g_free(w->zbuf);
+    }
+#endif
+    /*
+     * The buffers themselves stay allocated since their producers may still
+     * hold on to them, writes after this point are discarded.
+     */
+    atomic_set(&writer, NULL);
+}
+
+bool log_buffer_writer_active(void)
+{
+    return atomic_read(&writer) != NULL;
+}
+
+LogBuffer *log_buffer_new(size_t size)
+{
+    LogBuffer *buf = g_new0(LogBuffer, 1);
+
+    size = pow2ceil(size);
+    buf->data = g_malloc(size);
+    buf->mask = size - 1;
+    qemu_sem_init(&buf->drained, 0);
+    if (writer) {
+        qemu_mutex_lock(&writer->lock);
+        buf->next = writer->buffers;
+        writer->buffers = buf;
+        qemu_mutex_unlock(&writer->lock);
+    }
+    return buf;
+}
+
+void log_buffer_write(LogBuffer *buf, const void *data, size_t len)
+{
+    LogBufferWriter *w = atomic_read(&writer);
+    size_t size = buf->mask + 1;
+    size_t head = buf->head;
+    size_t used;
+
+    if (unlikely(!w)) {
+        return;
+    }
+    assert(len <= size);
+    used = head - atomic_load_acquire(&buf->tail);
+    while (unlikely(used + len > size)) {
+        /* Full: wake up the writer thread and wait for it to drain. */
+        qemu_sem_post(&w->kick);
+        qemu_sem_wait(&buf->drained);
+        used = head - atomic_load_acquire(&buf->tail);
+    }
+    size_t start = head & buf->mask;
+    size_t first = MIN(len, size - start);
+    memcpy(buf->data + start, data, first);
+    memcpy(buf->data, (const uint8_t *)data + first, len - first);
+    atomic_store_release(&buf->head, head + len);
+    /* Kick the writer early once we cross the half-full mark. */
+    if (used < size / 2 && used + len >= size / 2) {
+        qemu_sem_post(&w->kick);
+    }
+}
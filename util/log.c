@@ -32,6 +32,7 @@ QemuLogFile *qemu_logfile;
 int qemu_loglevel;
 static int log_append = 0;
 static GArray *debug_regions;
+static GArray *debug_asids;
 
 /* Return the number of characters emitted.  */
 int qemu_log(const char *fmt, ...)
@@ -73,10 +74,9 @@ static void qemu_logfile_free(QemuLogFile *logfile)
 
 static bool log_uses_own_buffers;
 
-__attribute__((weak)) void flush_tcg_on_log_instr_chage(void);
-__attribute__((weak)) void flush_tcg_on_log_instr_chage(void) {
+__attribute__((weak)) void flush_tcg_on_log_instr_chage(bool invalidate);
+__attribute__((weak)) void flush_tcg_on_log_instr_chage(bool invalidate) {
     // Real implementation in translate-all.c
-    warn_report("Calling no-op %s\r", __func__);
 }
 
 /* enable or disable low levels log */
@@ -87,12 +87,14 @@ void qemu_set_log(int log_flags)
 
     const int need_to_flush_tcg_on_change =
         CPU_LOG_INSTR | CPU_LOG_USER_ONLY | CPU_LOG_CVTRACE;
-    if ((qemu_loglevel & need_to_flush_tcg_on_change) !=
-        (log_flags & need_to_flush_tcg_on_change)) {
-        // When instruction tracing flags change, we have to re-translate all
-        // blocks that were translated with tracing on/off.
-        // This may flush too much state, but such changes should be rare.
-        flush_tcg_on_log_instr_chage();
+    const int old_trace = qemu_loglevel & need_to_flush_tcg_on_change;
+    const int new_trace = log_flags & need_to_flush_tcg_on_change;
+    if (old_trace != new_trace) {
+        // Blocks translated with and without tracing are kept apart by
+        // CF_LOG_INSTR, so turning tracing on or off only requires the
+        // vCPUs to look up new blocks. Blocks translated with tracing on
+        // must be discarded if the trace format or user-only mode changed.
+        flush_tcg_on_log_instr_chage(old_trace && new_trace);
     }
     qemu_loglevel = log_flags;
 
@@ -196,6 +198,27 @@ void qemu_set_log_filename(const char *filename, Error **errp)
     }
 }
 
+/* Returns the expanded log file name, or NULL when logging to stderr. */
+const char *qemu_get_log_filename(void)
+{
+    return logfilename;
+}
+
+/* Returns true if asid is in our debug filter or no ASID filter defined
+ */
+bool qemu_log_in_asid_filter(uint64_t asid)
+{
+    if (debug_asids) {
+        for (int i = 0; i < debug_asids->len; i++) {
+            if (g_array_index(debug_asids, uint64_t, i) == asid) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
 /* Returns true if addr is in our debug filter or no filter defined
  */
 bool qemu_log_in_addr_range(uint64_t addr)
@@ -224,6 +247,10 @@ void qemu_set_dfilter_ranges(const char *filter_spec, Error **errp)
         g_array_unref(debug_regions);
         debug_regions = NULL;
     }
+    if (debug_asids) {
+        g_array_unref(debug_asids);
+        debug_asids = NULL;
+    }
 
     debug_regions = g_array_sized_new(FALSE, FALSE,
                                       sizeof(Range), g_strv_length(ranges));
@@ -233,6 +260,18 @@ void qemu_set_dfilter_ranges(const char *filter_spec, Error **errp)
         uint64_t r1val, r2val, lob, upb;
         struct Range range;
 
+        if (g_str_has_prefix(r, "asid=")) {
+            uint64_t asid;
+            if (qemu_strtou64(r + 5, NULL, 0, &asid)) {
+                error_setg(errp, "Invalid ASID %s", r + 5);
+                goto out;
+            }
+            if (!debug_asids) {
+                debug_asids = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+            }
+            g_array_append_val(debug_asids, asid);
+            continue;
+        }
         range_op = strstr(r, "-");
         r2 = range_op ? range_op + 1 : NULL;
         if (!range_op) {
@@ -283,8 +322,15 @@ void qemu_set_dfilter_ranges(const char *filter_spec, Error **errp)
         range_set_bounds(&range, lob, upb);
         g_array_append_val(debug_regions, range);
     }
+    /* A filter that only lists ASIDs does not restrict addresses. */
+    if (debug_asids && debug_regions->len == 0) {
+        g_array_unref(debug_regions);
+        debug_regions = NULL;
+    }
 out:
     g_strfreev(ranges);
+    /* Code translated with the old filter must not be reused. */
+    flush_tcg_on_log_instr_chage(true);
 }
 
 /* fflush() the log file */